@@ -165,7 +165,8 @@ CREATE TABLE `sensorValues` (
   `idSensor` int NOT NULL,
   `timestamp` bigint NOT NULL,
   `removed` tinyint(1) NOT NULL DEFAULT '0',
-  PRIMARY KEY (`idSensorValue`)
+  PRIMARY KEY (`idSensorValue`),
+  KEY `idSensorTimestamp` (`idSensor`,`timestamp`)
 ) ENGINE=InnoDB AUTO_INCREMENT=35856 DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_0900_ai_ci;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
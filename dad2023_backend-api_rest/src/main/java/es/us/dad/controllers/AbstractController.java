@@ -1,12 +1,19 @@
 package es.us.dad.controllers;
 
+import java.util.Arrays;
+import java.util.Calendar;
 import java.util.List;
 
 import com.google.gson.Gson;
 
+import es.us.dad.mysql.entities.Device;
 import es.us.dad.mysql.messages.DatabaseEntity;
 import es.us.dad.mysql.messages.DatabaseMessage;
+import es.us.dad.mysql.messages.DatabaseMessageLatestValues;
+import es.us.dad.mysql.messages.DatabaseMessageType;
+import es.us.dad.mysql.messages.DatabaseMethod;
 import io.vertx.core.AbstractVerticle;
+import io.vertx.core.Handler;
 import io.vertx.core.Promise;
 import io.vertx.core.eventbus.Message;
 
@@ -81,6 +88,88 @@ public abstract class AbstractController extends AbstractVerticle {
 		});
 	}
 
+	/**
+	 * Same as launchDatabaseOperation(Message), but the response of the data
+	 * access Verticle is also handed to onSuccess before it is replied, e.g. to
+	 * keep a cache up to date with what has been written.
+	 * 
+	 * @param message   Message where the request to be made to the Verticle of
+	 *                  communication with the database is stored.
+	 * @param onSuccess Handler receiving the response when the operation succeeds
+	 */
+	protected void launchDatabaseOperation(Message<Object> message, Handler<DatabaseMessage> onSuccess) {
+		DatabaseMessage databaseMessage = gson.fromJson((String) message.body(), DatabaseMessage.class);
+		getVertx().eventBus().request(databaseEntity.getAddress(), gson.toJson(databaseMessage), persistenceMessage -> {
+			if (persistenceMessage.succeeded()) {
+				onSuccess.handle(
+						gson.fromJson(persistenceMessage.result().body().toString(), DatabaseMessage.class));
+				message.reply(persistenceMessage.result().body());
+			} else {
+				message.fail(100, persistenceMessage.cause().getLocalizedMessage());
+				System.err.println(persistenceMessage.cause());
+			}
+		});
+	}
+
+	/**
+	 * Answers a request of the last (single) or latest values of a sensor or
+	 * actuator from cache. On a miss the database is asked for as many values as
+	 * the cache keeps, so the following requests of that id are hits, and the
+	 * reply is built from that result. Requests of more values than the cache
+	 * keeps, or any request when the cache is disabled, go straight to the data
+	 * access Verticle.
+	 * 
+	 * @param message         Message received from the Rest API
+	 * @param databaseMessage Content of message, the reply is built on it
+	 * @param cache           Cache of the entity managed by the controller
+	 * @param id              Sensor or actuator id
+	 * @param limit           Values requested
+	 * @param single          True to reply with the newest value (or null)
+	 *                        instead of a list
+	 * @param latestMethod    DatabaseMethod returning the latest values of an id
+	 * @param arrayType       Array type of the values, e.g. SensorValue[].class
+	 */
+	protected <T> void launchLatestValuesOperation(Message<Object> message, DatabaseMessage databaseMessage,
+			LatestValuesCache<T> cache, int id, int limit, boolean single, DatabaseMethod latestMethod,
+			Class<T[]> arrayType) {
+		List<T> cached = limit >= 0 ? cache.latest(id, limit) : null;
+		if (cached != null) {
+			replyLatestValues(message, databaseMessage, cached, single);
+			return;
+		}
+		if (limit < 0 || limit > cache.getCapacity()) {
+			launchDatabaseOperation(message);
+			return;
+		}
+
+		int requested = cache.getCapacity();
+		cache.loading(id);
+		launchDatabaseOperation(databaseEntity, new DatabaseMessage(DatabaseMessageType.SELECT, databaseEntity,
+				latestMethod, new DatabaseMessageLatestValues(id, requested))).future().onComplete(res -> {
+					if (res.succeeded()) {
+						T[] values = res.result().getResponseBodyAs(arrayType);
+						List<T> newest = values != null ? Arrays.asList(values) : Arrays.asList();
+						cache.load(id, newest, requested);
+						replyLatestValues(message, databaseMessage, newest.subList(0, Math.min(limit, newest.size())),
+								single);
+					} else {
+						message.fail(100, res.cause().getLocalizedMessage());
+						System.err.println(res.cause());
+					}
+				});
+	}
+
+	private <T> void replyLatestValues(Message<Object> message, DatabaseMessage databaseMessage, List<T> values,
+			boolean single) {
+		if (single) {
+			databaseMessage.setResponseBody(values.isEmpty() ? (T) null : values.get(0));
+		} else {
+			databaseMessage.setResponseBody(values);
+		}
+		databaseMessage.setStatusCode(200);
+		message.reply(gson.toJson(databaseMessage));
+	}
+
 	/**
 	 * Enables the execution of a set of DatabaseMessage against the Data Access
 	 * Verticle. These messages shall be executed sequentially in the same order as
@@ -119,4 +208,79 @@ public abstract class AbstractController extends AbstractVerticle {
 		return ControllersUtils.launchDatabaseOperation(databaseEntity, databaseMessage, getVertx());
 	}
 
+	/**
+	 * Records that a device has sent a value now. The devices table is updated by
+	 * the next flush of lastSeen, or right away if LastSeenBuffer.FLUSH_INTERVAL is
+	 * 0.
+	 * 
+	 * @param lastSeen Buffer of the controller
+	 * @param idDevice Device that sent the value
+	 */
+	protected void touchLastSeen(LastSeenBuffer lastSeen, int idDevice) {
+		if (lastSeen.touch(idDevice, Calendar.getInstance().getTimeInMillis())
+				&& LastSeenBuffer.FLUSH_INTERVAL == 0) {
+			flushLastSeen(lastSeen);
+		}
+	}
+
+	/**
+	 * Starts a report of the hit rate of a LatestValuesCache every minute, which
+	 * tools/fleet_sim/compare.sh collects.
+	 *
+	 * @param cache Cache of the controller
+	 */
+	protected void startLatestValuesReport(LatestValuesCache<?> cache) {
+		long[] reported = { 0 };
+		getVertx().setPeriodic(60000, timer -> {
+			long reads = cache.getHits() + cache.getMisses();
+			if (reads != reported[0]) {
+				reported[0] = reads;
+				System.out.println(getClass().getSimpleName() + " latest values: " + cache.getHits() + " hits, "
+						+ cache.getMisses() + " misses (" + String.format("%.1f", 100.0 * cache.getHits() / reads)
+						+ "% hit rate), " + cache.size() + " ids cached");
+			}
+		});
+	}
+
+	/**
+	 * Starts the periodic flush of a LastSeenBuffer, and a report of the writes it
+	 * saved every minute.
+	 * 
+	 * @param lastSeen Buffer of the controller
+	 */
+	protected void startLastSeenFlush(LastSeenBuffer lastSeen) {
+		if (LastSeenBuffer.FLUSH_INTERVAL > 0) {
+			getVertx().setPeriodic(LastSeenBuffer.FLUSH_INTERVAL, timer -> flushLastSeen(lastSeen));
+		}
+		long[] reported = { 0 };
+		getVertx().setPeriodic(60000, timer -> {
+			if (lastSeen.getTouches() != reported[0]) {
+				reported[0] = lastSeen.getTouches();
+				System.out.println(getClass().getSimpleName() + " last seen: " + lastSeen.getTouches()
+						+ " values, " + lastSeen.getRows() + " device rows in " + lastSeen.getFlushes() + " UPDATE");
+			}
+		});
+	}
+
+	/**
+	 * Writes every device queued in lastSeen, one UPDATE per
+	 * LastSeenBuffer.MAX_BATCH devices. Devices of a failed UPDATE are queued
+	 * again for the next flush.
+	 * 
+	 * @param lastSeen Buffer of the controller
+	 */
+	protected void flushLastSeen(LastSeenBuffer lastSeen) {
+		for (List<Device> devices = lastSeen.drain(); !devices.isEmpty(); devices = lastSeen.drain()) {
+			List<Device> batch = devices;
+			launchDatabaseOperation(DatabaseEntity.Device, new DatabaseMessage(DatabaseMessageType.UPDATE,
+					DatabaseEntity.Device, DatabaseMethod.EditDevicesLastTimestamps, batch)).future()
+					.onComplete(res -> {
+						if (res.failed()) {
+							lastSeen.failed(batch);
+							System.err.println(res.cause());
+						}
+					});
+		}
+	}
+
 }
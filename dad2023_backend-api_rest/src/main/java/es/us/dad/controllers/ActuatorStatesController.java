@@ -1,11 +1,10 @@
 package es.us.dad.controllers;
 
-import java.util.Calendar;
-
 import es.us.dad.mysql.entities.Actuator;
-import es.us.dad.mysql.entities.Device;
+import es.us.dad.mysql.entities.ActuatorStatus;
 import es.us.dad.mysql.messages.DatabaseEntity;
 import es.us.dad.mysql.messages.DatabaseMessage;
+import es.us.dad.mysql.messages.DatabaseMessageLatestValues;
 import es.us.dad.mysql.messages.DatabaseMessageType;
 import es.us.dad.mysql.messages.DatabaseMethod;
 import es.us.dad.mysql.rest.RestEntityMessage;
@@ -23,13 +22,36 @@ import io.vertx.core.Promise;
  */
 public class ActuatorStatesController extends AbstractController {
 
+	/**
+	 * Latest states of the actuators read recently, kept up to date with every
+	 * state created or deleted through this controller.
+	 */
+	private final LatestValuesCache<ActuatorStatus> latestStates;
+
+	/**
+	 * Devices that sent states since the last update of their
+	 * lastTimestampActuatorModified.
+	 */
+	private final LastSeenBuffer lastSeen = new LastSeenBuffer(false, LastSeenBuffer.GRANULARITY);
+
 	/**
 	 * Constructor of the class where the type of entity managed by the class is
 	 * indicated to the AbstractController class where the basic functionality of
 	 * the controllers is defined.
 	 */
 	public ActuatorStatesController() {
+		this(LatestValuesCache.CAPACITY);
+	}
+
+	/**
+	 * @param latestStatesCapacity States cached per actuator for the last and
+	 *                             latest states requests, 0 to always query the
+	 *                             database
+	 */
+	public ActuatorStatesController(int latestStatesCapacity) {
 		super(DatabaseEntity.ActuatorStatus);
+		latestStates = new LatestValuesCache<ActuatorStatus>(latestStatesCapacity, LatestValuesCache.MAX_IDS,
+				ActuatorStatus::getIdActuator, ActuatorStatus::getIdActuatorState, ActuatorStatus::getTimestamp);
 	}
 
 	/**
@@ -44,6 +66,8 @@ public class ActuatorStatesController extends AbstractController {
 	 * layer.
 	 */
 	public void start(Promise<Void> startFuture) {
+		startLastSeenFlush(lastSeen);
+		startLatestValuesReport(latestStates);
 
 		/*
 		 * The switch considers all the messages that can be managed by this controller
@@ -60,21 +84,38 @@ public class ActuatorStatesController extends AbstractController {
 			DatabaseMessage databaseMessage = gson.fromJson((String) message.body(), DatabaseMessage.class);
 			switch (databaseMessage.getMethod()) {
 			case CreateActuatorStatus:
-				launchDatabaseOperation(message);
-				Actuator actuator = databaseMessage.getRequestBodyAs(Actuator.class);
-				launchDatabaseOperation(DatabaseEntity.Device,
-						new DatabaseMessage(DatabaseMessageType.UPDATE, DatabaseEntity.Device,
-								DatabaseMethod.EditDevice, new Device(actuator.getIdDevice(), null, null, null, null,
-										null, Calendar.getInstance().getTimeInMillis())));
+				launchDatabaseOperation(message,
+						created -> latestStates.add(created.getResponseBodyAs(ActuatorStatus.class)));
+				ActuatorStatus actuatorStatus = databaseMessage.getRequestBodyAs(ActuatorStatus.class);
+
+				// Getting the device of the actuator to update its
+				// lastTimestampActuatorModified in the next flush
+				launchDatabaseOperation(DatabaseEntity.Actuator, new DatabaseMessage(DatabaseMessageType.SELECT,
+						DatabaseEntity.Actuator, DatabaseMethod.GetActuator, actuatorStatus.getIdActuator()))
+						.future().onComplete(res -> {
+							if (res.succeeded()) {
+								Actuator actuator = res.result().getResponseBodyAs(Actuator.class);
+								if (actuator != null) {
+									touchLastSeen(lastSeen, actuator.getIdDevice());
+								}
+							}
+						});
 				break;
 			case DeleteActuatorStatus:
-				launchDatabaseOperation(message);
+				int idActuatorState = Integer.parseInt(databaseMessage.getRequestBody());
+				launchDatabaseOperation(message, deleted -> latestStates.remove(idActuatorState));
 				break;
 			case GetLastActuatorStatusFromActuatorId:
-				launchDatabaseOperation(message);
+				launchLatestValuesOperation(message, databaseMessage, latestStates,
+						Integer.parseInt(databaseMessage.getRequestBody()), 1, true,
+						DatabaseMethod.GetLatestActuatorStatesFromActuatorId, ActuatorStatus[].class);
 				break;
 			case GetLatestActuatorStatesFromActuatorId:
-				launchDatabaseOperation(message);
+				DatabaseMessageLatestValues latest = databaseMessage
+						.getRequestBodyAs(DatabaseMessageLatestValues.class);
+				launchLatestValuesOperation(message, databaseMessage, latestStates, latest.getId(),
+						latest.getLimit(), false, DatabaseMethod.GetLatestActuatorStatesFromActuatorId,
+						ActuatorStatus[].class);
 				break;
 			default:
 				/*
@@ -88,6 +129,7 @@ public class ActuatorStatesController extends AbstractController {
 	}
 
 	public void stop(Future<Void> stopFuture) throws Exception {
+		flushLastSeen(lastSeen);
 		super.stop(stopFuture);
 	}
 
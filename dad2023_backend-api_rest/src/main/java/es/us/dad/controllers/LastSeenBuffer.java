@@ -0,0 +1,157 @@
+package es.us.dad.controllers;
+
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Map;
+
+import es.us.dad.mysql.entities.Device;
+
+/**
+ * Last time each device sent a sensor value (or an actuator status), kept in
+ * memory so the devices table is updated once per flush with every device that
+ * changed, instead of once per value received.
+ *
+ * A device is only queued when its timestamp is at least granularity ms newer
+ * than the one last written for it, so devices sending many values per second
+ * cost one row per flush at most, and with a large granularity, far less.
+ * Rows of deleted devices are simply not matched by the UPDATE.
+ *
+ * The buffer is not thread safe. It is meant to be used from the event loop of
+ * the controller Verticle that owns it.
+ *
+ * @author luismi
+ *
+ */
+public class LastSeenBuffer {
+
+	/**
+	 * Ms between flushes unless the dad.lastSeenFlushMs system property says
+	 * otherwise. 0 writes every change right away, as it was done before.
+	 */
+	public static final long FLUSH_INTERVAL = Long.getLong("dad.lastSeenFlushMs", 1000);
+
+	/**
+	 * Minimum advance of a timestamp to be written, from the
+	 * dad.lastSeenGranularityMs system property.
+	 */
+	public static final long GRANULARITY = Long.getLong("dad.lastSeenGranularityMs", 1000);
+
+	/**
+	 * Devices written at most per UPDATE statement.
+	 */
+	public static final int MAX_BATCH = 500;
+
+	private final boolean sensors;
+	private final long granularity;
+
+	/**
+	 * Timestamp last handed to a flush for each device.
+	 */
+	private final Map<Integer, Long> written = new HashMap<Integer, Long>();
+	private final Map<Integer, Long> pending = new LinkedHashMap<Integer, Long>();
+
+	private long touches;
+	private long rows;
+	private long flushes;
+
+	/**
+	 * @param sensors     True to update lastTimestampSensorModified, false for
+	 *                    lastTimestampActuatorModified
+	 * @param granularity Minimum advance in ms of the timestamp of a device for
+	 *                    it to be written again
+	 */
+	public LastSeenBuffer(boolean sensors, long granularity) {
+		this.sensors = sensors;
+		this.granularity = granularity;
+	}
+
+	/**
+	 * Records that a device has just been seen.
+	 *
+	 * @param idDevice  Device id
+	 * @param timestamp Time in ms
+	 *
+	 * @return True if the device is waiting for the next flush
+	 */
+	public boolean touch(int idDevice, long timestamp) {
+		touches++;
+		Long queued = pending.get(idDevice);
+		if (queued != null) {
+			if (timestamp > queued) {
+				pending.put(idDevice, timestamp);
+			}
+			return true;
+		}
+		Long last = written.get(idDevice);
+		if (last != null && timestamp - last < granularity) {
+			return false;
+		}
+		pending.put(idDevice, timestamp);
+		return true;
+	}
+
+	/**
+	 * Takes up to MAX_BATCH queued devices to be written in one statement. Each
+	 * one only has the id and the timestamp of this buffer set.
+	 *
+	 * @return Devices to write, empty if none changed
+	 */
+	public List<Device> drain() {
+		List<Device> devices = new ArrayList<Device>(Math.min(pending.size(), MAX_BATCH));
+		Iterator<Map.Entry<Integer, Long>> iterator = pending.entrySet().iterator();
+		while (iterator.hasNext() && devices.size() < MAX_BATCH) {
+			Map.Entry<Integer, Long> entry = iterator.next();
+			iterator.remove();
+			written.put(entry.getKey(), entry.getValue());
+			devices.add(sensors ? new Device(entry.getKey(), null, null, null, null, entry.getValue(), null)
+					: new Device(entry.getKey(), null, null, null, null, null, entry.getValue()));
+		}
+		if (!devices.isEmpty()) {
+			rows += devices.size();
+			flushes++;
+		}
+		return devices;
+	}
+
+	/**
+	 * Queues again the devices of a flush that could not be written, unless a
+	 * newer timestamp is already waiting.
+	 *
+	 * @param devices Result of drain
+	 */
+	public void failed(List<Device> devices) {
+		for (Device device : devices) {
+			Long timestamp = sensors ? device.getLastTimestampSensorModified()
+					: device.getLastTimestampActuatorModified();
+			pending.merge(device.getIdDevice(), timestamp, Math::max);
+		}
+	}
+
+	public int getPending() {
+		return pending.size();
+	}
+
+	/**
+	 * @return Values that touched a device
+	 */
+	public long getTouches() {
+		return touches;
+	}
+
+	/**
+	 * @return Device rows handed to flushes
+	 */
+	public long getRows() {
+		return rows;
+	}
+
+	/**
+	 * @return UPDATE statements, one per non-empty drain
+	 */
+	public long getFlushes() {
+		return flushes;
+	}
+}
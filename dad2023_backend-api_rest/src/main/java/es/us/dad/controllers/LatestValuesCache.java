@@ -0,0 +1,221 @@
+package es.us.dad.controllers;
+
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.function.Function;
+import java.util.function.ToLongFunction;
+
+/**
+ * In-memory copy of the most recent values of every sensor (or actuator), so
+ * the last and latest values endpoints can be answered without going to the
+ * database. It is fed by the creation of new values and filled from the
+ * database the first time an id is read.
+ *
+ * The values kept for an id are always exactly its newest ones by timestamp,
+ * the same ones the database would return: an id is only cached once it has
+ * been loaded from the database, values older than everything cached are not
+ * added, and the oldest value is dropped when the ring is full. A request for
+ * more values than are cached is a miss. A load is thrown away if the id
+ * changed while the query was running, since the result may already be stale.
+ *
+ * The cache is not thread safe. It is meant to be used from the event loop of
+ * the controller Verticle that owns it.
+ *
+ * @author luismi
+ *
+ * @param <T> SensorValue or ActuatorStatus
+ */
+public class LatestValuesCache<T> {
+
+	/**
+	 * Values of one id, oldest first.
+	 */
+	private static class Ring<T> {
+		private final List<T> values = new ArrayList<T>();
+
+		/**
+		 * True if values holds every value of the id, so any limit can be answered.
+		 */
+		private boolean complete;
+	}
+
+	/**
+	 * Values kept per id unless the dad.latestValues system property says
+	 * otherwise. -Ddad.latestValues=0 disables the caches, e.g. to compare.
+	 */
+	public static final int CAPACITY = Integer.getInteger("dad.latestValues", 32);
+
+	/**
+	 * Ids kept per cache, a few hundred bytes each.
+	 */
+	public static final int MAX_IDS = 10000;
+
+	private final int capacity;
+	private final Map<Integer, Ring<T>> rings;
+
+	/**
+	 * Ids with a query in flight, true once a value of the id changed meanwhile.
+	 */
+	private final Map<Integer, Boolean> loading = new HashMap<Integer, Boolean>();
+	private final Function<T, Integer> idOf;
+	private final Function<T, Integer> keyOf;
+	private final ToLongFunction<T> timestampOf;
+
+	private long hits;
+	private long misses;
+
+	/**
+	 * @param capacity    Values kept per id. 0 disables the cache, every read is
+	 *                    a miss
+	 * @param maxIds      Ids kept at most; the least recently used one is
+	 *                    forgotten when a new one is loaded
+	 * @param idOf        Sensor or actuator id of a value
+	 * @param keyOf       Primary key of a value, used when one is deleted
+	 * @param timestampOf Timestamp of a value
+	 */
+	public LatestValuesCache(int capacity, final int maxIds, Function<T, Integer> idOf, Function<T, Integer> keyOf,
+			ToLongFunction<T> timestampOf) {
+		this.capacity = capacity;
+		this.idOf = idOf;
+		this.keyOf = keyOf;
+		this.timestampOf = timestampOf;
+		this.rings = new LinkedHashMap<Integer, Ring<T>>(16, 0.75f, true) {
+			private static final long serialVersionUID = 1L;
+
+			@Override
+			protected boolean removeEldestEntry(Map.Entry<Integer, Ring<T>> eldest) {
+				return size() > maxIds;
+			}
+		};
+	}
+
+	public int getCapacity() {
+		return capacity;
+	}
+
+	/**
+	 * Adds a value that has just been stored in the database. Ids that have not
+	 * been loaded yet are ignored, their first read goes to the database anyway.
+	 *
+	 * @param value Value as returned by the database, with its primary key
+	 */
+	public void add(T value) {
+		Integer id = idOf.apply(value);
+		if (loading.containsKey(id)) {
+			loading.put(id, true);
+		}
+		Ring<T> ring = rings.get(id);
+		if (ring == null) {
+			return;
+		}
+		Integer key = keyOf.apply(value);
+		for (T cached : ring.values) {
+			if (keyOf.apply(cached).equals(key)) {
+				// Already there, the load that created the ring saw it in the database
+				return;
+			}
+		}
+
+		long timestamp = timestampOf.applyAsLong(value);
+		int position = ring.values.size();
+		while (position > 0 && timestampOf.applyAsLong(ring.values.get(position - 1)) > timestamp) {
+			position--;
+		}
+		if (position == 0 && !ring.complete && !ring.values.isEmpty()) {
+			// Older than everything cached, there may be newer values in the database
+			return;
+		}
+		ring.values.add(position, value);
+		if (ring.values.size() > capacity) {
+			ring.values.remove(0);
+			ring.complete = false;
+		}
+	}
+
+	/**
+	 * Must be called right before querying the database for the latest values of
+	 * an id that will then be passed to load.
+	 *
+	 * @param id Sensor or actuator id
+	 */
+	public void loading(int id) {
+		if (capacity > 0 && !loading.containsKey(id)) {
+			loading.put(id, false);
+		}
+	}
+
+	/**
+	 * Stores the result of a query of the latest values of an id, unless the id
+	 * changed since loading was called.
+	 *
+	 * @param id        Sensor or actuator id
+	 * @param newest    Values returned by the database, newest first
+	 * @param requested Limit of the query. Fewer values than this means newest
+	 *                  holds every value of the id
+	 */
+	public void load(int id, List<T> newest, int requested) {
+		Boolean changed = loading.remove(id);
+		if (capacity == 0 || changed == null || changed) {
+			return;
+		}
+		Ring<T> ring = new Ring<T>();
+		int count = Math.min(newest.size(), capacity);
+		for (int i = count - 1; i >= 0; i--) {
+			ring.values.add(newest.get(i));
+		}
+		ring.complete = newest.size() < requested && count == newest.size();
+		rings.put(id, ring);
+	}
+
+	/**
+	 * Returns the newest values of an id, newest first, or null on a miss.
+	 *
+	 * @param id    Sensor or actuator id
+	 * @param limit Values wanted
+	 */
+	public List<T> latest(int id, int limit) {
+		Ring<T> ring = rings.get(id);
+		if (ring == null || (limit > ring.values.size() && !ring.complete)) {
+			misses++;
+			return null;
+		}
+		hits++;
+		int count = Math.min(limit, ring.values.size());
+		List<T> result = new ArrayList<T>(count);
+		for (int i = 0; i < count; i++) {
+			result.add(ring.values.get(ring.values.size() - 1 - i));
+		}
+		return result;
+	}
+
+	/**
+	 * Forgets a value deleted from the database. What is left for its id is still
+	 * the newest values, only one fewer.
+	 *
+	 * @param key Primary key of the deleted value
+	 */
+	public void remove(int key) {
+		// The id of the value is unknown, any load in flight may have seen it
+		loading.replaceAll((id, changed) -> true);
+		for (Ring<T> ring : rings.values()) {
+			if (ring.values.removeIf(value -> keyOf.apply(value).equals(key))) {
+				return;
+			}
+		}
+	}
+
+	public int size() {
+		return rings.size();
+	}
+
+	public long getHits() {
+		return hits;
+	}
+
+	public long getMisses() {
+		return misses;
+	}
+}
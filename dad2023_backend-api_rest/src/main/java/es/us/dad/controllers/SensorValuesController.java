@@ -1,7 +1,5 @@
 package es.us.dad.controllers;
 
-import java.util.Calendar;
-
 import es.us.dad.mqtt.MqttClientUtil;
 import es.us.dad.mysql.entities.Device;
 import es.us.dad.mysql.entities.Group;
@@ -9,6 +7,7 @@ import es.us.dad.mysql.entities.Sensor;
 import es.us.dad.mysql.entities.SensorValue;
 import es.us.dad.mysql.messages.DatabaseEntity;
 import es.us.dad.mysql.messages.DatabaseMessage;
+import es.us.dad.mysql.messages.DatabaseMessageLatestValues;
 import es.us.dad.mysql.messages.DatabaseMessageType;
 import es.us.dad.mysql.messages.DatabaseMethod;
 import es.us.dad.mysql.rest.RestEntityMessage;
@@ -26,13 +25,37 @@ import io.vertx.core.Promise;
  */
 public class SensorValuesController extends AbstractController {
 
+	/**
+	 * Latest values of the sensors read recently, kept up to date with every
+	 * value created or deleted through this controller.
+	 */
+	private final LatestValuesCache<SensorValue> latestValues;
+
+	/**
+	 * Devices that sent values since the last update of their
+	 * lastTimestampSensorModified.
+	 */
+	private final LastSeenBuffer lastSeen = new LastSeenBuffer(true, LastSeenBuffer.GRANULARITY);
+
+	private MqttClientUtil mqttClientUtil;
+
 	/**
 	 * Constructor of the class where the type of entity managed by the class is
 	 * indicated to the AbstractController class where the basic functionality of
 	 * the controllers is defined.
 	 */
 	public SensorValuesController() {
+		this(LatestValuesCache.CAPACITY);
+	}
+
+	/**
+	 * @param latestValuesCapacity Values cached per sensor for the last and latest
+	 *                             values requests, 0 to always query the database
+	 */
+	public SensorValuesController(int latestValuesCapacity) {
 		super(DatabaseEntity.SensorValue);
+		latestValues = new LatestValuesCache<SensorValue>(latestValuesCapacity, LatestValuesCache.MAX_IDS,
+				SensorValue::getIdSensor, SensorValue::getIdSensorValue, SensorValue::getTimestamp);
 	}
 
 	/**
@@ -47,7 +70,9 @@ public class SensorValuesController extends AbstractController {
 	 * layer.
 	 */
 	public void start(Promise<Void> startFuture) {
-		MqttClientUtil mqttClientUtil = MqttClientUtil.getInstance(vertx);
+		mqttClientUtil = MqttClientUtil.getInstance(vertx);
+		startLastSeenFlush(lastSeen);
+		startLatestValuesReport(latestValues);
 		getVertx().eventBus().consumer(RestEntityMessage.SensorValue.getAddress(), message -> {
 			DatabaseMessage databaseMessage = gson.fromJson((String) message.body(), DatabaseMessage.class);
 			/*
@@ -63,87 +88,37 @@ public class SensorValuesController extends AbstractController {
 			 */
 			switch (databaseMessage.getMethod()) {
 			case CreateSensorValue:
-				launchDatabaseOperation(message);
-				SensorValue sensorValue = databaseMessage.getRequestBodyAs(SensorValue.class);
-
-				// Getting sensor entity from idSensor property present in SensorValue
-				launchDatabaseOperation(DatabaseEntity.Sensor, new DatabaseMessage(DatabaseMessageType.SELECT,
-						DatabaseEntity.Sensor, DatabaseMethod.GetSensor, sensorValue.getIdSensor())).future()
-						.onComplete(res -> {
-							if (res.succeeded()) {
-								Sensor sensor = res.result().getResponseBodyAs(Sensor.class);
-								if (sensor != null) {
-
-									// Getting device entity from idDevice property present in Sensor
-									launchDatabaseOperation(DatabaseEntity.Device,
-											new DatabaseMessage(DatabaseMessageType.SELECT, DatabaseEntity.Device,
-													DatabaseMethod.GetDevice, sensor.getIdDevice()))
-											.future().onComplete(resDevice -> {
-												Device device = resDevice.result().getResponseBodyAs(Device.class);
-												if (resDevice.succeeded()) {
-													
-													// Publish MQTT Message in device MQTT topic
-//													mqttClientUtil.publishMqttMessage(device.getMqttChannel(),
-//															gson.toJson(sensorValue), handler -> {
-//																System.out.println(handler.result());
-//															});
-													if(sensorValue.getValue() >27.5) {
-														mqttClientUtil.publishMqttMessage(
-																device.getMqttChannel(), "1",
-																handler -> {System.out.println(handler.result());
-																});
-													} else {
-														mqttClientUtil.publishMqttMessage(
-																device.getMqttChannel(), "0",
-																handler -> {System.out.println(handler.result());
-																});
-													}
-
-													// Getting group entity from idGroup property present in Device
-													launchDatabaseOperation(DatabaseEntity.Group,
-															new DatabaseMessage(DatabaseMessageType.SELECT,
-																	DatabaseEntity.Group, DatabaseMethod.GetGroup,
-																	device.getIdGroup()))
-															.future().onComplete(resGroup -> {
-																Group group = resGroup.result()
-																		.getResponseBodyAs(Group.class);
-																if (resGroup.succeeded()) {
-																	// Publish MQTT Message in group' MQTT topic
-																	// TODO: implements business logic here (publish
-																	// some readable message for devices in group)
-																	
-																	mqttClientUtil.publishMqttMessage(
-																			group.getMqttChannel(),
-																			gson.toJson(sensorValue), handler -> {
-																				System.out.println(handler.result());
-																			});
-																	
-																	
-																}
-															});
-
-												}
-											});
-
-									// Updates device entity with the current timestamp where last sensor has
-									// been modified
-									launchDatabaseOperation(DatabaseEntity.Device,
-											new DatabaseMessage(DatabaseMessageType.UPDATE, DatabaseEntity.Device,
-													DatabaseMethod.EditDevice,
-													new Device(sensor.getIdDevice(), null, null, null, null, null,
-															Calendar.getInstance().getTimeInMillis())));
-								}
-							}
-						});
+				launchDatabaseOperation(message,
+						created -> latestValues.add(created.getResponseBodyAs(SensorValue.class)));
+				notifySensorValue(databaseMessage.getRequestBodyAs(SensorValue.class));
+				break;
+			case CreateSensorValues:
+				// One notification per block, for its newest value
+				launchDatabaseOperation(message, created -> {
+					SensorValue[] sensorValues = created.getResponseBodyAs(SensorValue[].class);
+					for (SensorValue sensorValue : sensorValues) {
+						latestValues.add(sensorValue);
+					}
+					if (sensorValues.length > 0) {
+						notifySensorValue(sensorValues[sensorValues.length - 1]);
+					}
+				});
 				break;
 			case DeleteSensorValue:
-				launchDatabaseOperation(message);
+				int idSensorValue = Integer.parseInt(databaseMessage.getRequestBody());
+				launchDatabaseOperation(message, deleted -> latestValues.remove(idSensorValue));
 				break;
 			case GetLastSensorValueFromSensorId:
-				launchDatabaseOperation(message);
+				launchLatestValuesOperation(message, databaseMessage, latestValues,
+						Integer.parseInt(databaseMessage.getRequestBody()), 1, true,
+						DatabaseMethod.GetLatestSensorValuesFromSensorId, SensorValue[].class);
 				break;
 			case GetLatestSensorValuesFromSensorId:
-				launchDatabaseOperation(message);
+				DatabaseMessageLatestValues latest = databaseMessage
+						.getRequestBodyAs(DatabaseMessageLatestValues.class);
+				launchLatestValuesOperation(message, databaseMessage, latestValues, latest.getId(),
+						latest.getLimit(), false, DatabaseMethod.GetLatestSensorValuesFromSensorId,
+						SensorValue[].class);
 				break;
 			default:
 				/*
@@ -156,7 +131,83 @@ public class SensorValuesController extends AbstractController {
 		startFuture.complete();
 	}
 
+	/**
+	 * Publishes a new value of a sensor on MQTT (the relay command on the channel
+	 * of its device and the value on the channel of its group) and records that
+	 * its device has been seen.
+	 * 
+	 * @param sensorValue Value created
+	 */
+	private void notifySensorValue(SensorValue sensorValue) {
+		// Getting sensor entity from idSensor property present in SensorValue
+		launchDatabaseOperation(DatabaseEntity.Sensor, new DatabaseMessage(DatabaseMessageType.SELECT,
+				DatabaseEntity.Sensor, DatabaseMethod.GetSensor, sensorValue.getIdSensor())).future()
+				.onComplete(res -> {
+					if (res.succeeded()) {
+						Sensor sensor = res.result().getResponseBodyAs(Sensor.class);
+						if (sensor != null) {
+
+							// Getting device entity from idDevice property present in Sensor
+							launchDatabaseOperation(DatabaseEntity.Device,
+									new DatabaseMessage(DatabaseMessageType.SELECT, DatabaseEntity.Device,
+											DatabaseMethod.GetDevice, sensor.getIdDevice()))
+									.future().onComplete(resDevice -> {
+										Device device = resDevice.result().getResponseBodyAs(Device.class);
+										if (resDevice.succeeded()) {
+											
+											// Publish MQTT Message in device MQTT topic
+//											mqttClientUtil.publishMqttMessage(device.getMqttChannel(),
+//													gson.toJson(sensorValue), handler -> {
+//														System.out.println(handler.result());
+//													});
+											if(sensorValue.getValue() >27.5) {
+												mqttClientUtil.publishMqttMessage(
+														device.getMqttChannel(), "1",
+														handler -> {System.out.println(handler.result());
+														});
+											} else {
+												mqttClientUtil.publishMqttMessage(
+														device.getMqttChannel(), "0",
+														handler -> {System.out.println(handler.result());
+														});
+											}
+
+											// Getting group entity from idGroup property present in Device
+											launchDatabaseOperation(DatabaseEntity.Group,
+													new DatabaseMessage(DatabaseMessageType.SELECT,
+															DatabaseEntity.Group, DatabaseMethod.GetGroup,
+															device.getIdGroup()))
+													.future().onComplete(resGroup -> {
+														Group group = resGroup.result()
+																.getResponseBodyAs(Group.class);
+														if (resGroup.succeeded()) {
+															// Publish MQTT Message in group' MQTT topic
+															// TODO: implements business logic here (publish
+															// some readable message for devices in group)
+															
+															mqttClientUtil.publishMqttMessage(
+																	group.getMqttChannel(),
+																	gson.toJson(sensorValue), handler -> {
+																		System.out.println(handler.result());
+																	});
+															
+															
+														}
+													});
+
+										}
+									});
+
+							// Updates device entity with the current timestamp where last sensor has
+							// been modified, batched with the other devices in the next flush
+							touchLastSeen(lastSeen, sensor.getIdDevice());
+						}
+					}
+				});
+	}
+
 	public void stop(Future<Void> stopFuture) throws Exception {
+		flushLastSeen(lastSeen);
 		super.stop(stopFuture);
 	}
 
@@ -1,7 +1,10 @@
 package es.us.dad.mysql;
 
 import java.util.ArrayList;
+import java.util.HashSet;
 import java.util.List;
+import java.util.Set;
+import java.util.function.Function;
 
 import com.google.gson.Gson;
 
@@ -26,6 +29,7 @@ import io.vertx.mysqlclient.MySQLPool;
 import io.vertx.sqlclient.PoolOptions;
 import io.vertx.sqlclient.Row;
 import io.vertx.sqlclient.RowSet;
+import io.vertx.sqlclient.Transaction;
 import io.vertx.sqlclient.Tuple;
 
 public class MySQLVerticle extends AbstractVerticle {
@@ -83,6 +87,10 @@ public class MySQLVerticle extends AbstractVerticle {
 			case EditDevice:
 				this.editDevice(databaseMessage.getRequestBodyAs(Device.class), databaseMessage, message);
 				break;
+			case EditDevicesLastTimestamps:
+				this.editDevicesLastTimestamps(databaseMessage.getRequestBodyAs(Device[].class), databaseMessage,
+						message);
+				break;
 			case DeleteDevice:
 				this.deleteDevice(Integer.parseInt(databaseMessage.getRequestBody()), databaseMessage, message);
 				break;
@@ -158,6 +166,10 @@ public class MySQLVerticle extends AbstractVerticle {
 			case CreateSensorValue:
 				this.createSensorValue(databaseMessage.getRequestBodyAs(SensorValue.class), databaseMessage, message);
 				break;
+			case CreateSensorValues:
+				this.createSensorValues(databaseMessage.getRequestBodyAs(SensorValue[].class), databaseMessage,
+						message);
+				break;
 			case DeleteSensorValue:
 				this.deleteSensorValue(Integer.parseInt(databaseMessage.getRequestBody()), databaseMessage, message);
 				break;
@@ -349,6 +361,73 @@ public class MySQLVerticle extends AbstractVerticle {
 				});
 	}
 
+	/**
+	 * Sets the last sensor and/or actuator timestamps of many devices in a single
+	 * UPDATE, so a whole flush of LastSeenBuffer takes the row locks once. Null
+	 * timestamps leave the column as it is, and a timestamp never goes back.
+	 */
+	protected void editDevicesLastTimestamps(Device[] devices, DatabaseMessage databaseMessage,
+			Message<Object> message) {
+		Tuple tuple = Tuple.tuple();
+		List<String> assignments = new ArrayList<>();
+		addLastTimestampAssignment("lastTimestampSensorModified", devices, Device::getLastTimestampSensorModified,
+				assignments, tuple);
+		addLastTimestampAssignment("lastTimestampActuatorModified", devices,
+				Device::getLastTimestampActuatorModified, assignments, tuple);
+		if (assignments.isEmpty()) {
+			databaseMessage.setResponseBody(0);
+			databaseMessage.setStatusCode(200);
+			message.reply(gson.toJson(databaseMessage));
+			return;
+		}
+		StringBuilder ids = new StringBuilder();
+		for (Device device : devices) {
+			ids.append(ids.length() == 0 ? "?" : ",?");
+			tuple.addInteger(device.getIdDevice());
+		}
+		mySqlClient.preparedQuery("UPDATE dad.devices g SET " + String.join(", ", assignments)
+				+ " WHERE idDevice IN (" + ids + ");", tuple, res -> {
+					if (res.succeeded()) {
+						databaseMessage.setResponseBody(res.result().rowCount());
+						databaseMessage.setStatusCode(200);
+						message.reply(gson.toJson(databaseMessage));
+					} else {
+						message.fail(100, res.cause().getLocalizedMessage());
+						System.err.println(res.cause());
+					}
+				});
+	}
+
+	/**
+	 * Appends "column = newest of the current value and the one given for the
+	 * device" to assignments, unless no device has a value for column.
+	 */
+	private void addLastTimestampAssignment(String column, Device[] devices, Function<Device, Long> timestampOf,
+			List<String> assignments, Tuple tuple) {
+		StringBuilder whens = new StringBuilder();
+		List<Object> values = new ArrayList<>();
+		for (Device device : devices) {
+			Long timestamp = timestampOf.apply(device);
+			if (timestamp != null) {
+				whens.append(" WHEN ? THEN ?");
+				values.add(device.getIdDevice());
+				values.add(timestamp);
+			}
+		}
+		if (values.isEmpty()) {
+			return;
+		}
+		// GREATEST is null if the column is, the COALESCE falls back to the new value
+		String newValue = "CASE idDevice" + whens + " END";
+		assignments.add(column + " = COALESCE(GREATEST(" + newValue + ", g." + column + "), " + newValue + ", g."
+				+ column + ")");
+		for (int i = 0; i < 2; i++) {
+			for (Object value : values) {
+				tuple.addValue(value);
+			}
+		}
+	}
+
 	protected void deleteDevice(int idDevice, DatabaseMessage databaseMessage, Message<Object> message) {
 		mySqlClient.preparedQuery("DELETE FROM dad.devices WHERE idDevice = ?;", Tuple.of(idDevice), res -> {
 			if (res.succeeded()) {
@@ -588,6 +667,102 @@ public class MySQLVerticle extends AbstractVerticle {
 				});
 	}
 
+	/**
+	 * Inserts the values of one sensor (a block uploaded by a device) in a single
+	 * transaction. Values whose timestamp is already stored for the sensor (or
+	 * repeated in the block) are left out, so a block sent again after a failure
+	 * or a lost response adds no row twice. Replies with the values inserted, with their ids; when anything
+	 * fails nothing is inserted.
+	 */
+	protected void createSensorValues(SensorValue[] sensorValues, DatabaseMessage databaseMessage,
+			Message<Object> message) {
+		if (sensorValues.length == 0) {
+			databaseMessage.setResponseBody(sensorValues);
+			databaseMessage.setStatusCode(200);
+			message.reply(gson.toJson(databaseMessage));
+			return;
+		}
+		int idSensor = sensorValues[0].getIdSensor();
+		long first = sensorValues[0].getTimestamp();
+		long last = first;
+		for (SensorValue sensorValue : sensorValues) {
+			first = Math.min(first, sensorValue.getTimestamp());
+			last = Math.max(last, sensorValue.getTimestamp());
+		}
+		long from = first;
+		long to = last;
+		mySqlClient.begin(begin -> {
+			if (begin.failed()) {
+				message.fail(100, begin.cause().getLocalizedMessage());
+				System.err.println(begin.cause());
+				return;
+			}
+			Transaction tx = begin.result();
+			// Locks the range of the block, so a resend arriving while the first
+			// attempt is still running waits for it and then finds its rows
+			tx.preparedQuery(
+					"SELECT timestamp FROM dad.sensorValues WHERE idSensor = ? AND timestamp BETWEEN ? AND ? FOR UPDATE;",
+					Tuple.of(idSensor, from, to), existing -> {
+						if (existing.failed()) {
+							failTransaction(tx, existing.cause(), message);
+							return;
+						}
+						Set<Long> stored = new HashSet<Long>();
+						for (Row row : existing.result()) {
+							stored.add(row.getLong("timestamp"));
+						}
+						List<SensorValue> created = new ArrayList<SensorValue>();
+						StringBuilder rows = new StringBuilder();
+						Tuple tuple = Tuple.tuple();
+						for (SensorValue sensorValue : sensorValues) {
+							if (sensorValue.getIdSensor() == idSensor && stored.add(sensorValue.getTimestamp())) {
+								created.add(sensorValue);
+								rows.append(rows.length() == 0 ? "(?,?,?,?)" : ",(?,?,?,?)");
+								tuple.addFloat(sensorValue.getValue()).addInteger(idSensor)
+										.addLong(sensorValue.getTimestamp()).addBoolean(sensorValue.isRemoved());
+							}
+						}
+						if (created.isEmpty()) {
+							commitSensorValues(tx, created, databaseMessage, message);
+							return;
+						}
+						tx.preparedQuery("INSERT INTO dad.sensorValues (value, idSensor, timestamp, removed) VALUES "
+								+ rows + ";", tuple, inserted -> {
+									if (inserted.failed()) {
+										failTransaction(tx, inserted.cause(), message);
+										return;
+									}
+									// The ids of a multi-row INSERT are consecutive from the first one
+									long firstId = inserted.result().property(MySQLClient.LAST_INSERTED_ID);
+									for (int i = 0; i < created.size(); i++) {
+										created.get(i).setIdSensorValue((int) firstId + i);
+									}
+									commitSensorValues(tx, created, databaseMessage, message);
+								});
+					});
+		});
+	}
+
+	private void commitSensorValues(Transaction tx, List<SensorValue> created, DatabaseMessage databaseMessage,
+			Message<Object> message) {
+		tx.commit(commit -> {
+			if (commit.succeeded()) {
+				databaseMessage.setResponseBody(created);
+				databaseMessage.setStatusCode(200);
+				message.reply(gson.toJson(databaseMessage));
+			} else {
+				message.fail(100, commit.cause().getLocalizedMessage());
+				System.err.println(commit.cause());
+			}
+		});
+	}
+
+	private void failTransaction(Transaction tx, Throwable cause, Message<Object> message) {
+		tx.rollback();
+		message.fail(100, cause.getLocalizedMessage());
+		System.err.println(cause);
+	}
+
 	protected void deleteSensorValue(int idSensorValue, DatabaseMessage databaseMessage, Message<Object> message) {
 		mySqlClient.preparedQuery("DELETE FROM dad.sensorValues WHERE idSensorValue = ?;",
 				Tuple.of(idSensorValue), res -> {
@@ -16,7 +16,7 @@ public enum DatabaseMethod {
 
 	// Device operations
 	CreateDevice, GetDevice, EditDevice, DeleteDevice, GetSensorsFromDeviceId, GetActuatorsFromDeviceId,
-	GetSensorsFromDeviceIdAndSensorType, GetActuatorsFromDeviceIdAndActuatorType,
+	GetSensorsFromDeviceIdAndSensorType, GetActuatorsFromDeviceIdAndActuatorType, EditDevicesLastTimestamps,
 
 	// Sensor operations
 	CreateSensor, GetSensor, EditSensor, DeleteSensor,
@@ -25,7 +25,8 @@ public enum DatabaseMethod {
 	CreateActuator, GetActuator, EditActuator, DeleteActuator,
 
 	// Sensor value operations
-	CreateSensorValue, DeleteSensorValue, GetLastSensorValueFromSensorId, GetLatestSensorValuesFromSensorId,
+	CreateSensorValue, CreateSensorValues, DeleteSensorValue, GetLastSensorValueFromSensorId,
+	GetLatestSensorValuesFromSensorId,
 
 	// Actuator status operations
 	CreateActuatorStatus, DeleteActuatorStatus, GetLastActuatorStatusFromActuatorId,
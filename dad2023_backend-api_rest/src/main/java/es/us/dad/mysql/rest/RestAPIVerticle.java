@@ -1,6 +1,7 @@
 package es.us.dad.mysql.rest;
 
 import java.util.Calendar;
+import java.util.List;
 
 import com.google.gson.Gson;
 import com.google.gson.GsonBuilder;
@@ -86,6 +87,7 @@ public class RestAPIVerticle extends AbstractVerticle {
 		router.put("/api/actuators/:actuatorid").handler(this::putActuator);
 
 		router.post("/api/sensor_values").handler(this::addSensorValue);
+		router.post("/api/sensor_values/block").handler(this::addSensorValueBlock);
 		router.delete("/api/sensor_values/:sensorvalueid").handler(this::deleteSensorValue);
 		router.get("/api/sensor_values/:sensorid/last").handler(this::getLastSensorValue);
 		router.get("/api/sensor_values/:sensorid/latest/:limit").handler(this::getLatestSensorValue);
@@ -675,6 +677,38 @@ public class RestAPIVerticle extends AbstractVerticle {
 		});
 	}
 
+	/**
+	 * POST handler function for /api/sensor_values/block endpoint. The body is a
+	 * binary block of values of one sensor (see SensorValueBlock), inserted in a
+	 * single transaction by CreateSensorValues. A block sent again after a failure
+	 * or a lost response only adds the values not stored yet. Responds with the
+	 * array of created values, or 500 with none of them created.
+	 * 
+	 * @param routingContext
+	 */
+	private void addSensorValueBlock(RoutingContext routingContext) {
+		final List<SensorValue> sensorValues;
+		try {
+			sensorValues = SensorValueBlock.decode(routingContext.getBody().getBytes());
+		} catch (IllegalArgumentException e) {
+			routingContext.response().putHeader("content-type", "application/json").setStatusCode(500).end();
+			return;
+		}
+
+		DatabaseMessage databaseMessage = new DatabaseMessage(DatabaseMessageType.INSERT, DatabaseEntity.SensorValue,
+				DatabaseMethod.CreateSensorValues, gson.toJson(sensorValues));
+
+		vertx.eventBus().request(RestEntityMessage.SensorValue.getAddress(), gson.toJson(databaseMessage), handler -> {
+			if (handler.succeeded()) {
+				DatabaseMessage responseMessage = deserializeDatabaseMessageFromMessageHandler(handler);
+				routingContext.response().putHeader("content-type", "application/json").setStatusCode(201)
+						.end(gson.toJson(responseMessage.getResponseBodyAs(SensorValue[].class)));
+			} else {
+				routingContext.response().putHeader("content-type", "application/json").setStatusCode(500).end();
+			}
+		});
+	}
+
 	/**
 	 * DELETE SensorValue handler function for
 	 * /api/sensor_values/lastest/:sensorvalueid endpoint
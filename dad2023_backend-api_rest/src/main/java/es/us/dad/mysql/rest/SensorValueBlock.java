@@ -0,0 +1,103 @@
+package es.us.dad.mysql.rest;
+
+import java.util.ArrayList;
+import java.util.List;
+
+import es.us.dad.mysql.entities.SensorValue;
+
+/**
+ * Decoder for the time series blocks the firmware uploads to
+ * /api/sensor_values/block (lib/TimeSeries in the firmware). A block holds many
+ * (timestamp, value) samples of a single sensor, so a device can send them in
+ * one request instead of one JSON body per value.
+ *
+ * Block layout: version (1 byte), sample count (2 bytes, little endian), varint
+ * sensor id, then the first sample as zigzag varint timestamp and zigzag varint
+ * value. Every following sample is a varint holding the zigzag value delta
+ * shifted left by one, whose low bit says whether a zigzag varint
+ * delta-of-delta of the timestamp follows (otherwise it is 0). Values are in
+ * hundredths.
+ *
+ * @author luismi
+ *
+ */
+public class SensorValueBlock {
+
+	public static final int VERSION = 1;
+
+	private static final int HEADER_SIZE = 3;
+
+	private final byte[] data;
+	private int offset;
+
+	private SensorValueBlock(byte[] data) {
+		this.data = data;
+	}
+
+	/**
+	 * Decodes a block into SensorValue rows ready to be inserted, in the order they
+	 * were recorded.
+	 *
+	 * @param data Block as sent by the device
+	 *
+	 * @return List of SensorValue with idSensor, value and timestamp set and
+	 *         removed false
+	 *
+	 * @throws IllegalArgumentException if the block is truncated, has an unknown
+	 *                                  version or a value out of range
+	 */
+	public static List<SensorValue> decode(byte[] data) {
+		if (data == null || data.length < HEADER_SIZE || data[0] != VERSION) {
+			throw new IllegalArgumentException("Not a version " + VERSION + " sensor value block");
+		}
+		SensorValueBlock block = new SensorValueBlock(data);
+		int count = (data[1] & 0xff) | (data[2] & 0xff) << 8;
+		block.offset = HEADER_SIZE;
+		long idSensor = block.readVarint();
+		if (idSensor > Integer.MAX_VALUE) {
+			throw new IllegalArgumentException("Sensor id out of range");
+		}
+
+		List<SensorValue> sensorValues = new ArrayList<SensorValue>(count);
+		long timestamp = 0;
+		long delta = 0;
+		long value = 0;
+		for (int i = 0; i < count; i++) {
+			if (i == 0) {
+				timestamp = unzigzag(block.readVarint());
+				value = unzigzag(block.readVarint());
+			} else {
+				long change = block.readVarint();
+				if ((change & 1) != 0) {
+					delta += unzigzag(block.readVarint());
+				}
+				timestamp += delta;
+				value += unzigzag(change >>> 1);
+			}
+			if (value <= Short.MIN_VALUE || value > Short.MAX_VALUE) {
+				throw new IllegalArgumentException("Value out of range in sample " + i);
+			}
+			sensorValues.add(new SensorValue(value / 100f, (int) idSensor, timestamp, false));
+		}
+		return sensorValues;
+	}
+
+	private long readVarint() {
+		long result = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (offset == data.length) {
+				throw new IllegalArgumentException("Truncated sensor value block");
+			}
+			byte b = data[offset++];
+			result |= (long) (b & 0x7f) << shift;
+			if ((b & 0x80) == 0) {
+				return result;
+			}
+		}
+		throw new IllegalArgumentException("Malformed varint in sensor value block");
+	}
+
+	private static long unzigzag(long value) {
+		return (value >>> 1) ^ -(value & 1);
+	}
+}
@@ -0,0 +1,78 @@
+package es.us.dad.test;
+
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertNull;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.util.List;
+
+import org.junit.jupiter.api.DisplayName;
+import org.junit.jupiter.api.Test;
+
+import es.us.dad.controllers.LastSeenBuffer;
+import es.us.dad.mysql.entities.Device;
+
+public class LastSeenBufferTest {
+
+	@Test
+	@DisplayName("Many values of a device are written as one row with the newest timestamp")
+	void coalescesValues() {
+		LastSeenBuffer lastSeen = new LastSeenBuffer(true, 0);
+		for (int i = 0; i < 100; i++) {
+			lastSeen.touch(1, 1000 + i);
+			lastSeen.touch(2, 2000 + i);
+		}
+		lastSeen.touch(1, 500);
+		List<Device> devices = lastSeen.drain();
+		assertEquals(2, devices.size());
+		assertEquals(1, devices.get(0).getIdDevice().intValue());
+		assertEquals(1099L, devices.get(0).getLastTimestampSensorModified().longValue());
+		assertNull(devices.get(0).getLastTimestampActuatorModified());
+		assertEquals(2099L, devices.get(1).getLastTimestampSensorModified().longValue());
+		assertEquals(0, lastSeen.drain().size());
+		assertEquals(201, lastSeen.getTouches());
+		assertEquals(2, lastSeen.getRows());
+		assertEquals(1, lastSeen.getFlushes());
+	}
+
+	@Test
+	@DisplayName("A device is written again only when its timestamp advances by the granularity")
+	void granularity() {
+		LastSeenBuffer lastSeen = new LastSeenBuffer(false, 1000);
+		assertTrue(lastSeen.touch(1, 10000));
+		assertEquals(10000L, lastSeen.drain().get(0).getLastTimestampActuatorModified().longValue());
+		assertFalse(lastSeen.touch(1, 10999));
+		assertEquals(0, lastSeen.drain().size());
+		assertTrue(lastSeen.touch(1, 11000));
+		assertTrue(lastSeen.touch(1, 11500));
+		assertEquals(11500L, lastSeen.drain().get(0).getLastTimestampActuatorModified().longValue());
+	}
+
+	@Test
+	@DisplayName("Flushes are split in batches of MAX_BATCH devices")
+	void batches() {
+		LastSeenBuffer lastSeen = new LastSeenBuffer(true, 0);
+		for (int i = 0; i < LastSeenBuffer.MAX_BATCH + 1; i++) {
+			lastSeen.touch(i, 1000);
+		}
+		assertEquals(LastSeenBuffer.MAX_BATCH, lastSeen.drain().size());
+		assertEquals(1, lastSeen.drain().size());
+		assertEquals(0, lastSeen.getPending());
+	}
+
+	@Test
+	@DisplayName("Devices of a failed flush are queued again without losing newer timestamps")
+	void failedFlush() {
+		LastSeenBuffer lastSeen = new LastSeenBuffer(true, 1000);
+		lastSeen.touch(1, 1000);
+		lastSeen.touch(2, 1000);
+		List<Device> devices = lastSeen.drain();
+		lastSeen.touch(2, 5000);
+		lastSeen.failed(devices);
+		List<Device> retried = lastSeen.drain();
+		assertEquals(2, retried.size());
+		assertEquals(5000L, retried.get(0).getLastTimestampSensorModified().longValue());
+		assertEquals(1000L, retried.get(1).getLastTimestampSensorModified().longValue());
+	}
+}
@@ -0,0 +1,160 @@
+package es.us.dad.test;
+
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertNull;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
+import org.junit.jupiter.api.BeforeEach;
+import org.junit.jupiter.api.DisplayName;
+import org.junit.jupiter.api.Test;
+
+import es.us.dad.controllers.LatestValuesCache;
+import es.us.dad.mysql.entities.SensorValue;
+
+public class LatestValuesCacheTest {
+
+	private LatestValuesCache<SensorValue> cache;
+	private int nextKey;
+
+	@BeforeEach
+	void createCache() {
+		cache = new LatestValuesCache<SensorValue>(4, 2, SensorValue::getIdSensor, SensorValue::getIdSensorValue,
+				SensorValue::getTimestamp);
+		nextKey = 1;
+	}
+
+	private SensorValue value(int idSensor, long timestamp) {
+		return new SensorValue(nextKey++, (float) timestamp, idSensor, timestamp, false);
+	}
+
+	/**
+	 * Values newest first, as the database returns them
+	 */
+	private List<SensorValue> newest(int idSensor, long... timestamps) {
+		List<SensorValue> values = new ArrayList<SensorValue>();
+		for (long timestamp : timestamps) {
+			values.add(value(idSensor, timestamp));
+		}
+		return values;
+	}
+
+	private List<Long> timestamps(List<SensorValue> values) {
+		List<Long> result = new ArrayList<Long>();
+		for (SensorValue value : values) {
+			result.add(value.getTimestamp());
+		}
+		return result;
+	}
+
+	private void load(int idSensor, List<SensorValue> values, int requested) {
+		cache.loading(idSensor);
+		cache.load(idSensor, values, requested);
+	}
+
+	@Test
+	@DisplayName("Unknown ids are misses and are not cached by new values")
+	void unknownIdMisses() {
+		assertNull(cache.latest(1, 1));
+		cache.add(value(1, 100));
+		assertNull(cache.latest(1, 1));
+		assertEquals(2, cache.getMisses());
+	}
+
+	@Test
+	@DisplayName("Loaded values are served newest first and new values are added")
+	void loadThenAdd() {
+		load(1, newest(1, 300, 200, 100), 4);
+		assertEquals(Arrays.asList(300L, 200L), timestamps(cache.latest(1, 2)));
+
+		cache.add(value(1, 400));
+		assertEquals(Arrays.asList(400L, 300L, 200L, 100L), timestamps(cache.latest(1, 4)));
+
+		// Full: the oldest value goes and larger limits become misses
+		cache.add(value(1, 500));
+		assertEquals(Arrays.asList(500L, 400L, 300L, 200L), timestamps(cache.latest(1, 4)));
+		assertNull(cache.latest(1, 5));
+	}
+
+	@Test
+	@DisplayName("A short load holds the whole history and answers any limit")
+	void completeHistory() {
+		load(1, newest(1, 200, 100), 4);
+		assertEquals(Arrays.asList(200L, 100L), timestamps(cache.latest(1, 10)));
+		load(2, newest(2), 4);
+		assertEquals(0, cache.latest(2, 1).size());
+		cache.add(value(2, 50));
+		assertEquals(Arrays.asList(50L), timestamps(cache.latest(2, 10)));
+	}
+
+	@Test
+	@DisplayName("Late values are ordered by timestamp and older ones are left to the database")
+	void outOfOrderValues() {
+		load(1, newest(1, 400, 300, 200, 100), 4);
+		cache.add(value(1, 350));
+		assertEquals(Arrays.asList(400L, 350L, 300L, 200L), timestamps(cache.latest(1, 4)));
+		cache.add(value(1, 150));
+		assertEquals(Arrays.asList(400L, 350L, 300L, 200L), timestamps(cache.latest(1, 4)));
+	}
+
+	@Test
+	@DisplayName("A load is dropped if the id changed while it was running")
+	void staleLoad() {
+		cache.loading(1);
+		cache.add(value(1, 500));
+		cache.load(1, newest(1, 400, 300), 4);
+		assertNull(cache.latest(1, 1));
+
+		cache.loading(1);
+		cache.remove(12345);
+		cache.load(1, newest(1, 400, 300), 4);
+		assertNull(cache.latest(1, 1));
+
+		load(1, newest(1, 400, 300), 4);
+		assertEquals(Arrays.asList(400L), timestamps(cache.latest(1, 1)));
+	}
+
+	@Test
+	@DisplayName("A value already loaded is not added twice")
+	void duplicateAdd() {
+		List<SensorValue> loaded = newest(1, 300, 200);
+		load(1, loaded, 4);
+		cache.add(loaded.get(0));
+		assertEquals(Arrays.asList(300L, 200L), timestamps(cache.latest(1, 4)));
+	}
+
+	@Test
+	@DisplayName("Deleted values are forgotten")
+	void remove() {
+		List<SensorValue> loaded = newest(1, 300, 200, 100, 50);
+		load(1, loaded, 4);
+		cache.remove(loaded.get(0).getIdSensorValue());
+		assertEquals(Arrays.asList(200L, 100L, 50L), timestamps(cache.latest(1, 3)));
+		assertNull(cache.latest(1, 4));
+	}
+
+	@Test
+	@DisplayName("Only the most recently used ids are kept")
+	void evictsLeastRecentlyUsed() {
+		load(1, newest(1, 100), 4);
+		load(2, newest(2, 100), 4);
+		cache.latest(1, 1);
+		load(3, newest(3, 100), 4);
+		assertEquals(2, cache.size());
+		assertNull(cache.latest(2, 1));
+		assertEquals(1, cache.latest(1, 1).size());
+	}
+
+	@Test
+	@DisplayName("Capacity 0 disables the cache")
+	void disabled() {
+		LatestValuesCache<SensorValue> off = new LatestValuesCache<SensorValue>(0, 2, SensorValue::getIdSensor,
+				SensorValue::getIdSensorValue, SensorValue::getTimestamp);
+		off.loading(1);
+		off.load(1, newest(1, 100), 4);
+		assertNull(off.latest(1, 1));
+		assertEquals(0, off.size());
+	}
+}
@@ -0,0 +1,60 @@
+package es.us.dad.test;
+
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertThrows;
+
+import java.util.Arrays;
+import java.util.List;
+
+import org.junit.jupiter.api.DisplayName;
+import org.junit.jupiter.api.Test;
+
+import es.us.dad.mysql.entities.SensorValue;
+import es.us.dad.mysql.rest.SensorValueBlock;
+
+public class SensorValueBlockTest {
+
+	// Same block as test_time_series in the firmware: sensor 72, samples 30 s
+	// apart (the last one 5 ms late) with values 23.45, 23.5, 23.4 and -0.05
+	private static final byte[] REFERENCE = { 0x01, 0x04, 0x00, 0x48, (byte) 0x80, (byte) 0xa0, (byte) 0xab,
+			(byte) 0xfe, (byte) 0xf9, 0x62, (byte) 0xd2, 0x24, 0x15, (byte) 0xe0, (byte) 0xd4, 0x03, 0x26,
+			(byte) 0xa3, 0x49, 0x0a };
+
+	@Test
+	@DisplayName("Decodes the firmware reference block")
+	void decodeReference() {
+		List<SensorValue> sensorValues = SensorValueBlock.decode(REFERENCE);
+		assertEquals(4, sensorValues.size());
+		long[] timestamps = { 1700000000000L, 1700000030000L, 1700000060000L, 1700000090005L };
+		float[] values = { 23.45f, 23.5f, 23.4f, -0.05f };
+		for (int i = 0; i < 4; i++) {
+			SensorValue sensorValue = sensorValues.get(i);
+			assertEquals(72, sensorValue.getIdSensor().intValue());
+			assertEquals(timestamps[i], sensorValue.getTimestamp().longValue());
+			assertEquals(values[i], sensorValue.getValue().floatValue());
+			assertFalse(sensorValue.isRemoved());
+		}
+	}
+
+	@Test
+	@DisplayName("Empty block has no values")
+	void decodeEmpty() {
+		assertEquals(0, SensorValueBlock.decode(new byte[] { 0x01, 0x00, 0x00, 0x48 }).size());
+	}
+
+	@Test
+	@DisplayName("Rejects malformed blocks")
+	void rejectMalformed() {
+		byte[] otherVersion = REFERENCE.clone();
+		otherVersion[0] = 2;
+		assertThrows(IllegalArgumentException.class, () -> SensorValueBlock.decode(otherVersion));
+		assertThrows(IllegalArgumentException.class, () -> SensorValueBlock.decode(new byte[] { 0x01, 0x00 }));
+		assertThrows(IllegalArgumentException.class,
+				() -> SensorValueBlock.decode(Arrays.copyOf(REFERENCE, REFERENCE.length - 1)));
+
+		// 327.67 followed by a +0.01 delta
+		byte[] outOfRange = { 0x01, 0x02, 0x00, 0x48, 0x00, (byte) 0xfe, (byte) 0xff, 0x03, 0x04 };
+		assertThrows(IllegalArgumentException.class, () -> SensorValueBlock.decode(outOfRange));
+	}
+}
@@ -116,6 +116,48 @@ public class SensorValueControllerTest {
 
 	}
 
+	@Test
+	@DisplayName("testBCreateBlockTwice")
+	public void testBCreateBlockTwice(Vertx vertx, VertxTestContext testContext) {
+		long now = Calendar.getInstance().getTimeInMillis();
+		SensorValue[] block = new SensorValue[5];
+		for (int i = 0; i < block.length; i++) {
+			block[i] = new SensorValue(20f + i, 10, now + i * 1000, false);
+		}
+		String request = gson.toJson(new DatabaseMessage(DatabaseMessageType.INSERT, DatabaseEntity.SensorValue,
+				DatabaseMethod.CreateSensorValues, block));
+
+		// The second request is a resend of the first one: nothing is created twice
+		vertx.eventBus().request(RestEntityMessage.SensorValue.getAddress(), request, first -> {
+			if (first.failed()) {
+				testContext.failNow(first.cause());
+				return;
+			}
+			SensorValue[] created = gson.fromJson(
+					gson.fromJson((String) first.result().body(), DatabaseMessage.class).getResponseBody(),
+					SensorValue[].class);
+			if (created.length != block.length || created[0].getIdSensorValue() == null
+					|| created[4].getIdSensorValue() != created[0].getIdSensorValue() + 4) {
+				testContext.failNow(new Throwable("Block not created"));
+				return;
+			}
+			vertx.eventBus().request(RestEntityMessage.SensorValue.getAddress(), request, second -> {
+				if (second.failed()) {
+					testContext.failNow(second.cause());
+					return;
+				}
+				SensorValue[] again = gson.fromJson(
+						gson.fromJson((String) second.result().body(), DatabaseMessage.class).getResponseBody(),
+						SensorValue[].class);
+				if (again.length == 0) {
+					testContext.completeNow();
+				} else {
+					testContext.failNow(new Throwable(again.length + " values created twice"));
+				}
+			});
+		});
+	}
+
 	@Test
 	@DisplayName("testCGetLastSensorValueFromSensorId")
 	public void testCGetLastSensorValueFromSensorId(Vertx vertx, VertxTestContext testContext)
@@ -2,7 +2,8 @@
 #include "ArduinoJson.h"
 #include <NTPClient.h>
 #include <WiFiUdp.h>
-#include <pwmWrite.h>
+#include <ServoEngine.h>
+#include <DigitalInput.h>
 #include <PubSubClient.h>
 
 // Replace 0 by ID of this current device
@@ -40,8 +41,16 @@ const int digitalSensorPin = 13;
 const int actuatorPin = 15;
 const int analogActuatorPin = 16;
 
-// Property initialization for servo movement using PWM signal
-Pwm pwm = Pwm();
+// Digital sensor edges captured by interrupt, so pulses between two loop()
+// passes are counted. Reported as the pulses and their frequency of each pass.
+DigitalInput digitalSensor;
+const uint32_t digitalDebounceUs = 2000; // 0 for clean signals, a few ms for contacts
+const int digitalPulsesSensorId = 19;
+const int digitalFrequencySensorId = 20;
+
+// Servo movement using PWM signal, stepped by a timer independently of loop()
+ServoEngine servos;
+int servoArm = -1;
 
 // callback a ejecutar cuando se recibe un mensaje
 // en este ejemplo, muestra por serial el mensaje recibido
@@ -101,8 +110,9 @@ void setup()
   // You must find de pinout for your specific board version
   pinMode(actuatorPin, OUTPUT);
   pinMode(analogSensorPin, INPUT);
-  pinMode(digitalSensorPin, INPUT);
-  pinMode(analogActuatorPin, OUTPUT);
+  digitalSensor.begin(digitalSensorPin, INPUT, digitalDebounceUs);
+  servos.begin();
+  servoArm = servos.attach(analogActuatorPin);
 
   // Init and get the time
   timeClient.begin();
@@ -356,6 +366,26 @@ void GET_tests()
   deserializeActuatorsFromDevice(http.GET());
 }
 
+// Sends what the digital sensor did since the previous call instead of its
+// level at this instant
+void POST_digital()
+{
+  EdgeWindow window = digitalSensor.take();
+  digitalSensor.printWindow(Serial, window);
+
+  describe("Test POST with digital sensor pulses");
+  String serverPath = serverName + "api/sensor_values";
+  http.begin(serverPath.c_str());
+  test_response(http.POST(serializeSensorValueBody(digitalPulsesSensorId, millis(), window.pulses)));
+
+  if (window.hz > 0)
+  {
+    describe("Test POST with digital sensor frequency");
+    http.begin(serverPath.c_str());
+    test_response(http.POST(serializeSensorValueBody(digitalFrequencySensorId, millis(), window.hz)));
+  }
+}
+
 void POST_tests()
 {
   String actuator_states_body = serializeActuatorStatusBody(random(2000, 4000) / 100, true, 1, millis());
@@ -370,6 +400,8 @@ void POST_tests()
   http.begin(serverPath.c_str());
   test_response(http.POST(sensor_value_body));
 
+  POST_digital();
+
   // String device_body = serializeDeviceBody(String(DEVICE_ID), ("Name_" + String(DEVICE_ID)).c_str(), ("mqtt_" + String(DEVICE_ID)).c_str(), 12);
   // describe("Test POST with path and body and response");
   // serverPath = serverName + "api/device";
@@ -435,16 +467,17 @@ void loop()
     Serial.println("OFF");
   }
 
-  // Servo moves from 0 to 180 deg at 140 deg/s with sigmoid motion.
-  pwm.writeServo(analogActuatorPin, 180, 140.0, 0.6);
+  // Servo moves from 0 to 180 deg at 140 deg/s with sigmoid motion. Only
+  // starts the move, the engine's timer runs it.
+  servos.moveTo(servoArm, 180, 140.0, MOTION_EASE);
+  servos.printJitter(Serial);
 
   // Reads analog sensor value and print it by serial monitor
   int analogValue = analogRead(analogSensorPin);
   Serial.println("Analog sensor value :" + String(analogValue));
 
-  // Reads digital sensor value and print ON or OFF by serial monitor depending on the sensor status (binary)
-  int digitalValue = digitalRead(digitalSensorPin);
-  if (digitalValue == HIGH)
+  // Prints the debounced digital sensor status (binary), its pulses are sent by POST_tests()
+  if (digitalSensor.level() == HIGH)
   {
     Serial.println("Digital sensor value : ON");
   }
@@ -0,0 +1,149 @@
+#include <ESP8266HTTPClient.h>
+#include <NTPClient.h>
+#include <WiFiUdp.h>
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>
+#include <DadProtocol.h>
+#include <EspNowRadio.h>
+#include <Gateway.h>
+
+// Gateway build (pio run -e gateway): sensor nodes built with -D DAD_PEER send
+// their readings over ESP-NOW, and this device is the only one with a WiFi
+// association, an HTTP client and an MQTT session. Readings are POSTed per
+// node as TimeSeries blocks, commands published on a node's channel are
+// forwarded to it. The logic itself is in lib/Gateway.
+
+String serverName = "http://192.168.43.195:8080/";
+HTTPClient http;
+WiFiClient client;
+WiFiClient client2;
+PubSubClient mqttClient(client2);
+
+const char *MQTT_BROKER_ADRESS = "192.168.43.195";
+const uint16_t MQTT_PORT = 1883;
+const char *MQTT_CLIENT_NAME = "gateway5";
+
+#define STASSID "AquarisV_ajm"    //"Your_Wifi_SSID"
+#define STAPSK "ajmTest123" //"Your_Wifi_PASSWORD"
+
+// Nodes send their readings every UPLOAD_EVERY loop passes, so a block of
+// GATEWAY_BATCH samples is a POST every few minutes per node
+const uint16_t GATEWAY_BATCH = 30;
+const uint32_t GATEWAY_FLUSH_MS = 60000;
+const uint32_t STATS_EVERY_MS = 60000;
+
+WiFiUDP ntpUDP;
+NTPClient timeClient(ntpUDP);
+
+EspNowRadio radio;
+Gateway gateway;
+
+// The one HTTP connection and MQTT session shared by every node
+class Upstream : public GatewayUpstream
+{
+public:
+  bool postBlock(const uint8_t *data, size_t length) override
+  {
+    String serverPath = serverName + DAD_PATH_SENSOR_VALUE_BLOCKS;
+    http.begin(client, serverPath.c_str());
+    http.addHeader("Content-Type", "application/octet-stream");
+    int httpResponseCode = http.POST(const_cast<uint8_t *>(data), length);
+    http.end();
+    Serial.printf("POST %u bytes: %d\n", (unsigned)length, httpResponseCode);
+    return httpResponseCode == 201;
+  }
+
+  bool subscribe(const char *filter) override
+  {
+    return mqttClient.connected() && mqttClient.subscribe(filter);
+  }
+};
+
+Upstream upstream;
+
+void OnMqttReceived(char *topic, byte *payload, unsigned int length)
+{
+  if (!gateway.onMqtt(topic, payload, length))
+    Serial.println("No node for " + String(topic));
+}
+
+void ConnectMqtt()
+{
+  Serial.print("Starting MQTT connection...");
+  if (mqttClient.connect(MQTT_CLIENT_NAME))
+  {
+    gateway.resubscribe(); // done from gateway.poll()
+    Serial.println("Conectado!");
+  }
+  else
+  {
+    Serial.print("Failed MQTT connection, rc=");
+    Serial.println(mqttClient.state());
+  }
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  // ESP-NOW runs on the channel of the access point, nodes have to use it too
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(STASSID, STAPSK);
+  while (WiFi.status() != WL_CONNECTED)
+  {
+    delay(500);
+    Serial.print(".");
+  }
+  Serial.println("");
+  Serial.printf("WiFi connected, ESP-NOW on channel %d, MAC %s\n", WiFi.channel(), WiFi.macAddress().c_str());
+  if (!radio.begin())
+    Serial.println("ESP-NOW init failed");
+  gateway.begin(&radio, &upstream, GATEWAY_BATCH, GATEWAY_FLUSH_MS);
+  mqttClient.setServer(MQTT_BROKER_ADRESS, MQTT_PORT);
+  mqttClient.setCallback(OnMqttReceived);
+  timeClient.begin();
+}
+
+void printStats()
+{
+  const GatewayStats &stats = gateway.stats();
+  Serial.printf("%u nodes, %u frames (%u malformed, %u unknown, %u radio overruns), %u readings, %u duplicates, "
+                "%u refused, %u lost, %u POSTs (%u failed), %u commands (%u failed)\n",
+                gateway.peers(), stats.frames, stats.malformed, stats.unknown, radio.overruns(), stats.readings,
+                stats.duplicates, stats.refused, stats.lost, stats.posts, stats.postFailures, stats.commands,
+                stats.commandFailures);
+}
+
+uint32_t lastStats = 0;
+
+void loop()
+{
+  timeClient.update();
+
+  uint8_t mac[PEER_MAC_SIZE];
+  uint8_t frame[PEER_FRAME_SIZE];
+  size_t length;
+  while (radio.receive(mac, frame, &length))
+  {
+    // Readings are stamped with NTP time: until there is one they are left
+    // unacknowledged, and the nodes send them again
+    if (timeClient.isTimeSet())
+      gateway.onFrame(mac, frame, length, millis(), (int64_t)timeClient.getEpochTime() * 1000);
+  }
+
+  // No delay on a failed connection: the nodes keep being heard meanwhile
+  static uint32_t lastMqttAttempt = 0;
+  if (!mqttClient.connected() && millis() - lastMqttAttempt >= 5000)
+  {
+    lastMqttAttempt = millis();
+    ConnectMqtt();
+  }
+  mqttClient.loop();
+
+  gateway.poll(millis());
+
+  if (millis() - lastStats >= STATS_EVERY_MS)
+  {
+    lastStats = millis();
+    printStats();
+  }
+}
@@ -0,0 +1,67 @@
+#include "CycleArena.h"
+#include <stdio.h>
+#include <string.h>
+
+CycleArena::CycleArena(uint8_t *buffer, size_t size) : _buffer(buffer), _size(size)
+{
+}
+
+// Offset of the next aligned address, whatever the alignment of the buffer
+static size_t aligned(const uint8_t *buffer, size_t offset)
+{
+  uintptr_t address = ((uintptr_t)(buffer + offset) + CYCLE_ARENA_ALIGN - 1) & ~(uintptr_t)(CYCLE_ARENA_ALIGN - 1);
+  return (size_t)(address - (uintptr_t)buffer);
+}
+
+void *CycleArena::alloc(size_t size)
+{
+  size_t start = aligned(_buffer, _used);
+  if (start > _size || size > _size - start)
+  {
+    _failures++;
+    return nullptr;
+  }
+  _used = start + size;
+  if (_used > _highWater)
+    _highWater = _used;
+  return _buffer + start;
+}
+
+// Written straight into what is left, where alloc() then returns it
+char *CycleArena::vformat(const char *fmt, va_list args)
+{
+  size_t start = aligned(_buffer, _used);
+  size_t room = start < _size ? _size - start : 0;
+  int length = vsnprintf((char *)_buffer + start, room, fmt, args);
+  if (length < 0 || (size_t)length >= room)
+  {
+    _failures++;
+    return nullptr;
+  }
+  return (char *)alloc(length + 1);
+}
+
+char *CycleArena::format(const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  char *text = vformat(fmt, args);
+  va_end(args);
+  return text;
+}
+
+char *CycleArena::copy(const char *text, size_t length)
+{
+  char *out = (char *)alloc(length + 1);
+  if (out == nullptr)
+    return nullptr;
+  memcpy(out, text, length);
+  out[length] = 0;
+  return out;
+}
+
+void CycleArena::reset()
+{
+  _used = 0;
+  _cycles++;
+}
@@ -0,0 +1,51 @@
+#ifndef CYCLE_ARENA_H
+#define CYCLE_ARENA_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump allocator for what one upload cycle of src/main.cpp needs: URLs,
+// request bodies, responses and log lines. Everything comes out of one
+// buffer allocated once, and reset() at the end of the cycle frees it all,
+// so the cycle no longer leaves String-sized holes all over the heap.
+//
+// Nothing allocated from it may be kept past reset().
+
+#define CYCLE_ARENA_ALIGN 4
+
+class CycleArena
+{
+public:
+  CycleArena(uint8_t *buffer, size_t size);
+
+  // nullptr, counted in failures(), if size bytes are not left
+  void *alloc(size_t size);
+
+  // printf into the arena; nullptr if it does not fit
+  char *format(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+  char *vformat(const char *fmt, va_list args);
+
+  // Null terminated copy of length bytes of text
+  char *copy(const char *text, size_t length);
+
+  // End of the cycle: everything allocated since the last reset() is gone
+  void reset();
+
+  size_t used() const { return _used; }
+  size_t left() const { return _size - _used; }
+  size_t size() const { return _size; }
+  size_t highWater() const { return _highWater; } // most used in one cycle
+  uint32_t failures() const { return _failures; }
+  uint32_t cycles() const { return _cycles; }
+
+private:
+  uint8_t *_buffer;
+  size_t _size;
+  size_t _used = 0;
+  size_t _highWater = 0;
+  uint32_t _failures = 0;
+  uint32_t _cycles = 0;
+};
+
+#endif
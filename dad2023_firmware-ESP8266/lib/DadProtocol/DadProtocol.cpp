@@ -0,0 +1,98 @@
+#include "DadProtocol.h"
+#include <ArduinoJson.h>
+
+// Longest int64_t in decimal plus terminator
+#define INT64_TEXT_SIZE 21
+
+// Decimal text of an int64_t, written here because neither ArduinoJson
+// without long long support nor the ESP8266 printf take 64 bit integers
+static const char *formatInt64(char *text, int64_t value)
+{
+  char *p = text + INT64_TEXT_SIZE - 1;
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  *p = 0;
+  do
+  {
+    *--p = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0)
+    *--p = '-';
+  return p;
+}
+
+size_t writeSensorValueBody(char *out, size_t size, int idSensor, long timestamp, float value)
+{
+  StaticJsonDocument<128> doc;
+
+  doc["idSensor"] = idSensor;
+  doc["timestamp"] = timestamp;
+  doc["value"] = value;
+  doc["removed"] = false;
+
+  if (measureJson(doc) >= size)
+    return 0;
+  return serializeJson(doc, out, size);
+}
+
+size_t writeSensorValueBodyCenti(char *out, size_t size, int idSensor, int64_t timestamp, centi_t value)
+{
+  StaticJsonDocument<128> doc;
+  char text[CENTI_TEXT_SIZE];
+  char stamp[INT64_TEXT_SIZE];
+  formatCenti(text, sizeof(text), value);
+
+  doc["idSensor"] = idSensor;
+  doc["timestamp"] = serialized(formatInt64(stamp, timestamp));
+  doc["value"] = serialized((const char *)text);
+  doc["removed"] = false;
+
+  if (measureJson(doc) >= size)
+    return 0;
+  return serializeJson(doc, out, size);
+}
+
+size_t writeActuatorStatusBody(char *out, size_t size, float status, bool statusBinary, int idActuator, long timestamp)
+{
+  StaticJsonDocument<128> doc;
+
+  doc["status"] = status;
+  doc["statusBinary"] = statusBinary;
+  doc["idActuator"] = idActuator;
+  doc["timestamp"] = timestamp;
+  doc["removed"] = false;
+
+  if (measureJson(doc) >= size)
+    return 0;
+  return serializeJson(doc, out, size);
+}
+
+size_t writeActuatorStatusBodyCenti(char *out, size_t size, centi_t status, bool statusBinary, int idActuator,
+                                    int64_t timestamp)
+{
+  StaticJsonDocument<128> doc;
+  char text[CENTI_TEXT_SIZE];
+  char stamp[INT64_TEXT_SIZE];
+  formatCenti(text, sizeof(text), status);
+
+  doc["status"] = serialized((const char *)text);
+  doc["statusBinary"] = statusBinary;
+  doc["idActuator"] = idActuator;
+  doc["timestamp"] = serialized(formatInt64(stamp, timestamp));
+  doc["removed"] = false;
+
+  if (measureJson(doc) >= size)
+    return 0;
+  return serializeJson(doc, out, size);
+}
+
+RelayCommand parseRelayCommand(const char *payload, size_t length)
+{
+  if (length != 1)
+    return RELAY_NONE;
+  if (payload[0] == '1')
+    return RELAY_ON;
+  if (payload[0] == '0')
+    return RELAY_OFF;
+  return RELAY_NONE;
+}
@@ -0,0 +1,48 @@
+#ifndef DAD_PROTOCOL_H
+#define DAD_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <FixedTemp.h>
+
+// Wire protocol shared by the firmware and the host tools (tools/). Nothing in
+// here may depend on Arduino.h, so the same code that builds the HTTP bodies on
+// the device can be linked into native executables.
+
+// REST endpoints, relative to serverName
+#define DAD_PATH_SENSOR_VALUES "api/sensor_values"
+#define DAD_PATH_ACTUATOR_STATES "api/actuator_states"
+#define DAD_PATH_SENSOR_VALUE_BLOCKS "api/sensor_values/block" // TimeSeries block body
+
+// Enough room for any body produced below
+#define DAD_BODY_SIZE 160
+
+// Command published by the backend on the device channel after each reading
+enum RelayCommand
+{
+  RELAY_NONE,
+  RELAY_ON,
+  RELAY_OFF
+};
+
+// Writes the JSON body for POST api/sensor_values into out (null terminated).
+// Returns the body length, or 0 if it did not fit.
+size_t writeSensorValueBody(char *out, size_t size, int idSensor, long timestamp, float value);
+
+// Same body with the value in hundredths of a degree, written as an exact
+// decimal ("23.45") without going through float formatting. The timestamp is
+// in epoch milliseconds, which do not fit the 32 bit long of the ESP8266.
+size_t writeSensorValueBodyCenti(char *out, size_t size, int idSensor, int64_t timestamp, centi_t value);
+
+// Writes the JSON body for POST api/actuator_states into out (null terminated).
+// Returns the body length, or 0 if it did not fit.
+size_t writeActuatorStatusBody(char *out, size_t size, float status, bool statusBinary, int idActuator, long timestamp);
+
+// Same body with status in hundredths and the timestamp in epoch milliseconds
+size_t writeActuatorStatusBodyCenti(char *out, size_t size, centi_t status, bool statusBinary, int idActuator,
+                                    int64_t timestamp);
+
+// Decodes a payload received on the device MQTT channel ("1" -> on, "0" -> off)
+RelayCommand parseRelayCommand(const char *payload, size_t length);
+
+#endif
@@ -0,0 +1,184 @@
+#include "DeltaOta.h"
+#include <ESP8266HTTPClient.h>
+#include <Updater.h>
+
+#define DELTA_OTA_TIMEOUT_MS 5000 // without data before the download is given up
+
+// The running image, from flash offset 0. The flash mode and size bytes of
+// its header are rewritten by esptool and Update when flashing, so they read
+// as 0 here and in tools/delta_gen.
+class FlashSource : public DeltaSource
+{
+public:
+  bool read(uint32_t offset, uint8_t *out, size_t length) override
+  {
+    if (!ESP.flashRead(offset, out, length))
+      return false;
+    for (uint32_t i = 2; i < 4; i++)
+    {
+      if (i >= offset && i < offset + length)
+        out[i - offset] = 0;
+    }
+    return true;
+  }
+};
+
+class UpdaterSink : public DeltaSink
+{
+public:
+  bool begin(uint32_t targetSize) override
+  {
+    return Update.begin(targetSize, U_FLASH);
+  }
+
+  bool write(const uint8_t *data, size_t length) override
+  {
+    bool written = Update.write(const_cast<uint8_t *>(data), length) == length;
+    yield(); // sector erases add up to seconds, keep the watchdog fed
+    return written;
+  }
+};
+
+// Reads the remaining bytes of a body into push() as they arrive. The body
+// is read raw, so a chunked one would not do. False when push() refuses a
+// chunk or the server stops sending before the end.
+template <typename Push>
+static bool download(HTTPClient &http, int remaining, uint32_t *downloaded, Push push)
+{
+  WiFiClient *stream = http.getStreamPtr();
+  uint8_t chunk[DELTA_WINDOW];
+  uint32_t lastData = millis();
+  while (remaining > 0 && millis() - lastData < DELTA_OTA_TIMEOUT_MS)
+  {
+    size_t available = stream->available();
+    if (available == 0)
+    {
+      delay(1);
+      continue;
+    }
+    size_t n = stream->readBytes(chunk, available < sizeof(chunk) ? available : sizeof(chunk));
+    lastData = millis();
+    remaining -= n;
+    *downloaded += n;
+    if (!push(chunk, n))
+      return false;
+  }
+  return remaining <= 0;
+}
+
+uint32_t DeltaOta::imageCrc()
+{
+  if (_haveCrc)
+    return _imageCrc;
+  FlashSource flash;
+  uint8_t window[DELTA_WINDOW];
+  uint32_t size = ESP.getSketchSize();
+  uint32_t crc = 0;
+  for (uint32_t offset = 0; offset < size; offset += sizeof(window))
+  {
+    uint32_t length = size - offset < sizeof(window) ? size - offset : sizeof(window);
+    if (!flash.read(offset, window, length))
+      return 0;
+    crc = deltaCrc32(crc, window, length);
+  }
+  _imageCrc = crc;
+  _haveCrc = true;
+  return crc;
+}
+
+DeltaOtaResult DeltaOta::updateDelta(WiFiClient &client, const String &baseUrl)
+{
+  _stats = DeltaOtaStats();
+  _stats.delta = true;
+  _stats.result = OTA_FAILED;
+  uint32_t start = millis();
+
+  char name[16];
+  snprintf(name, sizeof(name), "%08x.ddl", (unsigned)imageCrc());
+  HTTPClient http;
+  http.begin(client, baseUrl + name);
+  _stats.httpCode = http.GET();
+  if (_stats.httpCode == HTTP_CODE_NOT_FOUND)
+    _stats.result = OTA_NO_UPDATE;
+  int remaining = http.getSize();
+  if (_stats.httpCode != HTTP_CODE_OK || remaining <= 0)
+  {
+    http.end();
+    _stats.ms = millis() - start;
+    return _stats.result;
+  }
+
+  FlashSource flash;
+  UpdaterSink sink;
+  DeltaPatcher patcher;
+  patcher.begin(&flash, ESP.getSketchSize(), &sink);
+  bool pushed = download(http, remaining, &_stats.downloaded,
+                         [&patcher](const uint8_t *data, size_t length)
+                         { return patcher.push(data, length); });
+  http.end();
+
+  // Update.end() refuses an image it did not get all of, which is what a
+  // failed patch leaves behind
+  bool patched = pushed && patcher.finish();
+  _stats.error = patcher.error();
+  _stats.imageSize = patcher.targetSize();
+  if (Update.end() && patched)
+    _stats.result = OTA_UPDATED;
+  _stats.ms = millis() - start;
+  return _stats.result;
+}
+
+// firmware.bin has no checksum of its own like a delta, so Update checks it
+// against firmware.bin.md5 and Update.end() refuses an image that does not
+// match or did not arrive whole. Without the digest nothing is flashed.
+DeltaOtaResult DeltaOta::updateFull(WiFiClient &client, const String &baseUrl)
+{
+  _stats = DeltaOtaStats();
+  _stats.result = OTA_FAILED;
+  uint32_t start = millis();
+
+  HTTPClient http;
+  http.begin(client, baseUrl + "firmware.bin.md5");
+  _stats.httpCode = http.GET();
+  // md5sum output: the digest, then the file name
+  String md5 = _stats.httpCode == HTTP_CODE_OK ? http.getString().substring(0, 32) : String();
+  http.end();
+  if (md5.length() != 32)
+  {
+    _stats.ms = millis() - start;
+    return _stats.result;
+  }
+
+  http.begin(client, baseUrl + "firmware.bin");
+  _stats.httpCode = http.GET();
+  if (_stats.httpCode == HTTP_CODE_NOT_FOUND)
+    _stats.result = OTA_NO_UPDATE;
+  int remaining = http.getSize();
+  if (_stats.httpCode != HTTP_CODE_OK || remaining <= 0 || !Update.begin(remaining, U_FLASH))
+  {
+    http.end();
+    _stats.ms = millis() - start;
+    return _stats.result;
+  }
+  _stats.imageSize = remaining;
+  Update.setMD5(md5.c_str()); // after begin(), which clears it
+  UpdaterSink sink;
+  download(http, remaining, &_stats.downloaded,
+           [&sink](const uint8_t *data, size_t length)
+           { return sink.write(data, length); });
+  http.end();
+
+  if (Update.end())
+    _stats.result = OTA_UPDATED;
+  _stats.ms = millis() - start;
+  return _stats.result;
+}
+
+size_t DeltaOta::formatStats(char *out, size_t size) const
+{
+  static const char *const RESULTS[] = {"updated", "no update", "failed"};
+  int n = snprintf(out, size, "%s %s: %u bytes downloaded in %u ms for a %u byte image (http %d, delta error %d)",
+                   _stats.delta ? "delta" : "full", RESULTS[_stats.result], (unsigned)_stats.downloaded,
+                   (unsigned)_stats.ms, (unsigned)_stats.imageSize, _stats.httpCode, (int)_stats.error);
+  return n < 0 ? 0 : ((size_t)n < size ? (size_t)n : size - 1);
+}
@@ -0,0 +1,60 @@
+#ifndef DELTA_OTA_H
+#define DELTA_OTA_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <DeltaPatch.h>
+
+// Updates the running sketch from a local update server holding
+// <CRC-32 of the image>.ddl deltas made by tools/delta_gen, firmware.bin and
+// its md5sum output as firmware.bin.md5.
+//
+// The delta is applied while it downloads: the old bytes are read from the
+// running image in flash, the new ones go to Update, and the CRC of the new
+// image is checked before its last window is written, so Update.end() only
+// switches to an image that is complete and right. The full image is kept
+// as the fallback and to compare transfer sizes and times; Update checks it
+// against firmware.bin.md5 the same way.
+
+enum DeltaOtaResult
+{
+  OTA_UPDATED,   // restart to run the new image
+  OTA_NO_UPDATE, // the server has nothing for this image
+  OTA_FAILED
+};
+
+struct DeltaOtaStats
+{
+  bool delta;
+  DeltaOtaResult result;
+  int httpCode;
+  DeltaError error;
+  uint32_t downloaded; // bytes
+  uint32_t imageSize;  // of the new image
+  uint32_t ms;
+};
+
+class DeltaOta
+{
+public:
+  // CRC-32 of the running image, computed once
+  uint32_t imageCrc();
+
+  // GET <baseUrl><imageCrc>.ddl; OTA_NO_UPDATE on 404
+  DeltaOtaResult updateDelta(WiFiClient &client, const String &baseUrl);
+
+  // GET <baseUrl>firmware.bin.md5, then <baseUrl>firmware.bin checked against
+  // it; OTA_FAILED without the digest, OTA_NO_UPDATE on 404 of the image
+  DeltaOtaResult updateFull(WiFiClient &client, const String &baseUrl);
+
+  // Of the last update
+  const DeltaOtaStats &stats() const { return _stats; }
+  size_t formatStats(char *out, size_t size) const;
+
+private:
+  uint32_t _imageCrc = 0;
+  bool _haveCrc = false;
+  DeltaOtaStats _stats = {};
+};
+
+#endif
@@ -0,0 +1,338 @@
+#include "DeltaPatch.h"
+#include <string.h>
+
+// Half-byte table: 64 bytes of flash instead of 1 KB
+static const uint32_t CRC_NIBBLES[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+
+uint32_t deltaCrc32(uint32_t crc, const uint8_t *data, size_t length)
+{
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++)
+  {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ CRC_NIBBLES[crc & 15];
+    crc = (crc >> 4) ^ CRC_NIBBLES[crc & 15];
+  }
+  return ~crc;
+}
+
+static uint32_t read32(const uint8_t *in)
+{
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+void DeltaPatcher::begin(DeltaSource *source, uint32_t sourceSize, DeltaSink *sink)
+{
+  _source = source;
+  _sink = sink;
+  _sourceSize = sourceSize;
+  _targetSize = 0;
+  _targetCrc = 0;
+  _error = DELTA_OK;
+  _state = HEADER;
+  _headerLength = 0;
+  _sourceCursor = 0;
+  _sourceBase = 0;
+  _sourceFill = 0;
+  _outFill = 0;
+  _written = 0;
+  _crc = 0;
+}
+
+bool DeltaPatcher::fail(DeltaError error)
+{
+  _error = error;
+  _state = FAILED;
+  return false;
+}
+
+// Checks the delta is for the image we have by the CRC of all of it, before
+// anything is written
+bool DeltaPatcher::header()
+{
+  if (memcmp(_header, DELTA_MAGIC, 4) != 0)
+    return fail(DELTA_BAD_HEADER);
+  uint32_t sourceSize = read32(_header + 4);
+  uint32_t sourceCrc = read32(_header + 8);
+  _targetSize = read32(_header + 12);
+  _targetCrc = read32(_header + 16);
+  if (sourceSize != _sourceSize)
+    return fail(DELTA_WRONG_SOURCE);
+
+  uint32_t crc = 0;
+  for (uint32_t offset = 0; offset < _sourceSize; offset += DELTA_WINDOW)
+  {
+    uint32_t length = _sourceSize - offset < DELTA_WINDOW ? _sourceSize - offset : DELTA_WINDOW;
+    if (!_source->read(offset, _sourceWindow, length))
+      return fail(DELTA_SOURCE_READ);
+    crc = deltaCrc32(crc, _sourceWindow, length);
+  }
+  _sourceFill = 0; // the window holds the last chunk, not what _sourceBase says
+  if (crc != sourceCrc)
+    return fail(DELTA_WRONG_SOURCE);
+  if (!_sink->begin(_targetSize))
+    return fail(DELTA_SINK_FAILED);
+  _state = OP;
+  return true;
+}
+
+bool DeltaPatcher::sourceByte(uint32_t offset, uint8_t *value)
+{
+  if (offset - _sourceBase >= _sourceFill)
+  {
+    _sourceBase = offset;
+    _sourceFill = _sourceSize - offset < DELTA_WINDOW ? _sourceSize - offset : DELTA_WINDOW;
+    if (!_source->read(offset, _sourceWindow, _sourceFill))
+    {
+      _sourceFill = 0;
+      return fail(DELTA_SOURCE_READ);
+    }
+  }
+  *value = _sourceWindow[offset - _sourceBase];
+  return true;
+}
+
+// The window is only written when the next byte needs the room, so the last
+// one is still here for finish()
+bool DeltaPatcher::emit(uint8_t value)
+{
+  if (_outFill == DELTA_WINDOW)
+  {
+    _crc = deltaCrc32(_crc, _out, _outFill);
+    if (!_sink->write(_out, _outFill))
+      return fail(DELTA_SINK_FAILED);
+    _outFill = 0;
+  }
+  _out[_outFill++] = value;
+  _written++;
+  return true;
+}
+
+bool DeltaPatcher::copySource(uint32_t length)
+{
+  uint8_t value;
+  for (uint32_t i = 0; i < length; i++)
+  {
+    if (!sourceByte(_sourcePos++, &value) || !emit(value))
+      return false;
+  }
+  return true;
+}
+
+// A varint of the current op is complete. The lengths were checked against
+// what is left of the source and the target, so emit() never overruns.
+bool DeltaPatcher::field(uint32_t value)
+{
+  _state = VARINT;
+  _varint = 0;
+  _varintShift = 0;
+  switch (_field)
+  {
+  case DIFF_OFFSET:
+  {
+    int32_t offset = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    _sourcePos = _sourceCursor + (uint32_t)offset;
+    if (_sourcePos > _sourceSize)
+      return fail(DELTA_MALFORMED);
+    _field = DIFF_LENGTH;
+    return true;
+  }
+  case DIFF_LENGTH:
+    if (value > _sourceSize - _sourcePos || value > _targetSize - _written)
+      return fail(DELTA_MALFORMED);
+    _diffLeft = value;
+    _sourceCursor = _sourcePos + value;
+    _field = DIFF_ZEROS;
+    if (value == 0)
+      _state = OP;
+    return true;
+  case DIFF_ZEROS:
+    if (value > _diffLeft)
+      return fail(DELTA_MALFORMED);
+    _diffLeft -= value;
+    _field = DIFF_COUNT;
+    return copySource(value);
+  case DIFF_COUNT:
+    if (value > _diffLeft)
+      return fail(DELTA_MALFORMED);
+    _bytesLeft = value;
+    _field = DIFF_ZEROS;
+    if (value > 0)
+      _state = DIFF_BYTES;
+    else if (_diffLeft == 0)
+      _state = OP;
+    return true;
+  case INSERT_LENGTH:
+    if (value > _targetSize - _written)
+      return fail(DELTA_MALFORMED);
+    _bytesLeft = value;
+    _state = value > 0 ? INSERT_BYTES : OP;
+    return true;
+  }
+  return fail(DELTA_MALFORMED);
+}
+
+bool DeltaPatcher::push(const uint8_t *data, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    uint8_t byte = data[i];
+    switch (_state)
+    {
+    case HEADER:
+      _header[_headerLength++] = byte;
+      if (_headerLength == DELTA_HEADER_SIZE && !header())
+        return false;
+      break;
+    case OP:
+      _varint = 0;
+      _varintShift = 0;
+      if (byte == DELTA_DIFF)
+      {
+        _field = DIFF_OFFSET;
+        _state = VARINT;
+      }
+      else if (byte == DELTA_INSERT)
+      {
+        _field = INSERT_LENGTH;
+        _state = VARINT;
+      }
+      else if (byte == DELTA_END)
+        _state = DONE;
+      else
+        return fail(DELTA_MALFORMED);
+      break;
+    case VARINT:
+      if (_varintShift > 28)
+        return fail(DELTA_MALFORMED);
+      _varint |= (uint32_t)(byte & 0x7f) << _varintShift;
+      _varintShift += 7;
+      if ((byte & 0x80) == 0 && !field(_varint))
+        return false;
+      break;
+    case DIFF_BYTES:
+    {
+      uint8_t value;
+      if (!sourceByte(_sourcePos++, &value) || !emit((uint8_t)(value + byte)))
+        return false;
+      _diffLeft--;
+      if (--_bytesLeft == 0)
+        _state = _diffLeft == 0 ? OP : VARINT;
+      break;
+    }
+    case INSERT_BYTES:
+      if (!emit(byte))
+        return false;
+      if (--_bytesLeft == 0)
+        _state = OP;
+      break;
+    case DONE:
+      return fail(DELTA_MALFORMED); // bytes after END
+    case FAILED:
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DeltaPatcher::finish()
+{
+  if (_state == FAILED)
+    return false;
+  if (_state != DONE)
+    return fail(DELTA_TRUNCATED);
+  if (_written != _targetSize)
+    return fail(DELTA_MALFORMED);
+  if (deltaCrc32(_crc, _out, _outFill) != _targetCrc)
+    return fail(DELTA_BAD_CRC);
+  if (_outFill > 0 && !_sink->write(_out, _outFill))
+    return fail(DELTA_SINK_FAILED);
+  _outFill = 0;
+  return true;
+}
+
+DeltaWriter::DeltaWriter(uint8_t *buffer, size_t size) : _buffer(buffer), _size(size)
+{
+}
+
+void DeltaWriter::put(uint8_t value)
+{
+  if (_length == _size)
+  {
+    _overflowed = true;
+    return;
+  }
+  _buffer[_length++] = value;
+}
+
+void DeltaWriter::put32(uint32_t value)
+{
+  for (int i = 0; i < 4; i++, value >>= 8)
+    put((uint8_t)value);
+}
+
+void DeltaWriter::putVarint(uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    put((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  put((uint8_t)value);
+}
+
+void DeltaWriter::header(uint32_t sourceSize, uint32_t sourceCrc, uint32_t targetSize, uint32_t targetCrc)
+{
+  for (int i = 0; i < 4; i++)
+    put((uint8_t)DELTA_MAGIC[i]);
+  put32(sourceSize);
+  put32(sourceCrc);
+  put32(targetSize);
+  put32(targetCrc);
+}
+
+void DeltaWriter::diff(uint32_t sourceOffset, const uint8_t *diff, uint32_t length)
+{
+  int32_t offset = (int32_t)(sourceOffset - _sourceCursor);
+  put(DELTA_DIFF);
+  putVarint(((uint32_t)offset << 1) ^ (uint32_t)(offset >> 31));
+  putVarint(length);
+  _sourceCursor = sourceOffset + length;
+
+  uint32_t i = 0;
+  while (i < length)
+  {
+    uint32_t zeros = 0;
+    while (i + zeros < length && diff[i + zeros] == 0)
+      zeros++;
+    i += zeros;
+    // A run of literals ends at 3 zeros: shorter gaps cost more to skip
+    uint32_t count = 0;
+    while (i + count < length)
+    {
+      if (diff[i + count] == 0 && (i + count + 3 > length || (diff[i + count + 1] == 0 && diff[i + count + 2] == 0)))
+        break;
+      count++;
+    }
+    putVarint(zeros);
+    putVarint(count);
+    for (uint32_t j = 0; j < count; j++)
+      put(diff[i + j]);
+    i += count;
+  }
+}
+
+void DeltaWriter::insert(const uint8_t *data, uint32_t length)
+{
+  put(DELTA_INSERT);
+  putVarint(length);
+  for (uint32_t i = 0; i < length; i++)
+    put(data[i]);
+}
+
+void DeltaWriter::end()
+{
+  put(DELTA_END);
+}
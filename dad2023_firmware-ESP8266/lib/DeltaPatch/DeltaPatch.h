@@ -0,0 +1,174 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary delta between the firmware image a node is running and a new one,
+// applied while it downloads (lib/DeltaOta) and generated on the host by
+// tools/delta_gen. Only DELTA_WINDOW bytes of the source and of the target are
+// held in RAM, whatever the image size.
+//
+// Layout, little endian:
+//   magic "DDL1", source size (4), source CRC-32 (4), target size (4),
+//   target CRC-32 (4), then ops until END:
+//   DIFF    op, zigzag varint source offset relative to the end of the
+//           previous DIFF, varint length, then (varint zeros, varint count,
+//           count bytes) runs covering length: target = source + diff, with
+//           the zero bytes of the diff left out
+//   INSERT  op, varint length, bytes
+//   END     op
+//
+// Code that moved keeps most of its bytes, so the diff against the old
+// position is mostly zeros; that is where the size goes down.
+
+#define DELTA_MAGIC "DDL1"
+#define DELTA_HEADER_SIZE 20
+#define DELTA_WINDOW 256
+
+enum DeltaOp
+{
+  DELTA_END = 0,
+  DELTA_DIFF = 1,
+  DELTA_INSERT = 2
+};
+
+enum DeltaError
+{
+  DELTA_OK,
+  DELTA_BAD_HEADER,
+  DELTA_WRONG_SOURCE, // the delta is for another image than the running one
+  DELTA_MALFORMED,
+  DELTA_SOURCE_READ,
+  DELTA_SINK_FAILED,
+  DELTA_TRUNCATED,
+  DELTA_BAD_CRC // the result is not the image the delta was made for
+};
+
+// CRC-32 as zlib's; start with crc 0 and chain the calls
+uint32_t deltaCrc32(uint32_t crc, const uint8_t *data, size_t length);
+
+// The image being patched, read at random offsets
+class DeltaSource
+{
+public:
+  virtual ~DeltaSource() {}
+  virtual bool read(uint32_t offset, uint8_t *out, size_t length) = 0;
+};
+
+// Where the new image goes, written in order
+class DeltaSink
+{
+public:
+  virtual ~DeltaSink() {}
+
+  // Called once the source has been checked, before the first write
+  virtual bool begin(uint32_t targetSize) = 0;
+  virtual bool write(const uint8_t *data, size_t length) = 0;
+};
+
+class DeltaPatcher
+{
+public:
+  void begin(DeltaSource *source, uint32_t sourceSize, DeltaSink *sink);
+
+  // Delta bytes as they arrive, in chunks of any size. Returns false once the
+  // patch failed, see error().
+  bool push(const uint8_t *data, size_t length);
+
+  // True if the whole target was produced and its CRC matches. The last
+  // window is only written then, so the sink never gets a complete image
+  // that is wrong.
+  bool finish();
+
+  DeltaError error() const { return _error; }
+  uint32_t targetSize() const { return _targetSize; }
+  uint32_t written() const { return _written; }
+
+private:
+  enum State
+  {
+    HEADER,
+    OP,
+    VARINT,
+    DIFF_BYTES,
+    INSERT_BYTES,
+    DONE,
+    FAILED
+  };
+  enum Field
+  {
+    DIFF_OFFSET,
+    DIFF_LENGTH,
+    DIFF_ZEROS,
+    DIFF_COUNT,
+    INSERT_LENGTH
+  };
+
+  DeltaSource *_source;
+  DeltaSink *_sink;
+  uint32_t _sourceSize;
+  uint32_t _targetSize;
+  uint32_t _targetCrc;
+  DeltaError _error;
+  State _state;
+
+  uint8_t _header[DELTA_HEADER_SIZE];
+  uint8_t _headerLength;
+
+  Field _field;
+  uint32_t _varint;
+  uint8_t _varintShift;
+
+  uint32_t _sourceCursor; // end of the previous DIFF
+  uint32_t _sourcePos;
+  uint32_t _diffLeft; // bytes of the current DIFF not produced yet
+  uint32_t _bytesLeft; // literal bytes of the current run or INSERT
+
+  uint8_t _sourceWindow[DELTA_WINDOW];
+  uint32_t _sourceBase;
+  uint32_t _sourceFill;
+
+  uint8_t _out[DELTA_WINDOW];
+  uint32_t _outFill;
+  uint32_t _written;
+  uint32_t _crc; // of what was written to the sink
+
+  bool fail(DeltaError error);
+  bool header();
+  bool field(uint32_t value);
+  bool sourceByte(uint32_t offset, uint8_t *value);
+  bool copySource(uint32_t length);
+  bool emit(uint8_t value);
+};
+
+// Builds a delta into a caller's buffer. Used by tools/delta_gen and the tests.
+class DeltaWriter
+{
+public:
+  DeltaWriter(uint8_t *buffer, size_t size);
+
+  void header(uint32_t sourceSize, uint32_t sourceCrc, uint32_t targetSize, uint32_t targetCrc);
+
+  // length target bytes equal to source[sourceOffset..] + diff[..]
+  void diff(uint32_t sourceOffset, const uint8_t *diff, uint32_t length);
+  void insert(const uint8_t *data, uint32_t length);
+  void end();
+
+  const uint8_t *data() const { return _buffer; }
+  size_t length() const { return _length; }
+  bool overflowed() const { return _overflowed; }
+
+private:
+  uint8_t *_buffer;
+  size_t _size;
+  size_t _length = 0;
+  bool _overflowed = false;
+  uint32_t _sourceCursor = 0;
+
+  void put(uint8_t value);
+  void put32(uint32_t value);
+  void putVarint(uint32_t value);
+};
+
+#endif
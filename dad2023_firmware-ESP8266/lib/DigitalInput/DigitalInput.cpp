@@ -0,0 +1,95 @@
+#include "DigitalInput.h"
+#include <driver/gpio.h>
+
+bool DigitalInput::begin(uint8_t pin, uint8_t mode, uint32_t debounceUs)
+{
+  if (_timer != NULL)
+    return false;
+  if (_mutex == NULL)
+    _mutex = xSemaphoreCreateMutex();
+  if (_mutex == NULL)
+    return false;
+  _pin = pin;
+  pinMode(pin, mode);
+  _counter.begin(digitalRead(pin), (uint32_t)esp_timer_get_time(), debounceUs);
+  _dropped = _ring.dropped();
+
+  esp_timer_create_args_t args = {};
+  args.callback = onDrain;
+  args.arg = this;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "edges";
+  if (esp_timer_create(&args, &_timer) != ESP_OK)
+    return false;
+  if (esp_timer_start_periodic(_timer, DIGITAL_INPUT_DRAIN_US) != ESP_OK)
+    return false;
+  attachInterruptArg(pin, onEdge, this, CHANGE);
+  return true;
+}
+
+void DigitalInput::end()
+{
+  if (_timer == NULL)
+    return;
+  detachInterrupt(_pin);
+  esp_timer_stop(_timer);
+  esp_timer_delete(_timer);
+  _timer = NULL;
+}
+
+// The level is read back in the ISR: with bounces it may equal the previous
+// edge's, the counter treats that as a bounce
+void IRAM_ATTR DigitalInput::onEdge(void *input)
+{
+  DigitalInput *self = (DigitalInput *)input;
+  self->_ring.push((uint32_t)esp_timer_get_time(), (uint8_t)gpio_get_level((gpio_num_t)self->_pin));
+}
+
+// The timer task skips a pass while take() holds the mutex instead of
+// blocking the other esp_timer callbacks; take() drains the ring itself
+void DigitalInput::onDrain(void *input)
+{
+  DigitalInput *self = (DigitalInput *)input;
+  if (xSemaphoreTake(self->_mutex, 0) != pdTRUE)
+    return;
+  self->drain();
+  xSemaphoreGive(self->_mutex);
+}
+
+// Called with _mutex held, which keeps a single consumer at a time as the
+// ring requires and the edges in order; the ISR never takes it
+void DigitalInput::drain()
+{
+  Edge edge;
+  while (_ring.pop(&edge))
+    _counter.feed(edge);
+}
+
+EdgeWindow DigitalInput::take()
+{
+  EdgeWindow window;
+  xSemaphoreTake(_mutex, portMAX_DELAY);
+  drain();
+  _counter.take((uint32_t)esp_timer_get_time(), &window);
+  uint32_t dropped = _ring.dropped();
+  window.dropped = dropped - _dropped;
+  _dropped = dropped;
+  xSemaphoreGive(_mutex);
+  return window;
+}
+
+uint8_t DigitalInput::level() const
+{
+  xSemaphoreTake(_mutex, portMAX_DELAY);
+  uint8_t level = _counter.level();
+  xSemaphoreGive(_mutex);
+  return level;
+}
+
+void DigitalInput::printWindow(Print &out, const EdgeWindow &window) const
+{
+  out.printf("pin %u over %u ms: %s, %u pulses (%.2f Hz), %u changes, high %u ms, %u bounces, %u dropped\n",
+             (unsigned)_pin, (unsigned)(window.spanUs / 1000), window.level ? "ON" : "OFF",
+             (unsigned)window.pulses, window.hz, (unsigned)window.changes, (unsigned)(window.highUs / 1000),
+             (unsigned)window.bounces, (unsigned)window.dropped);
+}
@@ -0,0 +1,47 @@
+#ifndef DIGITAL_INPUT_H
+#define DIGITAL_INPUT_H
+
+#include <Arduino.h>
+#include <EdgeCapture.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#define DIGITAL_INPUT_DRAIN_US 10000 // ring drained every 10 ms, 25k edges/s before it fills
+
+// Captures every edge of a digital input on the ESP32 by interrupt, so pulses
+// shorter than a loop() pass are counted instead of missed by digitalRead().
+// The ISR only timestamps the edge into an EdgeRing; an esp_timer task drains
+// the ring into an EdgeCounter, so the ring does not fill while loop() blocks
+// in HTTP calls. loop() takes the aggregate of each report window. The two
+// consumers share a FreeRTOS mutex, so interrupts stay enabled while edges
+// are counted.
+class DigitalInput
+{
+public:
+  // mode: INPUT, INPUT_PULLUP or INPUT_PULLDOWN. debounceUs 0 counts every edge.
+  bool begin(uint8_t pin, uint8_t mode = INPUT, uint32_t debounceUs = 0);
+  void end();
+
+  // Closes the current window and returns what happened in it. take() and
+  // level() need begin() first.
+  EdgeWindow take();
+
+  uint8_t level() const; // debounced
+
+  void printWindow(Print &out, const EdgeWindow &window) const;
+
+private:
+  uint8_t _pin = 0;
+  EdgeRing _ring;
+  EdgeCounter _counter;
+  uint32_t _dropped = 0; // ring drops already reported
+  esp_timer_handle_t _timer = NULL;
+  SemaphoreHandle_t _mutex = NULL; // one consumer of _ring and _counter at a time
+
+  static void IRAM_ATTR onEdge(void *input);
+  static void onDrain(void *input);
+  void drain();
+};
+
+#endif
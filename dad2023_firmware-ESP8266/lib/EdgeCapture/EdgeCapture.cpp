@@ -0,0 +1,72 @@
+#include "EdgeCapture.h"
+
+void EdgeCounter::begin(uint8_t level, uint32_t nowUs, uint32_t debounceUs)
+{
+  *this = EdgeCounter();
+  _debounceUs = debounceUs;
+  _level = _raw = level ? 1 : 0;
+  _rawUs = _levelSinceUs = _windowUs = nowUs;
+  _changedUs = nowUs - debounceUs; // the first edge is never a bounce
+}
+
+void EdgeCounter::change(uint8_t level, uint32_t us)
+{
+  if (_level)
+    _highUs += us - _levelSinceUs;
+  _levelSinceUs = us;
+  _level = level;
+  _changedUs = us;
+  _changes++;
+  if (!level)
+    return;
+  _pulses++;
+  if (_haveRise)
+    _periods++;
+  else
+    _firstRiseUs = us;
+  _haveRise = true;
+  _lastRiseUs = us;
+}
+
+void EdgeCounter::settle(uint32_t nowUs)
+{
+  uint32_t lockoutEnd = _changedUs + _debounceUs;
+  if (_raw == _level || (int32_t)(nowUs - lockoutEnd) < 0)
+    return;
+  change(_raw, (int32_t)(_rawUs - lockoutEnd) > 0 ? _rawUs : lockoutEnd);
+}
+
+void EdgeCounter::feed(const Edge &edge)
+{
+  settle(edge.us);
+  uint8_t level = edge.level ? 1 : 0;
+  _raw = level;
+  _rawUs = edge.us;
+  if (level != _level && edge.us - _changedUs >= _debounceUs)
+    change(level, edge.us);
+  else
+    _bounces++;
+}
+
+void EdgeCounter::take(uint32_t nowUs, EdgeWindow *window)
+{
+  settle(nowUs);
+  if (_level)
+    _highUs += nowUs - _levelSinceUs;
+  _levelSinceUs = nowUs;
+
+  window->spanUs = nowUs - _windowUs;
+  window->pulses = _pulses;
+  window->changes = _changes;
+  window->bounces = _bounces;
+  window->dropped = 0;
+  window->highUs = _highUs;
+  window->hz = _periods > 0 ? (float)_periods * 1e6f / (float)(_lastRiseUs - _firstRiseUs) : 0.0f;
+  window->level = _level;
+
+  // The last rising edge starts the first period of the next window
+  _windowUs = nowUs;
+  _pulses = _changes = _bounces = _highUs = 0;
+  _periods = 0;
+  _firstRiseUs = _lastRiseUs;
+}
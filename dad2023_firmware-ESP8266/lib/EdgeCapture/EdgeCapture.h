@@ -0,0 +1,127 @@
+#ifndef EDGE_CAPTURE_H
+#define EDGE_CAPTURE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Edges of a digital input captured by an interrupt handler and aggregated
+// away from it. EdgeRing is a single producer / single consumer queue the ISR
+// pushes timestamped levels into without locks or waiting; EdgeCounter turns
+// them into debounced state changes, pulse counts, time high and frequency
+// per report window.
+//
+// Timestamps are microseconds of a free running 32 bit counter, so windows
+// and pulse periods must stay under 71 minutes.
+
+#define EDGE_RING_SIZE 256 // power of two
+
+struct Edge
+{
+  uint32_t us;
+  uint8_t level;
+};
+
+class EdgeRing
+{
+public:
+  // Producer side, callable from an ISR. Returns false and counts the edge
+  // as dropped when the ring is full.
+  inline __attribute__((always_inline)) bool push(uint32_t us, uint8_t level)
+  {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) == EDGE_RING_SIZE)
+    {
+      _dropped.store(_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    Edge &edge = _edges[head & (EDGE_RING_SIZE - 1)];
+    edge.us = us;
+    edge.level = level;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, oldest edge first
+  inline bool pop(Edge *edge)
+  {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire))
+      return false;
+    *edge = _edges[tail & (EDGE_RING_SIZE - 1)];
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const
+  {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+
+  uint32_t dropped() const
+  {
+    return _dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  Edge _edges[EDGE_RING_SIZE];
+  std::atomic<uint32_t> _head{0}; // written by the producer only
+  std::atomic<uint32_t> _tail{0}; // written by the consumer only
+  std::atomic<uint32_t> _dropped{0};
+};
+
+// What happened on the input since the previous window
+struct EdgeWindow
+{
+  uint32_t spanUs;  // window length
+  uint32_t pulses;  // debounced rising edges
+  uint32_t changes; // debounced level changes, both ways
+  uint32_t bounces; // edges rejected by the debounce
+  uint32_t dropped; // edges lost to a full ring, set by the owner of the ring
+  uint32_t highUs;  // time spent high
+  float hz;         // pulse frequency from the rising edges, 0 if fewer than two
+  uint8_t level;    // debounced level at the end of the window
+};
+
+// Lockout debounce: a change is accepted only debounceUs after the previous
+// one, edges in between are bounces. If the input ends the lockout on the
+// other level, that level is accepted when the lockout expires, so a short
+// pulse is never lost to its own bounce.
+class EdgeCounter
+{
+public:
+  void begin(uint8_t level, uint32_t nowUs, uint32_t debounceUs);
+
+  // Edges in the order they were captured
+  void feed(const Edge &edge);
+
+  // Closes the window at nowUs and starts the next one
+  void take(uint32_t nowUs, EdgeWindow *window);
+
+  uint8_t level() const { return _level; }
+
+private:
+  uint32_t _debounceUs = 0;
+  uint8_t _level = 0;      // debounced
+  uint8_t _raw = 0;        // level of the last edge seen
+  uint32_t _rawUs = 0;     // time of the last edge seen
+  uint32_t _changedUs = 0; // last accepted change
+  uint32_t _levelSinceUs = 0;
+  uint32_t _windowUs = 0;
+
+  uint32_t _pulses = 0;
+  uint32_t _changes = 0;
+  uint32_t _bounces = 0;
+  uint32_t _highUs = 0;
+
+  // Frequency: periods between rising edges since _firstRiseUs
+  bool _haveRise = false;
+  uint32_t _firstRiseUs = 0;
+  uint32_t _lastRiseUs = 0;
+  uint32_t _periods = 0;
+
+  void settle(uint32_t nowUs);
+  void change(uint8_t level, uint32_t us);
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "EspNowRadio.h"
+#include <string.h>
+extern "C"
+{
+#include <espnow.h>
+}
+
+EspNowRadio *EspNowRadio::_instance = nullptr;
+
+bool EspNowRadio::begin()
+{
+  if (esp_now_init() != 0)
+    return false;
+  _instance = this;
+  esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
+  esp_now_register_recv_cb(onReceive);
+  return true;
+}
+
+bool EspNowRadio::send(const uint8_t mac[PEER_MAC_SIZE], const uint8_t *data, size_t length)
+{
+  if (length > PEER_FRAME_SIZE)
+    return false;
+  // The SDK only sends to registered peers, broadcast included
+  uint8_t *peer = const_cast<uint8_t *>(mac);
+  if (!esp_now_is_peer_exist(peer) && esp_now_add_peer(peer, ESP_NOW_ROLE_COMBO, 0, NULL, 0) != 0)
+    return false;
+  return esp_now_send(peer, const_cast<uint8_t *>(data), (int)length) == 0;
+}
+
+void EspNowRadio::onReceive(uint8_t *mac, uint8_t *data, uint8_t length)
+{
+  EspNowRadio *self = _instance;
+  uint8_t next = (uint8_t)((self->_head + 1) % ESP_NOW_RADIO_QUEUE);
+  if (next == self->_tail || length > PEER_FRAME_SIZE)
+  {
+    self->_overruns++;
+    return;
+  }
+  Frame &frame = self->_queue[self->_head];
+  memcpy(frame.mac, mac, PEER_MAC_SIZE);
+  memcpy(frame.data, data, length);
+  frame.length = length;
+  self->_head = next;
+}
+
+bool EspNowRadio::receive(uint8_t mac[PEER_MAC_SIZE], uint8_t *data, size_t *length)
+{
+  if (_tail == _head)
+    return false;
+  const Frame &frame = _queue[_tail];
+  memcpy(mac, frame.mac, PEER_MAC_SIZE);
+  memcpy(data, frame.data, frame.length);
+  *length = frame.length;
+  _tail = (uint8_t)((_tail + 1) % ESP_NOW_RADIO_QUEUE);
+  return true;
+}
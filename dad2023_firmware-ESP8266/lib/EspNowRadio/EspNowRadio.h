@@ -0,0 +1,44 @@
+#ifndef ESP_NOW_RADIO_H
+#define ESP_NOW_RADIO_H
+
+#include <Arduino.h>
+#include <PeerLink.h>
+
+#define ESP_NOW_RADIO_QUEUE 8 // received frames waiting for loop()
+
+// RadioLink over ESP-NOW on the ESP8266. The receive callback only copies the
+// frame into a small queue, loop() takes it from there with receive(). Both run
+// on the same core without preempting each other, so the queue needs no lock.
+//
+// Gateway and nodes must be on the same WiFi channel: the gateway's is the one
+// of its access point, nodes set it with wifi_set_channel() before begin().
+class EspNowRadio : public RadioLink
+{
+public:
+  bool begin();
+
+  bool send(const uint8_t mac[PEER_MAC_SIZE], const uint8_t *data, size_t length) override;
+
+  // Next received frame, false if there is none. data holds PEER_FRAME_SIZE.
+  bool receive(uint8_t mac[PEER_MAC_SIZE], uint8_t *data, size_t *length);
+
+  uint32_t overruns() const { return _overruns; } // frames lost to a full queue
+
+private:
+  struct Frame
+  {
+    uint8_t mac[PEER_MAC_SIZE];
+    uint8_t length;
+    uint8_t data[PEER_FRAME_SIZE];
+  };
+
+  Frame _queue[ESP_NOW_RADIO_QUEUE];
+  volatile uint8_t _head = 0; // next slot the callback writes
+  volatile uint8_t _tail = 0; // next slot receive() reads
+  volatile uint32_t _overruns = 0;
+
+  static EspNowRadio *_instance; // the SDK callback takes no context
+  static void onReceive(uint8_t *mac, uint8_t *data, uint8_t length);
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "FixedTemp.h"
+
+centi_t centiFromFloat(float value)
+{
+  // NaN fails both comparisons
+  if (!(value > -327.67f && value < 327.67f))
+    return CENTI_INVALID;
+  float scaled = value * 100.0f;
+  return (centi_t)(scaled >= 0 ? scaled + 0.5f : scaled - 0.5f);
+}
+
+float centiToFloat(centi_t value)
+{
+  return value / 100.0f;
+}
+
+void centiFilterInit(CentiFilter *filter, uint8_t shift)
+{
+  filter->acc = 0;
+  filter->shift = shift;
+  filter->primed = false;
+}
+
+centi_t centiFilterUpdate(CentiFilter *filter, centi_t sample)
+{
+  // acc holds the average scaled by 2^shift, so no precision is lost between
+  // samples. Rounding (instead of truncating) the feedback term keeps the
+  // output from settling one unit short of negative inputs.
+  int32_t half = filter->shift > 0 ? 1 << (filter->shift - 1) : 0;
+  if (sample != CENTI_INVALID)
+  {
+    if (!filter->primed)
+    {
+      filter->acc = (int32_t)sample * (1 << filter->shift);
+      filter->primed = true;
+    }
+    else
+      filter->acc += sample - ((filter->acc + half) >> filter->shift);
+  }
+  if (!filter->primed)
+    return CENTI_INVALID;
+  return (centi_t)((filter->acc + half) >> filter->shift);
+}
+
+bool centiAbove(centi_t value, centi_t threshold, centi_t hysteresis, bool wasAbove)
+{
+  if (value == CENTI_INVALID)
+    return wasAbove;
+  if (wasAbove)
+    return value > (int32_t)threshold - hysteresis;
+  return value > threshold;
+}
+
+size_t formatCenti(char *out, size_t size, centi_t value)
+{
+  char text[CENTI_TEXT_SIZE];
+  size_t n = 0;
+  int32_t v = value;
+
+  if (v < 0)
+  {
+    text[n++] = '-';
+    v = -v;
+  }
+
+  uint16_t whole = v / 100;
+  uint8_t frac = v % 100;
+
+  char digits[3];
+  uint8_t count = 0;
+  do
+  {
+    digits[count++] = '0' + whole % 10;
+    whole /= 10;
+  } while (whole > 0);
+  while (count > 0)
+    text[n++] = digits[--count];
+
+  if (frac != 0)
+  {
+    text[n++] = '.';
+    text[n++] = '0' + frac / 10;
+    if (frac % 10 != 0)
+      text[n++] = '0' + frac % 10;
+  }
+
+  if (n >= size)
+    return 0;
+  for (size_t i = 0; i < n; i++)
+    out[i] = text[i];
+  out[n] = '\0';
+  return n;
+}
@@ -0,0 +1,47 @@
+#ifndef FIXED_TEMP_H
+#define FIXED_TEMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Temperatures in hundredths of a degree (2345 = 23.45 C). The ESP8266 has no
+// FPU, so readings are converted once when they are acquired and everything
+// after that (filtering, thresholds, JSON encoding) is integer only.
+
+typedef int16_t centi_t;
+
+// Returned for failed reads (the DHT library gives NaN)
+#define CENTI_INVALID INT16_MIN
+
+// Longest text produced by formatCenti, "-327.68" plus terminator
+#define CENTI_TEXT_SIZE 8
+
+// Exponential moving average with weight 1 / 2^shift for the newest sample
+struct CentiFilter
+{
+  int32_t acc;
+  uint8_t shift;
+  bool primed;
+};
+
+// Rounds a reading to the nearest hundredth. NaN or out of range -> CENTI_INVALID
+centi_t centiFromFloat(float value);
+
+// Only for logging and tests, the pipeline never needs it
+float centiToFloat(centi_t value);
+
+void centiFilterInit(CentiFilter *filter, uint8_t shift);
+
+// Feeds a sample and returns the filtered value. Invalid samples are ignored
+// and the previous output is returned (CENTI_INVALID until the first good one).
+centi_t centiFilterUpdate(CentiFilter *filter, centi_t sample);
+
+// Comparator with hysteresis: switches on above threshold, and only switches
+// off again once the value drops to threshold - hysteresis.
+bool centiAbove(centi_t value, centi_t threshold, centi_t hysteresis, bool wasAbove);
+
+// Exact decimal text with trailing zeros removed: 2345 -> "23.45",
+// 2350 -> "23.5", -5 -> "-0.05". Returns the length, or 0 if it did not fit.
+size_t formatCenti(char *out, size_t size, centi_t value);
+
+#endif
@@ -0,0 +1,225 @@
+#include "Gateway.h"
+#include <stdlib.h>
+#include <string.h>
+
+void Gateway::begin(RadioLink *radio, GatewayUpstream *upstream, uint16_t batchSamples, uint32_t flushMs,
+                    uint32_t retryMs)
+{
+  _radio = radio;
+  _upstream = upstream;
+  _batchSamples = batchSamples;
+  _flushMs = flushMs;
+  _retryMs = retryMs;
+  _count = 0;
+  _stats = GatewayStats();
+}
+
+Gateway::Peer *Gateway::find(const uint8_t mac[PEER_MAC_SIZE])
+{
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    if (memcmp(_peers[i].mac, mac, PEER_MAC_SIZE) == 0)
+      return &_peers[i];
+  }
+  return nullptr;
+}
+
+void Gateway::ack(const uint8_t mac[PEER_MAC_SIZE], uint8_t flags, uint16_t nextSeq)
+{
+  uint8_t frame[4];
+  _radio->send(mac, frame, peerWriteAck(frame, sizeof(frame), flags, nextSeq));
+}
+
+void Gateway::onFrame(const uint8_t mac[PEER_MAC_SIZE], const uint8_t *data, size_t length, uint32_t nowMs,
+                      int64_t epochMs)
+{
+  _stats.frames++;
+  if (length > 0 && data[0] == PEER_HELLO)
+    onHello(mac, data, length);
+  else if (length > 0 && data[0] == PEER_READINGS)
+    onReadings(mac, data, length, nowMs, epochMs);
+  else
+    _stats.malformed++;
+}
+
+void Gateway::onHello(const uint8_t mac[PEER_MAC_SIZE], const uint8_t *data, size_t length)
+{
+  if (length < 6 || data[5] >= PEER_CHANNEL_SIZE || 6u + data[5] > length)
+  {
+    _stats.malformed++;
+    return;
+  }
+  int32_t idSensor = (int32_t)peerRead32(data + 1);
+  char channel[PEER_CHANNEL_SIZE];
+  memcpy(channel, data + 6, data[5]);
+  channel[data[5]] = 0;
+
+  Peer *peer = find(mac);
+  if (peer == nullptr)
+  {
+    if (_count == GATEWAY_MAX_PEERS)
+      return; // no answer: the node keeps trying, maybe another gateway is in range
+    peer = &_peers[_count++];
+    memcpy(peer->mac, mac, PEER_MAC_SIZE);
+    peer->idSensor = idSensor;
+    peer->channel[0] = 0;
+    peer->subscribed = false;
+    peer->attempted = false;
+    peer->block.begin((uint32_t)idSensor);
+  }
+  // A node that restarted starts numbering its samples again. If it reports
+  // another sensor now, the block of the old one is sent first (see poll).
+  peer->haveSeq = false;
+  peer->idSensor = idSensor;
+  if (peer->block.count() == 0)
+    peer->block.begin((uint32_t)idSensor);
+  if (strcmp(peer->channel, channel) != 0)
+  {
+    strcpy(peer->channel, channel);
+    peer->subscribed = false;
+  }
+  ack(mac, PEER_ACK_JOINED, 0);
+}
+
+void Gateway::onReadings(const uint8_t mac[PEER_MAC_SIZE], const uint8_t *data, size_t length, uint32_t nowMs,
+                         int64_t epochMs)
+{
+  if (length < 4 || length < 4u + data[3] * PEER_READING_SIZE)
+  {
+    _stats.malformed++;
+    return;
+  }
+  Peer *peer = find(mac);
+  if (peer == nullptr)
+  {
+    _stats.unknown++;
+    ack(mac, PEER_ACK_UNKNOWN, 0);
+    return;
+  }
+  uint16_t seq = peerRead16(data + 1);
+  uint8_t count = data[3];
+  if (!peer->haveSeq)
+  {
+    peer->nextSeq = seq;
+    peer->haveSeq = true;
+  }
+  const uint8_t *p = data + 4;
+  for (uint8_t i = 0; i < count; i++, seq++, p += PEER_READING_SIZE)
+  {
+    if ((int16_t)(seq - peer->nextSeq) < 0)
+    {
+      _stats.duplicates++;
+      continue;
+    }
+    if (seq != peer->nextSeq)
+    {
+      // The node had to drop samples it could not get through
+      _stats.lost += (uint16_t)(seq - peer->nextSeq);
+      peer->nextSeq = seq;
+    }
+    // A sample for another sensor id waits until the block of the old one is sent
+    if (peer->block.idSensor() != (uint32_t)peer->idSensor)
+    {
+      _stats.refused += count - i;
+      break;
+    }
+    centi_t value = (centi_t)peerRead16(p);
+    int64_t timestamp = epochMs - (int64_t)peerRead32(p + 2);
+    if (peer->block.count() == 0)
+      peer->firstSampleMs = nowMs - peerRead32(p + 2);
+    if (value != CENTI_INVALID)
+    {
+      if (!peer->block.append(timestamp, value))
+      {
+        _stats.refused += count - i;
+        break;
+      }
+      _stats.readings++;
+    }
+    peer->nextSeq++;
+  }
+  ack(mac, 0, peer->nextSeq);
+}
+
+bool Gateway::onMqtt(const char *topic, const uint8_t *payload, size_t length)
+{
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    Peer &peer = _peers[i];
+    size_t channelLength = strlen(peer.channel);
+    if (channelLength == 0 || strncmp(topic, peer.channel, channelLength) != 0)
+      continue;
+    const char *rest = topic + channelLength;
+    int32_t idActuator;
+    if (*rest == 0)
+      idActuator = 0;
+    else if (strncmp(rest, "/actuators/", 11) == 0)
+      idActuator = atoi(rest + 11);
+    else
+      continue;
+
+    uint8_t frame[PEER_FRAME_SIZE];
+    size_t frameLength = peerWriteCommand(frame, sizeof(frame), idActuator, (const char *)payload, length);
+    if (frameLength > 0 && _radio->send(peer.mac, frame, frameLength))
+      _stats.commands++;
+    else
+      _stats.commandFailures++;
+    return true;
+  }
+  return false;
+}
+
+bool Gateway::post(Peer &peer, uint32_t nowMs)
+{
+  peer.attempted = true;
+  peer.lastAttemptMs = nowMs;
+  if (!_upstream->postBlock(peer.block.data(), peer.block.length()))
+  {
+    _stats.postFailures++;
+    return false;
+  }
+  _stats.posts++;
+  peer.attempted = false;
+  peer.block.begin((uint32_t)peer.idSensor);
+  return true;
+}
+
+void Gateway::poll(uint32_t nowMs)
+{
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    Peer &peer = _peers[i];
+    if (!peer.subscribed && peer.channel[0] != 0)
+    {
+      char filter[PEER_CHANNEL_SIZE + 16];
+      strcpy(filter, peer.channel);
+      if (_upstream->subscribe(filter))
+      {
+        strcat(filter, "/actuators/+");
+        peer.subscribed = _upstream->subscribe(filter);
+      }
+    }
+
+    if (peer.block.count() == 0)
+      continue;
+    bool due = peer.block.count() >= _batchSamples || peer.block.nearlyFull() ||
+               nowMs - peer.firstSampleMs >= _flushMs || peer.block.idSensor() != (uint32_t)peer.idSensor;
+    if (due && (!peer.attempted || nowMs - peer.lastAttemptMs >= _retryMs))
+      post(peer, nowMs);
+  }
+}
+
+void Gateway::resubscribe()
+{
+  for (uint8_t i = 0; i < _count; i++)
+    _peers[i].subscribed = false;
+}
+
+void Gateway::flush(uint32_t nowMs)
+{
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    if (_peers[i].block.count() > 0)
+      post(_peers[i], nowMs);
+  }
+}
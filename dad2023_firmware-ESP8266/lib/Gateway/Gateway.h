@@ -0,0 +1,112 @@
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <PeerLink.h>
+#include <TimeSeries.h>
+
+// Gateway logic without any I/O of its own: sensor nodes talk to it over a
+// RadioLink (ESP-NOW on the device), and it reaches the backend through a
+// GatewayUpstream, the one HTTP connection and MQTT session of the gateway.
+//
+// Readings of every node are batched into a TimeSeries block per node and
+// POSTed to api/sensor_values/block, instead of one connection and one JSON
+// body per reading and node. The MQTT channel of every node is subscribed on
+// the gateway's session, and what the backend publishes there or on
+// <channel>/actuators/<id> is forwarded to that node as a COMMAND frame.
+// Nothing else is: see PeerLink.h for what a peer node goes without.
+
+#define GATEWAY_MAX_PEERS 8
+#define GATEWAY_BLOCK_SIZE 256 // per node, about 200 samples of a steady sensor
+
+class GatewayUpstream
+{
+public:
+  virtual ~GatewayUpstream() {}
+
+  // POST of a TimeSeries block; true if the backend stored it
+  virtual bool postBlock(const uint8_t *data, size_t length) = 0;
+
+  // MQTT subscription; false if there is no session right now
+  virtual bool subscribe(const char *filter) = 0;
+};
+
+struct GatewayStats
+{
+  uint32_t frames;
+  uint32_t malformed;
+  uint32_t readings;   // samples added to a block
+  uint32_t duplicates; // samples resent by a node that were already in
+  uint32_t refused;    // samples left to the node because its block was full
+  uint32_t lost;       // samples a node dropped before they got through
+  uint32_t unknown;    // readings from nodes that had not said HELLO
+  uint32_t posts;
+  uint32_t postFailures;
+  uint32_t commands;
+  uint32_t commandFailures;
+};
+
+class Gateway
+{
+public:
+  // A node's block is sent when it holds batchSamples samples, is nearly full,
+  // or its oldest sample is flushMs old. A failed POST is retried after
+  // retryMs.
+  void begin(RadioLink *radio, GatewayUpstream *upstream, uint16_t batchSamples = 30, uint32_t flushMs = 60000,
+             uint32_t retryMs = 5000);
+
+  // Frame received from the radio. epochMs is the gateway's wall clock, used
+  // to stamp the readings.
+  void onFrame(const uint8_t mac[PEER_MAC_SIZE], const uint8_t *data, size_t length, uint32_t nowMs, int64_t epochMs);
+
+  // Message received on the MQTT session. Returns true if it was for a node.
+  bool onMqtt(const char *topic, const uint8_t *payload, size_t length);
+
+  // Sends the blocks that are due and subscribes the channels of new nodes.
+  // Call once per loop pass.
+  void poll(uint32_t nowMs);
+
+  // The MQTT session was reestablished: subscribe every channel again
+  void resubscribe();
+
+  // Sends every block now, e.g. before a restart
+  void flush(uint32_t nowMs);
+
+  uint8_t peers() const { return _count; }
+  const GatewayStats &stats() const { return _stats; }
+
+private:
+  struct Peer
+  {
+    uint8_t mac[PEER_MAC_SIZE];
+    int32_t idSensor;
+    char channel[PEER_CHANNEL_SIZE];
+    bool subscribed;
+    bool haveSeq;
+    uint16_t nextSeq;
+    uint32_t firstSampleMs;
+    uint32_t lastAttemptMs;
+    bool attempted;
+    uint8_t buffer[GATEWAY_BLOCK_SIZE];
+    TimeSeriesEncoder block{buffer, sizeof(buffer)};
+  };
+
+  RadioLink *_radio = nullptr;
+  GatewayUpstream *_upstream = nullptr;
+  uint16_t _batchSamples = 30;
+  uint32_t _flushMs = 60000;
+  uint32_t _retryMs = 5000;
+  Peer _peers[GATEWAY_MAX_PEERS];
+  uint8_t _count = 0;
+  GatewayStats _stats = {};
+
+  Peer *find(const uint8_t mac[PEER_MAC_SIZE]);
+  void onHello(const uint8_t mac[PEER_MAC_SIZE], const uint8_t *data, size_t length);
+  void onReadings(const uint8_t mac[PEER_MAC_SIZE], const uint8_t *data, size_t length, uint32_t nowMs,
+                  int64_t epochMs);
+  void ack(const uint8_t mac[PEER_MAC_SIZE], uint8_t flags, uint16_t nextSeq);
+  bool post(Peer &peer, uint32_t nowMs);
+};
+
+#endif
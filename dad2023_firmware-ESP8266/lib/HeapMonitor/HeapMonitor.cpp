@@ -0,0 +1,76 @@
+#include "HeapMonitor.h"
+#include <stdio.h>
+
+void HeapMonitor::begin(uint32_t periodMs, uint32_t guardBlock)
+{
+  _first = 0;
+  _count = 0;
+  _periodMs = periodMs;
+  _guardBlock = guardBlock;
+  _minLargestBlock = UINT32_MAX;
+}
+
+const HeapSample &HeapMonitor::last() const
+{
+  return _samples[(_first + _count + HEAP_MONITOR_SAMPLES - 1) % HEAP_MONITOR_SAMPLES];
+}
+
+bool HeapMonitor::poll(uint32_t nowMs, uint32_t freeBytes, uint32_t largestBlock)
+{
+  if (_count > 0 && nowMs - last().ms < _periodMs)
+    return false;
+  if (_count == HEAP_MONITOR_SAMPLES)
+  {
+    _first = (uint8_t)((_first + 1) % HEAP_MONITOR_SAMPLES);
+    _count--;
+  }
+  HeapSample &sample = _samples[(_first + _count) % HEAP_MONITOR_SAMPLES];
+  sample.ms = nowMs;
+  sample.freeBytes = freeBytes;
+  sample.largestBlock = largestBlock;
+  _count++;
+  if (largestBlock < _minLargestBlock)
+    _minLargestBlock = largestBlock;
+  return true;
+}
+
+// In integers: seconds since the oldest sample against bytes, which stays
+// far from overflowing int64 over days of samples
+int32_t HeapMonitor::largestBlockTrend() const
+{
+  if (_count < 2)
+    return 0;
+  uint32_t origin = _samples[_first].ms;
+  int64_t sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    const HeapSample &sample = _samples[(_first + i) % HEAP_MONITOR_SAMPLES];
+    int64_t x = (sample.ms - origin) / 1000;
+    int64_t y = sample.largestBlock;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  int64_t denominator = _count * sxx - sx * sx;
+  if (denominator == 0)
+    return 0;
+  return (int32_t)((_count * sxy - sx * sy) * 3600 / denominator);
+}
+
+uint8_t HeapMonitor::fragmentation() const
+{
+  if (_count == 0 || last().largestBlock >= last().freeBytes)
+    return 0;
+  return (uint8_t)(100 - (uint64_t)last().largestBlock * 100 / last().freeBytes);
+}
+
+size_t HeapMonitor::format(char *out, size_t size) const
+{
+  if (_count == 0)
+    return (size_t)snprintf(out, size, "heap: no samples");
+  int n = snprintf(out, size, "heap: %u free, largest block %u (min %u), %u%% fragmented, %+d B/h over %u samples",
+                   (unsigned)last().freeBytes, (unsigned)last().largestBlock, (unsigned)_minLargestBlock,
+                   (unsigned)fragmentation(), (int)largestBlockTrend(), (unsigned)_count);
+  return n < 0 ? 0 : ((size_t)n < size ? (size_t)n : size - 1);
+}
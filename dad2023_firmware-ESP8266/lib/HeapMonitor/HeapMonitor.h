@@ -0,0 +1,59 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Samples the free heap and its largest free block at a fixed period, so a
+// heap that fragments shows up as a shrinking trend long before a request
+// fails to allocate. The caller reads the heap (ESP.getFreeHeap() and
+// ESP.getMaxFreeBlockSize() on the device); this only keeps and summarizes
+// the numbers, so it runs in the host tests too.
+
+#define HEAP_MONITOR_SAMPLES 60 // an hour at one sample a minute
+
+struct HeapSample
+{
+  uint32_t ms;
+  uint32_t freeBytes;
+  uint32_t largestBlock;
+};
+
+class HeapMonitor
+{
+public:
+  // guardBlock: the largest block a request cycle needs to be sure to work
+  void begin(uint32_t periodMs, uint32_t guardBlock);
+
+  // Takes a sample if periodMs went by since the last one (or there is
+  // none); returns true when it did
+  bool poll(uint32_t nowMs, uint32_t freeBytes, uint32_t largestBlock);
+
+  uint8_t count() const { return _count; }
+  const HeapSample &last() const;
+  uint32_t minLargestBlock() const { return _minLargestBlock; } // since begin()
+
+  // Least squares slope of the largest block over the samples kept, in bytes
+  // per hour; 0 with fewer than 2 samples
+  int32_t largestBlockTrend() const;
+
+  // Percent of the free heap outside the largest block, of the last sample
+  uint8_t fragmentation() const;
+
+  // The largest block is under guardBlock: the next request cycle may fail
+  // to allocate half way
+  bool belowGuard() const { return _count > 0 && last().largestBlock < _guardBlock; }
+
+  // One line summary, null terminated; returns its length
+  size_t format(char *out, size_t size) const;
+
+private:
+  HeapSample _samples[HEAP_MONITOR_SAMPLES];
+  uint8_t _first = 0;
+  uint8_t _count = 0;
+  uint32_t _periodMs = 60000;
+  uint32_t _guardBlock = 0;
+  uint32_t _minLargestBlock = UINT32_MAX;
+};
+
+#endif
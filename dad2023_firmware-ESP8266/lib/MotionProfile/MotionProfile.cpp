@@ -0,0 +1,40 @@
+#include "MotionProfile.h"
+
+static const uint32_t BUCKET_LIMITS[JITTER_BUCKETS] = {50, 100, 200, 500, 1000, UINT32_MAX};
+
+void motionStart(MotionMove *move, int32_t from, int32_t to, uint32_t unitsPerS, MotionShape shape)
+{
+  uint32_t distance = (uint32_t)(to > from ? to - from : from - to);
+  move->from = from;
+  move->to = to;
+  move->shape = shape;
+  move->durationUs = unitsPerS > 0 ? (uint32_t)((uint64_t)distance * 1000000 / unitsPerS) : 0;
+}
+
+int32_t motionPosition(const MotionMove *move, uint32_t elapsedUs)
+{
+  if (elapsedUs >= move->durationUs)
+    return move->to;
+  uint16_t progress = (uint16_t)(((uint64_t)elapsedUs << 16) / move->durationUs);
+  int64_t covered = (int64_t)(move->to - move->from) * motionFraction(move->shape, progress);
+  return move->from + (int32_t)(covered / 65535);
+}
+
+void tickJitterAdd(TickJitter *jitter, uint32_t lateUs, uint32_t periodUs)
+{
+  jitter->ticks++;
+  jitter->totalLateUs += lateUs;
+  if (lateUs > jitter->maxLateUs)
+    jitter->maxLateUs = lateUs;
+  if (lateUs >= periodUs)
+    jitter->missed++;
+  size_t bucket = 0;
+  while (lateUs >= BUCKET_LIMITS[bucket])
+    bucket++;
+  jitter->buckets[bucket]++;
+}
+
+uint32_t tickJitterBucketLimit(size_t bucket)
+{
+  return bucket < JITTER_BUCKETS ? BUCKET_LIMITS[bucket] : UINT32_MAX;
+}
@@ -0,0 +1,107 @@
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Motion profiles for servo moves, precomputed at compile time so that
+// stepping a move at run time is a table lookup and integer arithmetic only.
+//
+// A table maps the progress of a move (0..65535, time) to the fraction of the
+// distance covered (0..65535). Positions are in whatever unit the caller uses,
+// ServoEngine uses hundredths of a degree.
+
+#define MOTION_TABLE_STEPS 256
+
+enum MotionShape
+{
+  MOTION_LINEAR,   // constant speed
+  MOTION_EASE,     // tunable sigmoid with k = 0.6, pwm.writeServo(pin, deg, speed, 0.6)
+  MOTION_MIN_JERK, // 10t^3 - 15t^4 + 6t^5, smoothest start and stop
+  MOTION_SHAPES
+};
+
+struct MotionTable
+{
+  uint16_t at[MOTION_TABLE_STEPS + 1];
+};
+
+// Normalized tunable sigmoid on [0, 1]; k in [0, 1) from linear to steep
+constexpr double motionEase(double x, double k)
+{
+  double u = 2 * x - 1;
+  double a = u < 0 ? -u : u;
+  return ((u + u * k) / (-k + 2 * k * a + 1) + 1) / 2;
+}
+
+constexpr double motionShape(MotionShape shape, double x)
+{
+  return shape == MOTION_EASE       ? motionEase(x, 0.6)
+         : shape == MOTION_MIN_JERK ? x * x * x * (x * (x * 6 - 15) + 10)
+                                    : x;
+}
+
+constexpr MotionTable makeMotionTable(MotionShape shape)
+{
+  MotionTable table = {};
+  for (int i = 0; i <= MOTION_TABLE_STEPS; i++)
+  {
+    double y = motionShape(shape, (double)i / MOTION_TABLE_STEPS);
+    y = y < 0 ? 0 : y > 1 ? 1 : y;
+    table.at[i] = (uint16_t)(y * 65535 + 0.5);
+  }
+  return table;
+}
+
+inline constexpr MotionTable MOTION_TABLES[MOTION_SHAPES] = {
+    makeMotionTable(MOTION_LINEAR),
+    makeMotionTable(MOTION_EASE),
+    makeMotionTable(MOTION_MIN_JERK),
+};
+
+static_assert(MOTION_TABLES[MOTION_EASE].at[0] == 0 && MOTION_TABLES[MOTION_EASE].at[MOTION_TABLE_STEPS] == 65535,
+              "profiles must start at 0 and end at 1");
+
+// Fraction covered at progress, both 0..65535, interpolated between entries
+inline uint16_t motionFraction(MotionShape shape, uint16_t progress)
+{
+  const MotionTable &table = MOTION_TABLES[shape < MOTION_SHAPES ? shape : MOTION_LINEAR];
+  uint32_t position = (uint32_t)progress * MOTION_TABLE_STEPS; // index in 16.16
+  uint32_t index = position >> 16;
+  int32_t a = table.at[index];
+  int32_t b = table.at[index + 1];
+  return (uint16_t)(a + (((b - a) * (int32_t)(position & 0xffff)) >> 16));
+}
+
+struct MotionMove
+{
+  int32_t from;
+  int32_t to;
+  uint32_t durationUs;
+  MotionShape shape;
+};
+
+// A move from -> to at an average speed of unitsPerS (0 = immediate)
+void motionStart(MotionMove *move, int32_t from, int32_t to, uint32_t unitsPerS, MotionShape shape);
+
+// Position elapsedUs after the start of the move
+int32_t motionPosition(const MotionMove *move, uint32_t elapsedUs);
+
+// Lateness of periodic ticks against their schedule, in microseconds
+#define JITTER_BUCKETS 6 // < 50, < 100, < 200, < 500, < 1000, >= 1000 us
+
+struct TickJitter
+{
+  uint32_t ticks;
+  uint32_t missed; // ticks that were later than a whole period
+  uint32_t maxLateUs;
+  uint64_t totalLateUs;
+  uint32_t buckets[JITTER_BUCKETS];
+};
+
+void tickJitterAdd(TickJitter *jitter, uint32_t lateUs, uint32_t periodUs);
+
+// Upper bound of a bucket in microseconds, UINT32_MAX for the last one
+uint32_t tickJitterBucketLimit(size_t bucket);
+
+#endif
@@ -0,0 +1,86 @@
+#include "NodeLogic.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool parseThreshold(const char *text, centi_t *threshold, centi_t *hysteresis)
+{
+  if (strcmp(text, "off") == 0)
+  {
+    *threshold = CENTI_INVALID;
+    *hysteresis = 0;
+    return true;
+  }
+  char *end;
+  long value = strtol(text, &end, 10);
+  if (end == text || value <= CENTI_INVALID || value > INT16_MAX)
+    return false;
+  long band = NODE_THRESHOLD_HYSTERESIS;
+  if (*end != 0)
+  {
+    char *bandEnd;
+    band = strtol(end, &bandEnd, 10);
+    if (bandEnd == end || *bandEnd != 0 || band < 0 || band > INT16_MAX)
+      return false;
+  }
+  *threshold = (centi_t)value;
+  *hysteresis = (centi_t)band;
+  return true;
+}
+
+void NodeLogic::begin(int actuatorId, long uploadEvery, uint8_t filterShift)
+{
+  centiFilterInit(&_filter, filterShift);
+  _actuatorId = actuatorId;
+  _uploadEvery = uploadEvery > 0 ? uploadEvery : 1;
+  _passes = 0;
+  _command = RELAY_NONE;
+  _threshold = CENTI_INVALID;
+  _hysteresis = 0;
+  _above = false;
+}
+
+void NodeLogic::onCommand(const char *payload, size_t length)
+{
+  // Anything else than "1"/"0" leaves the relay alone, as before
+  RelayCommand command = parseRelayCommand(payload, length);
+  if (command != RELAY_NONE)
+    _threshold = CENTI_INVALID;
+  _command = command;
+}
+
+void NodeLogic::onActuatorCommand(int idActuator, const char *payload, size_t length)
+{
+  if (idActuator == _actuatorId)
+    onCommand(payload, length);
+}
+
+bool NodeLogic::setUploadEvery(long passes)
+{
+  if (passes <= 0)
+    return false;
+  _uploadEvery = passes;
+  return true;
+}
+
+void NodeLogic::setThreshold(centi_t threshold, centi_t hysteresis)
+{
+  _threshold = threshold;
+  _hysteresis = hysteresis > 0 ? hysteresis : 0;
+  _above = false;
+}
+
+NodeDecision NodeLogic::pass(centi_t reading)
+{
+  NodeDecision decision;
+  decision.value = centiFilterUpdate(&_filter, reading);
+  decision.relay = _command;
+  if (_threshold != CENTI_INVALID && decision.value != CENTI_INVALID)
+  {
+    _above = centiAbove(decision.value, _threshold, _hysteresis, _above);
+    decision.relay = _above ? RELAY_ON : RELAY_OFF;
+  }
+  decision.upload = ++_passes >= _uploadEvery;
+  if (decision.upload)
+    _passes = 0;
+  return decision;
+}
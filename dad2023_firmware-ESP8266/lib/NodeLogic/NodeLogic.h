@@ -0,0 +1,63 @@
+#ifndef NODE_LOGIC_H
+#define NODE_LOGIC_H
+
+#include <stddef.h>
+#include <DadProtocol.h>
+#include <FixedTemp.h>
+
+// The decisions loop() in src/main.cpp takes, without any I/O: filtering the
+// readings, when to upload and what to do with the relay. tools/trace_replay
+// runs recorded traces through this same code.
+
+// What one loop pass has to do
+struct NodeDecision
+{
+  bool upload;        // upload cycle: POST value and apply relay
+  centi_t value;      // filtered reading, CENTI_INVALID if there is none yet
+  RelayCommand relay; // last command received, or the threshold's; RELAY_NONE if neither
+};
+
+// Hysteresis of a threshold configured without one (0.5 C)
+#define NODE_THRESHOLD_HYSTERESIS 50
+
+// Text of MQTT_DEVICE_CHANNEL/config/threshold: "<hundredths> [hysteresis]",
+// e.g. "2750 50", or "off" (threshold CENTI_INVALID). False if malformed.
+bool parseThreshold(const char *text, centi_t *threshold, centi_t *hysteresis);
+
+class NodeLogic
+{
+public:
+  void begin(int actuatorId, long uploadEvery, uint8_t filterShift = 2);
+
+  // Payload received on the device channel
+  void onCommand(const char *payload, size_t length);
+
+  // Payload received on <device channel>/actuators/<idActuator>
+  void onActuatorCommand(int idActuator, const char *payload, size_t length);
+
+  // Loop passes between uploads. Returns false (and keeps the old value)
+  // unless passes > 0.
+  bool setUploadEvery(long passes);
+  long uploadEvery() const { return _uploadEvery; }
+
+  // Local thermostat: the relay switches on above threshold and off again
+  // at threshold - hysteresis of the filtered value. A command received
+  // afterwards takes the relay back. CENTI_INVALID turns it off.
+  void setThreshold(centi_t threshold, centi_t hysteresis);
+  centi_t threshold() const { return _threshold; }
+
+  // One loop pass with the raw reading of this pass
+  NodeDecision pass(centi_t reading);
+
+private:
+  CentiFilter _filter;
+  int _actuatorId;
+  long _uploadEvery;
+  long _passes;
+  RelayCommand _command;
+  centi_t _threshold;
+  centi_t _hysteresis;
+  bool _above;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include "PeerLink.h"
+#include <string.h>
+
+const uint8_t PEER_BROADCAST[PEER_MAC_SIZE] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+static uint8_t *write16(uint8_t *out, uint16_t value)
+{
+  out[0] = (uint8_t)value;
+  out[1] = (uint8_t)(value >> 8);
+  return out + 2;
+}
+
+static uint8_t *write32(uint8_t *out, uint32_t value)
+{
+  out = write16(out, (uint16_t)value);
+  return write16(out, (uint16_t)(value >> 16));
+}
+
+uint16_t peerRead16(const uint8_t *in)
+{
+  return (uint16_t)(in[0] | in[1] << 8);
+}
+
+uint32_t peerRead32(const uint8_t *in)
+{
+  return peerRead16(in) | (uint32_t)peerRead16(in + 2) << 16;
+}
+
+size_t peerWriteHello(uint8_t *out, size_t size, int32_t idSensor, const char *channel)
+{
+  size_t length = strlen(channel);
+  if (length >= PEER_CHANNEL_SIZE || 6 + length > size)
+    return 0;
+  out[0] = PEER_HELLO;
+  write32(out + 1, (uint32_t)idSensor);
+  out[5] = (uint8_t)length;
+  memcpy(out + 6, channel, length);
+  return 6 + length;
+}
+
+size_t peerWriteAck(uint8_t *out, size_t size, uint8_t flags, uint16_t nextSeq)
+{
+  if (size < 4)
+    return 0;
+  out[0] = PEER_ACK;
+  out[1] = flags;
+  write16(out + 2, nextSeq);
+  return 4;
+}
+
+size_t peerWriteCommand(uint8_t *out, size_t size, int32_t idActuator, const char *payload, size_t length)
+{
+  if (length > PEER_COMMAND_SIZE || 6 + length > size)
+    return 0;
+  out[0] = PEER_COMMAND;
+  write32(out + 1, (uint32_t)idActuator);
+  out[5] = (uint8_t)length;
+  memcpy(out + 6, payload, length);
+  return 6 + length;
+}
+
+void PeerNode::begin(int32_t idSensor, const char *channel)
+{
+  *this = PeerNode();
+  _idSensor = idSensor;
+  strncpy(_channel, channel, sizeof(_channel) - 1);
+}
+
+void PeerNode::drop(uint8_t count)
+{
+  _first = (uint8_t)((_first + count) % PEER_MAX_SAMPLES);
+  _count -= count;
+  _firstSeq += count;
+}
+
+void PeerNode::add(centi_t value, uint32_t nowMs)
+{
+  if (_count == PEER_MAX_SAMPLES)
+  {
+    drop(1);
+    _dropped++;
+  }
+  uint8_t slot = (uint8_t)((_first + _count) % PEER_MAX_SAMPLES);
+  _values[slot] = value;
+  _times[slot] = nowMs;
+  _count++;
+}
+
+size_t PeerNode::frame(uint8_t *out, size_t size, uint32_t nowMs)
+{
+  if (!_joined)
+    return peerWriteHello(out, size, _idSensor, _channel);
+  if (_count == 0 || size < 4 + PEER_READING_SIZE)
+    return 0;
+  uint8_t count = (uint8_t)(_count < (size - 4) / PEER_READING_SIZE ? _count : (size - 4) / PEER_READING_SIZE);
+  out[0] = PEER_READINGS;
+  write16(out + 1, _firstSeq);
+  out[3] = count;
+  uint8_t *p = out + 4;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    uint8_t slot = (uint8_t)((_first + i) % PEER_MAX_SAMPLES);
+    p = write16(p, (uint16_t)_values[slot]);
+    p = write32(p, nowMs - _times[slot]);
+  }
+  return (size_t)(p - out);
+}
+
+bool PeerNode::onFrame(const uint8_t mac[PEER_MAC_SIZE], const uint8_t *data, size_t length, PeerCommand *command)
+{
+  if (length >= 4 && data[0] == PEER_ACK)
+  {
+    uint8_t flags = data[1];
+    if (flags & PEER_ACK_UNKNOWN)
+    {
+      _joined = false; // the gateway restarted, introduce ourselves again
+      return false;
+    }
+    memcpy(_gateway, mac, PEER_MAC_SIZE);
+    _joined = true;
+    uint16_t acked = (uint16_t)(peerRead16(data + 2) - _firstSeq);
+    if (!(flags & PEER_ACK_JOINED) && acked <= _count)
+      drop((uint8_t)acked);
+    return false;
+  }
+  // Commands only from the gateway the readings go to
+  if (!_joined || memcmp(mac, _gateway, PEER_MAC_SIZE) != 0)
+    return false;
+  if (length >= 6 && data[0] == PEER_COMMAND && data[5] <= PEER_COMMAND_SIZE && 6u + data[5] <= length)
+  {
+    command->idActuator = (int32_t)peerRead32(data + 1);
+    command->length = data[5];
+    memcpy(command->payload, data + 6, command->length);
+    return true;
+  }
+  return false;
+}
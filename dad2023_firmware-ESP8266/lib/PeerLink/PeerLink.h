@@ -0,0 +1,118 @@
+#ifndef PEER_LINK_H
+#define PEER_LINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <FixedTemp.h>
+
+// Frames exchanged over ESP-NOW between sensor nodes without a WiFi
+// association of their own (-D DAD_PEER) and the gateway that forwards their
+// readings upstream (gateway/main.cpp, lib/Gateway). The radio is behind
+// RadioLink so both ends run against a simulated link in the host tests.
+//
+// Frames, little endian, at most PEER_FRAME_SIZE bytes:
+//   HELLO    node -> broadcast  type, idSensor (4), channel length (1), channel
+//   READINGS node -> gateway    type, first sample seq (2), count (1),
+//                               count x (value centi (2), age ms (4))
+//   ACK      gateway -> node    type, flags (1), next sample seq expected (2)
+//   COMMAND  gateway -> node    type, idActuator (4, 0 = device channel),
+//                               payload length (1), payload
+//
+// Samples are numbered by the node and acknowledged cumulatively, so a node
+// resends whatever the gateway has not acknowledged yet and the gateway drops
+// what it already has. Ages are relative to when the frame is built: nodes
+// have no clock, the gateway stamps the samples with its own.
+//
+// A peer node has less than a WiFi node: READINGS carry sensor values only,
+// so relay states never reach api/actuator_states, and COMMAND carries what
+// is published on the node's channel and <channel>/actuators/<id> only.
+// <channel>/config/# (period, threshold, profile, trace, ota) and the group
+// channel are not forwarded.
+
+#define PEER_FRAME_SIZE 250 // ESP-NOW payload limit
+#define PEER_MAC_SIZE 6
+#define PEER_CHANNEL_SIZE 64      // MQTT channel of the node, null terminated
+#define PEER_MAX_SAMPLES 32       // unacknowledged samples a node keeps
+#define PEER_COMMAND_SIZE 32      // payload forwarded from MQTT
+#define PEER_READING_SIZE 6
+
+enum PeerFrameType
+{
+  PEER_HELLO = 1,
+  PEER_READINGS = 2,
+  PEER_ACK = 3,
+  PEER_COMMAND = 4
+};
+
+// ACK flags
+#define PEER_ACK_JOINED 0x01  // answer to HELLO, the seq is not meaningful
+#define PEER_ACK_UNKNOWN 0x02 // readings from a node the gateway does not know: send HELLO
+
+extern const uint8_t PEER_BROADCAST[PEER_MAC_SIZE];
+
+// What the radio has to offer to the node and gateway logic
+class RadioLink
+{
+public:
+  virtual ~RadioLink() {}
+
+  // Returns false if the frame could not be queued for sending
+  virtual bool send(const uint8_t mac[PEER_MAC_SIZE], const uint8_t *data, size_t length) = 0;
+};
+
+struct PeerCommand
+{
+  int32_t idActuator; // 0: the device channel itself
+  uint8_t length;
+  char payload[PEER_COMMAND_SIZE];
+};
+
+// Frame builders; return the frame length, 0 if it does not fit
+size_t peerWriteHello(uint8_t *out, size_t size, int32_t idSensor, const char *channel);
+size_t peerWriteAck(uint8_t *out, size_t size, uint8_t flags, uint16_t nextSeq);
+size_t peerWriteCommand(uint8_t *out, size_t size, int32_t idActuator, const char *payload, size_t length);
+
+uint16_t peerRead16(const uint8_t *in);
+uint32_t peerRead32(const uint8_t *in);
+
+// Node side: keeps the samples until the gateway acknowledges them
+class PeerNode
+{
+public:
+  void begin(int32_t idSensor, const char *channel);
+
+  // Queues a sample; when PEER_MAX_SAMPLES are waiting the oldest is dropped
+  void add(centi_t value, uint32_t nowMs);
+
+  // Frame to send now: HELLO until a gateway answers, then READINGS with
+  // every sample not acknowledged yet. Returns 0 if there is nothing to send.
+  size_t frame(uint8_t *out, size_t size, uint32_t nowMs);
+
+  // Where frame() goes: the gateway once known, broadcast before
+  const uint8_t *destination() const { return _joined ? _gateway : PEER_BROADCAST; }
+
+  // Handles a received frame. Returns true and fills command for a COMMAND.
+  bool onFrame(const uint8_t mac[PEER_MAC_SIZE], const uint8_t *data, size_t length, PeerCommand *command);
+
+  bool joined() const { return _joined; }
+  uint8_t pending() const { return _count; }
+  uint32_t dropped() const { return _dropped; }
+
+private:
+  int32_t _idSensor = 0;
+  char _channel[PEER_CHANNEL_SIZE] = "";
+  bool _joined = false;
+  uint8_t _gateway[PEER_MAC_SIZE] = {0};
+
+  // Ring of unacknowledged samples, _firstSeq is the seq of the oldest
+  centi_t _values[PEER_MAX_SAMPLES];
+  uint32_t _times[PEER_MAX_SAMPLES];
+  uint8_t _first = 0;
+  uint8_t _count = 0;
+  uint16_t _firstSeq = 0;
+  uint32_t _dropped = 0;
+
+  void drop(uint8_t count);
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ARDUINO_ARCH_ESP8266
+#include <Arduino.h>
+#define PROFILER_IRAM IRAM_ATTR // runs in the timer interrupt
+#else
+#define PROFILER_IRAM
+#endif
+
+volatile uint8_t profilerPhase;
+
+static ProfileSlot slots[PROFILER_SLOTS];
+static volatile uint32_t samples;
+static volatile uint32_t lost;
+static volatile uint32_t phaseSamples[PROFILER_PHASES];
+static volatile bool paused;
+
+void profilerClear()
+{
+  memset(slots, 0, sizeof(slots));
+  memset((void *)phaseSamples, 0, sizeof(phaseSamples));
+  samples = 0;
+  lost = 0;
+}
+
+void profilerPause()
+{
+  paused = true;
+}
+
+void profilerResume()
+{
+  paused = false;
+}
+
+void PROFILER_IRAM profilerSample(uint32_t pc)
+{
+  if (paused)
+    return;
+  uint8_t phase = profilerPhase % PROFILER_PHASES;
+  samples++;
+  phaseSamples[phase]++;
+
+  // Instructions are at least 2 bytes apart; mix the phase in so the same pc
+  // in two phases lands in different slots
+  uint32_t slot = ((pc >> 1) ^ ((uint32_t)phase << 24)) * 2654435761u % PROFILER_SLOTS;
+  for (int probe = 0; probe < PROFILER_PROBES; probe++)
+  {
+    ProfileSlot &s = slots[slot];
+    if (s.count == 0)
+    {
+      s.pc = pc;
+      s.phase = phase;
+      s.count = 1;
+      return;
+    }
+    if (s.pc == pc && s.phase == phase)
+    {
+      if (s.count != UINT16_MAX)
+        s.count++;
+      return;
+    }
+    slot = slot + 1 == PROFILER_SLOTS ? 0 : slot + 1;
+  }
+  lost++;
+}
+
+uint32_t profilerSamples()
+{
+  return samples;
+}
+
+uint32_t profilerLost()
+{
+  return lost;
+}
+
+uint32_t profilerPhaseSamples(uint8_t phase)
+{
+  return phase < PROFILER_PHASES ? phaseSamples[phase] : 0;
+}
+
+const ProfileSlot *profilerSlot(size_t index)
+{
+  return &slots[index];
+}
+
+void profilerWriteDump(const ProfileSnapshot &snapshot, const char *const *phaseNames, uint8_t phases,
+                       ProfileLineWriter write, void *context)
+{
+  char line[80];
+  snprintf(line, sizeof(line), "PROFILE BEGIN hz=%u ms=%u samples=%u lost=%u isr_cycles=%u\n", (unsigned)snapshot.hz,
+           (unsigned)snapshot.ms, (unsigned)snapshot.samples, (unsigned)snapshot.lost, (unsigned)snapshot.isrCycles);
+  write(context, line);
+  for (uint8_t i = 0; i < PROFILER_PHASES; i++)
+  {
+    if (phaseSamples[i] > 0)
+    {
+      snprintf(line, sizeof(line), "phase %u %s %u\n", i, i < phases ? phaseNames[i] : "?",
+               (unsigned)phaseSamples[i]);
+      write(context, line);
+    }
+  }
+  for (size_t i = 0; i < PROFILER_SLOTS; i++)
+  {
+    if (slots[i].count > 0)
+    {
+      snprintf(line, sizeof(line), "pc %08x %u %u\n", (unsigned)slots[i].pc, slots[i].phase, slots[i].count);
+      write(context, line);
+    }
+  }
+  write(context, "PROFILE END\n");
+}
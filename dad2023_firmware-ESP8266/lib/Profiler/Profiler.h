@@ -0,0 +1,102 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Statistical profiler. A timer interrupt samples the program counter it
+// interrupted, together with the phase tag the main loop set last (HTTP POST,
+// DHT read...), into a fixed histogram. tools/profile_report symbolizes a
+// dump of it against the firmware ELF.
+//
+// Nothing runs until profilerStart(), and then the cost is one short
+// interrupt per sample (profilerIsrCycles() says how much), so it can stay in
+// production builds and be switched on when a device misbehaves.
+
+#ifndef PROFILER_SLOTS
+#define PROFILER_SLOTS 256 // distinct (pc, phase) pairs, 8 bytes each
+#endif
+#define PROFILER_PROBES 8  // a sample that finds no slot in that many is lost
+#define PROFILER_PHASES 16
+
+struct ProfileSlot
+{
+  uint32_t pc;
+  uint16_t count; // 0 = empty, saturates at 65535
+  uint8_t phase;
+};
+
+// Phase tag recorded with every sample, see ProfileScope
+extern volatile uint8_t profilerPhase;
+
+// Tags the samples taken while it is in scope:
+//   { ProfileScope scope(PHASE_HTTP_POST); code = http.POST(body); }
+class ProfileScope
+{
+public:
+  explicit ProfileScope(uint8_t phase) : _previous(profilerPhase) { profilerPhase = phase; }
+  ~ProfileScope() { profilerPhase = _previous; }
+
+private:
+  uint8_t _previous;
+};
+
+void profilerClear();
+
+// Records one sample with the current phase. Called from the timer interrupt.
+void profilerSample(uint32_t pc);
+
+// Samples taken in between are dropped, so the histogram holds still while
+// it is read
+void profilerPause();
+void profilerResume();
+
+uint32_t profilerSamples();
+uint32_t profilerLost(); // samples that found the histogram full
+uint32_t profilerPhaseSamples(uint8_t phase);
+const ProfileSlot *profilerSlot(size_t index); // index < PROFILER_SLOTS
+
+// Header of a dump, taken once: every pass over the same paused histogram
+// with the same snapshot writes the same text, byte for byte
+struct ProfileSnapshot
+{
+  uint32_t hz;
+  uint32_t ms; // since profilerStart
+  uint32_t samples;
+  uint32_t lost;
+  uint32_t isrCycles;
+};
+
+// Text dump for tools/profile_report, handed to write() a line at a time:
+//   PROFILE BEGIN hz=<hz> ms=<ms> samples=<n> lost=<n> isr_cycles=<n>
+//   phase <index> <name> <samples>
+//   pc <hex pc> <phase> <samples>
+//   PROFILE END
+typedef void (*ProfileLineWriter)(void *context, const char *line);
+void profilerWriteDump(const ProfileSnapshot &snapshot, const char *const *phaseNames, uint8_t phases,
+                       ProfileLineWriter write, void *context);
+
+#ifdef ARDUINO_ARCH_ESP8266
+#include <Print.h>
+
+// Samples hz times per second with timer1 (so not together with analogWrite,
+// tone or Servo, which use it too). Code running with interrupts disabled is
+// not seen, its time is charged to where interrupts are enabled again.
+bool profilerStart(uint32_t hz);
+void profilerStop();
+bool profilerRunning();
+
+// Cycles spent in the sampling interrupt since profilerStart
+uint32_t profilerIsrCycles();
+
+ProfileSnapshot profilerSnapshot();
+
+// profilerWriteDump to out. Pause sampling around it; to write the same dump
+// twice (to measure it, then to send it), pass both the same snapshot.
+void profilerDump(Print &out, const ProfileSnapshot &snapshot, const char *const *phaseNames, uint8_t phases);
+
+// Pauses, snapshots and dumps in one go
+void profilerDump(Print &out, const char *const *phaseNames, uint8_t phases);
+#endif
+
+#endif
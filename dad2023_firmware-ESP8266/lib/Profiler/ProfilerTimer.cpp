@@ -0,0 +1,93 @@
+// Sampling interrupt and dump, ESP8266 only. The histogram itself is in
+// Profiler.cpp and is tested on the host.
+#ifdef ARDUINO_ARCH_ESP8266
+
+#include "Profiler.h"
+#include <Arduino.h>
+
+static volatile bool sampling;
+static volatile uint32_t isrCycles;
+static bool running;
+static uint32_t rateHz;
+static uint32_t startMs;
+
+static void IRAM_ATTR onSampleTimer()
+{
+  uint32_t start = ESP.getCycleCount();
+  // timer1 is a level 1 interrupt and the core uses the CALL0 ABI, so no
+  // other exception can have overwritten EPC1 by the time we get here
+  uint32_t pc;
+  asm volatile("rsr %0, epc1" : "=r"(pc));
+  if (sampling)
+    profilerSample(pc);
+  isrCycles += ESP.getCycleCount() - start;
+}
+
+bool profilerStart(uint32_t hz)
+{
+  // timer1 at 80 MHz / 16 counts 5 MHz in 23 bits
+  if (hz < 1 || hz > 5000)
+    return false;
+  profilerStop();
+  profilerClear();
+  isrCycles = 0;
+  rateHz = hz;
+  startMs = millis();
+  sampling = true;
+  timer1_isr_init();
+  timer1_attachInterrupt(onSampleTimer);
+  timer1_enable(TIM_DIV16, TIM_EDGE, TIM_LOOP);
+  timer1_write(5000000 / hz);
+  running = true;
+  return true;
+}
+
+void profilerStop()
+{
+  if (!running)
+    return;
+  timer1_disable();
+  timer1_detachInterrupt();
+  sampling = false;
+  running = false;
+}
+
+bool profilerRunning()
+{
+  return running;
+}
+
+uint32_t profilerIsrCycles()
+{
+  return isrCycles;
+}
+
+ProfileSnapshot profilerSnapshot()
+{
+  ProfileSnapshot snapshot;
+  snapshot.hz = rateHz;
+  snapshot.ms = millis() - startMs;
+  snapshot.samples = profilerSamples();
+  snapshot.lost = profilerLost();
+  snapshot.isrCycles = profilerIsrCycles();
+  return snapshot;
+}
+
+static void printLine(void *out, const char *line)
+{
+  ((Print *)out)->print(line);
+}
+
+void profilerDump(Print &out, const ProfileSnapshot &snapshot, const char *const *phaseNames, uint8_t phases)
+{
+  profilerWriteDump(snapshot, phaseNames, phases, printLine, &out);
+}
+
+void profilerDump(Print &out, const char *const *phaseNames, uint8_t phases)
+{
+  profilerPause();
+  profilerDump(out, profilerSnapshot(), phaseNames, phases);
+  profilerResume();
+}
+
+#endif
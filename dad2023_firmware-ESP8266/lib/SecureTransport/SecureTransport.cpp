@@ -0,0 +1,103 @@
+#include "SecureTransport.h"
+#include <StackThunk.h>
+
+SecureTransport::SecureTransport() : _origin(this)
+{
+  memset(&_stats, 0, sizeof(_stats));
+  _stats.minFreeHeap = UINT32_MAX;
+}
+
+#ifdef SECURE_TRANSPORT_CLONE
+// The base copy shares the TLS context, which holds pointers to the key and
+// session of origin: the clone's own are left unused
+SecureTransport::SecureTransport(const SecureTransport &origin)
+    : BearSSL::WiFiClientSecure(origin), _origin(origin._origin)
+{
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+std::unique_ptr<WiFiClient> SecureTransport::clone() const
+{
+  return std::unique_ptr<WiFiClient>(new SecureTransport(*this));
+}
+#endif
+
+bool SecureTransport::configure(const char *host, uint16_t port, const char *serverKeyPem, uint16_t fragmentLength)
+{
+  if (!_serverKey.parse(serverKeyPem))
+    return false;
+  setKnownKey(&_serverKey);
+  setSession(&_session);
+
+  // The transmit side never needs big records: our requests are a few hundred
+  // bytes. The receive side can only shrink if the server agrees to MFL.
+  if (fragmentLength > 0 && probeMaxFragmentLength(host, port, fragmentLength))
+  {
+    setBufferSizes(fragmentLength, fragmentLength);
+    _stats.fragmentLength = fragmentLength;
+  }
+  else
+  {
+    setBufferSizes(16384, 512);
+    _stats.fragmentLength = 0;
+  }
+  return true;
+}
+
+template <typename Host>
+int SecureTransport::timedConnect(Host host, uint16_t port)
+{
+  // A resumed handshake keeps the session id the server gave us last time
+  br_ssl_session_parameters *params = _origin->_session.getSession();
+  uint8_t previousId[sizeof(params->session_id)];
+  uint8_t previousIdLen = params->session_id_len;
+  memcpy(previousId, params->session_id, previousIdLen);
+
+  uint32_t heapBefore = ESP.getFreeHeap();
+  uint32_t start = millis();
+  int ok = BearSSL::WiFiClientSecure::connect(host, port);
+  uint32_t elapsed = millis() - start;
+
+  TlsStats &stats = _origin->_stats;
+  if (!ok)
+  {
+    stats.failures++;
+    return ok;
+  }
+
+  uint32_t heapAfter = ESP.getFreeHeap();
+  stats.handshakes++;
+  stats.lastHandshakeMs = elapsed;
+  if (elapsed > stats.maxHandshakeMs)
+    stats.maxHandshakeMs = elapsed;
+  stats.lastHeapUsed = heapBefore > heapAfter ? heapBefore - heapAfter : 0;
+  if (heapAfter < stats.minFreeHeap)
+    stats.minFreeHeap = heapAfter;
+  stats.peakStack = stack_thunk_get_max_usage();
+  stats.lastResumed = previousIdLen > 0 && params->session_id_len == previousIdLen &&
+                      memcmp(previousId, params->session_id, previousIdLen) == 0;
+  if (stats.lastResumed)
+    stats.resumed++;
+  return ok;
+}
+
+int SecureTransport::connect(IPAddress ip, uint16_t port)
+{
+  return timedConnect(ip, port);
+}
+
+int SecureTransport::connect(const char *host, uint16_t port)
+{
+  return timedConnect(host, port);
+}
+
+void SecureTransport::printStats(Print &out, const char *name) const
+{
+  const TlsStats &stats = _origin->_stats;
+  out.printf("TLS %s: %u handshakes (%u resumed, %u failed), last %u ms%s, max %u ms, "
+             "heap held %u, min free heap %u, BearSSL stack %u, MFL %u\n",
+             name, stats.handshakes, stats.resumed, stats.failures, stats.lastHandshakeMs,
+             stats.lastResumed ? " (resumed)" : "", stats.maxHandshakeMs, stats.lastHeapUsed,
+             stats.minFreeHeap == UINT32_MAX ? 0 : stats.minFreeHeap, stats.peakStack,
+             stats.fragmentLength);
+}
@@ -0,0 +1,72 @@
+#ifndef SECURE_TRANSPORT_H
+#define SECURE_TRANSPORT_H
+
+#include <Arduino.h>
+#include <WiFiClientSecureBearSSL.h>
+#include <core_version.h>
+
+// Since core 3.1 HTTPClient::begin(client, url) connects a clone() of client
+#if ARDUINO_ESP8266_MAJOR > 3 || (ARDUINO_ESP8266_MAJOR == 3 && ARDUINO_ESP8266_MINOR >= 1)
+#define SECURE_TRANSPORT_CLONE
+#endif
+
+// Handshake figures of one SecureTransport
+struct TlsStats
+{
+  uint32_t handshakes;      // successful connects
+  uint32_t resumed;         // ... of which resumed the cached session
+  uint32_t failures;
+  uint32_t lastHandshakeMs;
+  uint32_t maxHandshakeMs;
+  uint32_t lastHeapUsed;    // heap held by the connection once established
+  uint32_t minFreeHeap;     // lowest free heap seen right after a handshake
+  uint32_t peakStack;       // high-water mark of the BearSSL stack
+  uint16_t fragmentLength;  // negotiated record size, 0 = full 16 KB records
+  bool lastResumed;
+};
+
+// TLS client for both HTTPClient and PubSubClient on the ESP8266.
+//
+// A full handshake costs seconds and tens of KB, so this client:
+//  - pins the server public key instead of validating a certificate chain,
+//  - asks for small records (max fragment length) when the server allows it,
+//    which shrinks the receive buffer from 16 KB,
+//  - keeps the last session and resumes it on reconnect.
+// Every connect is timed and its heap use recorded in stats(), including the
+// connects of its clones.
+class SecureTransport : public BearSSL::WiFiClientSecure
+{
+public:
+  SecureTransport();
+
+  // Call once WiFi is up, before the first connect. serverKeyPem is the PEM
+  // public key printed by tools/tls_standin (or the one of the real server).
+  bool configure(const char *host, uint16_t port, const char *serverKeyPem, uint16_t fragmentLength = 512);
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+
+#ifdef SECURE_TRANSPORT_CLONE
+  // Shares the TLS context (key, session, connection) of this client and
+  // records its connects in the stats of this client
+  std::unique_ptr<WiFiClient> clone() const override;
+#endif
+
+  const TlsStats &stats() const { return _origin->_stats; }
+  void printStats(Print &out, const char *name) const;
+
+private:
+#ifdef SECURE_TRANSPORT_CLONE
+  SecureTransport(const SecureTransport &origin);
+#endif
+
+  template <typename Host>
+  int timedConnect(Host host, uint16_t port);
+
+  SecureTransport *_origin; // this, or the client a clone was made of
+  BearSSL::PublicKey _serverKey;
+  BearSSL::Session _session;
+  TlsStats _stats;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#include "ServoEngine.h"
+
+bool ServoEngine::begin(uint32_t updateHz)
+{
+  if (updateHz == 0 || _timer != NULL)
+    return false;
+  memset(&_jitter, 0, sizeof(_jitter));
+  _periodUs = 1000000 / updateHz;
+
+  // ESP_TIMER_TASK: runs in the high priority esp_timer task, which may call
+  // ledcWrite (an ISR could not)
+  esp_timer_create_args_t args = {};
+  args.callback = onTick;
+  args.arg = this;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "servo";
+  if (esp_timer_create(&args, &_timer) != ESP_OK)
+    return false;
+  _nextTickUs = esp_timer_get_time() + _periodUs;
+  return esp_timer_start_periodic(_timer, _periodUs) == ESP_OK;
+}
+
+void ServoEngine::end()
+{
+  if (_timer == NULL)
+    return;
+  esp_timer_stop(_timer);
+  esp_timer_delete(_timer);
+  _timer = NULL;
+}
+
+int ServoEngine::attach(int pin, uint16_t minPulseUs, uint16_t maxPulseUs, uint16_t maxDegrees)
+{
+  if (_count == SERVO_ENGINE_CHANNELS || maxDegrees == 0 || maxPulseUs <= minPulseUs)
+    return -1;
+  int servo = _count;
+  Channel &c = _channels[servo];
+  c.pin = pin;
+  c.minPulseUs = minPulseUs;
+  c.maxPulseUs = maxPulseUs;
+  c.maxCenti = (int32_t)maxDegrees * 100;
+  c.position = 0;
+  c.moving = false;
+  c.duty = dutyFor(c);
+
+  ledcSetup(servo, SERVO_PWM_HZ, SERVO_PWM_BITS);
+  ledcAttachPin(pin, servo);
+  ledcWrite(servo, c.duty);
+
+  portENTER_CRITICAL(&_lock);
+  _count++;
+  portEXIT_CRITICAL(&_lock);
+  return servo;
+}
+
+void ServoEngine::moveTo(int servo, float degrees, float degreesPerS, MotionShape shape)
+{
+  if (servo < 0 || servo >= _count)
+    return;
+  Channel &c = _channels[servo];
+  int32_t target = constrain((int32_t)(degrees * 100), 0, c.maxCenti);
+  uint32_t speed = degreesPerS > 0 ? (uint32_t)(degreesPerS * 100) : 0;
+
+  portENTER_CRITICAL(&_lock);
+  bool sameTarget = c.moving ? c.move.to == target : c.position == target;
+  if (!sameTarget)
+  {
+    motionStart(&c.move, c.position, target, speed, shape);
+    c.moveStartUs = esp_timer_get_time();
+    c.moving = true;
+  }
+  portEXIT_CRITICAL(&_lock);
+}
+
+float ServoEngine::position(int servo) const
+{
+  if (servo < 0 || servo >= _count)
+    return 0;
+  portENTER_CRITICAL(&_lock);
+  int32_t position = _channels[servo].position;
+  portEXIT_CRITICAL(&_lock);
+  return position / 100.0f;
+}
+
+bool ServoEngine::moving(int servo) const
+{
+  if (servo < 0 || servo >= _count)
+    return false;
+  portENTER_CRITICAL(&_lock);
+  bool moving = _channels[servo].moving;
+  portEXIT_CRITICAL(&_lock);
+  return moving;
+}
+
+TickJitter ServoEngine::jitter() const
+{
+  portENTER_CRITICAL(&_lock);
+  TickJitter copy = _jitter;
+  portEXIT_CRITICAL(&_lock);
+  return copy;
+}
+
+void ServoEngine::resetJitter()
+{
+  portENTER_CRITICAL(&_lock);
+  memset(&_jitter, 0, sizeof(_jitter));
+  portEXIT_CRITICAL(&_lock);
+}
+
+void ServoEngine::printJitter(Print &out) const
+{
+  TickJitter j = jitter();
+  out.printf("servo ticks %u every %u us, late avg %u us max %u us, missed %u |",
+             (unsigned)j.ticks, (unsigned)_periodUs, (unsigned)(j.ticks ? j.totalLateUs / j.ticks : 0),
+             (unsigned)j.maxLateUs, (unsigned)j.missed);
+  for (size_t i = 0; i < JITTER_BUCKETS; i++)
+  {
+    uint32_t limit = tickJitterBucketLimit(i);
+    if (limit == UINT32_MAX)
+      out.printf(" >=%u: %u", (unsigned)tickJitterBucketLimit(i - 1), (unsigned)j.buckets[i]);
+    else
+      out.printf(" <%u: %u", (unsigned)limit, (unsigned)j.buckets[i]);
+  }
+  out.println();
+}
+
+void ServoEngine::onTick(void *engine)
+{
+  ((ServoEngine *)engine)->tick();
+}
+
+uint32_t ServoEngine::dutyFor(const Channel &c) const
+{
+  uint32_t pulseUs = c.minPulseUs + (uint32_t)(c.maxPulseUs - c.minPulseUs) * c.position / c.maxCenti;
+  return (pulseUs << SERVO_PWM_BITS) / (1000000 / SERVO_PWM_HZ);
+}
+
+void ServoEngine::tick()
+{
+  int64_t now = esp_timer_get_time();
+  uint32_t duties[SERVO_ENGINE_CHANNELS];
+  bool changed[SERVO_ENGINE_CHANNELS];
+
+  portENTER_CRITICAL(&_lock);
+  tickJitterAdd(&_jitter, now > _nextTickUs ? (uint32_t)(now - _nextTickUs) : 0, _periodUs);
+  // Late ticks do not accumulate: the schedule stays on the timer's grid
+  do
+    _nextTickUs += _periodUs;
+  while (_nextTickUs <= now);
+
+  uint8_t count = _count;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    Channel &c = _channels[i];
+    changed[i] = false;
+    if (!c.moving)
+      continue;
+    // From the absolute time, so a late tick catches up instead of slowing the move
+    uint32_t elapsed = (uint32_t)(now - c.moveStartUs);
+    c.position = motionPosition(&c.move, elapsed);
+    c.moving = elapsed < c.move.durationUs;
+    uint32_t duty = dutyFor(c);
+    changed[i] = duty != c.duty;
+    c.duty = duties[i] = duty;
+  }
+  portEXIT_CRITICAL(&_lock);
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (changed[i])
+      ledcWrite(i, duties[i]);
+  }
+}
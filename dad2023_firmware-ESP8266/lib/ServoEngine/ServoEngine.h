@@ -0,0 +1,64 @@
+#ifndef SERVO_ENGINE_H
+#define SERVO_ENGINE_H
+
+#include <Arduino.h>
+#include <MotionProfile.h>
+#include <esp_timer.h>
+
+#define SERVO_ENGINE_CHANNELS 8 // LEDC channels 0..7, high speed group
+#define SERVO_PWM_HZ 50
+#define SERVO_PWM_BITS 16
+
+// Moves servos on the ESP32 from an esp_timer at a fixed rate, so the motion
+// does not depend on how long loop() blocks in HTTP calls. moveTo() only
+// records the move; the timer task steps every servo through its precomputed
+// profile and writes the LEDC duty. Lateness of every tick is recorded.
+class ServoEngine
+{
+public:
+  // updateHz: position updates per second, at most one per PWM frame is useful
+  bool begin(uint32_t updateHz = SERVO_PWM_HZ);
+  void end();
+
+  // Returns the servo index, -1 when all channels are taken
+  int attach(int pin, uint16_t minPulseUs = 500, uint16_t maxPulseUs = 2500, uint16_t maxDegrees = 180);
+
+  // Starts a move from where the servo is now. Asking again for the target
+  // it is already moving to does nothing, so it can be called every loop.
+  void moveTo(int servo, float degrees, float degreesPerS, MotionShape shape = MOTION_EASE);
+
+  float position(int servo) const; // degrees
+  bool moving(int servo) const;
+
+  TickJitter jitter() const;
+  void resetJitter();
+  void printJitter(Print &out) const;
+
+private:
+  struct Channel
+  {
+    uint8_t pin;
+    uint16_t minPulseUs;
+    uint16_t maxPulseUs;
+    int32_t maxCenti;
+    MotionMove move;
+    int64_t moveStartUs;
+    int32_t position; // hundredths of a degree
+    uint32_t duty;
+    bool moving;
+  };
+
+  Channel _channels[SERVO_ENGINE_CHANNELS];
+  uint8_t _count = 0;
+  esp_timer_handle_t _timer = NULL;
+  uint32_t _periodUs = 0;
+  int64_t _nextTickUs = 0;
+  TickJitter _jitter;
+  mutable portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+  static void onTick(void *engine);
+  void tick();
+  uint32_t dutyFor(const Channel &c) const;
+};
+
+#endif
@@ -0,0 +1,164 @@
+#include "TimeSeries.h"
+
+#include <string.h>
+
+static uint64_t zigzag(int64_t value)
+{
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static size_t putVarint(uint8_t *out, uint64_t value)
+{
+  size_t n = 0;
+  while (value >= 0x80)
+  {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+// Returns the bytes used, 0 if the varint runs past end or is too long
+static size_t getVarint(const uint8_t *in, size_t size, uint64_t *value)
+{
+  uint64_t result = 0;
+  for (size_t n = 0; n < size && n < 10; n++)
+  {
+    result |= (uint64_t)(in[n] & 0x7f) << (7 * n);
+    if ((in[n] & 0x80) == 0)
+    {
+      *value = result;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+TimeSeriesEncoder::TimeSeriesEncoder(uint8_t *buffer, size_t size)
+    : _buffer(buffer), _size(size)
+{
+  begin(0);
+}
+
+void TimeSeriesEncoder::begin(uint32_t idSensor)
+{
+  _idSensor = idSensor;
+  _count = 0;
+  _lastTimestamp = 0;
+  _lastDelta = 0;
+  _lastValue = 0;
+
+  uint8_t header[TIME_SERIES_HEADER_SIZE + 5];
+  header[0] = TIME_SERIES_VERSION;
+  header[1] = 0;
+  header[2] = 0;
+  size_t n = TIME_SERIES_HEADER_SIZE + putVarint(header + TIME_SERIES_HEADER_SIZE, idSensor);
+  // A buffer too small for the header takes no samples
+  _length = n <= _size ? n : _size;
+  memcpy(_buffer, header, _length);
+}
+
+bool TimeSeriesEncoder::append(int64_t timestamp, centi_t value)
+{
+  if (value == CENTI_INVALID || _count == UINT16_MAX || _length < TIME_SERIES_HEADER_SIZE)
+    return false;
+
+  uint8_t sample[TIME_SERIES_MAX_SAMPLE];
+  size_t n;
+  int64_t delta = timestamp - _lastTimestamp;
+  if (_count == 0)
+  {
+    n = putVarint(sample, zigzag(timestamp));
+    n += putVarint(sample + n, zigzag(value));
+    delta = 0;
+  }
+  else
+  {
+    // The low bit says whether a delta-of-delta follows
+    int64_t dod = delta - _lastDelta;
+    n = putVarint(sample, zigzag((int32_t)value - _lastValue) << 1 | (dod != 0));
+    if (dod != 0)
+      n += putVarint(sample + n, zigzag(dod));
+  }
+  if (n > _size - _length)
+    return false;
+
+  memcpy(_buffer + _length, sample, n);
+  _length += n;
+  _count++;
+  _buffer[1] = (uint8_t)_count;
+  _buffer[2] = (uint8_t)(_count >> 8);
+  _lastTimestamp = timestamp;
+  _lastDelta = delta;
+  _lastValue = value;
+  return true;
+}
+
+TimeSeriesReader::TimeSeriesReader(const uint8_t *data, size_t length)
+    : _data(data), _length(length), _offset(0), _valid(false), _idSensor(0), _count(0), _read(0),
+      _lastTimestamp(0), _lastDelta(0), _lastValue(0)
+{
+  if (length < TIME_SERIES_HEADER_SIZE || data[0] != TIME_SERIES_VERSION)
+    return;
+  uint64_t id;
+  size_t n = getVarint(data + TIME_SERIES_HEADER_SIZE, length - TIME_SERIES_HEADER_SIZE, &id);
+  if (n == 0 || id > UINT32_MAX)
+    return;
+  _idSensor = (uint32_t)id;
+  _count = (uint16_t)(data[1] | data[2] << 8);
+  _offset = TIME_SERIES_HEADER_SIZE + n;
+  _valid = true;
+}
+
+bool TimeSeriesReader::next(int64_t *timestamp, centi_t *value)
+{
+  if (!_valid || _read == _count)
+    return false;
+
+  int64_t t;
+  int64_t v;
+  size_t n;
+  if (_read == 0)
+  {
+    uint64_t time = 0;
+    uint64_t first = 0;
+    n = getVarint(_data + _offset, _length - _offset, &time);
+    size_t m = n == 0 ? 0 : getVarint(_data + _offset + n, _length - _offset - n, &first);
+    n = m == 0 ? 0 : n + m;
+    t = unzigzag(time);
+    v = unzigzag(first);
+  }
+  else
+  {
+    uint64_t change = 0;
+    uint64_t dod = 0;
+    n = getVarint(_data + _offset, _length - _offset, &change);
+    if (n != 0 && (change & 1) != 0)
+    {
+      size_t m = getVarint(_data + _offset + n, _length - _offset - n, &dod);
+      n = m == 0 ? 0 : n + m;
+    }
+    _lastDelta += unzigzag(dod);
+    t = _lastTimestamp + _lastDelta;
+    v = _lastValue + unzigzag(change >> 1);
+  }
+  if (n == 0 || v <= CENTI_INVALID || v > INT16_MAX)
+  {
+    _valid = false;
+    return false;
+  }
+
+  _offset += n;
+  _read++;
+  _lastTimestamp = t;
+  _lastValue = (int32_t)v;
+  *timestamp = t;
+  *value = (centi_t)v;
+  return true;
+}
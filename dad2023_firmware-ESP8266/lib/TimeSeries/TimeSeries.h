@@ -0,0 +1,89 @@
+#ifndef TIME_SERIES_H
+#define TIME_SERIES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <FixedTemp.h>
+
+// Compact block of (timestamp, value) samples of one sensor, so readings can
+// be kept on the device and uploaded many at a time instead of one JSON body
+// each. The backend decodes it in es.us.dad.mysql.rest.SensorValueBlock.
+//
+// Values stay in centi_t and are stored as zigzag varint deltas, timestamps
+// as zigzag varint delta-of-deltas that are left out when they are 0. With a
+// steady period and a temperature moving by less than 0.32 C between samples
+// that is one byte per sample.
+//
+// Block layout:
+//   version (1), sample count (2, little endian), varint idSensor,
+//   first sample: zigzag varint timestamp ms, zigzag varint value
+//   then per sample: varint (zigzag value delta << 1 | timestamp flag) and,
+//   if the flag is set, zigzag varint delta-of-delta of the timestamp (the
+//   second sample's previous delta is 0)
+
+#define TIME_SERIES_VERSION 1
+#define TIME_SERIES_HEADER_SIZE 3
+
+// Longest sample: 10 byte timestamp varint plus 3 byte value varint
+#define TIME_SERIES_MAX_SAMPLE 13
+
+class TimeSeriesEncoder
+{
+public:
+  // Samples are encoded straight into buffer, which is never overrun
+  TimeSeriesEncoder(uint8_t *buffer, size_t size);
+
+  // Starts an empty block for idSensor
+  void begin(uint32_t idSensor);
+
+  // Returns false, leaving the block unchanged, if the sample does not fit,
+  // the block already holds 65535 samples or value is CENTI_INVALID
+  bool append(int64_t timestamp, centi_t value);
+
+  const uint8_t *data() const { return _buffer; }
+  size_t length() const { return _length; }
+  uint16_t count() const { return _count; }
+  uint32_t idSensor() const { return _idSensor; }
+
+  // True when another sample may not fit
+  bool nearlyFull() const { return _size - _length < TIME_SERIES_MAX_SAMPLE; }
+
+private:
+  uint8_t *_buffer;
+  size_t _size;
+  size_t _length;
+  uint16_t _count;
+  uint32_t _idSensor;
+  int64_t _lastTimestamp;
+  int64_t _lastDelta;
+  centi_t _lastValue;
+};
+
+// Reads the samples of a block back, e.g. to resend or print local history
+class TimeSeriesReader
+{
+public:
+  TimeSeriesReader(const uint8_t *data, size_t length);
+
+  // False for an unknown version or a truncated header
+  bool valid() const { return _valid; }
+  uint32_t idSensor() const { return _idSensor; }
+  uint16_t count() const { return _count; }
+
+  // Returns false after the last sample or on a malformed block
+  bool next(int64_t *timestamp, centi_t *value);
+
+private:
+  const uint8_t *_data;
+  size_t _length;
+  size_t _offset;
+  bool _valid;
+  uint32_t _idSensor;
+  uint16_t _count;
+  uint16_t _read;
+  int64_t _lastTimestamp;
+  int64_t _lastDelta;
+  int32_t _lastValue;
+};
+
+#endif
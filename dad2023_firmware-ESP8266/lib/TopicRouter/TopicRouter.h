@@ -0,0 +1,256 @@
+#ifndef TOPIC_ROUTER_H
+#define TOPIC_ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Routes incoming MQTT messages to handlers by topic filter, including the
+// '+' (one level) and '#' (rest of the topic) wildcards.
+//
+// Filters are stored as a trie of topic levels. The children of every level
+// live in one open-addressing hash table keyed by (parent, level text), so a
+// message costs one lookup per topic level whatever the number of routes.
+// Everything is sized at compile time; nothing is allocated.
+//
+//   TopicRouter<24, 192> router; // 24 trie nodes, 192 bytes of level text
+//   router.add("mqttChannelDevice5/actuators/+", onActuator);
+//   router.dispatch(topic, payload, length);
+
+typedef void (*TopicHandler)(const char *topic, const uint8_t *payload, unsigned int length, void *context);
+
+// Topics with more levels are dropped
+#define TOPIC_ROUTER_MAX_DEPTH 16
+
+template <uint16_t MaxNodes, uint16_t PoolSize>
+class TopicRouter
+{
+public:
+  TopicRouter() { clear(); }
+
+  void clear()
+  {
+    memset(_slots, 0, sizeof(_slots));
+    _count = 1;
+    _poolUsed = 0;
+    initNode(0, NONE, 0, 0);
+  }
+
+  // Registers handler for filter. A filter registered twice keeps the last
+  // handler. Returns false for malformed filters or when out of space.
+  bool add(const char *filter, TopicHandler handler, void *context = NULL)
+  {
+    if (filter == NULL || handler == NULL)
+      return false;
+
+    uint16_t node = 0;
+    const char *level = filter;
+    for (;;)
+    {
+      const char *end = strchr(level, '/');
+      size_t len = end != NULL ? (size_t)(end - level) : strlen(level);
+      if (len > 255)
+        return false;
+
+      if (len == 1 && level[0] == '#')
+      {
+        if (end != NULL)
+          return false; // '#' must be the last level
+        _nodes[node].hashHandler = handler;
+        _nodes[node].hashContext = context;
+        return true;
+      }
+      if (memchr(level, '#', len) != NULL || (len > 1 && memchr(level, '+', len) != NULL))
+        return false; // wildcards must take a whole level
+
+      if (len == 1 && level[0] == '+')
+      {
+        if (_nodes[node].plus == NONE)
+        {
+          if (_count == MaxNodes)
+            return false;
+          uint16_t child = _count++;
+          initNode(child, node, 0, 0);
+          _nodes[node].plus = child;
+        }
+        node = _nodes[node].plus;
+      }
+      else
+      {
+        uint16_t child = findChild(node, level, (uint8_t)len);
+        if (child == NONE)
+          child = addChild(node, level, (uint8_t)len);
+        if (child == NONE)
+          return false;
+        node = child;
+      }
+
+      if (end == NULL)
+        break;
+      level = end + 1;
+    }
+
+    _nodes[node].handler = handler;
+    _nodes[node].context = context;
+    return true;
+  }
+
+  // Calls every handler whose filter matches topic and returns how many ran
+  uint8_t dispatch(const char *topic, const uint8_t *payload, unsigned int length) const
+  {
+    const char *starts[TOPIC_ROUTER_MAX_DEPTH];
+    uint8_t lens[TOPIC_ROUTER_MAX_DEPTH];
+    uint8_t depth = 0;
+
+    const char *level = topic;
+    for (;;)
+    {
+      if (depth == TOPIC_ROUTER_MAX_DEPTH)
+        return 0;
+      const char *end = strchr(level, '/');
+      size_t len = end != NULL ? (size_t)(end - level) : strlen(level);
+      if (len > 255)
+        return 0;
+      starts[depth] = level;
+      lens[depth] = (uint8_t)len;
+      depth++;
+      if (end == NULL)
+        break;
+      level = end + 1;
+    }
+
+    // Topics starting with '$' are never matched by a leading wildcard
+    bool system = topic[0] == '$';
+
+    // Depth-first walk; every step pushes at most one exact and one '+' branch
+    uint16_t stackNode[2 * TOPIC_ROUTER_MAX_DEPTH + 2];
+    uint8_t stackLevel[2 * TOPIC_ROUTER_MAX_DEPTH + 2];
+    uint8_t top = 0;
+    uint8_t called = 0;
+
+    stackNode[top] = 0;
+    stackLevel[top] = 0;
+    top++;
+    while (top > 0)
+    {
+      top--;
+      uint16_t node = stackNode[top];
+      uint8_t at = stackLevel[top];
+      const Node &n = _nodes[node];
+      bool wildcardsAllowed = !(system && at == 0);
+
+      if (n.hashHandler != NULL && wildcardsAllowed)
+      {
+        n.hashHandler(topic, payload, length, n.hashContext);
+        called++;
+      }
+      if (at == depth)
+      {
+        if (n.handler != NULL)
+        {
+          n.handler(topic, payload, length, n.context);
+          called++;
+        }
+        continue;
+      }
+
+      uint16_t child = findChild(node, starts[at], lens[at]);
+      if (child != NONE)
+      {
+        stackNode[top] = child;
+        stackLevel[top] = at + 1;
+        top++;
+      }
+      if (n.plus != NONE && wildcardsAllowed)
+      {
+        stackNode[top] = n.plus;
+        stackLevel[top] = at + 1;
+        top++;
+      }
+    }
+    return called;
+  }
+
+  uint16_t nodeCount() const { return _count; }
+  uint16_t poolUsed() const { return _poolUsed; }
+
+private:
+  static const uint16_t NONE = 0xffff;
+  static const uint16_t SLOTS = MaxNodes * 2;
+
+  struct Node
+  {
+    uint16_t parent;
+    uint16_t text; // offset of the level text in _pool
+    uint8_t length;
+    uint16_t plus; // '+' child
+    TopicHandler handler;
+    void *context;
+    TopicHandler hashHandler; // route "<this level>/#"
+    void *hashContext;
+  };
+
+  Node _nodes[MaxNodes];
+  uint16_t _count;
+  char _pool[PoolSize];
+  uint16_t _poolUsed;
+  uint16_t _slots[SLOTS]; // node index + 1, 0 = empty
+
+  void initNode(uint16_t index, uint16_t parent, uint16_t text, uint8_t length)
+  {
+    Node &n = _nodes[index];
+    n.parent = parent;
+    n.text = text;
+    n.length = length;
+    n.plus = NONE;
+    n.handler = NULL;
+    n.context = NULL;
+    n.hashHandler = NULL;
+    n.hashContext = NULL;
+  }
+
+  static uint16_t slotFor(uint16_t parent, const char *text, uint8_t len)
+  {
+    // FNV-1a over the parent index and the level text
+    uint32_t h = 2166136261u ^ parent;
+    h *= 16777619u;
+    for (uint8_t i = 0; i < len; i++)
+    {
+      h ^= (uint8_t)text[i];
+      h *= 16777619u;
+    }
+    return (uint16_t)(h % SLOTS);
+  }
+
+  uint16_t findChild(uint16_t parent, const char *text, uint8_t len) const
+  {
+    uint16_t slot = slotFor(parent, text, len);
+    while (_slots[slot] != 0)
+    {
+      const Node &n = _nodes[_slots[slot] - 1];
+      if (n.parent == parent && n.length == len && memcmp(_pool + n.text, text, len) == 0)
+        return _slots[slot] - 1;
+      slot = slot + 1 == SLOTS ? 0 : slot + 1;
+    }
+    return NONE;
+  }
+
+  uint16_t addChild(uint16_t parent, const char *text, uint8_t len)
+  {
+    if (_count == MaxNodes || (uint32_t)_poolUsed + len > PoolSize)
+      return NONE;
+    uint16_t index = _count++;
+    memcpy(_pool + _poolUsed, text, len);
+    initNode(index, parent, _poolUsed, len);
+    _poolUsed += len;
+
+    // At most MaxNodes entries in 2 * MaxNodes slots, so there is always a free one
+    uint16_t slot = slotFor(parent, text, len);
+    while (_slots[slot] != 0)
+      slot = slot + 1 == SLOTS ? 0 : slot + 1;
+    _slots[slot] = index + 1;
+    return index;
+  }
+};
+
+#endif
@@ -0,0 +1,277 @@
+#include "TraceLog.h"
+
+#include <string.h>
+
+static size_t putVarint(uint8_t *out, uint32_t value)
+{
+  size_t n = 0;
+  while (value >= 0x80)
+  {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+// Returns the bytes used, 0 if the varint runs past end
+static size_t getVarint(const uint8_t *in, size_t size, uint32_t *value)
+{
+  uint32_t result = 0;
+  for (size_t n = 0; n < size && n < 5; n++)
+  {
+    result |= (uint32_t)(in[n] & 0x7f) << (7 * n);
+    if ((in[n] & 0x80) == 0)
+    {
+      *value = result;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+static void putU32(uint8_t *out, uint32_t value)
+{
+  for (int i = 0; i < 4; i++)
+    out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint32_t getU32(const uint8_t *in)
+{
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+TraceLog::TraceLog(uint8_t *buffer, size_t size)
+    : _buffer(buffer), _size(size), _lastMs(0), _enabled(true)
+{
+  clear();
+}
+
+void TraceLog::clear()
+{
+  _head = 0;
+  _used = 0;
+  _baseMs = _lastMs;
+  _passes = 0;
+  _records = 0;
+  _dropped = 0;
+}
+
+void TraceLog::dropOldest()
+{
+  uint8_t bytes[12];
+  size_t n = _used < sizeof(bytes) ? _used : sizeof(bytes);
+  for (size_t i = 0; i < n; i++)
+    bytes[i] = at(i);
+
+  uint32_t dt = 0, passes = 0;
+  size_t dtLength = getVarint(bytes + 2, n - 2, &dt);
+  size_t passesLength = getVarint(bytes + 2 + dtLength, n - 2 - dtLength, &passes);
+  _baseMs += dt;
+  _used -= 2 + dtLength + passesLength + bytes[1];
+  _records--;
+  _dropped++;
+}
+
+bool TraceLog::record(uint8_t type, uint32_t nowMs, const uint8_t *payload, size_t length)
+{
+  if (!_enabled || length > TRACE_MAX_PAYLOAD)
+    return false;
+
+  uint8_t header[12];
+  header[0] = type;
+  header[1] = (uint8_t)length;
+  size_t headerLength = 2;
+  headerLength += putVarint(header + headerLength, nowMs - _lastMs);
+  headerLength += putVarint(header + headerLength, _passes);
+  if (headerLength + length > _size)
+    return false;
+
+  while (_size - _used < headerLength + length)
+    dropOldest();
+
+  for (size_t i = 0; i < headerLength + length; i++)
+  {
+    _buffer[_head] = i < headerLength ? header[i] : payload[i - headerLength];
+    _head = _head + 1 == _size ? 0 : _head + 1;
+  }
+  _used += headerLength + length;
+  _lastMs = nowMs;
+  _passes = 0;
+  _records++;
+  return true;
+}
+
+bool TraceLog::boot(uint32_t nowMs, const char *channel, int idActuator, long uploadEvery)
+{
+  uint8_t payload[TRACE_MAX_PAYLOAD];
+  size_t n = putVarint(payload, (uint32_t)idActuator);
+  n += putVarint(payload + n, (uint32_t)uploadEvery);
+  size_t channelLength = strlen(channel);
+  if (channelLength > sizeof(payload) - n)
+    channelLength = sizeof(payload) - n;
+  memcpy(payload + n, channel, channelLength);
+  return record(TRACE_BOOT, nowMs, payload, n + channelLength);
+}
+
+bool TraceLog::reading(uint32_t nowMs, int16_t value)
+{
+  uint8_t payload[2] = {(uint8_t)value, (uint8_t)((uint16_t)value >> 8)};
+  return record(TRACE_READING, nowMs, payload, sizeof(payload));
+}
+
+bool TraceLog::mqtt(uint32_t nowMs, const char *topic, const uint8_t *payload, unsigned int length)
+{
+  uint8_t data[TRACE_MAX_PAYLOAD];
+  size_t topicLength = strlen(topic);
+  if (topicLength > 64)
+    topicLength = 64;
+  data[0] = (uint8_t)topicLength;
+  memcpy(data + 1, topic, topicLength);
+  size_t n = 1 + topicLength;
+  if (length > sizeof(data) - n)
+    length = sizeof(data) - n;
+  memcpy(data + n, payload, length);
+  return record(TRACE_MQTT, nowMs, data, n + length);
+}
+
+bool TraceLog::http(uint32_t nowMs, uint8_t path, int16_t status, uint32_t durationMs)
+{
+  uint8_t payload[8] = {path, (uint8_t)status, (uint8_t)((uint16_t)status >> 8)};
+  size_t n = 3 + putVarint(payload + 3, durationMs);
+  return record(TRACE_HTTP, nowMs, payload, n);
+}
+
+bool TraceLog::upload(uint32_t nowMs, int16_t value)
+{
+  uint8_t payload[2] = {(uint8_t)value, (uint8_t)((uint16_t)value >> 8)};
+  return record(TRACE_UPLOAD, nowMs, payload, sizeof(payload));
+}
+
+bool TraceLog::relay(uint32_t nowMs, uint8_t command)
+{
+  return record(TRACE_RELAY, nowMs, &command, 1);
+}
+
+bool TraceLog::stall(uint32_t nowMs, uint32_t durationMs)
+{
+  uint8_t payload[5];
+  return record(TRACE_STALL, nowMs, payload, putVarint(payload, durationMs));
+}
+
+size_t TraceLog::dump(size_t offset, uint8_t *out, size_t size) const
+{
+  uint8_t header[TRACE_HEADER_SIZE];
+  memcpy(header, TRACE_MAGIC, 4);
+  header[4] = TRACE_VERSION;
+  putU32(header + 5, _baseMs);
+  putU32(header + 9, _dropped);
+  putU32(header + 13, (uint32_t)_used);
+
+  size_t n = 0;
+  for (; n < size && offset + n < dumpSize(); n++)
+  {
+    size_t i = offset + n;
+    out[n] = i < TRACE_HEADER_SIZE ? header[i] : at(i - TRACE_HEADER_SIZE);
+  }
+  return n;
+}
+
+bool TraceReader::begin(const uint8_t *data, size_t size)
+{
+  if (size < TRACE_HEADER_SIZE || memcmp(data, TRACE_MAGIC, 4) != 0 || data[4] != TRACE_VERSION)
+    return false;
+  _timeMs = getU32(data + 5);
+  _dropped = getU32(data + 9);
+  size_t length = getU32(data + 13);
+  _truncated = length > size - TRACE_HEADER_SIZE;
+  _data = data + TRACE_HEADER_SIZE;
+  _size = _truncated ? size - TRACE_HEADER_SIZE : length;
+  _pos = 0;
+  return true;
+}
+
+bool TraceReader::next(TraceRecord *record)
+{
+  if (_size - _pos < 2)
+  {
+    _truncated |= _pos != _size;
+    return false;
+  }
+  const uint8_t *p = _data + _pos;
+  size_t left = _size - _pos - 2;
+  uint32_t dt, passes;
+  size_t dtLength = getVarint(p + 2, left, &dt);
+  size_t passesLength = dtLength != 0 ? getVarint(p + 2 + dtLength, left - dtLength, &passes) : 0;
+  if (passesLength == 0 || left - dtLength - passesLength < p[1])
+  {
+    _truncated = true;
+    return false;
+  }
+
+  _timeMs += dt;
+  record->type = p[0];
+  record->length = p[1];
+  record->timeMs = _timeMs;
+  record->passes = passes;
+  record->payload = p + 2 + dtLength + passesLength;
+  _pos += 2 + dtLength + passesLength + p[1];
+  return true;
+}
+
+bool traceBoot(const TraceRecord &record, const char **channel, size_t *channelLength, int *idActuator, long *uploadEvery)
+{
+  uint32_t id, every;
+  size_t n = getVarint(record.payload, record.length, &id);
+  size_t m = n != 0 ? getVarint(record.payload + n, record.length - n, &every) : 0;
+  if (record.type != TRACE_BOOT || m == 0)
+    return false;
+  *idActuator = (int)id;
+  *uploadEvery = (long)every;
+  *channel = (const char *)record.payload + n + m;
+  *channelLength = record.length - n - m;
+  return true;
+}
+
+bool traceValue(const TraceRecord &record, int16_t *value)
+{
+  if ((record.type != TRACE_READING && record.type != TRACE_UPLOAD) || record.length != 2)
+    return false;
+  *value = (int16_t)(record.payload[0] | record.payload[1] << 8);
+  return true;
+}
+
+bool traceMqtt(const TraceRecord &record, const char **topic, size_t *topicLength, const uint8_t **payload, size_t *payloadLength)
+{
+  if (record.type != TRACE_MQTT || record.length < 1 || record.payload[0] > record.length - 1)
+    return false;
+  *topic = (const char *)record.payload + 1;
+  *topicLength = record.payload[0];
+  *payload = record.payload + 1 + record.payload[0];
+  *payloadLength = record.length - 1 - record.payload[0];
+  return true;
+}
+
+bool traceHttp(const TraceRecord &record, uint8_t *path, int16_t *status, uint32_t *durationMs)
+{
+  if (record.type != TRACE_HTTP || record.length < 4)
+    return false;
+  *path = record.payload[0];
+  *status = (int16_t)(record.payload[1] | record.payload[2] << 8);
+  return getVarint(record.payload + 3, record.length - 3, durationMs) != 0;
+}
+
+bool traceCommand(const TraceRecord &record, uint8_t *command)
+{
+  if (record.type != TRACE_RELAY || record.length != 1)
+    return false;
+  *command = record.payload[0];
+  return true;
+}
+
+bool traceDuration(const TraceRecord &record, uint32_t *durationMs)
+{
+  if (record.type != TRACE_STALL)
+    return false;
+  return getVarint(record.payload, record.length, durationMs) != 0;
+}
@@ -0,0 +1,127 @@
+#ifndef TRACE_LOG_H
+#define TRACE_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact binary log of what the device saw and decided, kept in a ring
+// buffer so the latest few minutes are always there to dump (serial or MQTT)
+// when something goes wrong in the field. tools/trace_replay reads the dumps.
+//
+// Dump layout, all integers little endian:
+//   "DADT", version (1), base time ms (4), records dropped (4), length (4)
+//   then length bytes of records, oldest first:
+//   type (1), payload length (1), varint ms since the previous record,
+//   varint loop passes since the previous record, payload
+
+#define TRACE_MAGIC "DADT"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 17
+#define TRACE_MAX_PAYLOAD 255
+
+enum TraceType
+{
+  TRACE_BOOT = 1, // varint idActuator, varint upload period, device channel
+  TRACE_READING,  // raw centi_t reading (2), when it changes
+  TRACE_MQTT,     // topic length (1), topic, payload (may be truncated)
+  TRACE_HTTP,     // TracePath (1), status code (2), varint duration ms
+  TRACE_UPLOAD,   // filtered centi_t value (2) of an upload cycle
+  TRACE_RELAY,    // RelayCommand (1) applied on an upload cycle
+  TRACE_STALL     // varint duration ms of a slow loop pass
+};
+
+enum TracePath
+{
+  TRACE_PATH_OTHER,
+  TRACE_PATH_SENSOR_VALUES,
+  TRACE_PATH_ACTUATOR_STATES
+};
+
+class TraceLog
+{
+public:
+  // buffer holds the records; the oldest ones are dropped when it is full
+  TraceLog(uint8_t *buffer, size_t size);
+
+  void clear();
+  void setEnabled(bool enabled) { _enabled = enabled; }
+  bool enabled() const { return _enabled; }
+
+  // Call once per loop pass; every record carries the passes since the
+  // previous one so a replay can run the same number of passes
+  void pass() { _passes++; }
+
+  // Return false if disabled or the record can never fit
+  bool record(uint8_t type, uint32_t nowMs, const uint8_t *payload, size_t length);
+  bool boot(uint32_t nowMs, const char *channel, int idActuator, long uploadEvery);
+  bool reading(uint32_t nowMs, int16_t value);
+  bool mqtt(uint32_t nowMs, const char *topic, const uint8_t *payload, unsigned int length);
+  bool http(uint32_t nowMs, uint8_t path, int16_t status, uint32_t durationMs);
+  bool upload(uint32_t nowMs, int16_t value);
+  bool relay(uint32_t nowMs, uint8_t command);
+  bool stall(uint32_t nowMs, uint32_t durationMs);
+
+  // The dump is read in pieces so it can be sent without a second buffer.
+  // Returns the bytes copied to out.
+  size_t dumpSize() const { return TRACE_HEADER_SIZE + _used; }
+  size_t dump(size_t offset, uint8_t *out, size_t size) const;
+
+  uint32_t records() const { return _records; }
+  uint32_t dropped() const { return _dropped; }
+
+private:
+  uint8_t *_buffer;
+  size_t _size;
+  size_t _head; // next byte to write
+  size_t _used;
+  uint32_t _baseMs; // time the oldest record's delta is relative to
+  uint32_t _lastMs;
+  uint32_t _passes;
+  uint32_t _records;
+  uint32_t _dropped;
+  bool _enabled;
+
+  uint8_t at(size_t index) const { return _buffer[(_head + _size - _used + index) % _size]; }
+  void dropOldest();
+};
+
+struct TraceRecord
+{
+  uint8_t type;
+  uint32_t timeMs; // absolute, same clock as millis() on the device
+  uint32_t passes;
+  const uint8_t *payload;
+  uint8_t length;
+};
+
+// Walks the records of a dump
+class TraceReader
+{
+public:
+  // Returns false if data is not a trace dump of this version
+  bool begin(const uint8_t *data, size_t size);
+
+  // Returns false at the end, or at a truncated record
+  bool next(TraceRecord *record);
+
+  uint32_t dropped() const { return _dropped; }
+  bool truncated() const { return _truncated; }
+
+private:
+  const uint8_t *_data;
+  size_t _size;
+  size_t _pos;
+  uint32_t _timeMs;
+  uint32_t _dropped;
+  bool _truncated;
+};
+
+// Payload decoders, all return false for malformed records
+bool traceBoot(const TraceRecord &record, const char **channel, size_t *channelLength, int *idActuator, long *uploadEvery);
+bool traceValue(const TraceRecord &record, int16_t *value); // TRACE_READING, TRACE_UPLOAD
+bool traceMqtt(const TraceRecord &record, const char **topic, size_t *topicLength, const uint8_t **payload, size_t *payloadLength);
+bool traceHttp(const TraceRecord &record, uint8_t *path, int16_t *status, uint32_t *durationMs);
+bool traceCommand(const TraceRecord &record, uint8_t *command);       // TRACE_RELAY
+bool traceDuration(const TraceRecord &record, uint32_t *durationMs); // TRACE_STALL
+
+#endif
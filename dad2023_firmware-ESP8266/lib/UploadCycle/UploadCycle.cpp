@@ -0,0 +1,36 @@
+#include "UploadCycle.h"
+#include <string.h>
+
+// Longer than UPLOAD_URL_MAX is refused even with room left, so the arena
+// never needs more than UPLOAD_ARENA_SIZE
+const char *uploadUrl(CycleArena &arena, const char *server, const char *path)
+{
+  if (strlen(server) + strlen(path) >= UPLOAD_URL_MAX)
+    return nullptr;
+  return arena.format("%s%s", server, path);
+}
+
+const char *uploadPayload(CycleArena &arena, const uint8_t *payload, size_t length)
+{
+  if (length > UPLOAD_PAYLOAD_MAX)
+    return nullptr;
+  return arena.copy((const char *)payload, length);
+}
+
+const char *uploadSensorValueBody(CycleArena &arena, int idSensor, int64_t timestamp, centi_t value)
+{
+  char *output = (char *)arena.alloc(DAD_BODY_SIZE);
+  if (output == nullptr || writeSensorValueBodyCenti(output, DAD_BODY_SIZE, idSensor, timestamp, value) == 0)
+    return nullptr;
+  return output;
+}
+
+const char *uploadActuatorStatusBody(CycleArena &arena, centi_t status, bool statusBinary, int idActuator,
+                                     int64_t timestamp)
+{
+  char *output = (char *)arena.alloc(DAD_BODY_SIZE);
+  if (output == nullptr ||
+      writeActuatorStatusBodyCenti(output, DAD_BODY_SIZE, status, statusBinary, idActuator, timestamp) == 0)
+    return nullptr;
+  return output;
+}
@@ -0,0 +1,75 @@
+#ifndef UPLOAD_CYCLE_H
+#define UPLOAD_CYCLE_H
+
+#include <CycleArena.h>
+#include <DadProtocol.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The request-scoped buffers of a loop pass of src/main.cpp, out of its
+// CycleArena: request URLs, request bodies, responses and MQTT payloads.
+// Every one returns nullptr when the arena has no room left, and the caller
+// skips what needed it. Kept apart from main.cpp so test_cycle_arena soaks
+// the same code on the host.
+
+#define UPLOAD_URL_MAX 64       // server + path, with its terminator
+#define UPLOAD_RESPONSE_MAX 256 // response bytes kept, they are only printed
+#define UPLOAD_PAYLOAD_MAX 256  // MQTT_MAX_PACKET_SIZE of PubSubClient: no payload is longer
+
+// Aligned size of one allocation of at most size bytes
+#define UPLOAD_SLOT(size) (((size) + CYCLE_ARENA_ALIGN - 1) / CYCLE_ARENA_ALIGN * CYCLE_ARENA_ALIGN)
+
+// The most a pass takes: a sensor value and an actuator status, each a URL,
+// a body and a response, and one MQTT payload
+#define UPLOAD_REQUEST_MAX \
+  (UPLOAD_SLOT(UPLOAD_URL_MAX) + UPLOAD_SLOT(DAD_BODY_SIZE) + UPLOAD_SLOT(UPLOAD_RESPONSE_MAX + 1))
+#define UPLOAD_ARENA_SIZE (2 * UPLOAD_REQUEST_MAX + UPLOAD_SLOT(UPLOAD_PAYLOAD_MAX + 1))
+
+// server + path
+const char *uploadUrl(CycleArena &arena, const char *server, const char *path);
+
+// Null terminated copy of an MQTT payload
+const char *uploadPayload(CycleArena &arena, const uint8_t *payload, size_t length);
+
+// DadProtocol bodies, the same bytes the host tools send
+const char *uploadSensorValueBody(CycleArena &arena, int idSensor, int64_t timestamp, centi_t value);
+const char *uploadActuatorStatusBody(CycleArena &arena, centi_t status, bool statusBinary, int idActuator,
+                                     int64_t timestamp);
+
+// The first UPLOAD_RESPONSE_MAX bytes of a response body of size bytes (as
+// HTTPClient::getSize() gives it, -1 when unknown) from stream. With a size
+// the rest is read and dropped so the connection can be reused. Without one
+// (chunked, or up to the close) the end of the body is unknown: what has
+// arrived is kept and the connection is closed instead, as it is when the
+// body is not read to its end. Source: a WiFiClient on the device.
+template <typename Source>
+const char *uploadResponse(CycleArena &arena, Source &stream, int size)
+{
+  size_t length = size >= 0 ? (size_t)size : stream.available();
+  if (length > UPLOAD_RESPONSE_MAX)
+    length = UPLOAD_RESPONSE_MAX;
+  char *body = (char *)arena.alloc(length + 1);
+  if (body == nullptr)
+  {
+    stream.stop();
+    return nullptr;
+  }
+  length = stream.readBytes(body, length);
+  body[length] = 0;
+
+  // readBytes() waits for the rest as long as the stream timeout
+  char rest[32];
+  int left = size - (int)length;
+  while (size >= 0 && left > 0)
+  {
+    size_t n = stream.readBytes(rest, left < (int)sizeof(rest) ? (size_t)left : sizeof(rest));
+    if (n == 0)
+      break;
+    left -= (int)n;
+  }
+  if (size < 0 || left > 0)
+    stream.stop();
+  return body;
+}
+
+#endif
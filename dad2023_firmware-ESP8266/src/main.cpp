@@ -6,6 +6,28 @@
 #include <PubSubClient.h>
 #include <DHT.h>
 #include <DHT_U.h>
+#include <DadProtocol.h>
+#include <TopicRouter.h>
+#include <NodeLogic.h>
+#include <Profiler.h>
+#include <CycleArena.h>
+#include <HeapMonitor.h>
+#include <UploadCycle.h>
+#ifdef DAD_TRACE
+#include <TraceLog.h>
+#endif
+#ifdef DAD_TLS
+#include <SecureTransport.h>
+#endif
+#ifdef DAD_BLOCKS
+#include <TimeSeries.h>
+#endif
+#ifdef DAD_PEER
+#include <EspNowRadio.h>
+#endif
+#ifdef DAD_OTA
+#include <DeltaOta.h>
+#endif
 
 #define DHTTYPE DHT22
 
@@ -16,8 +38,8 @@
 const int DEVICE_ID = 124;
 const int sensor_id = 72;
 const int actuator_id = 3;
-String mqttmsg;
-int contador = 0;
+char mqttmsg[32] = ""; // last command for this device, printed on upload
+const long UPLOAD_EVERY = 10000; // loop passes between uploads, MQTT_DEVICE_CHANNEL/config/period
 
 // VARIABLES
 
@@ -27,11 +49,49 @@ const int actuatorPin = 12; //esto es el pin D6
 
 //DHT Sensor declaration
 DHT dht(sensorPin, DHTTYPE);
+NodeLogic logic; // filtering, upload cycle and relay decisions
 int test_delay = 4000; // so we don't spam the API
 boolean describe_tests = true;
 
 // Replace 0.0.0.0 by your server local IP (ipconfig [windows] or ifconfig [Linux o MacOS] gets IP assigned to your PC)
+#ifdef DAD_TLS
+// Build with -D DAD_TLS to go through TLS (tools/tls_standin/tls_standin.sh
+// puts a TLS front on the backend and the broker for lab tests)
+const char *TLS_HTTP_HOST = "192.168.43.195";
+const uint16_t TLS_HTTP_PORT = 8443;
+String serverName = "https://192.168.43.195:8443/";
+
+// Server public key, pinned instead of validating a certificate chain.
+// Replace it by the key printed by tools/tls_standin/tls_standin.sh, then
+// tools/tls_standin/check.sh checks the stand-in serves that key.
+constexpr char TLS_SERVER_KEY[] = R"KEY(
+-----BEGIN PUBLIC KEY-----
+MFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAE00000000000000000000000000000
+0000000000000000000000000000000000000000000000000000000000000000
+-----END PUBLIC KEY-----
+)KEY";
+
+// The placeholder is a run of zeros no real key has; a node built with it
+// would refuse every connection
+constexpr bool hasZeroRun(const char *text, int run)
+{
+  return run == 16 || (*text != 0 && hasZeroRun(text + 1, *text == '0' ? run + 1 : 0));
+}
+static_assert(!hasZeroRun(TLS_SERVER_KEY, 0), "TLS_SERVER_KEY is still the placeholder, see tools/tls_standin");
+
+// SecureTransport::configure, saying when the server did not agree to small
+// records: the receive buffer is then the full 16 KB
+bool configureTls(SecureTransport &transport, const char *name, const char *host, uint16_t port)
+{
+  if (!transport.configure(host, port, TLS_SERVER_KEY))
+    return false;
+  if (transport.stats().fragmentLength == 0)
+    Serial.printf("TLS %s: no max fragment length from %s:%u, 16 KB receive buffer\n", name, host, port);
+  return true;
+}
+#else
 String serverName = "http://192.168.43.195:8080/";
+#endif
 HTTPClient http;
 
 // Replace WifiName and WifiPassword by your WiFi credentials
@@ -48,38 +108,255 @@ WiFiUDP ntpUDP;
 NTPClient timeClient(ntpUDP);
 
 // MQTT configuration
+#ifdef DAD_TLS
+SecureTransport client;
+SecureTransport client2;
+#else
 WiFiClient client;
 WiFiClient client2;
+#endif
 PubSubClient mqttClient(client2);
 
 // Server IP, where de MQTT broker is deployed
 const char *MQTT_BROKER_ADRESS = "192.168.43.195";
+#ifdef DAD_TLS
+const uint16_t MQTT_PORT = 8883;
+#else
 const uint16_t MQTT_PORT = 1883;
+#endif
 
 // Name for this MQTT client
 const char *MQTT_CLIENT_NAME = "192.168.43.195";
-const char *MQTT_CHANNEL = "mqttChannelDevice5";
+// Literals so the route filters below can be built from them
+#define MQTT_DEVICE_CHANNEL "mqttChannelDevice5"
+#define MQTT_GROUP_CHANNEL "mqttChannelGroup5" // mqttChannel of the group of this device
+const char *MQTT_CHANNEL = MQTT_DEVICE_CHANNEL;
+
+// Profiler phases: where loop() spends its time. 'P' on the serial port
+// starts or stops the profiler and 'p' dumps it for tools/profile_report;
+// or "<hz>", "off" and "dump" on MQTT_DEVICE_CHANNEL/config/profile.
+enum LoopPhase
+{
+  PHASE_OTHER,
+  PHASE_NTP,
+  PHASE_DHT,
+  PHASE_HTTP_POST,
+  PHASE_HTTP_READ,
+  PHASE_MQTT,
+  PHASE_COUNT
+};
+const char *const PHASE_NAMES[PHASE_COUNT] = {"other", "ntp", "dht", "http_post", "http_read", "mqtt"};
+const uint32_t PROFILE_HZ = 1000;
+bool profileDumpRequested = false;
+
+#ifdef DAD_TRACE
+// Build with -D DAD_TRACE to keep the last minutes of readings, MQTT messages,
+// HTTP requests and decisions in RAM. 't' on the serial port, or "dump" on
+// MQTT_DEVICE_CHANNEL/config/trace, dumps them for tools/trace_replay.
+uint8_t traceBuffer[4096];
+TraceLog trace(traceBuffer, sizeof(traceBuffer));
+int32_t traceLastReading = INT32_MIN;
+bool traceDumpRequested = false;
+const uint32_t TRACE_STALL_MS = 50; // loop passes at least this long are recorded
+#endif
+
+#ifdef DAD_BLOCKS
+// Build with -D DAD_BLOCKS to keep uploads in a TimeSeries block and POST it
+// to DAD_PATH_SENSOR_VALUE_BLOCKS every BLOCK_SAMPLES uploads instead of one
+// JSON body per upload. Samples stay in the block until the backend takes
+// them; 'b' on the serial port prints the ones not sent yet.
+uint8_t blockBuffer[512];
+TimeSeriesEncoder block(blockBuffer, sizeof(blockBuffer));
+const uint16_t BLOCK_SAMPLES = 30;
+#endif
+
+#ifdef DAD_OTA
+// Build with -D DAD_OTA to update over the air from OTA_SERVER: "delta" on
+// MQTT_DEVICE_CHANNEL/config/ota downloads the delta for the running image
+// (tools/delta_gen) and falls back to the full image, "full" takes the full
+// image, which is only flashed if it matches firmware.bin.md5. The transfer
+// size and time are published on MQTT_DEVICE_CHANNEL/ota before the restart;
+// 'o' on the serial port prints the image the deltas are made against.
+#ifdef DAD_TLS
+// Through tools/tls_standin (:8444 -> the update server on :8000), pinned to
+// TLS_SERVER_KEY like the backend and the broker
+const uint16_t TLS_OTA_PORT = 8444;
+const char *OTA_SERVER = "https://192.168.43.195:8444/";
+#else
+const char *OTA_SERVER = "http://192.168.43.195:8000/";
+#endif
+DeltaOta ota;
+char otaRequested = 0; // 'd' or 'f'
+#endif
+
+#ifdef DAD_PEER
+// Build with -D DAD_PEER for a node without a WiFi association, HTTP client or
+// MQTT session of its own: uploads go over ESP-NOW to a gateway (pio run -e
+// gateway), which POSTs them and forwards what is published on
+// MQTT_DEVICE_CHANNEL. Uploads wait in the PeerNode until the gateway
+// acknowledges them and are resent every PEER_RESEND_MS meanwhile.
+// Only sensor values and device and actuator commands cross the link: relay
+// states are not POSTed to api/actuator_states, and nothing published on
+// MQTT_DEVICE_CHANNEL/config/# or MQTT_GROUP_CHANNEL reaches the node:
+// UPLOAD_EVERY and the threshold stay as built, the profiler and the trace
+// are reached on the serial port only, and OTA cannot be requested.
+const uint8_t PEER_WIFI_CHANNEL = 6; // the channel of the gateway's access point
+const uint32_t PEER_RESEND_MS = 2000;
+EspNowRadio radio;
+PeerNode peer;
+uint32_t lastPeerSend = 0;
+#endif
+
+// Request-scoped buffers of a loop pass (URLs, bodies, responses, MQTT
+// payloads) come from cycleArena through lib/UploadCycle and are all dropped
+// by its reset() at the end of loop(), instead of Strings allocated and freed
+// all over the heap. The arena holds the most a pass takes; should a request
+// still not fit, it is skipped with a log line. heapMonitor follows the
+// largest free block to show the heap stays flat; 'h' on the serial port
+// prints both. A largest block under HEAP_GUARD_BLOCK is logged and published
+// on MQTT_DEVICE_CHANNEL/heap; build with -D DAD_HEAP_GUARD to also restart
+// between passes then, rather than let a request fail half way.
+alignas(CYCLE_ARENA_ALIGN) uint8_t cycleBuffer[UPLOAD_ARENA_SIZE];
+CycleArena cycleArena(cycleBuffer, sizeof(cycleBuffer));
+static_assert(MQTT_MAX_PACKET_SIZE <= UPLOAD_PAYLOAD_MAX, "MQTT payloads would not fit UPLOAD_PAYLOAD_MAX");
+HeapMonitor heapMonitor;
+const uint32_t HEAP_SAMPLE_MS = 60000;
+const uint32_t HEAP_GUARD_BLOCK = 4096; // the most a request cycle may need at once
 
 // Pinout settings
 
 
+// Null terminated copy of an MQTT payload, for this pass only
+const char *payloadText(const uint8_t *payload, unsigned int length)
+{
+  const char *text = uploadPayload(cycleArena, payload, length);
+  if (text == nullptr)
+    Serial.printf("No room for a %u byte MQTT payload, dropped\n", length);
+  return text;
+}
+
+// serverName + path, for this pass only
+const char *serverUrl(const char *path)
+{
+  return uploadUrl(cycleArena, serverName.c_str(), path);
+}
+
+void rememberCommand(const char *payload, size_t length)
+{
+  if (length >= sizeof(mqttmsg))
+    length = sizeof(mqttmsg) - 1;
+  memcpy(mqttmsg, payload, length);
+  mqttmsg[length] = 0;
+}
+
+// "1"/"0" from the backend for the relay of this device
+void OnDeviceCommand(const char *topic, const uint8_t *payload, unsigned int length, void *context)
+{
+  rememberCommand((const char *)payload, length);
+  logic.onCommand((const char *)payload, length);
+}
+
+// MQTT_DEVICE_CHANNEL/actuators/<idActuator>: the same command for one actuator
+void OnActuatorCommand(const char *topic, const uint8_t *payload, unsigned int length, void *context)
+{
+  const char *id = strrchr(topic, '/') + 1;
+  if (atoi(id) == actuator_id)
+    rememberCommand((const char *)payload, length);
+  logic.onActuatorCommand(atoi(id), (const char *)payload, length);
+}
+
+// MQTT_DEVICE_CHANNEL/config/<key>
+void OnConfig(const char *topic, const uint8_t *payload, unsigned int length, void *context)
+{
+  const char *key = topic + strlen(MQTT_DEVICE_CHANNEL "/config");
+  const char *value = payloadText(payload, length);
+  if (value == nullptr)
+    return;
+  if (strcmp(key, "/period") == 0 && logic.setUploadEvery(atol(value)))
+  {
+    Serial.printf("Upload period: %ld\n", logic.uploadEvery());
+  }
+  else if (strcmp(key, "/threshold") == 0)
+  {
+    // Relay from the filtered reading until the next relay command, see parseThreshold
+    centi_t threshold, hysteresis;
+    if (parseThreshold(value, &threshold, &hysteresis))
+      logic.setThreshold(threshold, hysteresis);
+    else
+      Serial.printf("Invalid threshold %s\n", value);
+  }
+  else if (strcmp(key, "/profile") == 0)
+  {
+    if (strcmp(value, "off") == 0)
+      profilerStop();
+    else if (strcmp(value, "dump") == 0)
+      profileDumpRequested = true;
+    else if (!profilerStart(atoi(value) > 0 ? atoi(value) : PROFILE_HZ))
+      Serial.printf("Invalid profiler rate %s\n", value);
+  }
+#ifdef DAD_TRACE
+  else if (strcmp(key, "/trace") == 0)
+  {
+    // "on", "off", "clear" or "dump" (published on MQTT_DEVICE_CHANNEL/trace)
+    if (strcmp(value, "on") == 0 || strcmp(value, "off") == 0)
+      trace.setEnabled(strcmp(value, "on") == 0);
+    else if (strcmp(value, "clear") == 0)
+      trace.clear();
+    else if (strcmp(value, "dump") == 0)
+      traceDumpRequested = true; // not from inside the MQTT callback
+  }
+#endif
+#ifdef DAD_OTA
+  else if (strcmp(key, "/ota") == 0 && (strcmp(value, "delta") == 0 || strcmp(value, "full") == 0))
+  {
+    otaRequested = value[0];
+  }
+#endif
+  else
+  {
+    Serial.printf("Unknown config %s: %s\n", key, value);
+  }
+}
+
+// Sensor values published by the backend for every device of the group
+void OnGroupReading(const char *topic, const uint8_t *payload, unsigned int length, void *context)
+{
+  const char *reading = payloadText(payload, length);
+  if (reading != nullptr)
+    Serial.printf("Group reading: %s\n", reading);
+}
+
+struct MqttRoute
+{
+  const char *filter;
+  TopicHandler handler;
+};
+
+// Every filter is subscribed on connect and routed by mqttRouter
+const MqttRoute MQTT_ROUTES[] = {
+    {MQTT_DEVICE_CHANNEL, OnDeviceCommand},
+    {MQTT_DEVICE_CHANNEL "/actuators/+", OnActuatorCommand},
+    {MQTT_DEVICE_CHANNEL "/config/#", OnConfig},
+    {MQTT_GROUP_CHANNEL, OnGroupReading},
+};
+
+TopicRouter<16, 128> mqttRouter;
+
 // callback a ejecutar cuando se recibe un mensaje
-// en este ejemplo, muestra por serial el mensaje recibido
+// muestra por serial el mensaje recibido y lo pasa a su ruta
 
 void OnMqttReceived(char *topic, byte *payload, unsigned int length)
 {
   Serial.print("Received on ");
   Serial.print(topic);
   Serial.print(": ");
-
-  String content = "";
-  for (size_t i = 0; i < length; i++)
-  {
-    content.concat((char)payload[i]);
-  }
-  Serial.print(content);
+  Serial.write(payload, length);
   Serial.println();
-  mqttmsg=content;
+#ifdef DAD_TRACE
+  trace.mqtt(millis(), topic, payload, length);
+#endif
+  if (mqttRouter.dispatch(topic, payload, length) == 0)
+    Serial.printf("No route for %s\n", topic);
 }
 
 // inicia la comunicacion MQTT
@@ -88,6 +365,11 @@ void InitMqtt()
 {
   mqttClient.setServer(MQTT_BROKER_ADRESS, MQTT_PORT);
   mqttClient.setCallback(OnMqttReceived);
+  for (size_t i = 0; i < sizeof(MQTT_ROUTES) / sizeof(MQTT_ROUTES[0]); i++)
+  {
+    if (!mqttRouter.add(MQTT_ROUTES[i].filter, MQTT_ROUTES[i].handler))
+      Serial.println("Invalid MQTT route " + String(MQTT_ROUTES[i].filter));
+  }
 }
 
 // Setup
@@ -98,7 +380,22 @@ void setup()
   //Serial.print("Connecting to ");
   //Serial.println(STASSID);
   dht.begin();
-  mqttmsg = "";
+  logic.begin(actuator_id, UPLOAD_EVERY);
+#ifdef DAD_BLOCKS
+  block.begin(sensor_id);
+#endif
+#ifdef DAD_TRACE
+  trace.boot(millis(), MQTT_DEVICE_CHANNEL, actuator_id, UPLOAD_EVERY);
+#endif
+  heapMonitor.begin(HEAP_SAMPLE_MS, HEAP_GUARD_BLOCK);
+#ifdef DAD_PEER
+  WiFi.mode(WIFI_STA);
+  wifi_set_channel(PEER_WIFI_CHANNEL);
+  if (!radio.begin())
+    Serial.println("ESP-NOW init failed");
+  peer.begin(sensor_id, MQTT_DEVICE_CHANNEL);
+  Serial.println("Peer node " + WiFi.macAddress());
+#else
   /* Explicitly set the ESP32 to be a WiFi-client, otherwise, it by default,
      would try to act as both a client and an access-point and could cause
      network-issues with your other WiFi-devices on your WiFi-network. */
@@ -109,11 +406,20 @@ void setup()
     delay(500);
     Serial.print(".");
   }
+#ifdef DAD_TLS
+  // Both connections resume their last TLS session, and HTTP keeps its
+  // connection open between requests so most requests need no handshake
+  if (!configureTls(client, "http", TLS_HTTP_HOST, TLS_HTTP_PORT) ||
+      !configureTls(client2, "mqtt", MQTT_BROKER_ADRESS, MQTT_PORT))
+    Serial.println("Invalid TLS_SERVER_KEY");
+  http.setReuse(true);
+#endif
   InitMqtt();
   Serial.println("");
   Serial.println("WiFi connected");
   Serial.println("IP address: ");
   Serial.println(WiFi.localIP());
+#endif
   Serial.println("Setup!");
   // Configure pin modes for actuators (output mode) and sensors (input mode). Pin numbers should be described by GPIO number (https://www.upesy.com/blogs/tutorials/esp32-pinout-reference-gpio-pins-ultimate-guide)
   // For ESP32 WROOM 32D https://uelectronics.com/producto/esp32-38-pines-esp-wroom-32/
@@ -121,48 +427,48 @@ void setup()
   pinMode(actuatorPin, OUTPUT);
   //pinMode(sensorPin, INPUT);
 
+#ifndef DAD_PEER
   // Init and get the time
   timeClient.begin();
+#endif
 }
 
-String response;
-
-String serializeSensorValueBody(int idSensor, long timestamp, float value) //he quitado long timestamp
+// Epoch milliseconds from NTP, the one clock of every timestamp sent to the
+// backend (JSON bodies and blocks alike). 0 until NTP has answered, and
+// nothing is stamped then.
+int64_t epochMs()
 {
-  // StaticJsonObject allocates memory on the stack, it can be
-  // replaced by StaticJsonDocument<200> which allocates in the heap.
-  //
-  StaticJsonDocument<400> doc;
-
-  // Add values in the document
-  //
-  doc["idSensor"] = idSensor;
-  doc["timestamp"] = timestamp;
-  doc["value"] = value;
-  doc["removed"] = false;
+  if (!timeClient.isTimeSet())
+    return 0;
+  return (int64_t)timeClient.getEpochTime() * 1000;
+}
 
-  // Generate the minified JSON and send it to the Serial port.
-  //
-  String output;
-  serializeJson(doc, output);
-  Serial.println(output);
+// Bodies are in cycleArena, for this pass only
+const char *serializeSensorValueBody(int idSensor, int64_t timestamp, centi_t value)
+{
+  // The body itself is built by DadProtocol so the host tools send exactly
+  // the same bytes as the device.
+  const char *output = uploadSensorValueBody(cycleArena, idSensor, timestamp, value);
+  if (output != nullptr)
+    Serial.println(output);
 
   return output;
 }
 
-String serializeActuatorStatusBody(float status, bool statusBinary, int idActuator, long timestamp)
+const char *serializeActuatorStatusBody(centi_t status, bool statusBinary, int idActuator, int64_t timestamp)
 {
-  StaticJsonDocument<200> doc;
-
-  doc["status"] = status;
-  doc["statusBinary"] = statusBinary;
-  doc["idActuator"] = idActuator;
-  doc["timestamp"] = timestamp;
-  doc["removed"] = false;
+  return uploadActuatorStatusBody(cycleArena, status, statusBinary, idActuator, timestamp);
+}
 
-  String output;
-  serializeJson(doc, output);
-  return output;
+// url and body of a request, or false with a log line if the arena had no
+// room for them; a body that is not from the arena is left out
+bool requestFits(const char *what, const char *url, const char *body = "")
+{
+  if (url != nullptr && body != nullptr)
+    return true;
+  Serial.printf("No room in cycleArena (%u of %u bytes used), %s not sent\n", (unsigned)cycleArena.used(),
+                (unsigned)cycleArena.size(), what);
+  return false;
 }
 
 String serializeDeviceBody(String deviceSerialId, String name, String mqttChannel, int idGroup)
@@ -355,6 +661,12 @@ void deserializeActuatorsFromDevice(int httpResponseCode)
   }
 }
 
+// The start of the response body in cycleArena, see uploadResponse
+const char *readResponse()
+{
+  return uploadResponse(cycleArena, http.getStream(), http.getSize());
+}
+
 void test_response(int httpResponseCode)
 {
   //delay(test_delay);
@@ -362,8 +674,12 @@ void test_response(int httpResponseCode)
   {
     Serial.print("HTTP Response code: ");
     Serial.println(httpResponseCode);
-    String payload = http.getString();
-    Serial.println(payload);
+    const char *payload;
+    {
+      ProfileScope scope(PHASE_HTTP_READ);
+      payload = readResponse();
+    }
+    Serial.println(payload != nullptr ? payload : "(no room for the response)");
   }
   else
   {
@@ -416,17 +732,19 @@ void GET_tests()
 
 void POST_tests()
 {
-  /* String actuator_states_body = serializeActuatorStatusBody(random(2000, 4000) / 100, true, 1, millis());
+  /* String actuator_states_body = serializeActuatorStatusBody(random(2000, 4000), true, 1, millis());
   describe("Test POST with actuator state");
   String serverPath = serverName + "api/actuator_states";
   http.begin(client, serverPath.c_str());
   test_response(http.POST(actuator_states_body)); */
 
-  String sensor_value_body = serializeSensorValueBody(72, millis(), random(2000, 4000) / 100);
+  const char *sensor_value_body = serializeSensorValueBody(72, epochMs(), random(2000, 4000));
+  const char *url = serverUrl(DAD_PATH_SENSOR_VALUES);
   describe("Test POST with sensor value");
-  String serverPath = serverName + "api/sensor_values";
-  http.begin(client, serverPath.c_str());
-  test_response(http.POST(sensor_value_body));
+  if (!requestFits("test value", url, sensor_value_body))
+    return;
+  http.begin(client, url);
+  test_response(http.POST((const uint8_t *)sensor_value_body, strlen(sensor_value_body)));
 
   // String device_body = serializeDeviceBody(String(DEVICE_ID), ("Name_" + String(DEVICE_ID)).c_str(), ("mqtt_" + String(DEVICE_ID)).c_str(), 12);
   // describe("Test POST with path and body and response");
@@ -439,23 +757,222 @@ void POST_tests()
 void POST_null(){
   test_response(http.POST(""));
 }
-void POST_sv(float valor){
-  String sensor_value_body2 = serializeSensorValueBody(sensor_id, millis(), valor);
+void POST_sv(centi_t valor){
+  int64_t now = epochMs();
+  if (now == 0)
+  {
+    Serial.println("No NTP time yet, reading not sent");
+    return;
+  }
+  const char *sensor_value_body2 = serializeSensorValueBody(sensor_id, now, valor);
+  const char *url = serverUrl(DAD_PATH_SENSOR_VALUES);
   describe("POST SENSOR VALUES");
-  String serverPath2 = serverName + "api/sensor_values";
-  http.begin(client, serverPath2.c_str());
-  test_response(http.POST(sensor_value_body2));
+  if (!requestFits("reading", url, sensor_value_body2))
+    return;
+  http.begin(client, url);
+  uint32_t start = millis();
+  int httpResponseCode;
+  {
+    ProfileScope scope(PHASE_HTTP_POST);
+    httpResponseCode = http.POST((const uint8_t *)sensor_value_body2, strlen(sensor_value_body2));
+  }
+#ifdef DAD_TRACE
+  trace.http(millis(), TRACE_PATH_SENSOR_VALUES, httpResponseCode, millis() - start);
+#endif
+  test_response(httpResponseCode);
   //http.POST("{\'ejemplo\': \'hola\'}");
 }
 
+#ifdef DAD_BLOCKS
+// Returns true if the backend stored the block
+bool POST_block()
+{
+  describe("POST SENSOR VALUE BLOCK");
+  const char *url = serverUrl(DAD_PATH_SENSOR_VALUE_BLOCKS);
+  if (!requestFits("block", url))
+    return false;
+  http.begin(client, url);
+  http.addHeader("Content-Type", "application/octet-stream");
+  uint32_t start = millis();
+  int httpResponseCode;
+  {
+    ProfileScope scope(PHASE_HTTP_POST);
+    httpResponseCode = http.POST(block.data(), block.length());
+  }
+#ifdef DAD_TRACE
+  trace.http(millis(), TRACE_PATH_SENSOR_VALUES, httpResponseCode, millis() - start);
+#endif
+  Serial.printf("%u samples in %u bytes\n", (unsigned)block.count(), (unsigned)block.length());
+  test_response(httpResponseCode);
+  return httpResponseCode == 201;
+}
+
+void record_sv(centi_t valor)
+{
+  int64_t now = epochMs();
+  if (now == 0)
+  {
+    Serial.println("No NTP time yet, reading not recorded");
+    return;
+  }
+  if (!block.append(now, valor))
+  {
+    // Full because the backend has been unreachable: keep the newest samples
+    Serial.printf("Block full, dropping %u samples\n", (unsigned)block.count());
+    block.begin(sensor_id);
+    block.append(now, valor);
+  }
+  if ((block.count() >= BLOCK_SAMPLES || block.nearlyFull()) && POST_block())
+    block.begin(sensor_id);
+}
+
+void printBlock()
+{
+  TimeSeriesReader reader(block.data(), block.length());
+  int64_t timestamp;
+  centi_t value;
+  char text[CENTI_TEXT_SIZE];
+  Serial.printf("Sensor %u, %u samples, %u bytes\n", (unsigned)reader.idSensor(), (unsigned)reader.count(),
+                (unsigned)block.length());
+  while (reader.next(&timestamp, &value))
+  {
+    formatCenti(text, sizeof(text), value);
+    Serial.printf("%lu %s\n", (unsigned long)(timestamp / 1000), text);
+  }
+}
+#endif
+
 void POST_actuator(bool status){
-  String sensor_value_body2 = serializeActuatorStatusBody(random(5,30), status, actuator_id, millis());
+  int64_t now = epochMs();
+  if (now == 0)
+  {
+    Serial.println("No NTP time yet, actuator status not sent");
+    return;
+  }
+  const char *sensor_value_body2 = serializeActuatorStatusBody(random(5,30) * 100, status, actuator_id, now);
+  const char *url = serverUrl(DAD_PATH_ACTUATOR_STATES);
   describe("POST ACTUATOR STATUS");
-  String serverPath2 = serverName + "api/actuator_states";
-  http.begin(client, serverPath2.c_str());
-  test_response(http.POST(sensor_value_body2));
+  if (!requestFits("actuator status", url, sensor_value_body2))
+    return;
+  http.begin(client, url);
+  uint32_t start = millis();
+  int httpResponseCode;
+  {
+    ProfileScope scope(PHASE_HTTP_POST);
+    httpResponseCode = http.POST((const uint8_t *)sensor_value_body2, strlen(sensor_value_body2));
+  }
+#ifdef DAD_TRACE
+  trace.http(millis(), TRACE_PATH_ACTUATOR_STATES, httpResponseCode, millis() - start);
+#endif
+  test_response(httpResponseCode);
   //http.POST("{\'ejemplo\': \'hola\'}");
 }
+
+#ifdef DAD_TRACE
+// Hex between TRACE BEGIN / TRACE END, tools/trace_replay reads it from a
+// capture of the serial monitor
+void dumpTraceSerial()
+{
+  uint8_t chunk[32];
+  size_t n;
+  Serial.printf("TRACE BEGIN %u\n", (unsigned)trace.dumpSize());
+  for (size_t offset = 0; (n = trace.dump(offset, chunk, sizeof(chunk))) > 0; offset += n)
+  {
+    for (size_t i = 0; i < n; i++)
+      Serial.printf("%02x", chunk[i]);
+    Serial.println();
+  }
+  Serial.println("TRACE END");
+}
+
+// Raw chunks in order on MQTT_DEVICE_CHANNEL/trace, then an empty message:
+// mosquitto_sub -t mqttChannelDevice5/trace -N -C <chunks + 1> > node.trace
+void dumpTraceMqtt()
+{
+  uint8_t chunk[128]; // fits PubSubClient's default 256 byte packet
+  size_t n;
+  for (size_t offset = 0; (n = trace.dump(offset, chunk, sizeof(chunk))) > 0; offset += n)
+  {
+    if (!mqttClient.publish(MQTT_DEVICE_CHANNEL "/trace", chunk, n))
+      return;
+  }
+  mqttClient.publish(MQTT_DEVICE_CHANNEL "/trace", "");
+}
+#endif
+
+// Counts what is printed to it
+class PrintLength : public Print
+{
+public:
+  size_t length = 0;
+  size_t write(uint8_t) override
+  {
+    length++;
+    return 1;
+  }
+};
+
+// The text dump as one message on MQTT_DEVICE_CHANNEL/profile. The length
+// beginPublish() announces must be exactly what follows, or the broker reads
+// the rest of the stream out of step: both passes write the same paused
+// histogram under the same snapshot.
+void dumpProfileMqtt()
+{
+  profilerPause();
+  ProfileSnapshot snapshot = profilerSnapshot();
+  PrintLength measure;
+  profilerDump(measure, snapshot, PHASE_NAMES, PHASE_COUNT);
+  if (mqttClient.beginPublish(MQTT_DEVICE_CHANNEL "/profile", measure.length, false))
+  {
+    profilerDump(mqttClient, snapshot, PHASE_NAMES, PHASE_COUNT);
+    mqttClient.endPublish();
+  }
+  profilerResume();
+}
+
+// Single character commands on the serial port
+void HandleSerial()
+{
+  if (Serial.available() == 0)
+    return;
+  switch (Serial.read())
+  {
+  case 'P':
+    if (profilerRunning())
+      profilerStop();
+    else
+      profilerStart(PROFILE_HZ);
+    Serial.println(profilerRunning() ? "Profiler on" : "Profiler off");
+    break;
+  case 'p':
+    profilerDump(Serial, PHASE_NAMES, PHASE_COUNT);
+    break;
+#ifdef DAD_TRACE
+  case 't':
+    dumpTraceSerial();
+    break;
+#endif
+#ifdef DAD_BLOCKS
+  case 'b':
+    printBlock();
+    break;
+#endif
+  case 'h':
+  {
+    char line[160];
+    heapMonitor.format(line, sizeof(line));
+    Serial.println(line);
+    Serial.printf("arena: %u of %u bytes at most, %u failures over %u passes\n", (unsigned)cycleArena.highWater(),
+                  (unsigned)cycleArena.size(), (unsigned)cycleArena.failures(), (unsigned)cycleArena.cycles());
+    break;
+  }
+#ifdef DAD_OTA
+  case 'o':
+    Serial.printf("Image %08x, %u bytes\n", (unsigned)ota.imageCrc(), (unsigned)ESP.getSketchSize());
+    break;
+#endif
+  }
+}
 // conecta o reconecta al MQTT
 // consigue conectar -> suscribe a topic y publica un mensaje
 // no -> espera 5 segundos
@@ -464,7 +981,8 @@ void ConnectMqtt()
   Serial.print("Starting MQTT connection...");
   if (mqttClient.connect(MQTT_CLIENT_NAME))
   {
-    mqttClient.subscribe(MQTT_CHANNEL);
+    for (size_t i = 0; i < sizeof(MQTT_ROUTES) / sizeof(MQTT_ROUTES[0]); i++)
+      mqttClient.subscribe(MQTT_ROUTES[i].filter);
     //mqttClient.publish(MQTT_CHANNEL, "connected");
     Serial.println("Conectado!");
   }
@@ -491,47 +1009,213 @@ void HandleMqtt()
   mqttClient.loop();
 }
 
+#ifdef DAD_OTA
+void runOta(bool full)
+{
+#ifdef DAD_TLS
+  // A session of its own, so the HTTP and MQTT ones are kept
+  SecureTransport otaClient;
+  if (!configureTls(otaClient, "ota", TLS_HTTP_HOST, TLS_OTA_PORT))
+  {
+    Serial.println("Invalid TLS_SERVER_KEY");
+    return;
+  }
+#else
+  WiFiClient otaClient;
+#endif
+  DeltaOtaResult result = OTA_NO_UPDATE;
+  char line[160];
+  if (!full)
+  {
+    result = ota.updateDelta(otaClient, OTA_SERVER);
+    ota.formatStats(line, sizeof(line));
+    Serial.println(line);
+    mqttClient.publish(MQTT_DEVICE_CHANNEL "/ota", line);
+  }
+  if (result != OTA_UPDATED)
+  {
+    result = ota.updateFull(otaClient, OTA_SERVER);
+    ota.formatStats(line, sizeof(line));
+    Serial.println(line);
+    mqttClient.publish(MQTT_DEVICE_CHANNEL "/ota", line);
+  }
+  if (result == OTA_UPDATED)
+  {
+    mqttClient.disconnect(); // sends what was published
+    ESP.restart();
+  }
+}
+#endif
 
-
+#ifdef DAD_PEER
+// Takes the gateway's answers and commands, and sends HELLO or the readings
+// not acknowledged yet every PEER_RESEND_MS
+void HandlePeer()
+{
+  uint8_t mac[PEER_MAC_SIZE];
+  uint8_t frame[PEER_FRAME_SIZE];
+  size_t length;
+  PeerCommand command;
+  while (radio.receive(mac, frame, &length))
+  {
+    if (!peer.onFrame(mac, frame, length, &command))
+      continue;
+    if (command.idActuator == 0)
+    {
+      rememberCommand(command.payload, command.length);
+      logic.onCommand(command.payload, command.length);
+    }
+    else
+    {
+      if (command.idActuator == actuator_id)
+        rememberCommand(command.payload, command.length);
+      logic.onActuatorCommand(command.idActuator, command.payload, command.length);
+    }
+  }
+  if (millis() - lastPeerSend < PEER_RESEND_MS)
+    return;
+  length = peer.frame(frame, sizeof(frame), millis());
+  if (length > 0)
+  {
+    lastPeerSend = millis();
+    radio.send(peer.destination(), frame, length);
+  }
+}
+#endif
 
 // Run the tests!
 void loop()
 {
+#ifdef DAD_TRACE
+  uint32_t passStart = millis();
+  trace.pass();
+#endif
+#ifndef DAD_PEER
   // Update current time using NTP protocol
-  timeClient.update();
-  float valor = dht.readTemperature();
+  {
+    ProfileScope scope(PHASE_NTP);
+    timeClient.update();
+  }
+#endif
+  // The only float operation left: the DHT library hands out a float, from
+  // here on the reading stays in hundredths of a degree
+  centi_t reading;
+  {
+    ProfileScope scope(PHASE_DHT);
+    reading = centiFromFloat(dht.readTemperature());
+  }
+#ifdef DAD_TRACE
+  if (reading != traceLastReading)
+  {
+    trace.reading(millis(), reading);
+    traceLastReading = reading;
+  }
+#endif
   //POST_tests();
   //GET_tests();
   //POST_null();
-  if(contador == 10000){
+  NodeDecision decision = logic.pass(reading);
+  if (decision.upload)
+  {
+#ifdef DAD_TRACE
+    trace.upload(millis(), decision.value);
+    trace.relay(millis(), decision.relay);
+#endif
 
-  POST_sv(valor);
+  if (decision.value != CENTI_INVALID)
+  {
+#if defined(DAD_PEER)
+    peer.add(decision.value, millis());
+    lastPeerSend = millis() - PEER_RESEND_MS; // send it now
+#elif defined(DAD_BLOCKS)
+    record_sv(decision.value);
+#else
+    POST_sv(decision.value);
+#endif
+  }
   
   // Reads analog sensor value and print it by serial monitor
 
-  if (mqttmsg == "1")
+  if (decision.relay == RELAY_ON)
     {
       digitalWrite(actuatorPin, HIGH);
       Serial.println("Digital sensor value : ON");
+#ifndef DAD_PEER
       POST_actuator(true);
+#endif
     }
-    else if (mqttmsg == "0")
+    else if (decision.relay == RELAY_OFF)
     {
       digitalWrite(actuatorPin, LOW);
       Serial.println("Digital sensor value : OFF");
+#ifndef DAD_PEER
       POST_actuator(false);
+#endif
     } else{
-      Serial.println("NADA " + mqttmsg);
+      Serial.printf("NADA %s\n", mqttmsg);
     }
-    contador=0;
+#ifdef DAD_TLS
+    client.printStats(Serial, "http");
+    client2.printStats(Serial, "mqtt");
+#endif
   }
-  contador++;
   //UNA VEZ TENEMOS LOS DATOS, ¿LOS SUBIMOS A LA BASE DE DATOS? ¿ESPERAMOS A RECIBIR EL DATO DE LA BBDD, O ACTUAMOS Y LUEGO SUBIMOS?
 
   
   // Reads digital sensor value and print ON or OFF by serial monitor depending on the sensor status (binary)
 
 
+  {
+    ProfileScope scope(PHASE_MQTT);
+#ifdef DAD_PEER
+    HandlePeer();
+#else
     HandleMqtt();
-  
-}
\ No newline at end of file
+#endif
+  }
+  HandleSerial();
+  if (profileDumpRequested)
+  {
+    dumpProfileMqtt();
+    profileDumpRequested = false;
+  }
+
+#ifdef DAD_OTA
+  if (otaRequested != 0)
+  {
+    bool full = otaRequested == 'f';
+    otaRequested = 0;
+    runOta(full);
+  }
+#endif
+
+#ifdef DAD_TRACE
+  if (traceDumpRequested)
+  {
+    dumpTraceMqtt();
+    traceDumpRequested = false;
+  }
+  uint32_t passMs = millis() - passStart;
+  if (passMs >= TRACE_STALL_MS)
+    trace.stall(millis(), passMs);
+#endif
+
+  // Nothing of this pass is used past here
+  cycleArena.reset();
+  if (heapMonitor.poll(millis(), ESP.getFreeHeap(), ESP.getMaxFreeBlockSize()) && heapMonitor.belowGuard())
+  {
+    char line[160];
+    heapMonitor.format(line, sizeof(line));
+    Serial.println(line);
+#ifndef DAD_PEER
+    mqttClient.publish(MQTT_DEVICE_CHANNEL "/heap", line);
+#endif
+#ifdef DAD_HEAP_GUARD
+    Serial.println("Heap too fragmented, restarting");
+#ifndef DAD_PEER
+    mqttClient.disconnect(); // sends what was published
+#endif
+    ESP.restart();
+#endif
+  }
+}
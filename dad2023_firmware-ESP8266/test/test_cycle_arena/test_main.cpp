@@ -0,0 +1,420 @@
+// CycleArena, and a soak of the loop pass of src/main.cpp through the same
+// lib/UploadCycle calls: millions of passes of URLs, bodies, responses and
+// an MQTT payload out of the arena. On the host every operator new of the
+// test comes from a first-fit heap the size of what a node has free, so the
+// soak reads free bytes and the largest free block as the node does, and
+// shows the pass leaves the heap alone where the same pass with strings
+// allocates a few times each.
+//
+// pio test -e native -f test_cycle_arena
+
+#include <CycleArena.h>
+#include <DadProtocol.h>
+#include <HeapMonitor.h>
+#include <UploadCycle.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#ifndef ARDUINO
+#include <new>
+#include <string>
+
+#define SIM_HEAP_SIZE 32768 // about what the sketch leaves free on an ESP8266
+
+// Block header, followed by size bytes; sizes stay multiples of 16 so every
+// block is aligned for any type
+struct alignas(16) SimBlock
+{
+  uint32_t size;
+  uint32_t used;
+};
+
+alignas(16) static uint8_t simHeap[SIM_HEAP_SIZE];
+static bool simReady = false;
+static uint64_t heapAllocations = 0;
+static uint32_t heapInUse = 0; // bytes of the blocks handed out, headers included
+static uint32_t heapPeak = 0;
+
+static SimBlock *simFirst()
+{
+  if (!simReady)
+  {
+    SimBlock *block = (SimBlock *)simHeap;
+    block->size = SIM_HEAP_SIZE - sizeof(SimBlock);
+    block->used = 0;
+    simReady = true;
+  }
+  return (SimBlock *)simHeap;
+}
+
+static SimBlock *simNext(SimBlock *block)
+{
+  SimBlock *next = (SimBlock *)((uint8_t *)(block + 1) + block->size);
+  return (uint8_t *)next < simHeap + SIM_HEAP_SIZE ? next : nullptr;
+}
+
+static void *simAlloc(size_t size)
+{
+  size = (size + 15) & ~(size_t)15;
+  for (SimBlock *block = simFirst(); block != nullptr; block = simNext(block))
+  {
+    if (block->used || block->size < size)
+      continue;
+    if (block->size >= size + 2 * sizeof(SimBlock))
+    {
+      SimBlock *rest = (SimBlock *)((uint8_t *)(block + 1) + size);
+      rest->size = block->size - size - sizeof(SimBlock);
+      rest->used = 0;
+      block->size = size;
+    }
+    block->used = 1;
+    heapInUse += sizeof(SimBlock) + block->size;
+    if (heapInUse > heapPeak)
+      heapPeak = heapInUse;
+    return block + 1;
+  }
+  return nullptr;
+}
+
+static void simFree(void *p)
+{
+  if (p == nullptr)
+    return;
+  ((SimBlock *)p - 1)->used = 0;
+  heapInUse -= sizeof(SimBlock) + ((SimBlock *)p - 1)->size;
+  for (SimBlock *block = simFirst(); block != nullptr; block = simNext(block))
+  {
+    SimBlock *next;
+    while (!block->used && (next = simNext(block)) != nullptr && !next->used)
+      block->size += sizeof(SimBlock) + next->size;
+  }
+}
+
+// ESP.getFreeHeap() and ESP.getMaxFreeBlockSize() of the simulated heap
+static void readHeap(uint32_t *freeBytes, uint32_t *largestBlock)
+{
+  *freeBytes = 0;
+  *largestBlock = 0;
+  for (SimBlock *block = simFirst(); block != nullptr; block = simNext(block))
+  {
+    if (block->used)
+      continue;
+    *freeBytes += block->size;
+    if (block->size > *largestBlock)
+      *largestBlock = block->size;
+  }
+}
+
+void *operator new(size_t size)
+{
+  heapAllocations++;
+  void *p = simAlloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  simFree(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  simFree(p);
+}
+
+#define SOAK_CYCLES 2000000
+#else
+#include <Arduino.h>
+
+static void readHeap(uint32_t *freeBytes, uint32_t *largestBlock)
+{
+  *freeBytes = ESP.getFreeHeap();
+  *largestBlock = ESP.getMaxFreeBlockSize();
+}
+
+#define SOAK_CYCLES 20000
+#endif
+
+#define ARENA_SIZE UPLOAD_ARENA_SIZE // what main.cpp gives it
+#define HEAP_SAMPLE_CYCLES 10000     // a heap sample every this many passes
+#define WARM_CYCLES (64 * 97)        // every payload length with every response length
+
+alignas(CYCLE_ARENA_ALIGN) static uint8_t buffer[ARENA_SIZE];
+static const char *SERVER = "http://192.168.43.195:8080/";
+static const uint8_t PAYLOAD[UPLOAD_PAYLOAD_MAX + 1] = {'1'};
+
+// Stands in for the WiFiClient HTTPClient reads a response body from: left
+// bytes to come, of which arrived are there already
+struct FakeBody
+{
+  size_t left;
+  size_t arrived;
+  bool stopped;
+
+  size_t available() { return arrived; }
+
+  size_t readBytes(char *out, size_t length)
+  {
+    length = length < left ? length : left;
+    memset(out, 'x', length);
+    left -= length;
+    arrived = arrived > length ? arrived - length : 0;
+    return length;
+  }
+
+  void stop() { stopped = true; }
+};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_allocations_are_aligned_and_bounded(void)
+{
+  CycleArena arena(buffer, 64);
+  uint8_t *a = (uint8_t *)arena.alloc(3);
+  uint8_t *b = (uint8_t *)arena.alloc(8);
+  TEST_ASSERT_TRUE(a == buffer);
+  TEST_ASSERT_TRUE(b == buffer + CYCLE_ARENA_ALIGN);
+  TEST_ASSERT_EQUAL(12, arena.used());
+
+  TEST_ASSERT_NULL(arena.alloc(53)); // 52 left
+  TEST_ASSERT_EQUAL(1, arena.failures());
+  TEST_ASSERT_EQUAL(12, arena.used());
+  TEST_ASSERT_NOT_NULL(arena.alloc(52));
+  TEST_ASSERT_EQUAL(0, arena.left());
+  TEST_ASSERT_NULL(arena.alloc(1));
+}
+
+void test_format_writes_in_place(void)
+{
+  CycleArena arena(buffer, 32);
+  arena.alloc(1);
+  char *url = arena.format("%s%d", "api/devices/", 124);
+  TEST_ASSERT_TRUE((uint8_t *)url == buffer + CYCLE_ARENA_ALIGN);
+  TEST_ASSERT_EQUAL_STRING("api/devices/124", url);
+  TEST_ASSERT_EQUAL(CYCLE_ARENA_ALIGN + 16, arena.used());
+
+  // 12 left: does not fit with its terminator, and takes nothing
+  TEST_ASSERT_NULL(arena.format("%s", "twelve chars"));
+  TEST_ASSERT_EQUAL(CYCLE_ARENA_ALIGN + 16, arena.used());
+  TEST_ASSERT_EQUAL_STRING("eleven char", arena.copy("eleven chars", 11));
+  TEST_ASSERT_EQUAL_STRING("api/devices/124", url);
+}
+
+void test_reset_frees_the_cycle(void)
+{
+  CycleArena arena(buffer, sizeof(buffer));
+  arena.alloc(100);
+  arena.alloc(200);
+  arena.reset();
+  TEST_ASSERT_EQUAL(0, arena.used());
+  TEST_ASSERT_EQUAL(300, arena.highWater());
+  TEST_ASSERT_TRUE(arena.alloc(10) == buffer);
+  arena.reset();
+  TEST_ASSERT_EQUAL(300, arena.highWater());
+  TEST_ASSERT_EQUAL(2, arena.cycles());
+}
+
+// One request of a pass: its URL, its body and the response, whose length
+// varies with what the backend echoes
+static bool request(CycleArena &arena, const char *server, const char *path, const char *body, size_t response)
+{
+  const char *url = uploadUrl(arena, server, path);
+  FakeBody stream = {response, response, false};
+  const char *answer = url != nullptr && body != nullptr ? uploadResponse(arena, stream, (int)response) : nullptr;
+  return answer != nullptr && stream.left == 0 && !stream.stopped;
+}
+
+// What a pass of main.cpp takes from the arena at most: an MQTT payload, a
+// sensor value and an actuator status
+static bool uploadPass(CycleArena &arena, const char *server, uint32_t i, size_t response, size_t payload)
+{
+  bool ok = uploadPayload(arena, PAYLOAD, payload) != nullptr;
+  const char *value = uploadSensorValueBody(arena, 72, 1700000000000LL + i * 1000LL, (centi_t)(2000 + i % 700));
+  ok &= request(arena, server, DAD_PATH_SENSOR_VALUES, value, response);
+  const char *status = uploadActuatorStatusBody(arena, 2500, i % 2 == 0, 3, 1700000000000LL + i * 1000LL);
+  ok &= request(arena, server, DAD_PATH_ACTUATOR_STATES, status, response);
+  arena.reset();
+  return ok;
+}
+
+void test_worst_pass_fits_exactly(void)
+{
+  // The longest server a URL may have, with the longest path of a pass
+  char server[UPLOAD_URL_MAX];
+  size_t length = UPLOAD_URL_MAX - 1 - strlen(DAD_PATH_ACTUATOR_STATES);
+  memset(server, 'h', length);
+  server[length] = 0;
+
+  CycleArena arena(buffer, ARENA_SIZE);
+  TEST_ASSERT_TRUE(uploadPass(arena, server, 0, 4000, UPLOAD_PAYLOAD_MAX));
+  TEST_ASSERT_EQUAL(0, arena.failures());
+  TEST_ASSERT_LESS_OR_EQUAL(ARENA_SIZE, arena.highWater());
+
+  // No slack but the alignment of the last response
+  CycleArena smaller(buffer, ARENA_SIZE - CYCLE_ARENA_ALIGN);
+  TEST_ASSERT_FALSE(uploadPass(smaller, server, 0, 4000, UPLOAD_PAYLOAD_MAX));
+  TEST_ASSERT_EQUAL(1, smaller.failures());
+}
+
+void test_oversized_requests_are_refused(void)
+{
+  CycleArena arena(buffer, ARENA_SIZE);
+  char server[UPLOAD_URL_MAX];
+  memset(server, 'h', sizeof(server) - 1);
+  server[sizeof(server) - 1] = 0;
+  TEST_ASSERT_NOT_NULL(uploadUrl(arena, server, ""));
+  arena.reset();
+  TEST_ASSERT_NULL(uploadUrl(arena, server, "/"));
+  TEST_ASSERT_NULL(uploadPayload(arena, PAYLOAD, UPLOAD_PAYLOAD_MAX + 1));
+  TEST_ASSERT_EQUAL(0, arena.used());
+}
+
+void test_response_keeps_the_connection_only_when_read_to_its_end(void)
+{
+  CycleArena arena(buffer, ARENA_SIZE);
+
+  // Its first UPLOAD_RESPONSE_MAX bytes are kept and the rest dropped
+  FakeBody whole = {1000, 1000, false};
+  const char *answer = uploadResponse(arena, whole, 1000);
+  TEST_ASSERT_NOT_NULL(answer);
+  TEST_ASSERT_EQUAL(UPLOAD_RESPONSE_MAX, strlen(answer));
+  TEST_ASSERT_EQUAL(0, whole.left);
+  TEST_ASSERT_FALSE(whole.stopped);
+
+  // Chunked or up to the close: what has arrived, then closed
+  FakeBody unknown = {1000, 40, false};
+  answer = uploadResponse(arena, unknown, -1);
+  TEST_ASSERT_EQUAL(40, strlen(answer));
+  TEST_ASSERT_TRUE(unknown.stopped);
+
+  // The server stopped sending before Content-Length
+  FakeBody cut = {300, 300, false};
+  answer = uploadResponse(arena, cut, 500);
+  TEST_ASSERT_EQUAL(UPLOAD_RESPONSE_MAX, strlen(answer));
+  TEST_ASSERT_TRUE(cut.stopped);
+
+  // No room to read it into
+  CycleArena full(buffer, 8);
+  FakeBody unread = {100, 100, false};
+  TEST_ASSERT_NULL(uploadResponse(full, unread, 100));
+  TEST_ASSERT_TRUE(unread.stopped);
+}
+
+#ifndef ARDUINO
+// The same pass as main.cpp wrote it before, with String's equivalent
+static size_t stringPass(uint32_t i)
+{
+  std::string payload((const char *)PAYLOAD, i % 64);
+  size_t total = payload.size();
+  const char *paths[] = {DAD_PATH_SENSOR_VALUES, DAD_PATH_ACTUATOR_STATES};
+  for (const char *path : paths)
+  {
+    std::string url = std::string(SERVER) + path;
+    char output[DAD_BODY_SIZE];
+    writeSensorValueBodyCenti(output, sizeof(output), 72, 1700000000000LL + i * 1000LL, (centi_t)(2000 + i % 700));
+    std::string body(output);
+    std::string response(60 + i % 97, 'x');
+    std::string line = "POST " + url + ": " + std::to_string(201) + ", " + std::to_string(response.size()) + " bytes";
+    total += line.size() + body.size();
+  }
+  return total;
+}
+#endif
+
+void test_soak_keeps_the_heap_flat(void)
+{
+  CycleArena arena(buffer, sizeof(buffer));
+  for (uint32_t i = 0; i < WARM_CYCLES; i++)
+    TEST_ASSERT_TRUE(uploadPass(arena, SERVER, i, 60 + i % 97, i % 64));
+  size_t warmHighWater = arena.highWater();
+
+  // A sample a minute, as on the node
+  HeapMonitor heap;
+  heap.begin(60000, 0);
+  uint32_t freeBytes, largestBlock;
+  readHeap(&freeBytes, &largestBlock);
+  uint32_t startFree = freeBytes;
+  uint32_t startLargest = largestBlock;
+#ifndef ARDUINO
+  uint64_t before = heapAllocations;
+#endif
+  bool ok = true;
+  for (uint32_t i = WARM_CYCLES; i < SOAK_CYCLES; i++)
+  {
+    ok &= uploadPass(arena, SERVER, i, 60 + i % 97, i % 64);
+    if (i % HEAP_SAMPLE_CYCLES == 0)
+    {
+      readHeap(&freeBytes, &largestBlock);
+      heap.poll(i / HEAP_SAMPLE_CYCLES * 60000, freeBytes, largestBlock);
+    }
+  }
+  TEST_ASSERT_TRUE(ok);
+  TEST_ASSERT_EQUAL(0, arena.failures());
+  TEST_ASSERT_EQUAL(0, arena.used());
+  TEST_ASSERT_EQUAL(SOAK_CYCLES, arena.cycles());
+  // The largest pass is seen early and never grows
+  TEST_ASSERT_EQUAL(warmHighWater, arena.highWater());
+  TEST_ASSERT_LESS_OR_EQUAL(ARENA_SIZE, arena.highWater());
+  // Nothing of the heap is taken or cut up over the soak
+  TEST_ASSERT_EQUAL(startFree, heap.last().freeBytes);
+  TEST_ASSERT_EQUAL(startLargest, heap.minLargestBlock());
+
+  char line[200];
+  heap.format(line, sizeof(line));
+  TEST_MESSAGE(line);
+#ifndef ARDUINO
+  uint64_t arenaAllocations = heapAllocations - before;
+  TEST_ASSERT_TRUE(arenaAllocations == 0);
+  TEST_ASSERT_EQUAL(0, heapPeak);
+  before = heapAllocations;
+  size_t sink = 0;
+  for (uint32_t i = 0; i < 1000; i++)
+    sink += stringPass(i);
+  TEST_ASSERT_TRUE(sink > 0);
+  snprintf(line, sizeof(line),
+           "%u passes: %llu heap allocations with the arena (%u of %u bytes at most), %.1f per pass with strings",
+           (unsigned)SOAK_CYCLES, (unsigned long long)arenaAllocations, (unsigned)arena.highWater(),
+           (unsigned)ARENA_SIZE, (heapAllocations - before) / 1000.0);
+  TEST_MESSAGE(line);
+  snprintf(line, sizeof(line), "strings take up to %u heap bytes at once in a pass, the arena none",
+           (unsigned)heapPeak);
+#else
+  snprintf(line, sizeof(line), "%u passes, %u of %u arena bytes at most", (unsigned)SOAK_CYCLES,
+           (unsigned)arena.highWater(), (unsigned)ARENA_SIZE);
+#endif
+  TEST_MESSAGE(line);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_allocations_are_aligned_and_bounded);
+  RUN_TEST(test_format_writes_in_place);
+  RUN_TEST(test_reset_frees_the_cycle);
+  RUN_TEST(test_worst_pass_fits_exactly);
+  RUN_TEST(test_oversized_requests_are_refused);
+  RUN_TEST(test_response_keeps_the_connection_only_when_read_to_its_end);
+  RUN_TEST(test_soak_keeps_the_heap_flat);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
@@ -0,0 +1,217 @@
+#include <DeltaPatch.h>
+#include <string.h>
+#include <unity.h>
+
+#define IMAGE_SIZE 3000
+
+static uint8_t source[IMAGE_SIZE];
+static uint8_t target[IMAGE_SIZE + 200];
+static uint32_t targetSize;
+static uint8_t deltaBuffer[2 * IMAGE_SIZE];
+
+// Flash of the running image; remembers the largest read
+class MemorySource : public DeltaSource
+{
+public:
+  size_t largestRead = 0;
+
+  bool read(uint32_t offset, uint8_t *out, size_t length) override
+  {
+    if (offset + length > IMAGE_SIZE)
+      return false;
+    memcpy(out, source + offset, length);
+    if (length > largestRead)
+      largestRead = length;
+    return true;
+  }
+};
+
+// Updater stand-in
+class MemorySink : public DeltaSink
+{
+public:
+  uint8_t image[IMAGE_SIZE + 200];
+  bool begun = false;
+  uint32_t size = 0;
+  uint32_t length = 0;
+  size_t largestWrite = 0;
+
+  bool begin(uint32_t targetSize) override
+  {
+    begun = true;
+    size = targetSize;
+    return targetSize <= sizeof(image);
+  }
+
+  bool write(const uint8_t *data, size_t n) override
+  {
+    if (length + n > size)
+      return false;
+    memcpy(image + length, data, n);
+    length += n;
+    if (n > largestWrite)
+      largestWrite = n;
+    return true;
+  }
+};
+
+static MemorySource memorySource;
+static MemorySink sink;
+static DeltaPatcher patcher;
+
+static uint32_t lcg = 1;
+static uint8_t nextRandom()
+{
+  lcg = lcg * 1103515245 + 12345;
+  return (uint8_t)(lcg >> 16);
+}
+
+// A new build: a few constants changed in place, 100 bytes of new code in the
+// middle, and what follows shifted by it
+static void makeImages()
+{
+  lcg = 1;
+  for (int i = 0; i < IMAGE_SIZE; i++)
+    source[i] = nextRandom();
+  memcpy(target, source, 1000);
+  target[10] ^= 0x40;
+  target[500] += 4;
+  for (int i = 0; i < 100; i++)
+    target[1000 + i] = nextRandom();
+  memcpy(target + 1100, source + 1000, IMAGE_SIZE - 1000);
+  target[1100 + 1500] += 8; // an address past the new code
+  targetSize = IMAGE_SIZE + 100;
+}
+
+static DeltaWriter writeDelta(uint32_t targetCrc)
+{
+  uint8_t diff[IMAGE_SIZE];
+  DeltaWriter writer(deltaBuffer, sizeof(deltaBuffer));
+  writer.header(IMAGE_SIZE, deltaCrc32(0, source, IMAGE_SIZE), targetSize, targetCrc);
+  for (int i = 0; i < 1000; i++)
+    diff[i] = (uint8_t)(target[i] - source[i]);
+  writer.diff(0, diff, 1000);
+  writer.insert(target + 1000, 100);
+  for (int i = 0; i < IMAGE_SIZE - 1000; i++)
+    diff[i] = (uint8_t)(target[1100 + i] - source[1000 + i]);
+  writer.diff(1000, diff, IMAGE_SIZE - 1000);
+  writer.end();
+  TEST_ASSERT_FALSE(writer.overflowed());
+  return writer;
+}
+
+void setUp(void)
+{
+  makeImages();
+  memorySource = MemorySource();
+  sink.begun = false;
+  sink.length = 0;
+  sink.largestWrite = 0;
+  patcher.begin(&memorySource, IMAGE_SIZE, &sink);
+}
+
+void tearDown(void) {}
+
+void test_crc32_is_zlibs(void)
+{
+  TEST_ASSERT_EQUAL_HEX32(0xcbf43926, deltaCrc32(0, (const uint8_t *)"123456789", 9));
+  TEST_ASSERT_EQUAL_HEX32(deltaCrc32(0, (const uint8_t *)"123456789", 9),
+                          deltaCrc32(deltaCrc32(0, (const uint8_t *)"1234", 4), (const uint8_t *)"56789", 5));
+}
+
+void test_delta_rebuilds_the_target(void)
+{
+  DeltaWriter delta = writeDelta(deltaCrc32(0, target, targetSize));
+  // the two diffs cost 9 bytes for their 3 changes
+  TEST_ASSERT_LESS_OR_EQUAL(DELTA_HEADER_SIZE + 100 + 30, delta.length());
+
+  TEST_ASSERT_TRUE(patcher.push(delta.data(), delta.length()));
+  TEST_ASSERT_TRUE(patcher.finish());
+  TEST_ASSERT_EQUAL(DELTA_OK, patcher.error());
+  TEST_ASSERT_EQUAL(targetSize, sink.length);
+  TEST_ASSERT_EQUAL_MEMORY(target, sink.image, targetSize);
+  TEST_ASSERT_LESS_OR_EQUAL(DELTA_WINDOW, memorySource.largestRead);
+  TEST_ASSERT_LESS_OR_EQUAL(DELTA_WINDOW, sink.largestWrite);
+}
+
+void test_delta_arrives_a_byte_at_a_time(void)
+{
+  DeltaWriter delta = writeDelta(deltaCrc32(0, target, targetSize));
+  for (size_t i = 0; i < delta.length(); i++)
+    TEST_ASSERT_TRUE(patcher.push(delta.data() + i, 1));
+  TEST_ASSERT_TRUE(patcher.finish());
+  TEST_ASSERT_EQUAL_MEMORY(target, sink.image, targetSize);
+}
+
+void test_delta_for_another_image_writes_nothing(void)
+{
+  DeltaWriter delta = writeDelta(deltaCrc32(0, target, targetSize));
+  source[2000] ^= 1; // the node runs another build than the delta was made from
+  TEST_ASSERT_FALSE(patcher.push(delta.data(), delta.length()));
+  TEST_ASSERT_EQUAL(DELTA_WRONG_SOURCE, patcher.error());
+  TEST_ASSERT_FALSE(sink.begun);
+  TEST_ASSERT_FALSE(patcher.finish());
+}
+
+void test_wrong_result_is_never_complete(void)
+{
+  DeltaWriter delta = writeDelta(deltaCrc32(0, target, targetSize) ^ 1);
+  TEST_ASSERT_TRUE(patcher.push(delta.data(), delta.length()));
+  TEST_ASSERT_FALSE(patcher.finish());
+  TEST_ASSERT_EQUAL(DELTA_BAD_CRC, patcher.error());
+  // The last window is held back, so the updater refuses to switch images
+  TEST_ASSERT_TRUE(sink.length < targetSize);
+}
+
+void test_truncated_delta_fails(void)
+{
+  DeltaWriter delta = writeDelta(deltaCrc32(0, target, targetSize));
+  TEST_ASSERT_TRUE(patcher.push(delta.data(), delta.length() - 1)); // END is missing
+  TEST_ASSERT_FALSE(patcher.finish());
+  TEST_ASSERT_EQUAL(DELTA_TRUNCATED, patcher.error());
+}
+
+void test_ops_past_the_images_are_refused(void)
+{
+  uint8_t diff[16] = {0};
+  DeltaWriter delta(deltaBuffer, sizeof(deltaBuffer));
+  delta.header(IMAGE_SIZE, deltaCrc32(0, source, IMAGE_SIZE), 16, 0);
+  delta.diff(IMAGE_SIZE - 8, diff, sizeof(diff));
+  TEST_ASSERT_FALSE(patcher.push(delta.data(), delta.length()));
+  TEST_ASSERT_EQUAL(DELTA_MALFORMED, patcher.error());
+
+  patcher.begin(&memorySource, IMAGE_SIZE, &sink);
+  DeltaWriter tooLong(deltaBuffer, sizeof(deltaBuffer));
+  tooLong.header(IMAGE_SIZE, deltaCrc32(0, source, IMAGE_SIZE), 16, 0);
+  tooLong.insert(target, 17);
+  TEST_ASSERT_FALSE(patcher.push(tooLong.data(), tooLong.length()));
+  TEST_ASSERT_EQUAL(DELTA_MALFORMED, patcher.error());
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_crc32_is_zlibs);
+  RUN_TEST(test_delta_rebuilds_the_target);
+  RUN_TEST(test_delta_arrives_a_byte_at_a_time);
+  RUN_TEST(test_delta_for_another_image_writes_nothing);
+  RUN_TEST(test_wrong_result_is_never_complete);
+  RUN_TEST(test_truncated_delta_fails);
+  RUN_TEST(test_ops_past_the_images_are_refused);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
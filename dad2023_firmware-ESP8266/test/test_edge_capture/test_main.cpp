@@ -0,0 +1,185 @@
+#include <EdgeCapture.h>
+#include <unity.h>
+
+#ifndef ARDUINO
+#include <thread>
+#endif
+
+static EdgeRing ring;
+static EdgeCounter counter;
+static EdgeWindow window;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void feed(uint32_t us, uint8_t level)
+{
+  Edge edge = {us, level};
+  counter.feed(edge);
+}
+
+void test_ring_keeps_order_and_drops_when_full(void)
+{
+  static EdgeRing full;
+  Edge edge;
+  TEST_ASSERT_FALSE(full.pop(&edge));
+  for (uint32_t i = 0; i < EDGE_RING_SIZE; i++)
+    TEST_ASSERT_TRUE(full.push(i, i & 1));
+  TEST_ASSERT_FALSE(full.push(999, 1));
+  TEST_ASSERT_EQUAL(1, full.dropped());
+  TEST_ASSERT_EQUAL(EDGE_RING_SIZE, full.size());
+
+  // Wraps around many times
+  for (uint32_t i = 0; i < EDGE_RING_SIZE * 10; i++)
+  {
+    TEST_ASSERT_TRUE(full.pop(&edge));
+    TEST_ASSERT_EQUAL(i, edge.us);
+    TEST_ASSERT_EQUAL(i & 1, edge.level);
+    TEST_ASSERT_TRUE(full.push(i + EDGE_RING_SIZE, (i + EDGE_RING_SIZE) & 1));
+  }
+  TEST_ASSERT_EQUAL(1, full.dropped());
+}
+
+void test_counts_clean_pulses_and_frequency(void)
+{
+  counter.begin(0, 0, 0);
+  // 50 Hz, 25% duty cycle
+  for (uint32_t i = 0; i < 100; i++)
+  {
+    feed(1000 + i * 20000, 1);
+    feed(1000 + i * 20000 + 5000, 0);
+  }
+  counter.take(2000000, &window);
+  TEST_ASSERT_EQUAL(2000000, window.spanUs);
+  TEST_ASSERT_EQUAL(100, window.pulses);
+  TEST_ASSERT_EQUAL(200, window.changes);
+  TEST_ASSERT_EQUAL(0, window.bounces);
+  TEST_ASSERT_EQUAL(500000, window.highUs);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 50.0f, window.hz);
+  TEST_ASSERT_EQUAL(0, window.level);
+}
+
+void test_frequency_spans_windows(void)
+{
+  // One pulse per window still gives a frequency from the previous window's edge
+  counter.begin(0, 0, 0);
+  feed(100000, 1);
+  feed(100100, 0);
+  counter.take(500000, &window);
+  TEST_ASSERT_EQUAL(1, window.pulses);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, window.hz);
+  feed(600000, 1);
+  feed(600100, 0);
+  counter.take(1000000, &window);
+  TEST_ASSERT_EQUAL(1, window.pulses);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 2.0f, window.hz);
+  counter.take(1500000, &window);
+  TEST_ASSERT_EQUAL(0, window.pulses);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, window.hz);
+}
+
+void test_debounce_rejects_contact_bounce(void)
+{
+  counter.begin(0, 0, 5000);
+  // Switch closes at 10 ms and bounces for 2 ms, opens at 100 ms and bounces again
+  uint32_t bounce[] = {10000, 10300, 10500, 11200, 11900};
+  for (size_t i = 0; i < 5; i++)
+    feed(bounce[i], i % 2 == 0);
+  for (size_t i = 0; i < 5; i++)
+    feed(bounce[i] + 90000, i % 2 == 1);
+  counter.take(200000, &window);
+  TEST_ASSERT_EQUAL(1, window.pulses);
+  TEST_ASSERT_EQUAL(2, window.changes);
+  TEST_ASSERT_EQUAL(8, window.bounces);
+  TEST_ASSERT_EQUAL(90000, window.highUs);
+  TEST_ASSERT_EQUAL(0, window.level);
+}
+
+void test_short_pulse_is_not_lost_to_debounce(void)
+{
+  // Ends on the other level inside the lockout: accepted when it expires
+  counter.begin(0, 0, 5000);
+  feed(10000, 1);
+  feed(10500, 0);
+  counter.take(12000, &window);
+  TEST_ASSERT_EQUAL(1, window.level); // still in the lockout
+  counter.take(20000, &window);
+  TEST_ASSERT_EQUAL(0, window.level);
+  TEST_ASSERT_EQUAL(1, window.changes);
+  TEST_ASSERT_EQUAL(3000, window.highUs); // until 15000, the end of the lockout
+}
+
+void test_timestamps_wrap(void)
+{
+  uint32_t start = 0xFFFFFF00u;
+  counter.begin(1, start, 1000);
+  feed(start + 0x80, 0);
+  feed(start + 0x400, 1); // inside the lockout
+  counter.take(start + 0x10000, &window);
+  TEST_ASSERT_EQUAL(0x10000, window.spanUs);
+  TEST_ASSERT_EQUAL(1, window.level);
+  TEST_ASSERT_EQUAL(1, window.pulses);
+  TEST_ASSERT_EQUAL(0x80 + (0x10000 - (0x80 + 1000)), window.highUs);
+}
+
+#ifndef ARDUINO
+// An ISR stand-in pushes while the consumer pops: nothing is lost or reordered
+// beyond what the ring reports as dropped
+void test_concurrent_producer_and_consumer(void)
+{
+  static EdgeRing shared;
+  const uint32_t edges = 2000000;
+  std::thread producer([&]() {
+    for (uint32_t i = 1; i <= edges; i++)
+    {
+      while (!shared.push(i, i & 1))
+        ; // an ISR would drop; here retry so every edge must arrive
+    }
+  });
+  uint32_t expected = 1;
+  Edge edge;
+  while (expected <= edges)
+  {
+    if (shared.pop(&edge))
+    {
+      if (edge.us != expected || edge.level != (expected & 1))
+        break;
+      expected++;
+    }
+  }
+  producer.join();
+  TEST_ASSERT_EQUAL(edges + 1, expected);
+}
+#endif
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_ring_keeps_order_and_drops_when_full);
+  RUN_TEST(test_counts_clean_pulses_and_frequency);
+  RUN_TEST(test_frequency_spans_windows);
+  RUN_TEST(test_debounce_rejects_contact_bounce);
+  RUN_TEST(test_short_pulse_is_not_lost_to_debounce);
+  RUN_TEST(test_timestamps_wrap);
+#ifndef ARDUINO
+  RUN_TEST(test_concurrent_producer_and_consumer);
+#endif
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
@@ -0,0 +1,160 @@
+#include <ArduinoJson.h>
+#include <DadProtocol.h>
+#include <FixedTemp.h>
+#include <math.h>
+#include <string.h>
+#include <unity.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void assertFormat(centi_t value, const char *expected)
+{
+  char text[CENTI_TEXT_SIZE];
+  TEST_ASSERT_EQUAL(strlen(expected), formatCenti(text, sizeof(text), value));
+  TEST_ASSERT_EQUAL_STRING(expected, text);
+}
+
+void test_format_is_exact(void)
+{
+  assertFormat(0, "0");
+  assertFormat(2345, "23.45");
+  assertFormat(2350, "23.5");
+  assertFormat(2300, "23");
+  assertFormat(2305, "23.05");
+  assertFormat(5, "0.05");
+  assertFormat(-5, "-0.05");
+  assertFormat(-1230, "-12.3");
+  assertFormat(INT16_MAX, "327.67");
+  assertFormat(INT16_MIN, "-327.68");
+}
+
+void test_format_reports_short_buffer(void)
+{
+  char text[5];
+  TEST_ASSERT_EQUAL(0, formatCenti(text, sizeof(text), 2345));
+  TEST_ASSERT_EQUAL(4, formatCenti(text, sizeof(text), 2350));
+}
+
+void test_from_float_rounds_to_nearest(void)
+{
+  TEST_ASSERT_EQUAL(2345, centiFromFloat(23.45f));
+  TEST_ASSERT_EQUAL(2346, centiFromFloat(23.456f));
+  TEST_ASSERT_EQUAL(-1230, centiFromFloat(-12.3f));
+  TEST_ASSERT_EQUAL(-1, centiFromFloat(-0.006f));
+  TEST_ASSERT_EQUAL(CENTI_INVALID, centiFromFloat(NAN));
+  TEST_ASSERT_EQUAL(CENTI_INVALID, centiFromFloat(1000.0f));
+}
+
+void test_filter_tracks_and_skips_invalid(void)
+{
+  CentiFilter filter;
+  centiFilterInit(&filter, 2);
+  TEST_ASSERT_EQUAL(CENTI_INVALID, centiFilterUpdate(&filter, CENTI_INVALID));
+  TEST_ASSERT_EQUAL(2000, centiFilterUpdate(&filter, 2000));
+
+  // Step response of a 1/4 EMA: 2000 + 400 * (1 - 0.75^n)
+  TEST_ASSERT_EQUAL(2100, centiFilterUpdate(&filter, 2400));
+  TEST_ASSERT_EQUAL(2175, centiFilterUpdate(&filter, 2400));
+  TEST_ASSERT_EQUAL(2175, centiFilterUpdate(&filter, CENTI_INVALID));
+
+  centi_t out = 0;
+  for (int i = 0; i < 100; i++)
+    out = centiFilterUpdate(&filter, 2400);
+  TEST_ASSERT_EQUAL(2400, out);
+
+  for (int i = 0; i < 100; i++)
+    out = centiFilterUpdate(&filter, -1500);
+  TEST_ASSERT_EQUAL(-1500, out);
+}
+
+void test_threshold_hysteresis(void)
+{
+  bool above = false;
+  above = centiAbove(2750, 2750, 50, above);
+  TEST_ASSERT_FALSE(above);
+  above = centiAbove(2751, 2750, 50, above);
+  TEST_ASSERT_TRUE(above);
+  above = centiAbove(2701, 2750, 50, above);
+  TEST_ASSERT_TRUE(above);
+  above = centiAbove(CENTI_INVALID, 2750, 50, above);
+  TEST_ASSERT_TRUE(above);
+  above = centiAbove(2700, 2750, 50, above);
+  TEST_ASSERT_FALSE(above);
+}
+
+// Every value a DHT22 can report (0.1 C steps from -40 to 80) must reach the
+// backend as the same number, within half the sensor resolution, on the old
+// float path and on the fixed-point path.
+void test_wire_values_match_float_path(void)
+{
+  char floatBody[DAD_BODY_SIZE];
+  char centiBody[DAD_BODY_SIZE];
+
+  for (int tenths = -400; tenths <= 800; tenths++)
+  {
+    float reading = tenths / 10.0f;
+    TEST_ASSERT_NOT_EQUAL(0, writeSensorValueBody(floatBody, sizeof(floatBody), 72, 123456L, reading));
+    TEST_ASSERT_NOT_EQUAL(0, writeSensorValueBodyCenti(centiBody, sizeof(centiBody), 72, 123456L, centiFromFloat(reading)));
+
+    StaticJsonDocument<128> floatDoc;
+    StaticJsonDocument<128> centiDoc;
+    TEST_ASSERT_FALSE(deserializeJson(floatDoc, floatBody));
+    TEST_ASSERT_FALSE(deserializeJson(centiDoc, centiBody));
+
+    TEST_ASSERT_EQUAL(floatDoc["idSensor"].as<int>(), centiDoc["idSensor"].as<int>());
+    TEST_ASSERT_EQUAL(floatDoc["timestamp"].as<long>(), centiDoc["timestamp"].as<long>());
+    TEST_ASSERT_EQUAL(floatDoc["removed"].as<bool>(), centiDoc["removed"].as<bool>());
+    TEST_ASSERT_DOUBLE_WITHIN(0.05, floatDoc["value"].as<double>(), centiDoc["value"].as<double>());
+    TEST_ASSERT_DOUBLE_WITHIN(0.005, tenths / 10.0, centiDoc["value"].as<double>());
+  }
+}
+
+void test_actuator_status_body(void)
+{
+  char body[DAD_BODY_SIZE];
+  writeActuatorStatusBodyCenti(body, sizeof(body), 1500, true, 3, 42L);
+  TEST_ASSERT_EQUAL_STRING("{\"status\":15,\"statusBinary\":true,\"idActuator\":3,\"timestamp\":42,\"removed\":false}", body);
+}
+
+// NTP epoch milliseconds, past the 32 bit long of the ESP8266
+void test_epoch_ms_timestamps(void)
+{
+  char body[DAD_BODY_SIZE];
+  writeSensorValueBodyCenti(body, sizeof(body), 72, 1700000000123LL, 2345);
+  TEST_ASSERT_EQUAL_STRING("{\"idSensor\":72,\"timestamp\":1700000000123,\"value\":23.45,\"removed\":false}", body);
+  writeActuatorStatusBodyCenti(body, sizeof(body), -5, false, 3, -1);
+  TEST_ASSERT_EQUAL_STRING("{\"status\":-0.05,\"statusBinary\":false,\"idActuator\":3,\"timestamp\":-1,\"removed\":false}",
+                           body);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_format_is_exact);
+  RUN_TEST(test_format_reports_short_buffer);
+  RUN_TEST(test_from_float_rounds_to_nearest);
+  RUN_TEST(test_filter_tracks_and_skips_invalid);
+  RUN_TEST(test_threshold_hysteresis);
+  RUN_TEST(test_wire_values_match_float_path);
+  RUN_TEST(test_actuator_status_body);
+  RUN_TEST(test_epoch_ms_timestamps);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
@@ -0,0 +1,152 @@
+// Per-sample processing cost of the float pipeline versus the fixed-point one:
+// acquisition conversion, 1/4 EMA filter, 27.5 C threshold with hysteresis and
+// the JSON body for api/sensor_values.
+//
+// On the board (pio test -e esp12e -f test_fixed_temp_bench) the cost is in
+// CPU cycles from ESP.getCycleCount(); on the host (-e native) it is in ns and
+// only useful to compare against a previous run. The costs are printed, not
+// asserted: on a shared host they vary from run to run.
+
+#include <DadProtocol.h>
+#include <FixedTemp.h>
+#include <stdio.h>
+#include <unity.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define TICK_UNIT "cycles"
+static uint32_t ticks()
+{
+  return ESP.getCycleCount();
+}
+#else
+#include <chrono>
+#define TICK_UNIT "ns"
+static uint32_t ticks()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#endif
+
+#define SAMPLES 256
+#define ROUNDS 8
+
+static float trace[SAMPLES];
+static volatile size_t sink;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Room temperature drifting across the threshold in DHT22 steps (0.1 C)
+static void buildTrace()
+{
+  uint32_t seed = 12345;
+  int tenths = 260;
+  for (int i = 0; i < SAMPLES; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    tenths += (int)((seed >> 16) % 5) - 2;
+    if (tenths < 240)
+      tenths = 240;
+    if (tenths > 310)
+      tenths = 310;
+    trace[i] = tenths / 10.0f;
+  }
+}
+
+static uint32_t runFloatPath()
+{
+  char body[DAD_BODY_SIZE];
+  float filtered = trace[0];
+  bool above = false;
+  uint32_t start = ticks();
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    for (int i = 0; i < SAMPLES; i++)
+    {
+      filtered += (trace[i] - filtered) * 0.25f;
+      above = above ? filtered > 27.0f : filtered > 27.5f;
+      sink += writeSensorValueBody(body, sizeof(body), 72, 1000L * i, filtered) + above;
+    }
+  }
+  return (ticks() - start) / (ROUNDS * SAMPLES);
+}
+
+static uint32_t runFixedPath()
+{
+  char body[DAD_BODY_SIZE];
+  CentiFilter filter;
+  centiFilterInit(&filter, 2);
+  bool above = false;
+  uint32_t start = ticks();
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    for (int i = 0; i < SAMPLES; i++)
+    {
+      centi_t filtered = centiFilterUpdate(&filter, centiFromFloat(trace[i]));
+      above = centiAbove(filtered, 2750, 50, above);
+      sink += writeSensorValueBodyCenti(body, sizeof(body), 72, 1000L * i, filtered) + above;
+    }
+  }
+  return (ticks() - start) / (ROUNDS * SAMPLES);
+}
+
+static uint32_t runFormatOnly(bool fixed)
+{
+  char text[CENTI_TEXT_SIZE];
+  char body[DAD_BODY_SIZE];
+  uint32_t start = ticks();
+  for (int i = 0; i < SAMPLES; i++)
+  {
+    if (fixed)
+      sink += formatCenti(text, sizeof(text), centiFromFloat(trace[i]));
+    else
+      sink += snprintf(body, sizeof(body), "%.2f", trace[i]);
+  }
+  return (ticks() - start) / SAMPLES;
+}
+
+void test_per_sample_cost(void)
+{
+  buildTrace();
+  // Warm up caches (and the flash cache on the ESP8266)
+  runFloatPath();
+  runFixedPath();
+
+  uint32_t floatCost = runFloatPath();
+  uint32_t fixedCost = runFixedPath();
+  uint32_t floatFormat = runFormatOnly(false);
+  uint32_t fixedFormat = runFormatOnly(true);
+
+  char line[128];
+  snprintf(line, sizeof(line), "pipeline per sample: float %u " TICK_UNIT ", fixed %u " TICK_UNIT,
+           (unsigned)floatCost, (unsigned)fixedCost);
+  TEST_MESSAGE(line);
+  snprintf(line, sizeof(line), "value formatting:    %%.2f %u " TICK_UNIT ", formatCenti %u " TICK_UNIT,
+           (unsigned)floatFormat, (unsigned)fixedFormat);
+  TEST_MESSAGE(line);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_per_sample_cost);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
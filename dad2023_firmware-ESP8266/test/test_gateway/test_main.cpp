@@ -0,0 +1,371 @@
+// Gateway and sensor nodes over a simulated radio that loses frames, with a
+// fake backend that decodes the blocks the gateway POSTs.
+
+#include <Gateway.h>
+#include <PeerLink.h>
+#include <TimeSeries.h>
+#include <string.h>
+#include <unity.h>
+
+#define NODES 4
+#define EPOCH_MS 1700000000000LL
+
+struct Frame
+{
+  uint8_t from[PEER_MAC_SIZE];
+  uint8_t to[PEER_MAC_SIZE];
+  uint8_t length;
+  uint8_t data[PEER_FRAME_SIZE];
+};
+
+// Frames sent during a step are delivered at the end of it, each one lost
+// with probability loss
+struct Medium
+{
+  Frame frames[64];
+  int count;
+  int sent;
+  int lost;
+  float loss;
+  uint32_t seed;
+
+  bool lose()
+  {
+    seed = seed * 1103515245 + 12345;
+    return (float)(seed >> 16 & 0x7fff) / 32768.0f < loss;
+  }
+};
+
+static Medium medium;
+
+class SimRadio : public RadioLink
+{
+public:
+  uint8_t mac[PEER_MAC_SIZE];
+
+  bool send(const uint8_t to[PEER_MAC_SIZE], const uint8_t *data, size_t length) override
+  {
+    if (length == 0 || length > PEER_FRAME_SIZE || medium.count == 64)
+      return false;
+    Frame &f = medium.frames[medium.count++];
+    memcpy(f.from, mac, PEER_MAC_SIZE);
+    memcpy(f.to, to, PEER_MAC_SIZE);
+    f.length = (uint8_t)length;
+    memcpy(f.data, data, length);
+    medium.sent++;
+    return true;
+  }
+};
+
+struct Sample
+{
+  uint32_t idSensor;
+  int64_t timestamp;
+  centi_t value;
+};
+
+class FakeBackend : public GatewayUpstream
+{
+public:
+  bool up = true;
+  bool connected = true;
+  int posts = 0;
+  int samples = 0;
+  Sample received[4096];
+  char filters[16][PEER_CHANNEL_SIZE + 16];
+  int subscriptions = 0;
+
+  bool postBlock(const uint8_t *data, size_t length) override
+  {
+    if (!up)
+      return false;
+    posts++;
+    TimeSeriesReader reader(data, length);
+    TEST_ASSERT_TRUE(reader.valid());
+    Sample s;
+    s.idSensor = reader.idSensor();
+    while (samples < 4096 && reader.next(&s.timestamp, &s.value))
+      received[samples++] = s;
+    return true;
+  }
+
+  bool subscribe(const char *filter) override
+  {
+    if (!connected || subscriptions == 16)
+      return false;
+    strcpy(filters[subscriptions++], filter);
+    return true;
+  }
+};
+
+static SimRadio gatewayRadio;
+static SimRadio nodeRadios[NODES];
+static PeerNode nodes[NODES];
+static FakeBackend backend;
+static Gateway gateway;
+static PeerCommand commands[NODES];
+static int commandCount[NODES];
+static uint32_t nowMs;
+
+static int32_t sensorOf(int node)
+{
+  return 100 + node;
+}
+
+static void deliver()
+{
+  // Frames sent while delivering (ACKs) go out in the next round
+  while (medium.count > 0)
+  {
+    Frame frames[64];
+    int count = medium.count;
+    memcpy(frames, medium.frames, sizeof(Frame) * count);
+    medium.count = 0;
+    for (int i = 0; i < count; i++)
+    {
+      Frame &f = frames[i];
+      if (medium.lose())
+      {
+        medium.lost++;
+        continue;
+      }
+      bool broadcast = memcmp(f.to, PEER_BROADCAST, PEER_MAC_SIZE) == 0;
+      if ((broadcast || memcmp(f.to, gatewayRadio.mac, PEER_MAC_SIZE) == 0) &&
+          memcmp(f.from, gatewayRadio.mac, PEER_MAC_SIZE) != 0)
+        gateway.onFrame(f.from, f.data, f.length, nowMs, EPOCH_MS + nowMs);
+      for (int n = 0; n < NODES; n++)
+      {
+        if ((broadcast || memcmp(f.to, nodeRadios[n].mac, PEER_MAC_SIZE) == 0) &&
+            memcmp(f.from, nodeRadios[n].mac, PEER_MAC_SIZE) != 0)
+        {
+          PeerCommand command;
+          if (nodes[n].onFrame(f.from, f.data, f.length, &command))
+          {
+            commands[n] = command;
+            commandCount[n]++;
+          }
+        }
+      }
+    }
+  }
+}
+
+// One second: every node takes a reading (unless value is CENTI_INVALID) and
+// sends its frame, then the gateway polls
+static void step(int sample)
+{
+  nowMs += 1000;
+  for (int n = 0; n < NODES; n++)
+  {
+    if (sample >= 0)
+      nodes[n].add((centi_t)(n * 1000 + sample), nowMs);
+    uint8_t frame[PEER_FRAME_SIZE];
+    size_t length = nodes[n].frame(frame, sizeof(frame), nowMs);
+    if (length > 0)
+      nodeRadios[n].send(nodes[n].destination(), frame, length);
+  }
+  deliver();
+  gateway.poll(nowMs);
+}
+
+static void startNodes()
+{
+  for (int n = 0; n < NODES; n++)
+  {
+    char channel[PEER_CHANNEL_SIZE];
+    snprintf(channel, sizeof(channel), "mqttChannelDevice%d", (int)sensorOf(n));
+    nodes[n].begin(sensorOf(n), channel);
+  }
+}
+
+void setUp(void)
+{
+  memset(&medium, 0, sizeof(medium));
+  medium.seed = 1;
+  backend = FakeBackend();
+  memset(commandCount, 0, sizeof(commandCount));
+  nowMs = 0;
+  memset(gatewayRadio.mac, 0, PEER_MAC_SIZE);
+  gatewayRadio.mac[5] = 0x10;
+  for (int n = 0; n < NODES; n++)
+  {
+    memset(nodeRadios[n].mac, 0, PEER_MAC_SIZE);
+    nodeRadios[n].mac[0] = 0x02;
+    nodeRadios[n].mac[5] = (uint8_t)(0x20 + n);
+  }
+  gateway.begin(&gatewayRadio, &backend, 30, 60000, 5000);
+  startNodes();
+}
+
+void tearDown(void) {}
+
+// Every sample of every node arrived once, in order, with the time it was taken
+static void assertReceived(int samples, bool exact)
+{
+  for (int n = 0; n < NODES; n++)
+  {
+    int next = 0;
+    for (int i = 0; i < backend.samples; i++)
+    {
+      const Sample &s = backend.received[i];
+      if (s.idSensor != (uint32_t)sensorOf(n))
+        continue;
+      int sample = s.value - n * 1000;
+      if (exact)
+        TEST_ASSERT_EQUAL(next, sample);
+      else
+        TEST_ASSERT_GREATER_OR_EQUAL(next, sample); // the node dropped some while the backend was down
+      next = sample + 1;
+    }
+    if (exact)
+      TEST_ASSERT_EQUAL(samples, next);
+  }
+}
+
+static void assertTimestamps()
+{
+  // Sample i of every node was taken at (i + 1) s, before the first sample there is one join step
+  for (int i = 0; i < backend.samples; i++)
+  {
+    const Sample &s = backend.received[i];
+    int sample = s.value - (int)(s.idSensor - 100) * 1000;
+    TEST_ASSERT_TRUE(EPOCH_MS + (sample + 2) * 1000LL == s.timestamp);
+  }
+}
+
+void test_readings_arrive_once_over_a_lossy_link(void)
+{
+  medium.loss = 0.3f;
+  step(-1); // HELLO
+  for (int i = 0; i < 300; i++)
+    step(i);
+  for (int i = 0; i < 40; i++)
+    step(-1); // let the nodes resend what was lost
+  gateway.flush(nowMs);
+
+  for (int n = 0; n < NODES; n++)
+  {
+    TEST_ASSERT_TRUE(nodes[n].joined());
+    TEST_ASSERT_EQUAL(0, nodes[n].pending());
+    TEST_ASSERT_EQUAL(0, nodes[n].dropped());
+  }
+  TEST_ASSERT_EQUAL(NODES * 300, backend.samples);
+  assertReceived(300, true);
+  assertTimestamps();
+  TEST_ASSERT_GREATER_THAN(0, (int)gateway.stats().duplicates);
+
+  // One POST per 30 samples and node instead of one per sample
+  TEST_ASSERT_LESS_OR_EQUAL(NODES * 300 / 30 + NODES, backend.posts);
+
+  char line[160];
+  snprintf(line, sizeof(line), "%d frames sent, %d lost, %u duplicates dropped, %d POSTs for %d readings",
+           medium.sent, medium.lost, (unsigned)gateway.stats().duplicates, backend.posts, backend.samples);
+  TEST_MESSAGE(line);
+}
+
+void test_channels_are_subscribed_and_commands_fan_out(void)
+{
+  backend.connected = false;
+  step(-1);
+  TEST_ASSERT_EQUAL(NODES, gateway.peers());
+  TEST_ASSERT_EQUAL(0, backend.subscriptions);
+  backend.connected = true;
+  step(-1);
+  TEST_ASSERT_EQUAL(NODES * 2, backend.subscriptions);
+  TEST_ASSERT_EQUAL_STRING("mqttChannelDevice100", backend.filters[0]);
+  TEST_ASSERT_EQUAL_STRING("mqttChannelDevice100/actuators/+", backend.filters[1]);
+
+  TEST_ASSERT_TRUE(gateway.onMqtt("mqttChannelDevice102", (const uint8_t *)"1", 1));
+  TEST_ASSERT_TRUE(gateway.onMqtt("mqttChannelDevice103/actuators/7", (const uint8_t *)"0", 1));
+  TEST_ASSERT_FALSE(gateway.onMqtt("mqttChannelDevice999", (const uint8_t *)"1", 1));
+  TEST_ASSERT_FALSE(gateway.onMqtt("mqttChannelDevice101/config/period", (const uint8_t *)"5", 1));
+  deliver();
+  TEST_ASSERT_EQUAL(0, commandCount[0]);
+  TEST_ASSERT_EQUAL(0, commandCount[1]);
+  TEST_ASSERT_EQUAL(1, commandCount[2]);
+  TEST_ASSERT_EQUAL(0, commands[2].idActuator);
+  TEST_ASSERT_EQUAL('1', commands[2].payload[0]);
+  TEST_ASSERT_EQUAL(1, commandCount[3]);
+  TEST_ASSERT_EQUAL(7, commands[3].idActuator);
+  TEST_ASSERT_EQUAL('0', commands[3].payload[0]);
+
+  // After an MQTT reconnection everything is subscribed again
+  gateway.resubscribe();
+  gateway.poll(nowMs);
+  TEST_ASSERT_EQUAL(NODES * 4, backend.subscriptions);
+}
+
+void test_nodes_rejoin_a_restarted_gateway(void)
+{
+  step(-1);
+  for (int i = 0; i < 50; i++)
+    step(i);
+  gateway.flush(nowMs);
+  gateway.begin(&gatewayRadio, &backend, 30, 60000, 5000);
+  for (int i = 50; i < 100; i++)
+    step(i);
+  for (int i = 0; i < 5; i++)
+    step(-1);
+  gateway.flush(nowMs);
+
+  TEST_ASSERT_EQUAL(NODES, gateway.peers());
+  TEST_ASSERT_EQUAL(NODES, (int)gateway.stats().unknown);
+  TEST_ASSERT_EQUAL(NODES * 100, backend.samples);
+  assertReceived(100, true);
+}
+
+void test_backend_outage_pushes_back_to_the_nodes(void)
+{
+  step(-1);
+  backend.up = false;
+  for (int i = 0; i < 400; i++)
+    step(i);
+  TEST_ASSERT_GREATER_THAN(0, (int)gateway.stats().refused);
+  TEST_ASSERT_EQUAL(PEER_MAX_SAMPLES, nodes[0].pending());
+  TEST_ASSERT_GREATER_THAN(0, (int)nodes[0].dropped());
+  TEST_ASSERT_EQUAL(0, backend.posts);
+  // Retried every 5 s, not every pass
+  TEST_ASSERT_LESS_THAN(400 / 5 * NODES + NODES, (int)gateway.stats().postFailures);
+
+  backend.up = true;
+  for (int i = 0; i < 20; i++)
+    step(-1);
+  gateway.flush(nowMs);
+  uint32_t dropped = 0;
+  for (int n = 0; n < NODES; n++)
+  {
+    TEST_ASSERT_EQUAL(0, nodes[n].pending());
+    dropped += nodes[n].dropped();
+  }
+  TEST_ASSERT_EQUAL(dropped, gateway.stats().lost);
+  TEST_ASSERT_EQUAL(NODES * 400 - (int)dropped, backend.samples);
+  assertReceived(400, false);
+  assertTimestamps();
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_readings_arrive_once_over_a_lossy_link);
+  RUN_TEST(test_channels_are_subscribed_and_commands_fan_out);
+  RUN_TEST(test_nodes_rejoin_a_restarted_gateway);
+  RUN_TEST(test_backend_outage_pushes_back_to_the_nodes);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
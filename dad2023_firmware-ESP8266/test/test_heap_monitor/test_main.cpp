@@ -0,0 +1,90 @@
+#include <HeapMonitor.h>
+#include <string.h>
+#include <unity.h>
+
+#define MINUTE 60000
+
+static HeapMonitor monitor;
+
+void setUp(void)
+{
+  monitor.begin(MINUTE, 4096);
+}
+
+void tearDown(void) {}
+
+void test_samples_once_per_period(void)
+{
+  TEST_ASSERT_EQUAL(0, monitor.largestBlockTrend());
+  TEST_ASSERT_TRUE(monitor.poll(5, 30000, 20000));
+  TEST_ASSERT_FALSE(monitor.poll(5 + MINUTE - 1, 30000, 20000));
+  TEST_ASSERT_TRUE(monitor.poll(5 + MINUTE, 29000, 19000));
+  TEST_ASSERT_EQUAL(2, monitor.count());
+  TEST_ASSERT_EQUAL(19000, monitor.last().largestBlock);
+}
+
+void test_trend_is_per_hour(void)
+{
+  for (uint32_t i = 0; i < 30; i++)
+    monitor.poll(i * MINUTE, 30000, 20000 - i * 100);
+  TEST_ASSERT_EQUAL(-6000, monitor.largestBlockTrend());
+
+  monitor.begin(MINUTE, 4096);
+  for (uint32_t i = 0; i < 30; i++)
+    monitor.poll(i * MINUTE, 30000, 20000 + (i % 2) * 64); // noise, but flat
+  TEST_ASSERT_INT_WITHIN(32, 0, monitor.largestBlockTrend());
+}
+
+void test_trend_covers_the_last_hour(void)
+{
+  uint32_t ms = 0;
+  for (uint32_t i = 0; i < 60; i++, ms += MINUTE)
+    monitor.poll(ms, 30000, 20000 - i * 100);
+  for (uint32_t i = 0; i < HEAP_MONITOR_SAMPLES; i++, ms += MINUTE)
+    monitor.poll(ms, 30000, 14100);
+  TEST_ASSERT_EQUAL(HEAP_MONITOR_SAMPLES, monitor.count());
+  TEST_ASSERT_EQUAL(0, monitor.largestBlockTrend());
+  TEST_ASSERT_EQUAL(14100, monitor.minLargestBlock());
+}
+
+void test_fragmentation_and_guard(void)
+{
+  monitor.poll(0, 30000, 24000);
+  TEST_ASSERT_EQUAL(20, monitor.fragmentation());
+  TEST_ASSERT_FALSE(monitor.belowGuard());
+  monitor.poll(MINUTE, 20000, 4000);
+  TEST_ASSERT_EQUAL(80, monitor.fragmentation());
+  TEST_ASSERT_TRUE(monitor.belowGuard());
+
+  char line[120];
+  size_t length = monitor.format(line, sizeof(line));
+  TEST_ASSERT_EQUAL(strlen(line), length);
+  TEST_ASSERT_EQUAL_STRING("heap: 20000 free, largest block 4000 (min 4000), 80% fragmented, -1200000 B/h over 2 samples",
+                           line);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_samples_once_per_period);
+  RUN_TEST(test_trend_is_per_hour);
+  RUN_TEST(test_trend_covers_the_last_hour);
+  RUN_TEST(test_fragmentation_and_guard);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
@@ -0,0 +1,122 @@
+#include <MotionProfile.h>
+#include <unity.h>
+
+// The tables are built by the compiler
+static_assert(MOTION_TABLES[MOTION_LINEAR].at[MOTION_TABLE_STEPS / 2] == 32768, "linear midpoint");
+static_assert(MOTION_TABLES[MOTION_MIN_JERK].at[MOTION_TABLE_STEPS / 2] == 32768, "symmetric");
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_tables_are_monotonic_and_symmetric(void)
+{
+  for (int shape = 0; shape < MOTION_SHAPES; shape++)
+  {
+    const MotionTable &t = MOTION_TABLES[shape];
+    TEST_ASSERT_EQUAL(0, t.at[0]);
+    TEST_ASSERT_EQUAL(65535, t.at[MOTION_TABLE_STEPS]);
+    for (int i = 0; i < MOTION_TABLE_STEPS; i++)
+    {
+      TEST_ASSERT_TRUE(t.at[i] <= t.at[i + 1]);
+      // Symmetric about the middle, within rounding
+      TEST_ASSERT_INT_WITHIN(1, 65535, t.at[i] + t.at[MOTION_TABLE_STEPS - i]);
+    }
+  }
+}
+
+void test_eased_profiles_start_and_stop_slowly(void)
+{
+  // First and last 1/16 of the time cover far less than 1/16 of the distance
+  uint16_t sixteenth = MOTION_TABLE_STEPS / 16;
+  TEST_ASSERT_LESS_THAN(65535 / 16 / 2, MOTION_TABLES[MOTION_EASE].at[sixteenth]);
+  TEST_ASSERT_LESS_THAN(65535 / 16 / 2, MOTION_TABLES[MOTION_MIN_JERK].at[sixteenth]);
+  TEST_ASSERT_EQUAL(65535 / 16 + 1, MOTION_TABLES[MOTION_LINEAR].at[sixteenth]);
+}
+
+void test_fraction_interpolates_between_entries(void)
+{
+  TEST_ASSERT_EQUAL(0, motionFraction(MOTION_LINEAR, 0));
+  TEST_ASSERT_INT_WITHIN(1, 100, motionFraction(MOTION_LINEAR, 100));
+  TEST_ASSERT_INT_WITHIN(1, 65535, motionFraction(MOTION_LINEAR, 65535));
+  uint16_t previous = 0;
+  for (uint32_t p = 0; p <= 65535; p += 7)
+  {
+    uint16_t f = motionFraction(MOTION_EASE, (uint16_t)p);
+    TEST_ASSERT_TRUE(f >= previous);
+    previous = f;
+  }
+}
+
+void test_move_duration_follows_speed(void)
+{
+  MotionMove move;
+  // pwm.writeServo(pin, 180, 140.0, 0.6) from 0: 180 degrees at 140 deg/s
+  motionStart(&move, 0, 18000, 14000, MOTION_EASE);
+  TEST_ASSERT_EQUAL(1285714, move.durationUs);
+  motionStart(&move, 9000, 0, 9000, MOTION_LINEAR);
+  TEST_ASSERT_EQUAL(1000000, move.durationUs);
+  motionStart(&move, 0, 5000, 0, MOTION_LINEAR);
+  TEST_ASSERT_EQUAL(0, move.durationUs);
+  TEST_ASSERT_EQUAL(5000, motionPosition(&move, 0));
+}
+
+void test_move_positions(void)
+{
+  MotionMove move;
+  motionStart(&move, 9000, 0, 9000, MOTION_LINEAR);
+  TEST_ASSERT_EQUAL(9000, motionPosition(&move, 0));
+  TEST_ASSERT_INT_WITHIN(1, 4500, motionPosition(&move, 500000));
+  TEST_ASSERT_EQUAL(0, motionPosition(&move, 1000000));
+  TEST_ASSERT_EQUAL(0, motionPosition(&move, 5000000));
+
+  motionStart(&move, 0, 18000, 14000, MOTION_EASE);
+  TEST_ASSERT_INT_WITHIN(2, 9000, motionPosition(&move, move.durationUs / 2));
+  TEST_ASSERT_LESS_THAN(9000 / 4, motionPosition(&move, move.durationUs / 4));
+}
+
+void test_jitter_buckets(void)
+{
+  TickJitter j = {};
+  tickJitterAdd(&j, 0, 20000);
+  tickJitterAdd(&j, 49, 20000);
+  tickJitterAdd(&j, 50, 20000);
+  tickJitterAdd(&j, 999, 20000);
+  tickJitterAdd(&j, 25000, 20000);
+  TEST_ASSERT_EQUAL(5, j.ticks);
+  TEST_ASSERT_EQUAL(2, j.buckets[0]);
+  TEST_ASSERT_EQUAL(1, j.buckets[1]);
+  TEST_ASSERT_EQUAL(1, j.buckets[4]);
+  TEST_ASSERT_EQUAL(1, j.buckets[5]);
+  TEST_ASSERT_EQUAL(1, j.missed);
+  TEST_ASSERT_EQUAL(25000, j.maxLateUs);
+  TEST_ASSERT_EQUAL(26098, j.totalLateUs);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_tables_are_monotonic_and_symmetric);
+  RUN_TEST(test_eased_profiles_start_and_stop_slowly);
+  RUN_TEST(test_fraction_interpolates_between_entries);
+  RUN_TEST(test_move_duration_follows_speed);
+  RUN_TEST(test_move_positions);
+  RUN_TEST(test_jitter_buckets);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
@@ -0,0 +1,123 @@
+#include <NodeLogic.h>
+#include <unity.h>
+
+static NodeLogic logic;
+
+void setUp(void)
+{
+  logic.begin(3, 4);
+}
+
+void tearDown(void) {}
+
+void test_uploads_every_n_passes(void)
+{
+  int uploads = 0;
+  for (int i = 1; i <= 12; i++)
+  {
+    NodeDecision d = logic.pass(2000);
+    TEST_ASSERT_EQUAL(i % 4 == 0, d.upload);
+    uploads += d.upload;
+  }
+  TEST_ASSERT_EQUAL(3, uploads);
+}
+
+void test_period_change(void)
+{
+  TEST_ASSERT_FALSE(logic.setUploadEvery(0));
+  TEST_ASSERT_FALSE(logic.setUploadEvery(-5));
+  TEST_ASSERT_EQUAL(4, logic.uploadEvery());
+  TEST_ASSERT_TRUE(logic.setUploadEvery(2));
+  TEST_ASSERT_FALSE(logic.pass(2000).upload);
+  TEST_ASSERT_TRUE(logic.pass(2000).upload);
+}
+
+void test_value_is_filtered(void)
+{
+  TEST_ASSERT_EQUAL(CENTI_INVALID, logic.pass(CENTI_INVALID).value);
+  TEST_ASSERT_EQUAL(2000, logic.pass(2000).value);
+  TEST_ASSERT_EQUAL(2100, logic.pass(2400).value); // 1/4 of the step
+  TEST_ASSERT_EQUAL(2100, logic.pass(CENTI_INVALID).value);
+}
+
+void test_commands_persist_until_replaced(void)
+{
+  TEST_ASSERT_EQUAL(RELAY_NONE, logic.pass(2000).relay);
+  logic.onCommand("1", 1);
+  TEST_ASSERT_EQUAL(RELAY_ON, logic.pass(2000).relay);
+  TEST_ASSERT_EQUAL(RELAY_ON, logic.pass(2000).relay);
+  logic.onCommand("0", 1);
+  TEST_ASSERT_EQUAL(RELAY_OFF, logic.pass(2000).relay);
+  logic.onCommand("on", 2);
+  TEST_ASSERT_EQUAL(RELAY_NONE, logic.pass(2000).relay);
+}
+
+void test_actuator_commands_for_other_actuators_are_ignored(void)
+{
+  logic.onActuatorCommand(4, "1", 1);
+  TEST_ASSERT_EQUAL(RELAY_NONE, logic.pass(2000).relay);
+  logic.onActuatorCommand(3, "1", 1);
+  TEST_ASSERT_EQUAL(RELAY_ON, logic.pass(2000).relay);
+}
+
+void test_threshold_drives_the_relay(void)
+{
+  logic.setThreshold(2750, 50);
+  TEST_ASSERT_EQUAL(RELAY_NONE, logic.pass(CENTI_INVALID).relay); // nothing to compare yet
+  TEST_ASSERT_EQUAL(RELAY_OFF, logic.pass(2700).relay);
+  TEST_ASSERT_EQUAL(RELAY_ON, logic.pass(3000).relay);  // filtered 2775
+  TEST_ASSERT_EQUAL(RELAY_ON, logic.pass(2600).relay);  // 2731, within the hysteresis
+  TEST_ASSERT_EQUAL(RELAY_OFF, logic.pass(2400).relay); // 2649
+
+  // A command takes the relay back from the threshold
+  logic.onCommand("1", 1);
+  TEST_ASSERT_EQUAL(CENTI_INVALID, logic.threshold());
+  TEST_ASSERT_EQUAL(RELAY_ON, logic.pass(2000).relay);
+}
+
+void test_threshold_config(void)
+{
+  centi_t threshold, hysteresis;
+  TEST_ASSERT_TRUE(parseThreshold("2750 20", &threshold, &hysteresis));
+  TEST_ASSERT_EQUAL(2750, threshold);
+  TEST_ASSERT_EQUAL(20, hysteresis);
+  TEST_ASSERT_TRUE(parseThreshold("-500", &threshold, &hysteresis));
+  TEST_ASSERT_EQUAL(-500, threshold);
+  TEST_ASSERT_EQUAL(NODE_THRESHOLD_HYSTERESIS, hysteresis);
+  TEST_ASSERT_TRUE(parseThreshold("off", &threshold, &hysteresis));
+  TEST_ASSERT_EQUAL(CENTI_INVALID, threshold);
+  TEST_ASSERT_FALSE(parseThreshold("", &threshold, &hysteresis));
+  TEST_ASSERT_FALSE(parseThreshold("27.5", &threshold, &hysteresis));
+  TEST_ASSERT_FALSE(parseThreshold("2750 -1", &threshold, &hysteresis));
+  TEST_ASSERT_FALSE(parseThreshold("40000", &threshold, &hysteresis));
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_uploads_every_n_passes);
+  RUN_TEST(test_period_change);
+  RUN_TEST(test_value_is_filtered);
+  RUN_TEST(test_commands_persist_until_replaced);
+  RUN_TEST(test_actuator_commands_for_other_actuators_are_ignored);
+  RUN_TEST(test_threshold_drives_the_relay);
+  RUN_TEST(test_threshold_config);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
@@ -0,0 +1,155 @@
+#include <Profiler.h>
+#include <string.h>
+#include <unity.h>
+
+void setUp(void)
+{
+  profilerResume();
+  profilerClear();
+  profilerPhase = 0;
+}
+
+void tearDown(void) {}
+
+static uint32_t countOf(uint32_t pc, uint8_t phase)
+{
+  for (size_t i = 0; i < PROFILER_SLOTS; i++)
+  {
+    const ProfileSlot *s = profilerSlot(i);
+    if (s->count > 0 && s->pc == pc && s->phase == phase)
+      return s->count;
+  }
+  return 0;
+}
+
+static size_t usedSlots()
+{
+  size_t used = 0;
+  for (size_t i = 0; i < PROFILER_SLOTS; i++)
+    used += profilerSlot(i)->count > 0;
+  return used;
+}
+
+void test_samples_merge_by_pc_and_phase(void)
+{
+  for (int i = 0; i < 10; i++)
+    profilerSample(0x40201000);
+  profilerPhase = 3;
+  for (int i = 0; i < 4; i++)
+    profilerSample(0x40201000);
+  profilerSample(0x40201004);
+
+  TEST_ASSERT_EQUAL(15, profilerSamples());
+  TEST_ASSERT_EQUAL(10, countOf(0x40201000, 0));
+  TEST_ASSERT_EQUAL(4, countOf(0x40201000, 3));
+  TEST_ASSERT_EQUAL(1, countOf(0x40201004, 3));
+  TEST_ASSERT_EQUAL(3, usedSlots());
+  TEST_ASSERT_EQUAL(10, profilerPhaseSamples(0));
+  TEST_ASSERT_EQUAL(5, profilerPhaseSamples(3));
+}
+
+void test_scopes_nest_and_restore(void)
+{
+  {
+    ProfileScope outer(2);
+    profilerSample(0x40100000);
+    {
+      ProfileScope inner(5);
+      profilerSample(0x40100000);
+    }
+    TEST_ASSERT_EQUAL(2, profilerPhase);
+  }
+  TEST_ASSERT_EQUAL(0, profilerPhase);
+  TEST_ASSERT_EQUAL(1, profilerPhaseSamples(2));
+  TEST_ASSERT_EQUAL(1, profilerPhaseSamples(5));
+}
+
+void test_counts_saturate(void)
+{
+  for (uint32_t i = 0; i < 70000; i++)
+    profilerSample(0x40202000);
+  TEST_ASSERT_EQUAL(65535, countOf(0x40202000, 0));
+  TEST_ASSERT_EQUAL(70000, profilerSamples());
+}
+
+void test_full_histogram_loses_samples_but_keeps_phase_totals(void)
+{
+  for (uint32_t i = 0; i < PROFILER_SLOTS * 2; i++)
+    profilerSample(0x40210000 + 4 * i);
+  TEST_ASSERT_EQUAL(PROFILER_SLOTS * 2, profilerSamples());
+  TEST_ASSERT_EQUAL(PROFILER_SLOTS * 2, profilerPhaseSamples(0));
+  TEST_ASSERT_EQUAL(PROFILER_SLOTS * 2, usedSlots() + profilerLost());
+  TEST_ASSERT_GREATER_OR_EQUAL(PROFILER_SLOTS * 3 / 4, usedSlots());
+}
+
+void test_clear(void)
+{
+  profilerSample(0x40201000);
+  profilerClear();
+  TEST_ASSERT_EQUAL(0, profilerSamples());
+  TEST_ASSERT_EQUAL(0, usedSlots());
+  TEST_ASSERT_EQUAL(0, profilerPhaseSamples(0));
+}
+
+static void countLength(void *context, const char *line)
+{
+  *(size_t *)context += strlen(line);
+}
+
+static size_t dumpLength(const ProfileSnapshot &snapshot)
+{
+  static const char *const names[] = {"idle", "sensors"};
+  size_t length = 0;
+  profilerWriteDump(snapshot, names, 2, countLength, &length);
+  return length;
+}
+
+// main.cpp announces the length of the first pass to MQTT and sends the
+// second: samples arriving in between must not change it
+void test_paused_dumps_have_the_same_length(void)
+{
+  profilerSample(0x40201000);
+  profilerPhase = 1;
+  profilerSample(0x40202000);
+  profilerPause();
+  ProfileSnapshot snapshot = {1000, 999, profilerSamples(), profilerLost(), 42};
+  size_t measured = dumpLength(snapshot);
+  for (uint32_t pc = 0x40203000; pc < 0x40203100; pc += 4)
+    profilerSample(pc);
+  TEST_ASSERT_EQUAL(measured, dumpLength(snapshot));
+  TEST_ASSERT_EQUAL(2, profilerSamples());
+
+  profilerResume();
+  profilerSample(0x40203000);
+  TEST_ASSERT_EQUAL(3, profilerSamples());
+  TEST_ASSERT_EQUAL(1, countOf(0x40203000, 1));
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_samples_merge_by_pc_and_phase);
+  RUN_TEST(test_scopes_nest_and_restore);
+  RUN_TEST(test_counts_saturate);
+  RUN_TEST(test_full_histogram_loses_samples_but_keeps_phase_totals);
+  RUN_TEST(test_clear);
+  RUN_TEST(test_paused_dumps_have_the_same_length);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
@@ -0,0 +1,187 @@
+#include <TimeSeries.h>
+#include <string.h>
+#include <unity.h>
+
+static uint8_t buffer[1024];
+static TimeSeriesEncoder encoder(buffer, sizeof(buffer));
+
+// Same block as SensorValueBlockTest in the backend
+static const uint8_t REFERENCE[] = {0x01, 0x04, 0x00, 0x48, 0x80, 0xa0, 0xab, 0xfe, 0xf9, 0x62,
+                                    0xd2, 0x24, 0x15, 0xe0, 0xd4, 0x03, 0x26, 0xa3, 0x49, 0x0a};
+
+void setUp(void)
+{
+  memset(buffer, 0xee, sizeof(buffer));
+  encoder.begin(72);
+}
+
+void tearDown(void) {}
+
+static void appendReference(TimeSeriesEncoder &e)
+{
+  TEST_ASSERT_TRUE(e.append(1700000000000LL, 2345));
+  TEST_ASSERT_TRUE(e.append(1700000030000LL, 2350));
+  TEST_ASSERT_TRUE(e.append(1700000060000LL, 2340));
+  TEST_ASSERT_TRUE(e.append(1700000090005LL, -5));
+}
+
+void test_empty_block_is_header_only(void)
+{
+  TEST_ASSERT_EQUAL(0, encoder.count());
+  TEST_ASSERT_EQUAL(4, encoder.length());
+  TEST_ASSERT_EQUAL_HEX8(TIME_SERIES_VERSION, buffer[0]);
+  TimeSeriesReader reader(encoder.data(), encoder.length());
+  TEST_ASSERT_TRUE(reader.valid());
+  TEST_ASSERT_EQUAL(72, reader.idSensor());
+  int64_t t;
+  centi_t v;
+  TEST_ASSERT_FALSE(reader.next(&t, &v));
+}
+
+void test_matches_reference_block(void)
+{
+  appendReference(encoder);
+  TEST_ASSERT_EQUAL(4, encoder.count());
+  TEST_ASSERT_EQUAL(sizeof(REFERENCE), encoder.length());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(REFERENCE, encoder.data(), sizeof(REFERENCE));
+}
+
+void test_round_trip(void)
+{
+  int64_t times[64];
+  centi_t values[64];
+  int64_t t = 1700000000000LL;
+  for (int i = 0; i < 64; i++)
+  {
+    t += 30000 + (i % 3 == 0 ? 1 : 0) - (i % 7 == 0 ? 250 : 0);
+    times[i] = t;
+    values[i] = (centi_t)(i % 2 ? -3276 + i * 100 : 32767 - i);
+    TEST_ASSERT_TRUE(encoder.append(times[i], values[i]));
+  }
+
+  TimeSeriesReader reader(encoder.data(), encoder.length());
+  TEST_ASSERT_EQUAL(64, reader.count());
+  for (int i = 0; i < 64; i++)
+  {
+    int64_t time;
+    centi_t value;
+    TEST_ASSERT_TRUE(reader.next(&time, &value));
+    TEST_ASSERT_TRUE(times[i] == time);
+    TEST_ASSERT_EQUAL(values[i], value);
+  }
+  int64_t time;
+  centi_t value;
+  TEST_ASSERT_FALSE(reader.next(&time, &value));
+}
+
+void test_steady_samples_take_one_byte(void)
+{
+  encoder.append(1000, 2300);
+  encoder.append(31000, 2310);
+  size_t before = encoder.length();
+  for (int i = 2; i < 50; i++)
+    TEST_ASSERT_TRUE(encoder.append(1000 + 30000LL * i, (centi_t)(2300 + (i % 2) * 10)));
+  TEST_ASSERT_EQUAL(48, encoder.length() - before);
+  TEST_ASSERT_TRUE(encoder.append(1000 + 30000LL * 50 + 3, 2300));
+  TEST_ASSERT_EQUAL(48 + 2, encoder.length() - before);
+}
+
+void test_full_buffer_rejects_without_overrun(void)
+{
+  uint8_t small[16];
+  memset(small, 0xee, sizeof(small));
+  TimeSeriesEncoder tiny(small, 12);
+  tiny.begin(72);
+  TEST_ASSERT_TRUE(tiny.append(1700000000000LL, 2345)); // 4 + 6 + 2 bytes
+  TEST_ASSERT_EQUAL(12, tiny.length());
+  TEST_ASSERT_FALSE(tiny.append(1700000030000LL, 2350));
+  TEST_ASSERT_EQUAL(1, tiny.count());
+  TEST_ASSERT_EQUAL_HEX8(0xee, small[12]);
+
+  TimeSeriesReader reader(tiny.data(), tiny.length());
+  int64_t t;
+  centi_t v;
+  TEST_ASSERT_TRUE(reader.next(&t, &v));
+  TEST_ASSERT_EQUAL(2345, v);
+  TEST_ASSERT_FALSE(reader.next(&t, &v));
+}
+
+void test_invalid_readings_are_rejected(void)
+{
+  TEST_ASSERT_FALSE(encoder.append(1000, CENTI_INVALID));
+  TEST_ASSERT_EQUAL(0, encoder.count());
+}
+
+void test_begin_starts_a_new_block(void)
+{
+  appendReference(encoder);
+  encoder.begin(300);
+  TEST_ASSERT_EQUAL(0, encoder.count());
+  TEST_ASSERT_EQUAL(300, encoder.idSensor());
+  TEST_ASSERT_TRUE(encoder.append(5, 10));
+  TimeSeriesReader reader(encoder.data(), encoder.length());
+  int64_t t;
+  centi_t v;
+  TEST_ASSERT_TRUE(reader.next(&t, &v));
+  TEST_ASSERT_TRUE(t == 5);
+  TEST_ASSERT_EQUAL(10, v);
+}
+
+void test_reader_rejects_malformed_blocks(void)
+{
+  uint8_t copy[sizeof(REFERENCE)];
+  memcpy(copy, REFERENCE, sizeof(copy));
+  int64_t t;
+  centi_t v;
+
+  copy[0] = 2;
+  TEST_ASSERT_FALSE(TimeSeriesReader(copy, sizeof(copy)).valid());
+  TEST_ASSERT_FALSE(TimeSeriesReader(REFERENCE, 2).valid());
+
+  // Last sample flags a delta-of-delta that is cut off
+  TimeSeriesReader truncated(REFERENCE, sizeof(REFERENCE) - 1);
+  int samples = 0;
+  while (truncated.next(&t, &v))
+    samples++;
+  TEST_ASSERT_EQUAL(3, samples);
+  TEST_ASSERT_FALSE(truncated.valid());
+
+  // Value delta taking the reading out of range
+  encoder.append(0, INT16_MAX);
+  encoder.append(0, INT16_MAX);
+  buffer[encoder.length() - 1] = 0x04; // delta 0 -> +1
+  TimeSeriesReader outOfRange(encoder.data(), encoder.length());
+  TEST_ASSERT_TRUE(outOfRange.next(&t, &v));
+  TEST_ASSERT_FALSE(outOfRange.next(&t, &v));
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_block_is_header_only);
+  RUN_TEST(test_matches_reference_block);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_steady_samples_take_one_byte);
+  RUN_TEST(test_full_buffer_rejects_without_overrun);
+  RUN_TEST(test_invalid_readings_are_rejected);
+  RUN_TEST(test_begin_starts_a_new_block);
+  RUN_TEST(test_reader_rejects_malformed_blocks);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
@@ -0,0 +1,259 @@
+// Size and encode cost of TimeSeries blocks on realistic temperature traces,
+// against one JSON body per sample (what POST_sv sends), raw 10 byte samples
+// and Gorilla style XOR floats with delta-of-delta timestamp buckets.
+//
+// pio test -e native -f test_time_series_bench (ns per sample), or on the
+// board with -e esp12e (CPU cycles per sample). Sizes are asserted, costs
+// only printed.
+
+#include <DadProtocol.h>
+#include <FixedTemp.h>
+#include <TimeSeries.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define TICK_UNIT "cycles"
+static uint32_t ticks()
+{
+  return ESP.getCycleCount();
+}
+#else
+#include <chrono>
+#define TICK_UNIT "ns"
+static uint32_t ticks()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#endif
+
+#define SAMPLES 720
+#define BLOCK_SIZE 512 // the RAM budget main.cpp gives a block
+
+static int64_t times[SAMPLES];
+static centi_t values[SAMPLES];
+static uint8_t block[BLOCK_SIZE];
+static uint8_t bits[SAMPLES * 16];
+static volatile size_t sink;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint32_t nextRandom(uint32_t *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 16;
+}
+
+// Indoor DHT22 every 30 s on NTP seconds: 0.1 C steps wandering around 24 C,
+// now and then a pass late by a second
+static void indoorTrace()
+{
+  uint32_t seed = 7;
+  int tenths = 240;
+  int64_t t = 1700000000000LL;
+  for (int i = 0; i < SAMPLES; i++)
+  {
+    t += 30000 + (nextRandom(&seed) % 20 == 0 ? 1000 : 0);
+    uint32_t r = nextRandom(&seed) % 8;
+    tenths += r == 0 ? -1 : r == 1 ? 1 : 0;
+    times[i] = t;
+    values[i] = (centi_t)(tenths * 10);
+  }
+}
+
+// Outdoor day: 6 C daily swing plus gusts, every 10 s taken from millis() so
+// the period jitters by a few ms with the loop
+static void outdoorTrace()
+{
+  uint32_t seed = 99;
+  int64_t t = 1700000000000LL;
+  for (int i = 0; i < SAMPLES; i++)
+  {
+    t += 10000 + (int)(nextRandom(&seed) % 21) - 10;
+    float hours = (float)i * 10.0f / 3600.0f * 12.0f; // the day squeezed in the trace
+    float c = 18.0f + 6.0f * sinf(hours * 6.2832f / 24.0f) + (float)((int)(nextRandom(&seed) % 7) - 3) * 0.1f;
+    times[i] = t;
+    values[i] = centiFromFloat(roundf(c * 10.0f) / 10.0f);
+  }
+}
+
+// Bit writer for the Gorilla encoding
+struct Bits
+{
+  size_t used;
+  void put(uint64_t value, int count)
+  {
+    for (int i = count - 1; i >= 0; i--)
+    {
+      if (value >> i & 1)
+        bits[used >> 3] |= (uint8_t)(0x80 >> (used & 7));
+      used++;
+    }
+  }
+};
+
+static size_t gorillaEncode()
+{
+  memset(bits, 0, sizeof(bits));
+  Bits out = {0};
+  int64_t lastTime = times[0];
+  int64_t lastDelta = 0;
+  float first = centiToFloat(values[0]);
+  uint32_t last;
+  memcpy(&last, &first, 4);
+  out.put((uint64_t)times[0], 64);
+  out.put(last, 32);
+  int lastLeading = 32;
+  int lastTrailing = 0;
+  for (int i = 1; i < SAMPLES; i++)
+  {
+    int64_t delta = times[i] - lastTime;
+    int64_t dod = delta - lastDelta;
+    if (dod == 0)
+      out.put(0, 1);
+    else if (dod >= -63 && dod <= 64)
+      out.put(0x2 << 7 | ((uint64_t)dod & 0x7f), 9);
+    else if (dod >= -255 && dod <= 256)
+      out.put(0x6 << 9 | ((uint64_t)dod & 0x1ff), 12);
+    else if (dod >= -2047 && dod <= 2048)
+      out.put(0xe << 12 | ((uint64_t)dod & 0xfff), 16);
+    else
+      out.put(0xfULL << 32 | ((uint64_t)dod & 0xffffffff), 36);
+    lastTime = times[i];
+    lastDelta = delta;
+
+    float f = centiToFloat(values[i]);
+    uint32_t v;
+    memcpy(&v, &f, 4);
+    uint32_t x = v ^ last;
+    last = v;
+    if (x == 0)
+    {
+      out.put(0, 1);
+      continue;
+    }
+    int leading = __builtin_clz(x);
+    int trailing = __builtin_ctz(x);
+    if (leading >= lastLeading && trailing >= lastTrailing)
+    {
+      out.put(0x2, 2);
+      out.put(x >> lastTrailing, 32 - lastLeading - lastTrailing);
+    }
+    else
+    {
+      out.put(0x3, 2);
+      out.put((uint64_t)leading, 5);
+      out.put((uint64_t)(32 - leading - trailing - 1), 5);
+      out.put(x >> trailing, 32 - leading - trailing);
+      lastLeading = leading;
+      lastTrailing = trailing;
+    }
+  }
+  return (out.used + 7) / 8;
+}
+
+// Encodes the whole trace in BLOCK_SIZE blocks; returns the bytes sent
+static size_t blockEncode(int *blocks)
+{
+  TimeSeriesEncoder encoder(block, sizeof(block));
+  size_t total = 0;
+  *blocks = 1;
+  encoder.begin(72);
+  for (int i = 0; i < SAMPLES; i++)
+  {
+    if (!encoder.append(times[i], values[i]))
+    {
+      total += encoder.length();
+      (*blocks)++;
+      encoder.begin(72);
+      encoder.append(times[i], values[i]);
+    }
+  }
+  return total + encoder.length();
+}
+
+// Timestamps in seconds so they fit the 32 bit long of the ESP8266, which
+// only flatters the JSON side
+static size_t jsonEncode()
+{
+  char body[DAD_BODY_SIZE];
+  size_t total = 0;
+  for (int i = 0; i < SAMPLES; i++)
+    total += writeSensorValueBodyCenti(body, sizeof(body), 72, (long)(times[i] / 1000), values[i]);
+  return total;
+}
+
+static void report(const char *name)
+{
+  int blocks;
+  size_t blockBytes = blockEncode(&blocks);
+  size_t json = jsonEncode();
+  size_t raw = SAMPLES * 10;
+  size_t gorilla = gorillaEncode();
+
+  uint32_t start = ticks();
+  for (int round = 0; round < 4; round++)
+    sink += blockEncode(&blocks);
+  uint32_t blockCost = (ticks() - start) / (4 * SAMPLES);
+
+  start = ticks();
+  for (int round = 0; round < 4; round++)
+    sink += gorillaEncode();
+  uint32_t gorillaCost = (ticks() - start) / (4 * SAMPLES);
+
+  start = ticks();
+  for (int round = 0; round < 4; round++)
+    sink += jsonEncode();
+  uint32_t jsonCost = (ticks() - start) / (4 * SAMPLES);
+
+  char line[200];
+  snprintf(line, sizeof(line), "%s, %d samples: json %u B (%u " TICK_UNIT "), raw %u B, gorilla %u B (%u " TICK_UNIT
+                               "), block %u B in %d x %d B (%u " TICK_UNIT "), %.1fx smaller than json",
+           name, SAMPLES, (unsigned)json, (unsigned)jsonCost, (unsigned)raw, (unsigned)gorilla, (unsigned)gorillaCost,
+           (unsigned)blockBytes, blocks, BLOCK_SIZE, (unsigned)blockCost, (double)json / (double)blockBytes);
+  TEST_MESSAGE(line);
+
+  TEST_ASSERT_LESS_THAN(raw / 4, blockBytes);
+  TEST_ASSERT_LESS_THAN(json / 20, blockBytes);
+}
+
+void test_indoor_trace(void)
+{
+  indoorTrace();
+  report("indoor 30 s");
+}
+
+void test_outdoor_trace(void)
+{
+  outdoorTrace();
+  report("outdoor 10 s");
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_indoor_trace);
+  RUN_TEST(test_outdoor_trace);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
@@ -0,0 +1,129 @@
+// On-target test of SecureTransport against tools/tls_standin/tls_standin.sh.
+//
+// pio test -e esp12e -f test_tls_transport with the stand-in running and
+// these defined in build_flags (or PLATFORMIO_BUILD_FLAGS):
+//   -D TEST_STASSID=\"ssid\" -D TEST_STAPSK=\"password\"
+//   -D TEST_TLS_HOST=\"192.168.1.10\" -D TEST_TLS_KEY=\"-----BEGIN PUBLIC KEY-----\\n...\"
+//
+// The stand-in side of these checks runs on the host with
+// tools/tls_standin/check.sh.
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <SecureTransport.h>
+#include <unity.h>
+
+#ifndef TEST_STASSID
+#define TEST_STASSID "Your_Wifi_SSID"
+#define TEST_STAPSK "Your_Wifi_PASSWORD"
+#endif
+
+#ifndef TEST_TLS_HOST
+#define TEST_TLS_HOST "192.168.43.195"
+#endif
+
+#ifndef TEST_TLS_PORT
+#define TEST_TLS_PORT 8443
+#endif
+
+#ifndef TEST_TLS_KEY
+#define TEST_TLS_KEY ""
+#endif
+
+// Full handshakes on an ESP8266 at 80 MHz take ~1-3 s with P-256, a
+// resumption has no public key operation and must be far below that
+#define RESUMED_MAX_MS 500
+
+SecureTransport transport;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void connectOnce()
+{
+  TEST_ASSERT_TRUE_MESSAGE(transport.connect(TEST_TLS_HOST, TEST_TLS_PORT), "TLS connect failed");
+  transport.print("GET / HTTP/1.1\r\nHost: " TEST_TLS_HOST "\r\nConnection: close\r\n\r\n");
+  uint32_t start = millis();
+  while (transport.connected() && millis() - start < 5000)
+  {
+    while (transport.available())
+      transport.read();
+    delay(1);
+  }
+  transport.stop();
+  transport.printStats(Serial, "test");
+}
+
+void test_configure_pins_key_and_negotiates_mfl(void)
+{
+  TEST_ASSERT_TRUE_MESSAGE(transport.configure(TEST_TLS_HOST, TEST_TLS_PORT, TEST_TLS_KEY, 512),
+                           "TEST_TLS_KEY is not a valid public key");
+  TEST_ASSERT_EQUAL(512, transport.stats().fragmentLength);
+}
+
+void test_first_handshake_is_full(void)
+{
+  connectOnce();
+  TEST_ASSERT_EQUAL(1, transport.stats().handshakes);
+  TEST_ASSERT_FALSE(transport.stats().lastResumed);
+}
+
+void test_reconnect_resumes_session(void)
+{
+  uint32_t fullMs = transport.stats().lastHandshakeMs;
+  for (int i = 0; i < 3; i++)
+  {
+    connectOnce();
+    TEST_ASSERT_TRUE(transport.stats().lastResumed);
+    TEST_ASSERT_LESS_THAN(RESUMED_MAX_MS, transport.stats().lastHandshakeMs);
+    TEST_ASSERT_LESS_THAN(fullMs, transport.stats().lastHandshakeMs);
+  }
+  TEST_ASSERT_EQUAL(3, transport.stats().resumed);
+}
+
+#ifdef SECURE_TRANSPORT_CLONE
+// HTTPClient connects a clone, whose handshakes must show in transport's stats
+void test_clone_records_in_stats_of_origin(void)
+{
+  uint32_t handshakes = transport.stats().handshakes;
+  std::unique_ptr<WiFiClient> clone = transport.clone();
+  TEST_ASSERT_TRUE_MESSAGE(clone->connect(TEST_TLS_HOST, TEST_TLS_PORT), "TLS connect failed");
+  clone->stop();
+  TEST_ASSERT_EQUAL(handshakes + 1, transport.stats().handshakes);
+  TEST_ASSERT_TRUE(transport.stats().lastResumed);
+}
+#endif
+
+void test_wrong_key_is_rejected(void)
+{
+  // Any other P-256 key must fail the pinning check
+  static const char otherKey[] = "-----BEGIN PUBLIC KEY-----\n"
+                                 "MFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAEJzXXuJ+IA7JKtzgNh6MaCO4n2rbI\n"
+                                 "IKEwiQVruhhRin+K37U7bjTeg06Eyx6hTvH0KKNCsQQ5Agr3+e33BOzQIQ==\n"
+                                 "-----END PUBLIC KEY-----\n";
+  SecureTransport other;
+  TEST_ASSERT_TRUE(other.configure(TEST_TLS_HOST, TEST_TLS_PORT, otherKey, 512));
+  TEST_ASSERT_FALSE(other.connect(TEST_TLS_HOST, TEST_TLS_PORT));
+  TEST_ASSERT_EQUAL(1, other.stats().failures);
+}
+
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(TEST_STASSID, TEST_STAPSK);
+  while (WiFi.status() != WL_CONNECTED)
+    delay(500);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_configure_pins_key_and_negotiates_mfl);
+  RUN_TEST(test_first_handshake_is_full);
+  RUN_TEST(test_reconnect_resumes_session);
+#ifdef SECURE_TRANSPORT_CLONE
+  RUN_TEST(test_clone_records_in_stats_of_origin);
+#endif
+  RUN_TEST(test_wrong_key_is_rejected);
+  UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,162 @@
+#include <TopicRouter.h>
+#include <string.h>
+#include <unity.h>
+
+// Every handler records which route fired through its context
+static char fired[256];
+
+static void record(const char *topic, const uint8_t *payload, unsigned int length, void *context)
+{
+  (void)topic;
+  (void)payload;
+  (void)length;
+  strcat(fired, (const char *)context);
+  strcat(fired, ";");
+}
+
+static TopicRouter<64, 512> router;
+
+void setUp(void)
+{
+  router.clear();
+  fired[0] = '\0';
+}
+
+void tearDown(void) {}
+
+static uint8_t send(const char *topic)
+{
+  fired[0] = '\0';
+  return router.dispatch(topic, (const uint8_t *)"1", 1);
+}
+
+void test_exact_route(void)
+{
+  TEST_ASSERT_TRUE(router.add("mqttChannelDevice5", record, (void *)"device"));
+  TEST_ASSERT_EQUAL(1, send("mqttChannelDevice5"));
+  TEST_ASSERT_EQUAL_STRING("device;", fired);
+  TEST_ASSERT_EQUAL(0, send("mqttChannelDevice6"));
+  TEST_ASSERT_EQUAL(0, send("mqttChannelDevice5/extra"));
+  TEST_ASSERT_EQUAL(0, send("mqttChannel"));
+}
+
+void test_plus_matches_one_level(void)
+{
+  TEST_ASSERT_TRUE(router.add("dev/+/cmd", record, (void *)"plus"));
+  TEST_ASSERT_EQUAL(1, send("dev/3/cmd"));
+  TEST_ASSERT_EQUAL(1, send("dev//cmd"));
+  TEST_ASSERT_EQUAL(0, send("dev/3/4/cmd"));
+  TEST_ASSERT_EQUAL(0, send("dev/cmd"));
+}
+
+void test_hash_matches_parent_and_below(void)
+{
+  TEST_ASSERT_TRUE(router.add("dev/config/#", record, (void *)"hash"));
+  TEST_ASSERT_EQUAL(1, send("dev/config"));
+  TEST_ASSERT_EQUAL(1, send("dev/config/period"));
+  TEST_ASSERT_EQUAL(1, send("dev/config/a/b/c"));
+  TEST_ASSERT_EQUAL(0, send("dev/configx"));
+  TEST_ASSERT_EQUAL(0, send("dev"));
+}
+
+void test_every_matching_route_fires(void)
+{
+  router.add("dev/5/cmd", record, (void *)"exact");
+  router.add("dev/+/cmd", record, (void *)"plus");
+  router.add("dev/#", record, (void *)"hash");
+  router.add("#", record, (void *)"all");
+  router.add("+/+/+", record, (void *)"three");
+  TEST_ASSERT_EQUAL(5, send("dev/5/cmd"));
+  TEST_ASSERT_NOT_NULL(strstr(fired, "exact;"));
+  TEST_ASSERT_NOT_NULL(strstr(fired, "plus;"));
+  TEST_ASSERT_NOT_NULL(strstr(fired, "hash;"));
+  TEST_ASSERT_NOT_NULL(strstr(fired, "all;"));
+  TEST_ASSERT_NOT_NULL(strstr(fired, "three;"));
+  TEST_ASSERT_EQUAL(1, send("other"));
+  TEST_ASSERT_EQUAL_STRING("all;", fired);
+}
+
+void test_system_topics_skip_leading_wildcards(void)
+{
+  router.add("#", record, (void *)"all");
+  router.add("+/broker", record, (void *)"plus");
+  router.add("$SYS/#", record, (void *)"sys");
+  TEST_ASSERT_EQUAL(1, send("$SYS/broker"));
+  TEST_ASSERT_EQUAL_STRING("sys;", fired);
+}
+
+void test_same_filter_replaces_handler(void)
+{
+  router.add("a/b", record, (void *)"old");
+  router.add("a/b", record, (void *)"new");
+  TEST_ASSERT_EQUAL(1, send("a/b"));
+  TEST_ASSERT_EQUAL_STRING("new;", fired);
+}
+
+void test_rejects_malformed_filters(void)
+{
+  TEST_ASSERT_FALSE(router.add("a/#/b", record, NULL));
+  TEST_ASSERT_FALSE(router.add("a/b#", record, NULL));
+  TEST_ASSERT_FALSE(router.add("a/b+/c", record, NULL));
+  TEST_ASSERT_FALSE(router.add("a", NULL, NULL));
+}
+
+void test_capacity_is_enforced(void)
+{
+  TopicRouter<4, 8> tiny;
+  TEST_ASSERT_TRUE(tiny.add("ab/cd/ef", record, (void *)"x"));
+  TEST_ASSERT_FALSE(tiny.add("gh", record, (void *)"y"));     // out of nodes
+  TopicRouter<8, 4> tinyPool;
+  TEST_ASSERT_FALSE(tinyPool.add("abcde", record, (void *)"z")); // out of text
+  TEST_ASSERT_EQUAL(0, tinyPool.dispatch("abcde", NULL, 0));
+}
+
+void test_shared_prefixes_share_nodes(void)
+{
+  router.add("mqttChannelDevice5/actuators/+", record, (void *)"a");
+  router.add("mqttChannelDevice5/config/#", record, (void *)"c");
+  router.add("mqttChannelDevice5", record, (void *)"d");
+  // root + device + actuators + '+' + config
+  TEST_ASSERT_EQUAL(5, router.nodeCount());
+  TEST_ASSERT_EQUAL(strlen("mqttChannelDevice5actuatorsconfig"), router.poolUsed());
+}
+
+void test_too_deep_topics_are_dropped(void)
+{
+  router.add("#", record, (void *)"all");
+  TEST_ASSERT_EQUAL(1, send("1/2/3/4/5/6/7/8/9/10/11/12/13/14/15/16"));
+  TEST_ASSERT_EQUAL(0, send("1/2/3/4/5/6/7/8/9/10/11/12/13/14/15/16/17"));
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_exact_route);
+  RUN_TEST(test_plus_matches_one_level);
+  RUN_TEST(test_hash_matches_parent_and_below);
+  RUN_TEST(test_every_matching_route_fires);
+  RUN_TEST(test_system_topics_skip_leading_wildcards);
+  RUN_TEST(test_same_filter_replaces_handler);
+  RUN_TEST(test_rejects_malformed_filters);
+  RUN_TEST(test_capacity_is_enforced);
+  RUN_TEST(test_shared_prefixes_share_nodes);
+  RUN_TEST(test_too_deep_topics_are_dropped);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
@@ -0,0 +1,194 @@
+// Dispatch cost of TopicRouter with hundreds of routes, compared with the
+// obvious alternative of testing every filter in turn.
+//
+// pio test -e native -f test_topic_router_bench (ns per message), or on the
+// board with -e esp12e (CPU cycles per message). The costs are printed, not
+// asserted; that both dispatchers agree is.
+
+#include <TopicRouter.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define TICK_UNIT "cycles"
+static uint32_t ticks()
+{
+  return ESP.getCycleCount();
+}
+#define DEVICES 16
+#define MESSAGES 2000
+#else
+#include <chrono>
+#define TICK_UNIT "ns"
+static uint32_t ticks()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#define DEVICES 100
+#define MESSAGES 200000
+#endif
+
+// Four routes per device: device channel, actuator commands, config tree,
+// sensor values, plus two fleet-wide wildcards
+#define ROUTES (DEVICES * 4 + 2)
+
+static TopicRouter<DEVICES * 6 + 8, DEVICES * 72 + 64> router;
+static char filters[ROUTES][48];
+static char topics[64][48];
+static volatile uint32_t hits;
+
+static void count(const char *topic, const uint8_t *payload, unsigned int length, void *context)
+{
+  (void)topic;
+  (void)payload;
+  (void)length;
+  (void)context;
+  hits++;
+}
+
+// MQTT filter matching one filter at a time
+static bool filterMatches(const char *filter, const char *topic)
+{
+  while (*filter != '\0')
+  {
+    if (filter[0] == '#')
+      return true;
+    if (filter[0] == '+')
+    {
+      while (*topic != '\0' && *topic != '/')
+        topic++;
+      filter++;
+    }
+    else
+    {
+      while (*filter != '\0' && *filter != '/')
+      {
+        if (*filter++ != *topic++)
+          return false;
+      }
+      if (*topic != '\0' && *topic != '/')
+        return false;
+    }
+    if (*filter == '/')
+    {
+      if (*topic != '/')
+      {
+        // "a/#" also matches "a"
+        return *topic == '\0' && filter[1] == '#' && filter[2] == '\0';
+      }
+      filter++;
+      topic++;
+    }
+  }
+  return *topic == '\0';
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void buildRoutes()
+{
+  int n = 0;
+  for (int d = 0; d < DEVICES; d++)
+  {
+    snprintf(filters[n++], sizeof(filters[0]), "mqttChannelDevice%d", d);
+    snprintf(filters[n++], sizeof(filters[0]), "mqttChannelDevice%d/actuators/+", d);
+    snprintf(filters[n++], sizeof(filters[0]), "mqttChannelDevice%d/config/#", d);
+    snprintf(filters[n++], sizeof(filters[0]), "mqttChannelGroup%d/sensor_values", d);
+  }
+  snprintf(filters[n++], sizeof(filters[0]), "+/actuators/broadcast");
+  snprintf(filters[n++], sizeof(filters[0]), "fleet/#");
+
+  router.clear();
+  for (int i = 0; i < ROUTES; i++)
+    TEST_ASSERT_TRUE(router.add(filters[i], count));
+
+  for (int i = 0; i < 64; i++)
+  {
+    int d = (i * 37) % DEVICES;
+    switch (i % 4)
+    {
+    case 0:
+      snprintf(topics[i], sizeof(topics[0]), "mqttChannelDevice%d", d);
+      break;
+    case 1:
+      snprintf(topics[i], sizeof(topics[0]), "mqttChannelDevice%d/actuators/%d", d, i);
+      break;
+    case 2:
+      snprintf(topics[i], sizeof(topics[0]), "mqttChannelDevice%d/config/upload/period", d);
+      break;
+    default:
+      snprintf(topics[i], sizeof(topics[0]), "unknown/device/%d", d);
+      break;
+    }
+  }
+}
+
+void test_both_dispatchers_agree(void)
+{
+  buildRoutes();
+  for (int i = 0; i < 64; i++)
+  {
+    uint32_t linear = 0;
+    for (int r = 0; r < ROUTES; r++)
+      linear += filterMatches(filters[r], topics[i]);
+    TEST_ASSERT_EQUAL(linear, router.dispatch(topics[i], NULL, 0));
+  }
+}
+
+void test_dispatch_cost(void)
+{
+  buildRoutes();
+  hits = 0;
+  uint32_t start = ticks();
+  for (uint32_t i = 0; i < MESSAGES; i++)
+    router.dispatch(topics[i & 63], NULL, 0);
+  uint32_t trie = (ticks() - start) / MESSAGES;
+  uint32_t trieHits = hits;
+
+  hits = 0;
+  start = ticks();
+  for (uint32_t i = 0; i < MESSAGES / 10; i++)
+  {
+    for (int r = 0; r < ROUTES; r++)
+    {
+      if (filterMatches(filters[r], topics[i & 63]))
+        hits++;
+    }
+  }
+  uint32_t linear = (ticks() - start) / (MESSAGES / 10);
+
+  char line[128];
+  snprintf(line, sizeof(line), "%d routes, %u nodes, %u bytes of text: trie %u " TICK_UNIT "/msg, linear %u " TICK_UNIT "/msg",
+           ROUTES, (unsigned)router.nodeCount(), (unsigned)router.poolUsed(), (unsigned)trie, (unsigned)linear);
+  TEST_MESSAGE(line);
+
+  TEST_ASSERT_EQUAL(trieHits / 10, hits);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_both_dispatchers_agree);
+  RUN_TEST(test_dispatch_cost);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
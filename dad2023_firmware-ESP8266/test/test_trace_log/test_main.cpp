@@ -0,0 +1,212 @@
+#include <TraceLog.h>
+#include <string.h>
+#include <unity.h>
+
+static uint8_t buffer[256];
+static uint8_t dumped[512];
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static size_t dumpAll(const TraceLog &trace)
+{
+  TEST_ASSERT_LESS_OR_EQUAL(sizeof(dumped), trace.dumpSize());
+  return trace.dump(0, dumped, sizeof(dumped));
+}
+
+void test_records_round_trip(void)
+{
+  TraceLog trace(buffer, sizeof(buffer));
+  trace.boot(100, "mqttChannelDevice5", 3, 10000);
+  trace.pass();
+  trace.reading(150, -1234);
+  trace.pass();
+  trace.pass();
+  trace.mqtt(2150, "mqttChannelDevice5", (const uint8_t *)"1", 1);
+  trace.upload(2200, 2345);
+  trace.relay(2200, 1);
+  trace.http(2300, TRACE_PATH_SENSOR_VALUES, -1, 5000);
+  trace.stall(9000, 6800);
+
+  TraceReader reader;
+  TEST_ASSERT_TRUE(reader.begin(dumped, dumpAll(trace)));
+  TraceRecord r;
+
+  TEST_ASSERT_TRUE(reader.next(&r));
+  const char *channel;
+  size_t channelLength;
+  int idActuator;
+  long uploadEvery;
+  TEST_ASSERT_TRUE(traceBoot(r, &channel, &channelLength, &idActuator, &uploadEvery));
+  TEST_ASSERT_EQUAL(100, r.timeMs);
+  TEST_ASSERT_EQUAL(18, channelLength);
+  TEST_ASSERT_EQUAL_MEMORY("mqttChannelDevice5", channel, 18);
+  TEST_ASSERT_EQUAL(3, idActuator);
+  TEST_ASSERT_EQUAL(10000, uploadEvery);
+
+  int16_t value;
+  TEST_ASSERT_TRUE(reader.next(&r));
+  TEST_ASSERT_TRUE(traceValue(r, &value));
+  TEST_ASSERT_EQUAL(TRACE_READING, r.type);
+  TEST_ASSERT_EQUAL(-1234, value);
+  TEST_ASSERT_EQUAL(150, r.timeMs);
+  TEST_ASSERT_EQUAL(1, r.passes);
+
+  const char *topic;
+  size_t topicLength, payloadLength;
+  const uint8_t *payload;
+  TEST_ASSERT_TRUE(reader.next(&r));
+  TEST_ASSERT_TRUE(traceMqtt(r, &topic, &topicLength, &payload, &payloadLength));
+  TEST_ASSERT_EQUAL(2, r.passes);
+  TEST_ASSERT_EQUAL(18, topicLength);
+  TEST_ASSERT_EQUAL(1, payloadLength);
+  TEST_ASSERT_EQUAL('1', payload[0]);
+
+  TEST_ASSERT_TRUE(reader.next(&r));
+  TEST_ASSERT_TRUE(traceValue(r, &value));
+  TEST_ASSERT_EQUAL(TRACE_UPLOAD, r.type);
+  TEST_ASSERT_EQUAL(2345, value);
+
+  uint8_t command;
+  TEST_ASSERT_TRUE(reader.next(&r));
+  TEST_ASSERT_TRUE(traceCommand(r, &command));
+  TEST_ASSERT_EQUAL(1, command);
+  TEST_ASSERT_EQUAL(0, r.passes);
+
+  uint8_t path;
+  int16_t status;
+  uint32_t ms;
+  TEST_ASSERT_TRUE(reader.next(&r));
+  TEST_ASSERT_TRUE(traceHttp(r, &path, &status, &ms));
+  TEST_ASSERT_EQUAL(TRACE_PATH_SENSOR_VALUES, path);
+  TEST_ASSERT_EQUAL(-1, status);
+  TEST_ASSERT_EQUAL(5000, ms);
+
+  TEST_ASSERT_TRUE(reader.next(&r));
+  TEST_ASSERT_TRUE(traceDuration(r, &ms));
+  TEST_ASSERT_EQUAL(6800, ms);
+  TEST_ASSERT_EQUAL(9000, r.timeMs);
+
+  TEST_ASSERT_FALSE(reader.next(&r));
+  TEST_ASSERT_FALSE(reader.truncated());
+  TEST_ASSERT_EQUAL(0, reader.dropped());
+}
+
+void test_full_ring_drops_oldest_records(void)
+{
+  TraceLog trace(buffer, sizeof(buffer));
+  for (int i = 0; i < 200; i++)
+    trace.reading(1000 + 10 * i, i);
+  TEST_ASSERT_EQUAL(200, trace.records() + trace.dropped());
+  TEST_ASSERT_LESS_OR_EQUAL(sizeof(buffer) + TRACE_HEADER_SIZE, trace.dumpSize());
+
+  TraceReader reader;
+  TEST_ASSERT_TRUE(reader.begin(dumped, dumpAll(trace)));
+  TEST_ASSERT_EQUAL(trace.dropped(), reader.dropped());
+  TraceRecord r;
+  int16_t expected = (int16_t)trace.dropped();
+  while (reader.next(&r))
+  {
+    int16_t value;
+    TEST_ASSERT_TRUE(traceValue(r, &value));
+    TEST_ASSERT_EQUAL(expected, value);
+    // Times stay absolute after the records before them are gone
+    TEST_ASSERT_EQUAL(1000 + 10 * expected, r.timeMs);
+    expected++;
+  }
+  TEST_ASSERT_EQUAL(200, expected);
+  TEST_ASSERT_FALSE(reader.truncated());
+}
+
+void test_dump_in_pieces_matches(void)
+{
+  TraceLog trace(buffer, sizeof(buffer));
+  for (int i = 0; i < 100; i++)
+    trace.mqtt(i * 7, "a/b", (const uint8_t *)"payload", 7);
+  size_t size = dumpAll(trace);
+
+  uint8_t pieces[512];
+  size_t n = 0, got;
+  while ((got = trace.dump(n, pieces + n, 13)) > 0)
+    n += got;
+  TEST_ASSERT_EQUAL(size, n);
+  TEST_ASSERT_EQUAL_MEMORY(dumped, pieces, size);
+}
+
+void test_disabled_trace_records_nothing(void)
+{
+  TraceLog trace(buffer, sizeof(buffer));
+  trace.setEnabled(false);
+  TEST_ASSERT_FALSE(trace.reading(10, 1));
+  TEST_ASSERT_EQUAL(0, trace.records());
+  TEST_ASSERT_EQUAL(TRACE_HEADER_SIZE, trace.dumpSize());
+}
+
+void test_oversized_payloads_are_truncated(void)
+{
+  uint8_t big[400];
+  memset(big, 'x', sizeof(big));
+
+  TraceLog small(buffer, 64);
+  TEST_ASSERT_FALSE(small.mqtt(1, "topic", big, 100)); // can never fit
+
+  static uint8_t large[300];
+  TraceLog trace(large, sizeof(large));
+  TEST_ASSERT_TRUE(trace.mqtt(1, "topic", big, sizeof(big)));
+
+  TraceReader reader;
+  TEST_ASSERT_TRUE(reader.begin(dumped, dumpAll(trace)));
+  TraceRecord r;
+  TEST_ASSERT_TRUE(reader.next(&r));
+  const char *topic;
+  size_t topicLength, payloadLength;
+  const uint8_t *payload;
+  TEST_ASSERT_TRUE(traceMqtt(r, &topic, &topicLength, &payload, &payloadLength));
+  TEST_ASSERT_EQUAL(5, topicLength);
+  TEST_ASSERT_EQUAL(TRACE_MAX_PAYLOAD - 6, payloadLength);
+}
+
+void test_reader_rejects_and_truncates(void)
+{
+  TraceReader reader;
+  TEST_ASSERT_FALSE(reader.begin((const uint8_t *)"not a trace at all", 18));
+
+  TraceLog trace(buffer, sizeof(buffer));
+  trace.reading(1, 1);
+  trace.reading(2, 2);
+  size_t size = dumpAll(trace);
+  TEST_ASSERT_TRUE(reader.begin(dumped, size - 1));
+  TraceRecord r;
+  TEST_ASSERT_TRUE(reader.next(&r));
+  TEST_ASSERT_FALSE(reader.next(&r));
+  TEST_ASSERT_TRUE(reader.truncated());
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_records_round_trip);
+  RUN_TEST(test_full_ring_drops_oldest_records);
+  RUN_TEST(test_dump_in_pieces_matches);
+  RUN_TEST(test_disabled_trace_records_nothing);
+  RUN_TEST(test_oversized_payloads_are_truncated);
+  RUN_TEST(test_reader_rejects_and_truncates);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup()
+{
+  delay(2000); // wait for the serial monitor
+  runUnityTests();
+}
+
+void loop() {}
+#else
+int main(void)
+{
+  return runUnityTests();
+}
+#endif
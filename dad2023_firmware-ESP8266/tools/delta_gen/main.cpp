@@ -0,0 +1,367 @@
+// Builds the delta a node running OLD.bin downloads to update itself to
+// NEW.bin (-D DAD_OTA builds, lib/DeltaOta). Format in lib/DeltaPatch.
+//
+// Matching is bsdiff's idea without its suffix sort: 8 byte seeds of the old
+// image are hashed, a seed found in the new image is extended both ways as
+// long as more bytes match than not, and the extended region is sent as a
+// diff against the old bytes. A rebuild moves code around and changes the
+// addresses in it, so such a diff is mostly zeros, which the format leaves
+// out. Whatever matches nothing is inserted as is.
+//
+// The delta is written as <CRC-32 of OLD>.ddl, the name the node asks for, and
+// is applied back with DeltaPatcher before the sizes are printed. Serve it
+// with any static HTTP server next to NEW.bin as firmware.bin, used when a
+// node has no delta, and its MD5 as firmware.bin.md5, without which the node
+// does not flash firmware.bin:
+//
+//   pio run -e delta_gen
+//   .pio/build/delta_gen/program old.bin .pio/build/esp12e/firmware.bin --out ota --kbps 40
+//   cp .pio/build/esp12e/firmware.bin ota/ && cd ota && md5sum firmware.bin > firmware.bin.md5
+//   python3 -m http.server 8000
+//
+// DAD_TLS nodes download through tools/tls_standin, which puts TLS on 8444.
+
+#include <DeltaPatch.h>
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Options
+
+struct Options
+{
+  std::string oldPath;
+  std::string newPath;
+  std::string out = ".";
+  double kbps = 0;
+};
+
+static void usage(const char *argv0)
+{
+  printf("usage: %s [options] OLD.bin NEW.bin\n"
+         "  --out DIR      where <crc of OLD>.ddl is written (.)\n"
+         "  --kbps N       also print the transfer times at this download rate\n",
+         argv0);
+}
+
+static bool parseOptions(int argc, char **argv, Options &o)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string a = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (a == "--help" || a == "-h")
+      return false;
+    else if (a.compare(0, 2, "--") != 0)
+    {
+      if (o.oldPath.empty())
+        o.oldPath = a;
+      else
+        o.newPath = a;
+    }
+    else if (!hasValue)
+    {
+      fprintf(stderr, "missing value for %s\n", a.c_str());
+      return false;
+    }
+    else if (a == "--out")
+      o.out = argv[++i];
+    else if (a == "--kbps")
+      o.kbps = atof(argv[++i]);
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", a.c_str());
+      return false;
+    }
+  }
+  return !o.oldPath.empty() && !o.newPath.empty();
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &out)
+{
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == NULL)
+    return false;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    out.insert(out.end(), chunk, chunk + n);
+  fclose(f);
+  return true;
+}
+
+// Matching
+
+#define SEED_SIZE 8
+#define MAX_CANDIDATES 32 // per seed, runs of padding would have thousands
+#define GIVE_UP 64        // bytes without a better score before an extension stops
+
+struct Match
+{
+  uint32_t oldPos;
+  uint32_t length;
+  int score; // matching bytes minus the others
+};
+
+class Matcher
+{
+public:
+  Matcher(const std::vector<uint8_t> &oldImage, const std::vector<uint8_t> &newImage)
+      : _old(oldImage), _new(newImage)
+  {
+    for (size_t j = 0; j + SEED_SIZE <= _old.size(); j++)
+    {
+      std::vector<uint32_t> &bucket = _seeds[seed(_old.data() + j)];
+      if (bucket.size() < MAX_CANDIDATES)
+        bucket.push_back((uint32_t)j);
+    }
+  }
+
+  // Best region of the old image that new[i..] can be a diff against
+  Match find(uint32_t i, int64_t lastShift) const
+  {
+    Match best = {0, 0, 0};
+    if (lastShift + i >= 0 && lastShift + i < (int64_t)_old.size())
+      best = extend((uint32_t)(lastShift + i), i); // where the previous region continues
+    if (i + SEED_SIZE > _new.size())
+      return best;
+    auto bucket = _seeds.find(seed(_new.data() + i));
+    if (bucket == _seeds.end())
+      return best;
+    for (uint32_t j : bucket->second)
+    {
+      Match m = extend(j, i);
+      if (m.score > best.score)
+        best = m;
+    }
+    return best;
+  }
+
+  // How far back from (j, i) the region still pays, down to newStart
+  uint32_t extendBack(uint32_t j, uint32_t i, uint32_t newStart) const
+  {
+    int score = 0, bestScore = 0;
+    uint32_t best = 0;
+    for (uint32_t k = 1; k <= j && k <= i - newStart && k - best <= GIVE_UP; k++)
+    {
+      score += _old[j - k] == _new[i - k] ? 1 : -1;
+      if (score > bestScore)
+      {
+        bestScore = score;
+        best = k;
+      }
+    }
+    return best;
+  }
+
+private:
+  const std::vector<uint8_t> &_old;
+  const std::vector<uint8_t> &_new;
+  std::unordered_map<uint64_t, std::vector<uint32_t>> _seeds;
+
+  static uint64_t seed(const uint8_t *p)
+  {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  Match extend(uint32_t j, uint32_t i) const
+  {
+    Match m = {j, 0, 0};
+    int score = 0;
+    for (uint32_t k = 0; j + k < _old.size() && i + k < _new.size() && k - m.length <= GIVE_UP; k++)
+    {
+      score += _old[j + k] == _new[i + k] ? 1 : -1;
+      if (score > m.score)
+      {
+        m.score = score;
+        m.length = k + 1;
+      }
+    }
+    return m;
+  }
+};
+
+struct Stats
+{
+  unsigned diffs = 0;
+  uint64_t diffBytes = 0;
+  uint64_t changedBytes = 0; // of the diffs
+  unsigned inserts = 0;
+  uint64_t insertBytes = 0;
+};
+
+static void generate(const std::vector<uint8_t> &oldImage, const std::vector<uint8_t> &newImage, DeltaWriter &writer,
+                     Stats &stats)
+{
+  Matcher matcher(oldImage, newImage);
+  std::vector<uint8_t> diff;
+  uint32_t literalStart = 0;
+  int64_t lastShift = 0;
+  uint32_t i = 0;
+  while (i < newImage.size())
+  {
+    Match m = matcher.find(i, lastShift);
+    if (m.score < SEED_SIZE)
+    {
+      i++;
+      continue;
+    }
+    uint32_t back = matcher.extendBack(m.oldPos, i, literalStart);
+    uint32_t start = i - back;
+    uint32_t oldStart = m.oldPos - back;
+    uint32_t length = back + m.length;
+    if (start > literalStart)
+    {
+      writer.insert(newImage.data() + literalStart, start - literalStart);
+      stats.inserts++;
+      stats.insertBytes += start - literalStart;
+    }
+    diff.resize(length);
+    for (uint32_t k = 0; k < length; k++)
+    {
+      diff[k] = (uint8_t)(newImage[start + k] - oldImage[oldStart + k]);
+      stats.changedBytes += diff[k] != 0;
+    }
+    writer.diff(oldStart, diff.data(), length);
+    stats.diffs++;
+    stats.diffBytes += length;
+    lastShift = (int64_t)oldStart - start;
+    i = start + length;
+    literalStart = i;
+  }
+  if (newImage.size() > literalStart)
+  {
+    writer.insert(newImage.data() + literalStart, (uint32_t)(newImage.size() - literalStart));
+    stats.inserts++;
+    stats.insertBytes += newImage.size() - literalStart;
+  }
+  writer.end();
+}
+
+// Verification, with the same code as the node
+
+class ImageSource : public DeltaSource
+{
+public:
+  explicit ImageSource(const std::vector<uint8_t> &image) : _image(image) {}
+
+  bool read(uint32_t offset, uint8_t *out, size_t length) override
+  {
+    if (offset + length > _image.size())
+      return false;
+    memcpy(out, _image.data() + offset, length);
+    return true;
+  }
+
+private:
+  const std::vector<uint8_t> &_image;
+};
+
+class ImageSink : public DeltaSink
+{
+public:
+  std::vector<uint8_t> image;
+
+  bool begin(uint32_t targetSize) override
+  {
+    image.reserve(targetSize);
+    return true;
+  }
+
+  bool write(const uint8_t *data, size_t length) override
+  {
+    image.insert(image.end(), data, data + length);
+    return true;
+  }
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  if (!parseOptions(argc, argv, opt))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  std::vector<uint8_t> oldImage, newImage;
+  if (!readFile(opt.oldPath, oldImage) || !readFile(opt.newPath, newImage))
+  {
+    fprintf(stderr, "cannot read %s or %s\n", opt.oldPath.c_str(), opt.newPath.c_str());
+    return 1;
+  }
+
+  // As FlashSource in lib/DeltaOta reads it: flash mode and size of an ESP
+  // image header depend on how it was flashed
+  if (oldImage.size() >= 4 && oldImage[0] == 0xe9)
+    oldImage[2] = oldImage[3] = 0;
+
+  // Worst case: all of it inserted, plus the op and its varint every time
+  std::vector<uint8_t> buffer(DELTA_HEADER_SIZE + newImage.size() * 2 + 16);
+  DeltaWriter writer(buffer.data(), buffer.size());
+  uint32_t oldCrc = deltaCrc32(0, oldImage.data(), oldImage.size());
+  writer.header((uint32_t)oldImage.size(), oldCrc, (uint32_t)newImage.size(),
+                deltaCrc32(0, newImage.data(), newImage.size()));
+  Stats stats;
+  auto start = std::chrono::steady_clock::now();
+  generate(oldImage, newImage, writer, stats);
+  double generateS = secondsSince(start);
+  if (writer.overflowed())
+  {
+    fprintf(stderr, "delta larger than expected\n");
+    return 1;
+  }
+
+  ImageSource source(oldImage);
+  ImageSink sink;
+  DeltaPatcher patcher;
+  start = std::chrono::steady_clock::now();
+  patcher.begin(&source, (uint32_t)oldImage.size(), &sink);
+  bool applied = patcher.push(writer.data(), writer.length()) && patcher.finish();
+  double applyS = secondsSince(start);
+  if (!applied || sink.image != newImage)
+  {
+    fprintf(stderr, "the delta does not rebuild %s (error %d)\n", opt.newPath.c_str(), (int)patcher.error());
+    return 2;
+  }
+
+  char name[16];
+  snprintf(name, sizeof(name), "%08x.ddl", (unsigned)oldCrc);
+  std::string path = opt.out + "/" + name;
+  FILE *f = fopen(path.c_str(), "wb");
+  if (f == NULL || fwrite(writer.data(), 1, writer.length(), f) != writer.length())
+  {
+    fprintf(stderr, "cannot write %s\n", path.c_str());
+    return 1;
+  }
+  fclose(f);
+
+  printf("%s: %zu bytes, %s: %zu bytes\n", opt.oldPath.c_str(), oldImage.size(), opt.newPath.c_str(),
+         newImage.size());
+  printf("%s: %zu bytes, %.1f%% of the full image\n", path.c_str(), writer.length(),
+         100.0 * writer.length() / newImage.size());
+  printf("  %u diffs over %llu bytes (%llu changed), %u inserts of %llu bytes\n", stats.diffs,
+         (unsigned long long)stats.diffBytes, (unsigned long long)stats.changedBytes, stats.inserts,
+         (unsigned long long)stats.insertBytes);
+  printf("  generated in %.2f s, applied in %.1f ms with a %d byte window\n", generateS, applyS * 1000,
+         DELTA_WINDOW);
+  if (opt.kbps > 0)
+  {
+    printf("  transfer at %.0f kB/s: %.1f s full image, %.1f s delta\n", opt.kbps, newImage.size() / 1024.0 / opt.kbps,
+           writer.length() / 1024.0 / opt.kbps);
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+#!/bin/sh
+# Runs the same fleet_sim load against the backend twice, once as is and once
+# with one of its optimizations disabled, and prints both reports side by side:
+#
+#   latest    the latest values caches (-Ddad.latestValues=0): dashboard read
+#             throughput and latency, and the hit rate the controllers log
+#   lastseen  the batched devices last seen UPDATE (-Ddad.lastSeenFlushMs=0
+#             -Ddad.lastSeenGranularityMs=0): database writes per reading
+#
+# The backend is compiled and started from ../dad2023_backend-api_rest with
+# maven for each run, so stop one already running first. MySQL with the dump
+# of that directory and an MQTT broker on :1883 must be running.
+#
+# Usage: tools/fleet_sim/compare.sh latest|lastseen [fleet_sim options]
+# The options are added to the defaults of the mode, e.g. --devices 1000.
+# MYSQL sets the client command for --db-status ("mysql -uroot -proot").
+# Full logs are left in compare-<mode>-<time>/.
+# Needs java, mvn and pio.
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT=$DIR/../..
+BACKEND=$ROOT/../dad2023_backend-api_rest
+PROGRAM=$ROOT/.pio/build/fleet_sim/program
+MYSQL=${MYSQL:-mysql -uroot -proot}
+
+MODE=$1
+[ $# -gt 0 ] && shift
+case "$MODE" in
+  latest)
+    OFF="-Ddad.latestValues=0"
+    set -- --devices 500 --dashboards 200 --read-rate 20 --duration 60 "$@"
+    SUMMARY='^reads |^read latency|^http latency'
+    REPORT='latest values:'
+    ;;
+  lastseen)
+    OFF="-Ddad.lastSeenFlushMs=0 -Ddad.lastSeenGranularityMs=0"
+    set -- --devices 2000 --rate 5 --duration 60 --db-status "$MYSQL" "$@"
+    SUMMARY='^throughput|^db |^http latency'
+    REPORT='last seen:'
+    ;;
+  *)
+    echo "usage: $0 latest|lastseen [fleet_sim options]" >&2
+    exit 1
+    ;;
+esac
+
+OUT=compare-$MODE-$(date +%Y%m%d-%H%M%S)
+mkdir -p "$OUT" || exit 1
+
+(cd "$ROOT" && pio run -e fleet_sim) >"$OUT/build.log" 2>&1 || { echo "pio run -e fleet_sim failed, see $OUT/build.log"; exit 1; }
+mvn -q -f "$BACKEND/pom.xml" compile dependency:build-classpath -Dmdep.outputFile="$PWD/$OUT/classpath" \
+  >>"$OUT/build.log" 2>&1 || { echo "mvn compile failed, see $OUT/build.log"; exit 1; }
+CLASSPATH=$BACKEND/target/classes:$(cat "$OUT/classpath")
+
+BACKEND_PID=
+trap '[ -n "$BACKEND_PID" ] && kill $BACKEND_PID 2>/dev/null' INT TERM EXIT
+
+# run <name> <java options> <fleet_sim options...>
+run() {
+  NAME=$1
+  JAVA_OPTS=$2
+  shift 2
+  java $JAVA_OPTS -cp "$CLASSPATH" io.vertx.core.Launcher run es.us.dad.Launcher >"$OUT/$NAME-backend.log" 2>&1 &
+  BACKEND_PID=$!
+  for i in $(seq 60); do
+    grep -q "listening" "$OUT/$NAME-backend.log" && break
+    sleep 1
+  done
+  "$PROGRAM" "$@" >"$OUT/$NAME-fleet_sim.log" 2>&1
+  # The controllers log their counters every minute when they changed, so the
+  # last line a minute after the load is the final one
+  sleep 61
+  kill $BACKEND_PID
+  wait $BACKEND_PID 2>/dev/null
+  BACKEND_PID=
+}
+
+run on "" "$@"
+run off "$OFF" "$@"
+
+for RUN in on off; do
+  echo "== $MODE $RUN =="
+  grep -E "$SUMMARY" "$OUT/$RUN-fleet_sim.log"
+  for CONTROLLER in SensorValuesController ActuatorStatesController; do
+    grep "^$CONTROLLER $REPORT" "$OUT/$RUN-backend.log" | tail -n 1
+  done
+done
+echo "logs in $OUT/"
@@ -0,0 +1,1130 @@
+// Host-side fleet simulator: runs N virtual devices against a local backend
+// (RestAPIVerticle on :8080) and MQTT broker (:1883) to size the backend.
+//
+// Every virtual device behaves like src/main.cpp: it POSTs a sensor value
+// (built with the same DadProtocol code as the firmware) and keeps an MQTT
+// session subscribed to its own channel, where SensorValuesController answers
+// each reading with "1" or "0". The time between sending a reading and
+// receiving that command is reported as the reading-to-actuation latency.
+//
+// Virtual dashboards (--dashboards) poll api/sensor_values/<id>/last and
+// /latest/<n> for random sensors of the fleet, alternately, and report read
+// throughput and latency. Run the backend once as is and once with
+// -Ddad.latestValues=0 to compare with and without its latest values cache:
+//   .pio/build/fleet_sim/program --devices 500 --dashboards 200 --read-rate 20
+// tools/fleet_sim/compare.sh latest does both runs and adds the hit rate the
+// backend logs.
+//
+// --db-status takes a MySQL client command line and reports how much the run
+// wrote to the database: UPDATE statements, rows updated, redo log bytes and
+// InnoDB row lock waits, also per accepted reading. Run the backend with
+// -Ddad.lastSeenFlushMs=0 -Ddad.lastSeenGranularityMs=0 to compare with one
+// devices UPDATE per reading:
+//   .pio/build/fleet_sim/program --devices 2000 --rate 5 --db-status "mysql -uroot -proot"
+// tools/fleet_sim/compare.sh lastseen does both runs.
+//
+// Build and run (Linux, epoll):
+//   pio run -e fleet_sim
+//   .pio/build/fleet_sim/program --devices 2000 --rate 1 --duration 60
+//
+// Run with --help for the full option list.
+
+#include <DadProtocol.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+// Options
+
+struct Options
+{
+  int devices = 100;
+  std::string httpHost = "127.0.0.1";
+  int httpPort = 8080;
+  std::string mqttHost = "127.0.0.1";
+  int mqttPort = 1883;
+  bool mqtt = true;
+  double rate = 1.0;        // samples per second and device
+  double jitterMs = 50.0;   // uniform +/- jitter on every sample period
+  double duration = 30.0;   // seconds of load, plus drain time
+  double drain = 3.0;       // seconds to wait for late actuations
+  int sensorBase = 1;       // device i reports as sensor sensorBase + i % sensorCount
+  int sensorCount = 0;      // 0 = one sensor per device
+  std::string channelFormat = "mqttChannelDevice%d"; // %d = sensor id
+  double faultDrop = 0.0;    // reading generated but never sent
+  double faultCorrupt = 0.0; // body truncated, backend must reject it
+  double faultReset = 0.0;   // connection closed halfway through the request
+  double timeoutMs = 5000.0; // HTTP request timeout
+  int dashboards = 0;        // virtual dashboards polling the read endpoints
+  double readRate = 10.0;    // requests per second and dashboard
+  int readLimit = 10;        // values per /latest request
+  std::string dbStatus;      // MySQL client command, empty = no database report
+  unsigned seed = 1;
+};
+
+static void usage(const char *argv0)
+{
+  printf("usage: %s [options]\n"
+         "  --devices N           virtual devices (100)\n"
+         "  --http HOST:PORT      backend REST API (127.0.0.1:8080)\n"
+         "  --mqtt HOST:PORT      MQTT broker (127.0.0.1:1883)\n"
+         "  --no-mqtt             do not open MQTT sessions (no actuation latency)\n"
+         "  --rate HZ             samples per second per device (1)\n"
+         "  --jitter MS           +/- jitter applied to every period (50)\n"
+         "  --duration S          load duration in seconds (30)\n"
+         "  --drain S             extra seconds waiting for actuations (3)\n"
+         "  --sensor-base ID      first sensor id (1)\n"
+         "  --sensor-count N      distinct sensor ids, 0 = one per device (0)\n"
+         "  --channel FMT         device MQTT channel, %%d = sensor id (mqttChannelDevice%%d)\n"
+         "  --fault-drop P        probability a reading is dropped (0)\n"
+         "  --fault-corrupt P     probability a body is truncated (0)\n"
+         "  --fault-reset P       probability the connection is reset mid-request (0)\n"
+         "  --timeout MS          HTTP request timeout (5000)\n"
+         "  --dashboards N        virtual dashboards polling last/latest values (0)\n"
+         "  --read-rate HZ        requests per second per dashboard (10)\n"
+         "  --read-limit N        values per /latest request (10)\n"
+         "  --db-status CMD       MySQL client command to report database writes, e.g. \"mysql -uroot -proot\"\n"
+         "  --seed N              random seed (1)\n",
+         argv0);
+}
+
+static bool splitHostPort(const char *arg, std::string &host, int &port)
+{
+  const char *colon = strrchr(arg, ':');
+  if (colon == NULL)
+    return false;
+  host.assign(arg, colon - arg);
+  port = atoi(colon + 1);
+  return port > 0;
+}
+
+static bool parseOptions(int argc, char **argv, Options &o)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string a = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (a == "--help" || a == "-h")
+      return false;
+    else if (a == "--no-mqtt")
+      o.mqtt = false;
+    else if (!hasValue)
+    {
+      fprintf(stderr, "missing value for %s\n", a.c_str());
+      return false;
+    }
+    else if (a == "--devices")
+      o.devices = atoi(argv[++i]);
+    else if (a == "--http")
+    {
+      if (!splitHostPort(argv[++i], o.httpHost, o.httpPort))
+        return false;
+    }
+    else if (a == "--mqtt")
+    {
+      if (!splitHostPort(argv[++i], o.mqttHost, o.mqttPort))
+        return false;
+    }
+    else if (a == "--rate")
+      o.rate = atof(argv[++i]);
+    else if (a == "--jitter")
+      o.jitterMs = atof(argv[++i]);
+    else if (a == "--duration")
+      o.duration = atof(argv[++i]);
+    else if (a == "--drain")
+      o.drain = atof(argv[++i]);
+    else if (a == "--sensor-base")
+      o.sensorBase = atoi(argv[++i]);
+    else if (a == "--sensor-count")
+      o.sensorCount = atoi(argv[++i]);
+    else if (a == "--channel")
+      o.channelFormat = argv[++i];
+    else if (a == "--fault-drop")
+      o.faultDrop = atof(argv[++i]);
+    else if (a == "--fault-corrupt")
+      o.faultCorrupt = atof(argv[++i]);
+    else if (a == "--fault-reset")
+      o.faultReset = atof(argv[++i]);
+    else if (a == "--timeout")
+      o.timeoutMs = atof(argv[++i]);
+    else if (a == "--dashboards")
+      o.dashboards = atoi(argv[++i]);
+    else if (a == "--read-rate")
+      o.readRate = atof(argv[++i]);
+    else if (a == "--read-limit")
+      o.readLimit = atoi(argv[++i]);
+    else if (a == "--db-status")
+      o.dbStatus = argv[++i];
+    else if (a == "--seed")
+      o.seed = (unsigned)atoi(argv[++i]);
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", a.c_str());
+      return false;
+    }
+  }
+  return o.devices >= 0 && o.dashboards >= 0 && o.devices + o.dashboards > 0 && o.rate > 0 && o.readRate > 0;
+}
+
+// Clock, in microseconds
+
+static int64_t nowUs()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Statistics
+
+struct Stats
+{
+  uint64_t generated = 0;
+  uint64_t sent = 0;
+  uint64_t ok = 0;
+  uint64_t httpErrors = 0;   // non 2xx answers
+  uint64_t connectErrors = 0;
+  uint64_t ioErrors = 0;     // connection dropped by the peer
+  uint64_t timeouts = 0;
+  uint64_t overruns = 0;     // sample due while the previous one was in flight
+  uint64_t droppedFault = 0;
+  uint64_t corruptFault = 0;
+  uint64_t resetFault = 0;
+  uint64_t rejectedCorrupt = 0; // corrupted bodies the backend refused, as expected
+  uint64_t actuations = 0;
+  uint64_t actuationsOn = 0;
+  uint64_t unmatchedActuations = 0;
+  uint64_t mqttErrors = 0;
+  uint64_t readsSent = 0;
+  uint64_t readsOk = 0;
+  uint64_t readErrors = 0;   // non 2xx answers to dashboards
+  uint64_t readOverruns = 0; // poll due while the previous one was in flight
+  std::vector<uint32_t> httpLatencyUs;
+  std::vector<uint32_t> actuationLatencyUs;
+  std::vector<uint32_t> readLatencyUs;
+};
+
+static Stats stats;
+
+static uint32_t percentile(std::vector<uint32_t> &sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  size_t idx = (size_t)std::ceil(p / 100.0 * sorted.size());
+  if (idx > 0)
+    idx--;
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+static void printLatency(const char *name, std::vector<uint32_t> &v)
+{
+  std::sort(v.begin(), v.end());
+  printf("%-20s n=%-9zu p50=%8.2f p90=%8.2f p99=%8.2f p99.9=%8.2f max=%8.2f ms\n", name, v.size(),
+         percentile(v, 50) / 1000.0, percentile(v, 90) / 1000.0, percentile(v, 99) / 1000.0,
+         percentile(v, 99.9) / 1000.0, v.empty() ? 0.0 : v.back() / 1000.0);
+}
+
+// Virtual devices
+
+enum HttpState
+{
+  HTTP_IDLE,       // no connection
+  HTTP_CONNECTING,
+  HTTP_READY,      // keep-alive connection, nothing in flight
+  HTTP_WRITING,
+  HTTP_READING
+};
+
+enum MqttState
+{
+  MQTT_OFF,
+  MQTT_CONNECTING,
+  MQTT_WAIT_CONNACK,
+  MQTT_WAIT_SUBACK,
+  MQTT_UP
+};
+
+#define PENDING_MAX 16
+
+struct Device
+{
+  int sensorId;
+  std::string channel;
+  bool dashboard = false; // polls the read endpoints instead of posting readings
+  uint32_t reads = 0;
+
+  int httpFd = -1;
+  HttpState http = HTTP_IDLE;
+  std::string out;
+  size_t outPos = 0;
+  std::string in;
+  int64_t requestStart = 0;
+  bool requestCorrupt = false;
+  bool requestReset = false;
+  bool requestTracked = false; // waiting for its actuation in pending[]
+  bool sampleQueued = false;
+
+  int mqttFd = -1;
+  MqttState mqtt = MQTT_OFF;
+  std::string mqttOut;
+  std::string mqttIn;
+  int64_t lastPing = 0;
+
+  // Send times of readings still waiting for their actuation, oldest first
+  int64_t pending[PENDING_MAX];
+  int pendingHead = 0;
+  int pendingCount = 0;
+
+  centi_t temperature = 2400;
+};
+
+static Options opt;
+static std::vector<Device> devices;
+static int epfd;
+static sockaddr_storage httpAddr, mqttAddr;
+static socklen_t httpAddrLen, mqttAddrLen;
+static std::mt19937 rng;
+static int64_t startUs;
+static volatile sig_atomic_t interrupted = 0;
+
+static double uniform01()
+{
+  return std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+}
+
+static bool resolve(const std::string &host, int port, sockaddr_storage &addr, socklen_t &len)
+{
+  addrinfo hints = {}, *res = NULL;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || res == NULL)
+    return false;
+  memcpy(&addr, res->ai_addr, res->ai_addrlen);
+  len = res->ai_addrlen;
+  freeaddrinfo(res);
+  return true;
+}
+
+// epoll user data: device index << 1 | (1 for MQTT, 0 for HTTP)
+static uint64_t tag(size_t index, bool mqtt)
+{
+  return ((uint64_t)index << 1) | (mqtt ? 1 : 0);
+}
+
+static int openSocket(const sockaddr_storage &addr, socklen_t len, uint64_t data)
+{
+  int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(fd, (const sockaddr *)&addr, len) < 0 && errno != EINPROGRESS)
+  {
+    close(fd);
+    return -1;
+  }
+  epoll_event ev = {};
+  ev.events = EPOLLIN | EPOLLOUT;
+  ev.data.u64 = data;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+  return fd;
+}
+
+static void watch(int fd, uint64_t data, bool wantWrite)
+{
+  epoll_event ev = {};
+  ev.events = wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+  ev.data.u64 = data;
+  epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+static void closeFd(int &fd)
+{
+  if (fd >= 0)
+  {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    fd = -1;
+  }
+}
+
+static void pendingPush(Device &d, int64_t t)
+{
+  if (d.pendingCount == PENDING_MAX)
+  {
+    // Oldest reading never got its command; forget it
+    d.pendingHead = (d.pendingHead + 1) % PENDING_MAX;
+    d.pendingCount--;
+  }
+  d.pending[(d.pendingHead + d.pendingCount) % PENDING_MAX] = t;
+  d.pendingCount++;
+}
+
+static void pendingDropNewest(Device &d)
+{
+  if (d.pendingCount > 0)
+    d.pendingCount--;
+}
+
+static bool pendingPop(Device &d, int64_t &t)
+{
+  if (d.pendingCount == 0)
+    return false;
+  t = d.pending[d.pendingHead];
+  d.pendingHead = (d.pendingHead + 1) % PENDING_MAX;
+  d.pendingCount--;
+  return true;
+}
+
+// HTTP
+
+static void httpFail(Device &d, size_t index, uint64_t &counter)
+{
+  counter++;
+  if ((d.http == HTTP_WRITING || d.http == HTTP_READING) && d.requestTracked)
+    pendingDropNewest(d);
+  closeFd(d.httpFd);
+  d.http = HTTP_IDLE;
+  d.in.clear();
+  d.sampleQueued = false;
+  (void)index;
+}
+
+static void httpFlush(Device &d, size_t index)
+{
+  while (d.outPos < d.out.size())
+  {
+    size_t chunk = d.out.size() - d.outPos;
+    if (d.requestReset)
+      chunk = std::min(chunk, d.out.size() / 2 - std::min(d.outPos, d.out.size() / 2));
+    if (chunk == 0)
+    {
+      // Fault injection: half the request went out, now hang up
+      httpFail(d, index, stats.resetFault);
+      return;
+    }
+    ssize_t n = send(d.httpFd, d.out.data() + d.outPos, chunk, MSG_NOSIGNAL);
+    if (n < 0)
+    {
+      if (errno == EAGAIN)
+      {
+        watch(d.httpFd, tag(index, false), true);
+        return;
+      }
+      httpFail(d, index, stats.ioErrors);
+      return;
+    }
+    d.outPos += n;
+  }
+  d.http = HTTP_READING;
+  watch(d.httpFd, tag(index, false), false);
+}
+
+// Sensor ids the fleet reports as
+static int sensorSpan()
+{
+  return opt.sensorCount > 0 ? opt.sensorCount : std::max(opt.devices, 1);
+}
+
+static void httpSendRead(Device &d, size_t index)
+{
+  int sensorId = opt.sensorBase + (int)(uniform01() * sensorSpan()) % sensorSpan();
+  std::string path = "/" DAD_PATH_SENSOR_VALUES "/" + std::to_string(sensorId);
+  if (d.reads++ % 2 == 0)
+    path += "/last";
+  else
+    path += "/latest/" + std::to_string(opt.readLimit);
+
+  d.out = "GET " + path + " HTTP/1.1\r\nHost: " + opt.httpHost + "\r\nConnection: keep-alive\r\n\r\n";
+  d.outPos = 0;
+  d.in.clear();
+  d.requestStart = nowUs();
+  d.requestCorrupt = false;
+  d.requestReset = false;
+  d.requestTracked = false;
+  d.http = HTTP_WRITING;
+  stats.readsSent++;
+  httpFlush(d, index);
+}
+
+static void httpSend(Device &d, size_t index)
+{
+  if (d.dashboard)
+  {
+    httpSendRead(d, index);
+    return;
+  }
+  int64_t now = nowUs();
+
+  // Same drift as a DHT22 next to a heater, so both relay commands show up
+  d.temperature += (centi_t)((uniform01() - 0.5) * 80);
+  d.temperature = std::min<centi_t>(3500, std::max<centi_t>(1800, d.temperature));
+
+  char body[DAD_BODY_SIZE];
+  size_t len = writeSensorValueBodyCenti(body, sizeof(body), d.sensorId, (long)((now - startUs) / 1000),
+                                         d.temperature);
+
+  d.requestCorrupt = uniform01() < opt.faultCorrupt;
+  d.requestReset = !d.requestCorrupt && uniform01() < opt.faultReset;
+  if (d.requestCorrupt)
+  {
+    len /= 2;
+    stats.corruptFault++;
+  }
+
+  d.out = "POST /" DAD_PATH_SENSOR_VALUES " HTTP/1.1\r\nHost: " + opt.httpHost +
+          "\r\nContent-Type: application/json\r\nConnection: keep-alive\r\nContent-Length: " +
+          std::to_string(len) + "\r\n\r\n";
+  d.out.append(body, len);
+  d.outPos = 0;
+  d.in.clear();
+  d.requestStart = now;
+  d.http = HTTP_WRITING;
+  stats.sent++;
+  // Only readings sent while subscribed can be matched with their command
+  d.requestTracked = opt.mqtt && !d.requestCorrupt && d.mqtt == MQTT_UP;
+  if (d.requestTracked)
+    pendingPush(d, now);
+  httpFlush(d, index);
+}
+
+static void httpConnect(Device &d, size_t index)
+{
+  d.httpFd = openSocket(httpAddr, httpAddrLen, tag(index, false));
+  if (d.httpFd < 0)
+  {
+    stats.connectErrors++;
+    return;
+  }
+  d.http = HTTP_CONNECTING;
+  d.requestStart = nowUs();
+}
+
+// Returns true once a full response is in d.in
+static bool httpResponseComplete(const std::string &in, int &status, bool &closeAfter)
+{
+  size_t headerEnd = in.find("\r\n\r\n");
+  if (headerEnd == std::string::npos)
+    return false;
+  status = 0;
+  if (in.compare(0, 5, "HTTP/") == 0)
+  {
+    size_t sp = in.find(' ');
+    if (sp != std::string::npos)
+      status = atoi(in.c_str() + sp + 1);
+  }
+  std::string headers = in.substr(0, headerEnd);
+  std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+  size_t contentLength = 0;
+  size_t cl = headers.find("content-length:");
+  if (cl != std::string::npos)
+    contentLength = strtoul(headers.c_str() + cl + 15, NULL, 10);
+  closeAfter = headers.find("connection: close") != std::string::npos;
+  return in.size() >= headerEnd + 4 + contentLength;
+}
+
+static void httpReadable(Device &d, size_t index)
+{
+  char buf[4096];
+  for (;;)
+  {
+    ssize_t n = recv(d.httpFd, buf, sizeof(buf), 0);
+    if (n > 0)
+    {
+      d.in.append(buf, n);
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN)
+      break;
+    // Peer closed or error
+    if (d.http == HTTP_READY)
+    {
+      closeFd(d.httpFd);
+      d.http = HTTP_IDLE;
+    }
+    else
+      httpFail(d, index, stats.ioErrors);
+    return;
+  }
+
+  if (d.http != HTTP_READING)
+    return;
+
+  int status;
+  bool closeAfter;
+  if (!httpResponseComplete(d.in, status, closeAfter))
+    return;
+
+  uint32_t latencyUs = (uint32_t)(nowUs() - d.requestStart);
+  if (d.dashboard)
+  {
+    stats.readLatencyUs.push_back(latencyUs);
+    if (status >= 200 && status < 300)
+      stats.readsOk++;
+    else
+      stats.readErrors++;
+  }
+  else if (status >= 200 && status < 300)
+  {
+    stats.httpLatencyUs.push_back(latencyUs);
+    stats.ok++;
+  }
+  else
+  {
+    stats.httpLatencyUs.push_back(latencyUs);
+    if (d.requestCorrupt)
+      stats.rejectedCorrupt++;
+    else
+      stats.httpErrors++;
+    if (d.requestTracked)
+      pendingDropNewest(d);
+  }
+  d.in.clear();
+  if (closeAfter)
+  {
+    closeFd(d.httpFd);
+    d.http = HTTP_IDLE;
+  }
+  else
+    d.http = HTTP_READY;
+}
+
+static void httpEvent(Device &d, size_t index, uint32_t events)
+{
+  if (d.http == HTTP_CONNECTING)
+  {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(d.httpFd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0 || (events & (EPOLLERR | EPOLLHUP)))
+    {
+      stats.connectErrors++;
+      closeFd(d.httpFd);
+      d.http = HTTP_IDLE;
+      d.sampleQueued = false;
+      return;
+    }
+    d.http = HTTP_READY;
+    watch(d.httpFd, tag(index, false), false);
+    if (d.sampleQueued)
+    {
+      d.sampleQueued = false;
+      httpSend(d, index);
+    }
+    return;
+  }
+  if ((events & EPOLLOUT) && d.http == HTTP_WRITING)
+    httpFlush(d, index);
+  if (d.httpFd >= 0 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+    httpReadable(d, index);
+}
+
+static void sampleDue(Device &d, size_t index)
+{
+  if (d.dashboard)
+  {
+    switch (d.http)
+    {
+    case HTTP_IDLE:
+      httpConnect(d, index);
+      d.sampleQueued = d.httpFd >= 0;
+      break;
+    case HTTP_READY:
+      httpSend(d, index);
+      break;
+    default:
+      stats.readOverruns++;
+      break;
+    }
+    return;
+  }
+  stats.generated++;
+  if (uniform01() < opt.faultDrop)
+  {
+    stats.droppedFault++;
+    return;
+  }
+  switch (d.http)
+  {
+  case HTTP_IDLE:
+    httpConnect(d, index);
+    d.sampleQueued = d.httpFd >= 0;
+    break;
+  case HTTP_READY:
+    httpSend(d, index);
+    break;
+  default:
+    // Like the firmware, a device never has two requests in flight
+    stats.overruns++;
+    break;
+  }
+}
+
+// MQTT 3.1.1, just enough for one QoS 0 subscription per device
+
+static void putRemainingLength(std::string &s, size_t len)
+{
+  do
+  {
+    uint8_t b = len % 128;
+    len /= 128;
+    if (len > 0)
+      b |= 0x80;
+    s.push_back((char)b);
+  } while (len > 0);
+}
+
+static void putString(std::string &s, const std::string &v)
+{
+  s.push_back((char)(v.size() >> 8));
+  s.push_back((char)(v.size() & 0xff));
+  s += v;
+}
+
+static void mqttFlush(Device &d, size_t index)
+{
+  while (!d.mqttOut.empty())
+  {
+    ssize_t n = send(d.mqttFd, d.mqttOut.data(), d.mqttOut.size(), MSG_NOSIGNAL);
+    if (n < 0)
+    {
+      if (errno == EAGAIN)
+      {
+        watch(d.mqttFd, tag(index, true), true);
+        return;
+      }
+      stats.mqttErrors++;
+      closeFd(d.mqttFd);
+      d.mqtt = MQTT_OFF;
+      return;
+    }
+    d.mqttOut.erase(0, n);
+  }
+  watch(d.mqttFd, tag(index, true), false);
+}
+
+static void mqttConnect(Device &d, size_t index)
+{
+  d.mqttFd = openSocket(mqttAddr, mqttAddrLen, tag(index, true));
+  if (d.mqttFd < 0)
+  {
+    stats.mqttErrors++;
+    return;
+  }
+  d.mqtt = MQTT_CONNECTING;
+  d.mqttIn.clear();
+
+  std::string var;
+  putString(var, "MQTT");
+  var.push_back(4);    // protocol level 3.1.1
+  var.push_back(0x02); // clean session
+  var.push_back(0);
+  var.push_back(60);   // keep alive
+  putString(var, "fleet-sim-" + std::to_string(getpid()) + "-" + std::to_string(index));
+  d.mqttOut.clear();
+  d.mqttOut.push_back((char)0x10);
+  putRemainingLength(d.mqttOut, var.size());
+  d.mqttOut += var;
+}
+
+static void mqttSubscribe(Device &d, size_t index)
+{
+  std::string var;
+  var.push_back(0);
+  var.push_back(1); // packet id
+  putString(var, d.channel);
+  var.push_back(0); // QoS 0
+  d.mqttOut.push_back((char)0x82);
+  putRemainingLength(d.mqttOut, var.size());
+  d.mqttOut += var;
+  d.mqtt = MQTT_WAIT_SUBACK;
+  mqttFlush(d, index);
+}
+
+static void mqttPacket(Device &d, size_t index, uint8_t type, const char *p, size_t len)
+{
+  switch (type >> 4)
+  {
+  case 2: // CONNACK
+    if (len >= 2 && p[1] == 0)
+      mqttSubscribe(d, index);
+    else
+    {
+      stats.mqttErrors++;
+      closeFd(d.mqttFd);
+      d.mqtt = MQTT_OFF;
+    }
+    break;
+  case 9: // SUBACK
+    d.mqtt = MQTT_UP;
+    break;
+  case 3: // PUBLISH
+  {
+    if (len < 2)
+      return;
+    size_t topicLen = ((uint8_t)p[0] << 8) | (uint8_t)p[1];
+    size_t offset = 2 + topicLen + (((type >> 1) & 3) ? 2 : 0);
+    if (offset > len)
+      return;
+    RelayCommand command = parseRelayCommand(p + offset, len - offset);
+    if (command == RELAY_NONE)
+      return;
+    stats.actuations++;
+    if (command == RELAY_ON)
+      stats.actuationsOn++;
+    int64_t sentAt;
+    if (pendingPop(d, sentAt))
+      stats.actuationLatencyUs.push_back((uint32_t)(nowUs() - sentAt));
+    else
+      stats.unmatchedActuations++;
+    break;
+  }
+  default: // PINGRESP and anything else
+    break;
+  }
+}
+
+static void mqttEvent(Device &d, size_t index, uint32_t events)
+{
+  if (d.mqtt == MQTT_CONNECTING)
+  {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(d.mqttFd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0 || (events & (EPOLLERR | EPOLLHUP)))
+    {
+      stats.mqttErrors++;
+      closeFd(d.mqttFd);
+      d.mqtt = MQTT_OFF;
+      return;
+    }
+    d.mqtt = MQTT_WAIT_CONNACK;
+    d.lastPing = nowUs();
+    mqttFlush(d, index);
+    return;
+  }
+  if (events & EPOLLOUT)
+    mqttFlush(d, index);
+  if (d.mqttFd < 0 || !(events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+    return;
+
+  char buf[4096];
+  for (;;)
+  {
+    ssize_t n = recv(d.mqttFd, buf, sizeof(buf), 0);
+    if (n > 0)
+    {
+      d.mqttIn.append(buf, n);
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN)
+      break;
+    stats.mqttErrors++;
+    closeFd(d.mqttFd);
+    d.mqtt = MQTT_OFF;
+    return;
+  }
+
+  // Split the stream into packets
+  size_t pos = 0;
+  while (d.mqttIn.size() - pos >= 2)
+  {
+    size_t remaining = 0, multiplier = 1, i = pos + 1;
+    bool complete = false;
+    while (i < d.mqttIn.size() && i < pos + 5)
+    {
+      uint8_t b = d.mqttIn[i++];
+      remaining += (b & 0x7f) * multiplier;
+      multiplier *= 128;
+      if (!(b & 0x80))
+      {
+        complete = true;
+        break;
+      }
+    }
+    if (!complete || d.mqttIn.size() - i < remaining)
+      break;
+    mqttPacket(d, index, (uint8_t)d.mqttIn[pos], d.mqttIn.data() + i, remaining);
+    if (d.mqttFd < 0)
+      return;
+    pos = i + remaining;
+  }
+  d.mqttIn.erase(0, pos);
+}
+
+static void mqttKeepAlive(int64_t now)
+{
+  for (size_t i = 0; i < devices.size(); i++)
+  {
+    Device &d = devices[i];
+    if (d.mqtt == MQTT_UP && now - d.lastPing > 30 * 1000000LL)
+    {
+      d.mqttOut.push_back((char)0xc0);
+      d.mqttOut.push_back(0);
+      d.lastPing = now;
+      mqttFlush(d, i);
+    }
+  }
+}
+
+// Scheduling
+
+struct Timer
+{
+  int64_t due;
+  size_t device;
+  bool operator>(const Timer &o) const { return due > o.due; }
+};
+
+static int64_t nextPeriodUs(const Device &d)
+{
+  double period = 1e6 / (d.dashboard ? opt.readRate : opt.rate);
+  double jitter = (uniform01() * 2.0 - 1.0) * opt.jitterMs * 1000.0;
+  return (int64_t)std::max(1000.0, period + jitter);
+}
+
+static void onSignal(int)
+{
+  interrupted = 1;
+}
+
+static void raiseFileLimit(size_t wanted)
+{
+  rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < wanted)
+  {
+    rl.rlim_cur = std::min((rlim_t)wanted, rl.rlim_max);
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+}
+
+// Database counters, read through the MySQL client before and after the run
+
+typedef std::map<std::string, uint64_t> DbStatus;
+
+static bool readDbStatus(DbStatus &status)
+{
+  std::string command = opt.dbStatus +
+                        " -N -B -e \"SHOW GLOBAL STATUS WHERE Variable_name IN ('Com_update', "
+                        "'Innodb_rows_updated', 'Innodb_os_log_written', 'Innodb_row_lock_waits', "
+                        "'Innodb_row_lock_time')\" 2>/dev/null";
+  FILE *f = popen(command.c_str(), "r");
+  if (f == NULL)
+    return false;
+  char line[256];
+  while (fgets(line, sizeof(line), f) != NULL)
+  {
+    char *tab = strchr(line, '\t');
+    if (tab == NULL)
+      continue;
+    *tab = 0;
+    status[line] = strtoull(tab + 1, NULL, 10);
+  }
+  return pclose(f) == 0 && status.size() == 5;
+}
+
+static void printDbStatus(const DbStatus &before, const DbStatus &after, double elapsed)
+{
+  auto delta = [&](const char *name) { return after.at(name) - before.at(name); };
+  double readings = stats.ok > 0 ? (double)stats.ok : 1.0;
+  printf("db updates           %llu statements (%.1f/s, %.3f per reading), %llu rows\n",
+         (unsigned long long)delta("Com_update"), elapsed > 0 ? delta("Com_update") / elapsed : 0.0,
+         delta("Com_update") / readings, (unsigned long long)delta("Innodb_rows_updated"));
+  printf("db redo log          %llu bytes (%.0f per reading)\n", (unsigned long long)delta("Innodb_os_log_written"),
+         delta("Innodb_os_log_written") / readings);
+  printf("db row lock waits    %llu, %llu ms waited\n", (unsigned long long)delta("Innodb_row_lock_waits"),
+         (unsigned long long)delta("Innodb_row_lock_time"));
+}
+
+int main(int argc, char **argv)
+{
+  if (!parseOptions(argc, argv, opt))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  if (!resolve(opt.httpHost, opt.httpPort, httpAddr, httpAddrLen) ||
+      (opt.mqtt && !resolve(opt.mqttHost, opt.mqttPort, mqttAddr, mqttAddrLen)))
+  {
+    fprintf(stderr, "cannot resolve backend or broker address\n");
+    return 1;
+  }
+
+  DbStatus dbBefore;
+  if (!opt.dbStatus.empty() && !readDbStatus(dbBefore))
+  {
+    fprintf(stderr, "cannot read database status with %s\n", opt.dbStatus.c_str());
+    return 1;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+  raiseFileLimit((size_t)opt.devices * 2 + opt.dashboards + 64);
+  rng.seed(opt.seed);
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  startUs = nowUs();
+
+  devices.resize(opt.devices + opt.dashboards);
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+  for (int i = 0; i < opt.devices; i++)
+  {
+    Device &d = devices[i];
+    d.sensorId = opt.sensorBase + (opt.sensorCount > 0 ? i % opt.sensorCount : i);
+    char channel[128];
+    snprintf(channel, sizeof(channel), opt.channelFormat.c_str(), d.sensorId);
+    d.channel = channel;
+    d.temperature = (centi_t)(2200 + uniform01() * 1000);
+    if (opt.mqtt)
+      mqttConnect(d, i);
+    // Spread the first samples over one period so the fleet does not start in lockstep
+    timers.push({startUs + (int64_t)(uniform01() * 1e6 / opt.rate), (size_t)i});
+  }
+  for (int i = opt.devices; i < opt.devices + opt.dashboards; i++)
+  {
+    devices[i].dashboard = true;
+    timers.push({startUs + (int64_t)(uniform01() * 1e6 / opt.readRate), (size_t)i});
+  }
+
+  printf("fleet_sim: %d devices, %.2f samples/s each, %.0f s, http %s:%d, mqtt %s\n", opt.devices, opt.rate,
+         opt.duration, opt.httpHost.c_str(), opt.httpPort, opt.mqtt ? opt.mqttHost.c_str() : "off");
+  if (opt.dashboards > 0)
+    printf("           %d dashboards, %.2f reads/s each, /latest/%d\n", opt.dashboards, opt.readRate, opt.readLimit);
+
+  int64_t loadEnd = startUs + (int64_t)(opt.duration * 1e6);
+  int64_t runEnd = loadEnd + (int64_t)(opt.drain * 1e6);
+  int64_t timeoutUs = (int64_t)(opt.timeoutMs * 1000);
+  int64_t nextHousekeeping = startUs + 1000000;
+  uint64_t lastOk = 0;
+  uint64_t lastReads = 0;
+
+  std::vector<epoll_event> events(1024);
+  while (!interrupted)
+  {
+    int64_t now = nowUs();
+    if (now >= runEnd)
+      break;
+
+    while (!timers.empty() && timers.top().due <= now && now < loadEnd)
+    {
+      Timer t = timers.top();
+      timers.pop();
+      sampleDue(devices[t.device], t.device);
+      timers.push({t.due + nextPeriodUs(devices[t.device]), t.device});
+    }
+
+    if (now >= nextHousekeeping)
+    {
+      for (size_t i = 0; i < devices.size(); i++)
+      {
+        Device &d = devices[i];
+        if ((d.http == HTTP_WRITING || d.http == HTTP_READING || d.http == HTTP_CONNECTING) &&
+            now - d.requestStart > timeoutUs)
+          httpFail(d, i, stats.timeouts);
+        if (opt.mqtt && !d.dashboard && d.mqtt == MQTT_OFF && now < loadEnd)
+          mqttConnect(d, i);
+      }
+      mqttKeepAlive(now);
+      printf("  t=%5.1fs  ok/s=%-7llu reads/s=%-7llu sent=%-9llu errors=%llu\n", (now - startUs) / 1e6,
+             (unsigned long long)(stats.ok - lastOk), (unsigned long long)(stats.readsOk - lastReads),
+             (unsigned long long)stats.sent,
+             (unsigned long long)(stats.httpErrors + stats.ioErrors + stats.connectErrors + stats.timeouts));
+      fflush(stdout);
+      lastOk = stats.ok;
+      lastReads = stats.readsOk;
+      nextHousekeeping += 1000000;
+    }
+
+    int64_t wake = std::min(nextHousekeeping, runEnd);
+    if (!timers.empty() && now < loadEnd)
+      wake = std::min(wake, timers.top().due);
+    int timeoutMs = (int)std::max<int64_t>(0, (wake - nowUs() + 999) / 1000);
+
+    int n = epoll_wait(epfd, events.data(), (int)events.size(), timeoutMs);
+    for (int i = 0; i < n; i++)
+    {
+      size_t index = events[i].data.u64 >> 1;
+      if (events[i].data.u64 & 1)
+        mqttEvent(devices[index], index, events[i].events);
+      else
+        httpEvent(devices[index], index, events[i].events);
+    }
+  }
+
+  double elapsed = (std::min(nowUs(), loadEnd) - startUs) / 1e6;
+  uint64_t lost = 0;
+  for (size_t i = 0; i < devices.size(); i++)
+  {
+    lost += devices[i].pendingCount;
+    closeFd(devices[i].httpFd);
+    closeFd(devices[i].mqttFd);
+  }
+  uint64_t errors = stats.httpErrors + stats.ioErrors + stats.connectErrors + stats.timeouts;
+
+  printf("\n== fleet_sim report ==\n");
+  printf("readings generated   %llu (dropped by fault %llu, overruns %llu)\n",
+         (unsigned long long)stats.generated, (unsigned long long)stats.droppedFault,
+         (unsigned long long)stats.overruns);
+  printf("requests sent        %llu (corrupted %llu, reset %llu)\n", (unsigned long long)stats.sent,
+         (unsigned long long)stats.corruptFault, (unsigned long long)stats.resetFault);
+  printf("throughput           %.1f ok req/s over %.1f s\n", elapsed > 0 ? stats.ok / elapsed : 0.0, elapsed);
+  printf("http ok              %llu\n", (unsigned long long)stats.ok);
+  printf("http errors          %llu (status %llu, io %llu, connect %llu, timeout %llu) = %.3f%%\n",
+         (unsigned long long)errors, (unsigned long long)stats.httpErrors, (unsigned long long)stats.ioErrors,
+         (unsigned long long)stats.connectErrors, (unsigned long long)stats.timeouts,
+         stats.sent + stats.readsSent ? 100.0 * errors / (stats.sent + stats.readsSent) : 0.0);
+  printf("corrupt rejected     %llu of %llu\n", (unsigned long long)stats.rejectedCorrupt,
+         (unsigned long long)stats.corruptFault);
+  if (opt.mqtt)
+  {
+    printf("actuations           %llu (on %llu, unmatched %llu, missing %llu, mqtt errors %llu)\n",
+           (unsigned long long)stats.actuations, (unsigned long long)stats.actuationsOn,
+           (unsigned long long)stats.unmatchedActuations, (unsigned long long)lost,
+           (unsigned long long)stats.mqttErrors);
+  }
+  if (opt.dashboards > 0)
+  {
+    printf("reads                %llu ok of %llu (%.1f/s), errors %llu, overruns %llu\n",
+           (unsigned long long)stats.readsOk, (unsigned long long)stats.readsSent,
+           elapsed > 0 ? stats.readsOk / elapsed : 0.0, (unsigned long long)stats.readErrors,
+           (unsigned long long)stats.readOverruns);
+  }
+  printLatency("http latency", stats.httpLatencyUs);
+  if (opt.mqtt)
+    printLatency("reading->actuation", stats.actuationLatencyUs);
+  if (opt.dashboards > 0)
+    printLatency("read latency", stats.readLatencyUs);
+  DbStatus dbAfter;
+  if (!opt.dbStatus.empty())
+  {
+    if (readDbStatus(dbAfter))
+      printDbStatus(dbBefore, dbAfter, elapsed);
+    else
+      fprintf(stderr, "cannot read database status with %s\n", opt.dbStatus.c_str());
+  }
+
+  close(epfd);
+  return errors + stats.readErrors > 0 ? 2 : 0;
+}
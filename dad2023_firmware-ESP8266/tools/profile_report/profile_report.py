@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Symbolizes a profiler dump from the firmware (lib/Profiler).
+
+Reads a capture of the serial monitor (after 'p'), or the message published
+on <device channel>/profile, and prints where loop() spends its time: per
+phase, per function and per source line, using addr2line on the ELF of the
+exact build that produced the dump.
+
+Usage:
+  tools/profile_report/profile_report.py capture.txt
+  tools/profile_report/profile_report.py capture.txt --elf .pio/build/esp12e/firmware.elf --top 30
+"""
+
+import argparse
+import collections
+import glob
+import os
+import shutil
+import subprocess
+import sys
+
+DEFAULT_ELF = ".pio/build/esp12e/firmware.elf"
+
+
+def find_addr2line():
+    tool = "xtensa-lx106-elf-addr2line"
+    found = shutil.which(tool)
+    if found:
+        return found
+    pattern = os.path.expanduser("~/.platformio/packages/toolchain-xtensa*/bin/" + tool)
+    candidates = sorted(glob.glob(pattern))
+    return candidates[-1] if candidates else None
+
+
+def parse_dump(text):
+    """Returns (header dict, {phase: (name, samples)}, [(pc, phase, samples)]) of the last dump."""
+    begin = text.rfind("PROFILE BEGIN")
+    if begin < 0:
+        sys.exit("no PROFILE BEGIN in the input")
+    header, phases, pcs = {}, {}, []
+    for line in text[begin:].splitlines():
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[:2] == ["PROFILE", "BEGIN"]:
+            header = dict(f.split("=", 1) for f in fields[2:] if "=" in f)
+        elif fields[:2] == ["PROFILE", "END"]:
+            break
+        elif fields[0] == "phase" and len(fields) == 4:
+            phases[int(fields[1])] = (fields[2], int(fields[3]))
+        elif fields[0] == "pc" and len(fields) == 4:
+            pcs.append((int(fields[1], 16), int(fields[2]), int(fields[3])))
+    return header, phases, pcs
+
+
+def symbolize(addr2line, elf, addresses):
+    """Returns {pc: (function, file:line)}."""
+    if not addresses:
+        return {}
+    if addr2line is None or not os.path.exists(elf):
+        return {pc: (region(pc), "?") for pc in addresses}
+    args = [addr2line, "-f", "-C", "-e", elf] + ["0x%08x" % pc for pc in addresses]
+    lines = subprocess.run(args, check=True, capture_output=True, text=True).stdout.splitlines()
+    result = {}
+    for i, pc in enumerate(addresses):
+        function, where = lines[2 * i], lines[2 * i + 1]
+        if function == "??":
+            function = region(pc)
+        where = "?" if where.startswith("??") else os.path.basename(where.split(" ")[0])
+        result[pc] = (function, where)
+    return result
+
+
+def region(pc):
+    """Best guess for code the ELF does not cover (the ROM, mostly)."""
+    if 0x40000000 <= pc < 0x40010000:
+        return "[ROM 0x%08x]" % pc
+    return "[0x%08x]" % pc
+
+
+def percent(part, total):
+    return 100.0 * part / total if total else 0.0
+
+
+def print_table(title, counts, total, top):
+    print("\n%s" % title)
+    for key, samples in counts.most_common(top):
+        print("  %6.2f%% %7d  %s" % (percent(samples, total), samples, key))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dump", help="serial capture or MQTT message with a PROFILE BEGIN ... END block")
+    parser.add_argument("--elf", default=DEFAULT_ELF, help="firmware ELF of the build (%(default)s)")
+    parser.add_argument("--addr2line", default=None, help="addr2line of the xtensa toolchain")
+    parser.add_argument("--top", type=int, default=20, help="rows per table (%(default)s)")
+    args = parser.parse_args()
+
+    with open(args.dump, encoding="utf-8", errors="replace") as f:
+        header, phases, pcs = parse_dump(f.read())
+    addr2line = args.addr2line or find_addr2line()
+    if addr2line is None or not os.path.exists(args.elf):
+        print("warning: no addr2line or no %s, addresses are not symbolized" % args.elf, file=sys.stderr)
+
+    samples = int(header.get("samples", 0))
+    lost = int(header.get("lost", 0))
+    hz = int(header.get("hz", 0))
+    ms = int(header.get("ms", 0))
+    isr_cycles = int(header.get("isr_cycles", 0))
+    print("%d samples at %d Hz over %.1f s, %d lost (histogram full)" % (samples, hz, ms / 1000.0, lost))
+    if ms:
+        # 80 MHz CPU clock
+        print("sampling overhead %.3f%% of the CPU" % percent(isr_cycles, ms * 80000.0))
+
+    print("\nphases")
+    for index, (name, count) in sorted(phases.items(), key=lambda p: -p[1][1]):
+        print("  %6.2f%% %7d  %s" % (percent(count, samples), count, name))
+
+    symbols = symbolize(addr2line, args.elf, sorted({pc for pc, _, _ in pcs}))
+    by_function = collections.Counter()
+    by_line = collections.Counter()
+    by_phase_function = collections.defaultdict(collections.Counter)
+    for pc, phase, count in pcs:
+        function, where = symbols[pc]
+        by_function[function] += count
+        by_line["%s (%s)" % (function, where)] += count
+        by_phase_function[phases.get(phase, (str(phase), 0))[0]][function] += count
+
+    print_table("functions", by_function, samples, args.top)
+    print_table("lines", by_line, samples, args.top)
+    for name, counts in sorted(by_phase_function.items()):
+        print_table("functions in phase %s" % name, counts, samples, min(args.top, 5))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Host check of the TLS stand-in against what the DAD_TLS firmware needs,
+# with openssl s_client in place of the node:
+#   - the key it presents is the one pinned in TLS_SERVER_KEY (src/main.cpp)
+#   - it accepts a 512 byte max_fragment_length
+#   - it resumes sessions by session ID, as BearSSL on the node does (no tickets)
+#
+# Starts tools/tls_standin/tls_standin.sh for the duration of the check, so
+# stop one already running first. The backend, broker and update server do
+# not need to run.
+#
+# Usage: tools/tls_standin/check.sh
+# Needs openssl and socat.
+
+DIR=$(dirname "$0")
+MAIN=$DIR/../../src/main.cpp
+FAILED=0
+
+"$DIR/tls_standin.sh" >/dev/null 2>&1 &
+STANDIN_PID=$!
+trap 'kill $STANDIN_PID 2>/dev/null' INT TERM EXIT
+
+# socat listens once the key exists
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  echo | openssl s_client -connect localhost:8443 >/dev/null 2>&1 && break
+  sleep 1
+done
+
+check() {
+  if [ "$2" = 0 ]; then
+    echo "ok   $1"
+  else
+    echo "FAIL $1"
+    FAILED=1
+  fi
+}
+
+for PORT in 8443 8883 8444; do
+  echo | openssl s_client -connect localhost:$PORT -tls1_2 -maxfraglen 512 -tlsextdebug 2>/dev/null |
+    grep -q '"max fragment length"'
+  check ":$PORT negotiates 512 byte records" $?
+
+  echo | openssl s_client -connect localhost:$PORT -tls1_2 -no_ticket -reconnect 2>/dev/null |
+    grep -q '^Reused'
+  check ":$PORT resumes by session ID" $?
+
+  SERVED=$(echo | openssl s_client -connect localhost:$PORT 2>/dev/null | openssl x509 -pubkey -noout 2>/dev/null)
+  PINNED=$(sed -n '/TLS_SERVER_KEY\[\] = R"KEY(/,/)KEY"/p' "$MAIN" | sed '1d;$d')
+  [ -n "$SERVED" ] && [ "$SERVED" = "$PINNED" ]
+  check ":$PORT key is TLS_SERVER_KEY of src/main.cpp" $?
+done
+
+if [ $FAILED != 0 ]; then
+  echo "Paste the key printed by tools/tls_standin/tls_standin.sh into TLS_SERVER_KEY"
+fi
+exit $FAILED
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Local TLS stand-in for lab tests of the DAD_TLS firmware build.
+#
+# Terminates TLS on 8443 (-> backend on 8080), 8883 (-> broker on 1883) and
+# 8444 (-> DAD_OTA update server on 8000) with a self-signed P-256 key, so
+# neither the backend, Mosquitto nor the update server need TLS configuration.
+# OpenSSL keeps a server-side session cache and honours the max_fragment_length
+# extension, which is what the firmware relies on.
+#
+# The first run creates the key and prints the public key to paste into
+# TLS_SERVER_KEY (src/main.cpp) or pass to test/test_tls_transport.
+# tools/tls_standin/check.sh checks it from the host, without a board.
+#
+# Usage: tools/tls_standin/tls_standin.sh [backend_port] [broker_port] [ota_port]
+# Needs openssl and socat.
+
+set -e
+
+DIR=$(dirname "$0")/.keys
+BACKEND_PORT=${1:-8080}
+BROKER_PORT=${2:-1883}
+OTA_PORT=${3:-8000}
+
+mkdir -p "$DIR"
+if [ ! -f "$DIR/server.pem" ]; then
+  openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes \
+    -keyout "$DIR/server.key" -out "$DIR/server.crt" -days 3650 -subj "/CN=dad-tls-standin"
+  cat "$DIR/server.key" "$DIR/server.crt" > "$DIR/server.pem"
+fi
+
+echo "Server public key (TLS_SERVER_KEY):"
+openssl pkey -in "$DIR/server.key" -pubout
+
+TLS="cert=$DIR/server.pem,verify=0,fork,reuseaddr"
+socat "OPENSSL-LISTEN:8443,$TLS" "TCP:localhost:$BACKEND_PORT" &
+HTTPS_PID=$!
+socat "OPENSSL-LISTEN:8883,$TLS" "TCP:localhost:$BROKER_PORT" &
+MQTTS_PID=$!
+socat "OPENSSL-LISTEN:8444,$TLS" "TCP:localhost:$OTA_PORT" &
+OTA_PID=$!
+trap 'kill $HTTPS_PID $MQTTS_PID $OTA_PID 2>/dev/null' INT TERM EXIT
+
+echo "https :8443 -> :$BACKEND_PORT, mqtts :8883 -> :$BROKER_PORT, ota :8444 -> :$OTA_PORT (Ctrl+C to stop)"
+wait
@@ -0,0 +1,580 @@
+// Replays a trace recorded by a DAD_TRACE build of src/main.cpp.
+//
+// The recorded readings and MQTT messages are fed, pass by pass, through the
+// NodeLogic of this build, and every upload/relay decision is compared with
+// the one the device took. Any difference is a behaviour change between the
+// build that recorded the trace and this one. The device timings in the trace
+// (slow loop passes, HTTP requests) are summarized, and compared with a second
+// trace given with --against, e.g. one recorded by the previous release on the
+// same bench.
+//
+// A trace is either the raw dump (MQTT, see dumpTraceMqtt) or a capture of
+// the serial monitor containing a TRACE BEGIN ... TRACE END block.
+//
+//   pio run -e trace_replay
+//   .pio/build/trace_replay/program node.trace --against previous.trace
+//
+// Exits with 2 when a decision differs, so it can gate a release.
+
+#include <NodeLogic.h>
+#include <TopicRouter.h>
+#include <TraceLog.h>
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Options
+
+struct Options
+{
+  std::string trace;
+  std::string against;
+  std::string channel = "mqttChannelDevice5"; // used when the trace has no boot record
+  int actuator = 3;
+  int maxDiffs = 20;
+  bool dump = false;
+};
+
+static void usage(const char *argv0)
+{
+  printf("usage: %s [options] TRACE\n"
+         "  --against TRACE       compare device timings with this trace\n"
+         "  --dump                print every record\n"
+         "  --max-diffs N         decision differences printed (20)\n"
+         "  --channel NAME        device channel if the boot record was dropped (mqttChannelDevice5)\n"
+         "  --actuator ID         actuator id if the boot record was dropped (3)\n",
+         argv0);
+}
+
+static bool parseOptions(int argc, char **argv, Options &o)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string a = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (a == "--help" || a == "-h")
+      return false;
+    else if (a == "--dump")
+      o.dump = true;
+    else if (a.compare(0, 2, "--") != 0)
+      o.trace = a;
+    else if (!hasValue)
+    {
+      fprintf(stderr, "missing value for %s\n", a.c_str());
+      return false;
+    }
+    else if (a == "--against")
+      o.against = argv[++i];
+    else if (a == "--max-diffs")
+      o.maxDiffs = atoi(argv[++i]);
+    else if (a == "--channel")
+      o.channel = argv[++i];
+    else if (a == "--actuator")
+      o.actuator = atoi(argv[++i]);
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", a.c_str());
+      return false;
+    }
+  }
+  return !o.trace.empty();
+}
+
+static Options opt;
+
+// Loading
+
+static bool readFile(const std::string &path, std::string &out)
+{
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == NULL)
+    return false;
+  char chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    out.append(chunk, n);
+  fclose(f);
+  return true;
+}
+
+static int hexDigit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Raw dump, or the last TRACE BEGIN/END block of a serial capture
+static bool loadTrace(const std::string &path, std::vector<uint8_t> &trace)
+{
+  std::string text;
+  if (!readFile(path, text))
+  {
+    fprintf(stderr, "cannot read %s\n", path.c_str());
+    return false;
+  }
+  if (text.compare(0, 4, TRACE_MAGIC) == 0)
+  {
+    trace.assign(text.begin(), text.end());
+    return true;
+  }
+
+  size_t begin = text.rfind("TRACE BEGIN");
+  if (begin == std::string::npos)
+  {
+    fprintf(stderr, "%s: neither a trace dump nor a serial capture with TRACE BEGIN\n", path.c_str());
+    return false;
+  }
+  size_t pos = text.find('\n', begin);
+  size_t end = text.find("TRACE END", begin);
+  if (end == std::string::npos)
+    end = text.size();
+  trace.clear();
+  for (; pos < end; pos++)
+  {
+    int hi = hexDigit(text[pos]);
+    if (hi < 0)
+      continue; // line breaks, \r
+    int lo = pos + 1 < end ? hexDigit(text[pos + 1]) : -1;
+    if (lo < 0)
+      break;
+    trace.push_back((uint8_t)(hi << 4 | lo));
+    pos++;
+  }
+  return true;
+}
+
+// Statistics
+
+static uint32_t percentile(std::vector<uint32_t> &sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  size_t idx = (size_t)std::ceil(p / 100.0 * sorted.size());
+  if (idx > 0)
+    idx--;
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+struct Timing
+{
+  std::vector<uint32_t> ms;
+  uint32_t errors = 0;
+};
+
+struct Report
+{
+  uint32_t records = 0;
+  uint32_t dropped = 0;
+  bool truncated = false;
+  uint32_t firstMs = 0;
+  uint32_t lastMs = 0;
+  uint64_t passes = 0;
+  uint32_t boots = 0;
+  uint32_t mqtt = 0;
+  uint32_t readings = 0;
+  // Decisions
+  uint32_t uploads = 0;    // recorded upload cycles that were compared
+  uint32_t valueDiffs = 0; // same cycle, different filtered value
+  uint32_t relayDiffs = 0;
+  uint32_t missing = 0; // recorded upload, none in the replay
+  uint32_t extra = 0;   // upload in the replay, none recorded
+  double replayNs = 0;  // NodeLogic time per pass in this build
+  // Device timings
+  Timing stalls;
+  Timing paths[3];
+};
+
+static const char *PATH_NAMES[] = {"other", "POST " DAD_PATH_SENSOR_VALUES, "POST " DAD_PATH_ACTUATOR_STATES};
+static const char *RELAY_NAMES[] = {"none", "on", "off"};
+
+static const char *relayName(int command)
+{
+  return command >= 0 && command <= RELAY_OFF ? RELAY_NAMES[command] : "?";
+}
+
+// Replay
+
+struct Replay
+{
+  NodeLogic logic;
+  TopicRouter<16, 256> router;
+  std::string channel;
+  int actuator;
+  bool synced; // logic state known: from a boot record, or from two uploads
+  bool verbose;
+  bool seenUpload; // when the ring dropped the boot record
+  uint64_t firstUploadPass;
+  centi_t reading;
+
+  // The pass the current records belong to
+  bool passOpen;
+  bool passRun;
+  NodeDecision decision;
+  bool recordedUpload;
+  int16_t recordedValue;
+  int recordedRelay; // -1 until the relay record of the upload cycle
+  uint32_t passMs;
+
+  Report *report;
+};
+
+static void diff(Replay &r, const char *what, const char *detail)
+{
+  uint32_t total = r.report->valueDiffs + r.report->relayDiffs + r.report->missing + r.report->extra;
+  if (r.verbose && (int)total <= opt.maxDiffs)
+    printf("  pass %llu at %u ms: %s%s\n", (unsigned long long)r.report->passes, r.passMs, what, detail);
+}
+
+static void onDeviceCommand(const char *topic, const uint8_t *payload, unsigned int length, void *context)
+{
+  (void)topic;
+  ((Replay *)context)->logic.onCommand((const char *)payload, length);
+}
+
+static void onActuatorCommand(const char *topic, const uint8_t *payload, unsigned int length, void *context)
+{
+  ((Replay *)context)->logic.onActuatorCommand(atoi(strrchr(topic, '/') + 1), (const char *)payload, length);
+}
+
+static void onConfig(const char *topic, const uint8_t *payload, unsigned int length, void *context)
+{
+  Replay *r = (Replay *)context;
+  std::string value((const char *)payload, length);
+  centi_t threshold, hysteresis;
+  if (strcmp(topic + r->channel.size(), "/config/period") == 0)
+    r->logic.setUploadEvery(atol(value.c_str()));
+  else if (strcmp(topic + r->channel.size(), "/config/threshold") == 0 &&
+           parseThreshold(value.c_str(), &threshold, &hysteresis))
+    r->logic.setThreshold(threshold, hysteresis);
+}
+
+static void configure(Replay &r, const std::string &channel, int actuator, long period)
+{
+  r.channel = channel;
+  r.actuator = actuator;
+  r.logic.begin(actuator, period);
+  r.router.clear();
+  r.router.add(channel.c_str(), onDeviceCommand, &r);
+  r.router.add((channel + "/actuators/+").c_str(), onActuatorCommand, &r);
+  r.router.add((channel + "/config/#").c_str(), onConfig, &r);
+  r.synced = true;
+}
+
+// Runs NodeLogic for the open pass, once its inputs are in
+static void runPass(Replay &r)
+{
+  if (r.passOpen && !r.passRun && r.synced)
+  {
+    r.decision = r.logic.pass(r.reading);
+    r.passRun = true;
+  }
+}
+
+static void closePass(Replay &r)
+{
+  if (!r.passOpen)
+    return;
+  runPass(r);
+  Report &rep = *r.report;
+  if (r.passRun)
+  {
+    char detail[96];
+    if (r.recordedUpload && !r.decision.upload)
+    {
+      rep.missing++;
+      diff(r, "upload recorded, none replayed", "");
+    }
+    else if (!r.recordedUpload && r.decision.upload)
+    {
+      rep.extra++;
+      diff(r, "upload replayed, none recorded", "");
+    }
+    else if (r.recordedUpload)
+    {
+      rep.uploads++;
+      if (r.recordedValue != r.decision.value)
+      {
+        rep.valueDiffs++;
+        snprintf(detail, sizeof(detail), " recorded %d, replayed %d", r.recordedValue, r.decision.value);
+        diff(r, "value", detail);
+      }
+      if (r.recordedRelay >= 0 && r.recordedRelay != r.decision.relay)
+      {
+        rep.relayDiffs++;
+        snprintf(detail, sizeof(detail), " recorded %s, replayed %s", relayName(r.recordedRelay), relayName(r.decision.relay));
+        diff(r, "relay", detail);
+      }
+    }
+  }
+  r.passOpen = false;
+}
+
+static void openPass(Replay &r, uint32_t timeMs)
+{
+  r.passOpen = true;
+  r.passRun = false;
+  r.recordedUpload = false;
+  r.recordedRelay = -1;
+  r.passMs = timeMs;
+  r.report->passes++;
+}
+
+static void replayRecord(Replay &r, const TraceRecord &rec)
+{
+  Report &rep = *r.report;
+  if (rec.passes > 0)
+  {
+    closePass(r);
+    // Passes in between recorded nothing: same inputs, and no upload expected
+    for (uint32_t i = 1; i < rec.passes; i++)
+    {
+      openPass(r, rec.timeMs);
+      closePass(r);
+    }
+    openPass(r, rec.timeMs);
+  }
+
+  int16_t value;
+  uint8_t command;
+  uint32_t ms;
+  switch (rec.type)
+  {
+  case TRACE_BOOT:
+  {
+    const char *channel;
+    size_t channelLength;
+    int actuator;
+    long period;
+    if (traceBoot(rec, &channel, &channelLength, &actuator, &period))
+    {
+      configure(r, std::string(channel, channelLength), actuator, period);
+      r.reading = CENTI_INVALID;
+      rep.boots++;
+    }
+    break;
+  }
+  case TRACE_READING:
+    if (traceValue(rec, &value))
+      r.reading = value;
+    rep.readings++;
+    break;
+  case TRACE_MQTT:
+  {
+    const char *topic;
+    size_t topicLength, length;
+    const uint8_t *payload;
+    rep.mqtt++;
+    if (traceMqtt(rec, &topic, &topicLength, &payload, &length) && r.synced)
+    {
+      runPass(r); // messages arrive in HandleMqtt, after the decisions
+      r.router.dispatch(std::string(topic, topicLength).c_str(), payload, length);
+    }
+    break;
+  }
+  case TRACE_UPLOAD:
+    if (!traceValue(rec, &value))
+      break;
+    if (!r.synced)
+    {
+      // The ring dropped the boot record: the passes between the first two
+      // uploads give the period, and the replay starts after the second one
+      if (!r.seenUpload)
+      {
+        r.seenUpload = true;
+        r.firstUploadPass = rep.passes;
+        break;
+      }
+      configure(r, opt.channel, opt.actuator, (long)(rep.passes - r.firstUploadPass));
+      r.passOpen = false;
+      if (r.verbose)
+        printf("  replay starts at %u ms, upload period %ld passes\n", rec.timeMs, r.logic.uploadEvery());
+      break;
+    }
+    runPass(r);
+    r.recordedUpload = true;
+    r.recordedValue = value;
+    break;
+  case TRACE_RELAY:
+    if (!traceCommand(rec, &command))
+      break;
+    if (r.passOpen)
+      r.recordedRelay = command;
+    else if (command == RELAY_ON || command == RELAY_OFF)
+      r.logic.onCommand(command == RELAY_ON ? "1" : "0", 1); // just synced
+    break;
+  case TRACE_HTTP:
+  {
+    uint8_t path;
+    int16_t status;
+    if (traceHttp(rec, &path, &status, &ms))
+    {
+      Timing &t = rep.paths[path <= TRACE_PATH_ACTUATOR_STATES ? path : (uint8_t)TRACE_PATH_OTHER];
+      t.ms.push_back(ms);
+      if (status < 200 || status >= 300)
+        t.errors++;
+    }
+    break;
+  }
+  case TRACE_STALL:
+    if (traceDuration(rec, &ms))
+      rep.stalls.ms.push_back(ms);
+    break;
+  }
+}
+
+static void dumpRecord(const TraceRecord &rec)
+{
+  int16_t value;
+  uint8_t command, path;
+  int16_t status;
+  uint32_t ms;
+  const char *text;
+  size_t textLength, length;
+  const uint8_t *payload;
+  int actuator;
+  long period;
+
+  printf("%10u ms %6u passes  ", rec.timeMs, rec.passes);
+  if (traceBoot(rec, &text, &textLength, &actuator, &period))
+    printf("boot %.*s actuator %d period %ld\n", (int)textLength, text, actuator, period);
+  else if (rec.type == TRACE_READING && traceValue(rec, &value))
+    printf("reading %d\n", value);
+  else if (traceMqtt(rec, &text, &textLength, &payload, &length))
+    printf("mqtt %.*s: %.*s\n", (int)textLength, text, (int)length, (const char *)payload);
+  else if (traceHttp(rec, &path, &status, &ms))
+    printf("http %s -> %d in %u ms\n", PATH_NAMES[path <= 2 ? path : 0], status, ms);
+  else if (rec.type == TRACE_UPLOAD && traceValue(rec, &value))
+    printf("upload %d\n", value);
+  else if (traceCommand(rec, &command))
+    printf("relay %s\n", relayName(command));
+  else if (traceDuration(rec, &ms))
+    printf("stall %u ms\n", ms);
+  else
+    printf("unknown record type %u, %u bytes\n", rec.type, rec.length);
+}
+
+static bool replayTrace(const std::string &path, Report &rep, bool verbose)
+{
+  std::vector<uint8_t> data;
+  if (!loadTrace(path, data))
+    return false;
+  TraceReader reader;
+  if (!reader.begin(data.data(), data.size()))
+  {
+    fprintf(stderr, "%s: not a version %d trace\n", path.c_str(), TRACE_VERSION);
+    return false;
+  }
+
+  static Replay r; // TopicRouter is large for the stack
+  r.synced = false;
+  r.verbose = verbose;
+  r.seenUpload = false;
+  r.reading = CENTI_INVALID;
+  r.passOpen = false;
+  r.report = &rep;
+  rep.dropped = reader.dropped();
+
+  if (verbose)
+    printf("%s\n", path.c_str());
+  auto start = std::chrono::steady_clock::now();
+  TraceRecord rec;
+  while (reader.next(&rec))
+  {
+    if (rep.records++ == 0)
+      rep.firstMs = rec.timeMs;
+    rep.lastMs = rec.timeMs;
+    if (verbose && opt.dump)
+      dumpRecord(rec);
+    replayRecord(r, rec);
+  }
+  closePass(r);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  rep.truncated = reader.truncated();
+  if (rep.passes > 0)
+    rep.replayNs = std::chrono::duration<double, std::nano>(elapsed).count() / rep.passes;
+
+  for (int i = 0; i < 3; i++)
+    std::sort(rep.paths[i].ms.begin(), rep.paths[i].ms.end());
+  std::sort(rep.stalls.ms.begin(), rep.stalls.ms.end());
+  return true;
+}
+
+static void printTimingRow(const char *name, Timing &t)
+{
+  printf("  %-28s %7zu %7u %7u %7u %7u %7u", name, t.ms.size(), percentile(t.ms, 50), percentile(t.ms, 90),
+         percentile(t.ms, 99), t.ms.empty() ? 0 : t.ms.back(), t.errors);
+}
+
+static void printTimingDelta(Timing &t, Timing &base)
+{
+  if (base.ms.empty() && t.ms.empty())
+  {
+    printf("\n");
+    return;
+  }
+  printf("   p50 %+d p99 %+d\n", (int)percentile(t.ms, 50) - (int)percentile(base.ms, 50),
+         (int)percentile(t.ms, 99) - (int)percentile(base.ms, 99));
+}
+
+int main(int argc, char **argv)
+{
+  if (!parseOptions(argc, argv, opt))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Report rep;
+  if (!replayTrace(opt.trace, rep, true))
+    return 1;
+
+  printf("%u records over %.1f s, %llu loop passes, %u readings, %u MQTT messages, %u boots\n", rep.records,
+         (rep.lastMs - rep.firstMs) / 1000.0, (unsigned long long)rep.passes, rep.readings, rep.mqtt, rep.boots);
+  if (rep.dropped > 0)
+    printf("%u older records were dropped by the ring\n", rep.dropped);
+  if (rep.truncated)
+    printf("the dump is truncated\n");
+  printf("decisions: %u uploads compared, %u value diffs, %u relay diffs, %u missing, %u extra\n", rep.uploads,
+         rep.valueDiffs, rep.relayDiffs, rep.missing, rep.extra);
+  printf("replay: %.1f ns per loop pass\n", rep.replayNs);
+
+  Report base;
+  bool against = !opt.against.empty() && replayTrace(opt.against, base, false);
+
+  printf("\ndevice timings (ms)              count     p50     p90     p99     max  errors%s\n",
+         against ? "   vs --against" : "");
+  printTimingRow("slow loop passes", rep.stalls);
+  if (against)
+    printTimingDelta(rep.stalls, base.stalls);
+  else
+    printf("\n");
+  for (int i = 1; i < 3; i++)
+  {
+    printTimingRow(PATH_NAMES[i], rep.paths[i]);
+    if (against)
+      printTimingDelta(rep.paths[i], base.paths[i]);
+    else
+      printf("\n");
+  }
+  if (against)
+  {
+    printf("\n%s: %zu stalls over %.1f s, %zu sensor uploads\n", opt.against.c_str(), base.stalls.ms.size(),
+           (base.lastMs - base.firstMs) / 1000.0, base.paths[TRACE_PATH_SENSOR_VALUES].ms.size());
+  }
+
+  bool differs = rep.valueDiffs + rep.relayDiffs + rep.missing + rep.extra > 0;
+  return differs ? 2 : 0;
+}